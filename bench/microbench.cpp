@@ -0,0 +1,671 @@
+// microbenchmarks of the per tick hot paths: opinions, CVC stats,
+// relationship expiry, learners, policies and action factories (sarsa,
+// crunchedin and heuristic), over populations from 25 to 10k characters (and
+// n-step chains for learners)
+//
+// results are written as JSON, so they can be compared run to run, e.g.
+//   benchmarks --benchmark_out=bench.json --benchmark_filter=Opinion
+// pass --benchmark_format=console for a table instead
+//
+// anything that looks at every pair of characters fills every character's
+// opinion cache, which at 10k characters is 100M cached opinions, so those
+// stop at kMaxPairPopulation
+
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "../src/util.h"
+#include "../src/core.h"
+#include "../src/action.h"
+#include "../src/action_factories.h"
+#include "../src/sarsa/sarsa_agent.h"
+#include "../src/sarsa/sarsa_learner.h"
+#include "../src/sarsa/feature_service.h"
+#include "../src/sarsa/sarsa_action_factories.h"
+#include "../src/crunchedin/culture.h"
+#include "../src/crunchedin/crunchedin.h"
+#include "../src/crunchedin/crunchedin_action_factories.h"
+
+namespace {
+
+const int kMaxPairPopulation = 2500;
+const size_t kRelationshipsPerCharacter = 10;
+// pairs sampled by the opinion benchmarks, so their caches stay small
+const size_t kSampledPairs = 4096;
+// candidates built at a time for the policy benchmarks, outside the timer
+const size_t kCandidateBatches = 1024;
+
+const double kLearningRate = 0.01;
+const double kDiscount = 0.9;
+const double kBeta1 = 0.9;
+const double kBeta2 = 0.999;
+
+// a population like main's, with a few relationships each that never expire
+// during a benchmark
+class Population {
+ public:
+  Population(size_t population)
+      : logger_("bench", stderr, WARN), random_generator_(population) {
+    std::uniform_real_distribution<> money_dist(10.0, 1000.0);
+    std::uniform_int_distribution<> background_dist(0, 10);
+    std::uniform_int_distribution<> language_dist(0, 5);
+    std::uniform_int_distribution<size_t> target_dist(0, population - 1);
+    std::uniform_real_distribution<> opinion_dist(-50.0, 50.0);
+
+    std::vector<Character*> character_ptrs;
+    for (size_t i = 0; i < population; i++) {
+      characters_.push_back(
+          std::make_unique<Character>(i, money_dist(random_generator_)));
+      characters_.back()->traits_[kBackground] =
+          background_dist(random_generator_);
+      characters_.back()->traits_[kLanguage] =
+          language_dist(random_generator_);
+      character_ptrs.push_back(characters_.back().get());
+    }
+    for (auto& character : characters_) {
+      for (size_t i = 0; i < kRelationshipsPerCharacter; i++) {
+        character->AddRelationship(std::make_unique<RelationshipModifier>(
+            character_ptrs[target_dist(random_generator_)], 0, 1 << 30,
+            opinion_dist(random_generator_)));
+      }
+    }
+    cvc_ = CVC(character_ptrs, &logger_, random_generator_);
+  }
+
+  // kSampledPairs random (character, target) pairs
+  std::vector<std::pair<Character*, Character*>> SamplePairs() {
+    std::uniform_int_distribution<size_t> dist(0, characters_.size() - 1);
+    std::vector<std::pair<Character*, Character*>> pairs;
+    for (size_t i = 0; i < kSampledPairs; i++) {
+      pairs.emplace_back(characters_[dist(random_generator_)].get(),
+                         characters_[dist(random_generator_)].get());
+    }
+    return pairs;
+  }
+
+  Character* Get(size_t i) { return characters_[i % characters_.size()].get(); }
+  size_t Size() const { return characters_.size(); }
+  CVC* GetCVC() { return &cvc_; }
+  Logger* GetLogger() { return &logger_; }
+  std::mt19937* GetRandomGenerator() { return &random_generator_; }
+
+ private:
+  Logger logger_;
+  std::mt19937 random_generator_;
+  std::vector<std::unique_ptr<Character>> characters_;
+  CVC cvc_;
+};
+
+void Populations(benchmark::internal::Benchmark* b) {
+  for (int population : {25, 100, 1000, 10000}) {
+    b->Arg(population);
+  }
+}
+
+void PairPopulations(benchmark::internal::Benchmark* b) {
+  for (int population : {25, 100, 1000, kMaxPairPopulation}) {
+    b->Arg(population);
+  }
+}
+
+template <size_t N, typename T>
+std::array<T, N> RandomFeatures(std::mt19937* random_generator) {
+  std::uniform_real_distribution<> dist(-1.0, 1.0);
+  std::array<T, N> features;
+  features[0] = 1.0; //bias
+  for (size_t i = 1; i < N; i++) {
+    features[i] = dist(*random_generator);
+  }
+  return features;
+}
+
+// opinions
+
+void BM_GetOpinionOfCold(benchmark::State& state) {
+  Population population(state.range(0));
+  auto pairs = population.SamplePairs();
+  size_t i = 0;
+  for (auto _ : state) {
+    auto& pair = pairs[i++ % pairs.size()];
+    benchmark::DoNotOptimize(pair.first->GetFreshOpinionOf(pair.second));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetOpinionOfCold)->Apply(Populations);
+
+void BM_GetOpinionOfCached(benchmark::State& state) {
+  Population population(state.range(0));
+  auto pairs = population.SamplePairs();
+  for (auto& pair : pairs) {
+    pair.first->GetOpinionOf(pair.second);
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    auto& pair = pairs[i++ % pairs.size()];
+    benchmark::DoNotOptimize(pair.first->GetOpinionOf(pair.second));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetOpinionOfCached)->Apply(Populations);
+
+// CVC stats and relationships, a whole population per iteration
+
+void BM_ComputeStats(benchmark::State& state) {
+  Population population(state.range(0));
+  CVC* cvc = population.GetCVC();
+  for (auto _ : state) {
+    // clears the cached stats (and expires nothing)
+    cvc->Tick();
+    benchmark::DoNotOptimize(cvc->GetOpinionStats().mean_);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ComputeStats)
+    ->Apply(PairPopulations)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_ExpireRelationships(benchmark::State& state) {
+  Population population(state.range(0));
+  for (auto _ : state) {
+    for (size_t i = 0; i < population.Size(); i++) {
+      population.Get(i)->ExpireRelationships(population.GetCVC()->Now());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ExpireRelationships)
+    ->Apply(Populations)
+    ->Unit(benchmark::kMicrosecond);
+
+// learners, for the standard and target feature vectors
+
+template <size_t N>
+void BM_LearnerScore(benchmark::State& state) {
+  std::mt19937 random_generator;
+  Logger logger("bench", stderr, WARN);
+  auto learner = cvc::sarsa::SARSALearner<N>::Create(
+      0, kLearningRate, kDiscount, kBeta1, kBeta2, random_generator, &logger);
+  std::vector<std::array<double, N>> features;
+  for (size_t i = 0; i < kSampledPairs; i++) {
+    features.push_back(RandomFeatures<N, double>(&random_generator));
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(learner->Score(features[i++ % features.size()]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_LearnerScore, cvc::sarsa::kStandardFeatures);
+BENCHMARK_TEMPLATE(BM_LearnerScore, cvc::sarsa::kTargetFeatures);
+
+// scoring a batch of candidates, blocked (the learner's ScoreBatch) against
+// the base Learner's loop of one Score per row
+template <size_t N, bool kBlocked>
+void BM_LearnerScoreBatch(benchmark::State& state) {
+  std::mt19937 random_generator;
+  Logger logger("bench", stderr, WARN);
+  auto learner = cvc::sarsa::SARSALearner<N>::Create(
+      0, kLearningRate, kDiscount, kBeta1, kBeta2, random_generator, &logger);
+  std::vector<std::array<double, N>> features;
+  for (int i = 0; i < state.range(0); i++) {
+    features.push_back(RandomFeatures<N, double>(&random_generator));
+  }
+  std::vector<double> scores(features.size());
+  for (auto _ : state) {
+    if (kBlocked) {
+      learner->ScoreBatch(features.data(), features.size(), scores.data());
+    } else {
+      learner->cvc::sarsa::Learner<N>::ScoreBatch(
+          features.data(), features.size(), scores.data());
+    }
+    benchmark::DoNotOptimize(scores.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_LearnerScoreBatch, cvc::sarsa::kStandardFeatures, false)
+    ->Arg(16)->Arg(256);
+BENCHMARK_TEMPLATE(BM_LearnerScoreBatch, cvc::sarsa::kStandardFeatures, true)
+    ->Arg(16)->Arg(256);
+BENCHMARK_TEMPLATE(BM_LearnerScoreBatch, cvc::sarsa::kTargetFeatures, false)
+    ->Arg(16)->Arg(256);
+BENCHMARK_TEMPLATE(BM_LearnerScoreBatch, cvc::sarsa::kTargetFeatures, true)
+    ->Arg(16)->Arg(256);
+
+// a chain of n_steps + 1 experiences, as a SARSAAgent keeps for n-step SARSA
+template <size_t N>
+class ExperienceChain {
+ public:
+  ExperienceChain(size_t n_steps, Population* population)
+      : learner_(cvc::sarsa::SARSALearner<N>::Create(
+            0, kLearningRate, kDiscount, kBeta1, kBeta2,
+            *population->GetRandomGenerator(), population->GetLogger())) {
+    std::uniform_real_distribution<> score_dist(0.0, 100.0);
+    cvc::sarsa::Experience* next = nullptr;
+    for (size_t i = 0; i <= n_steps; i++) {
+      experiences_.push_back(
+          std::make_unique<cvc::sarsa::ExperienceImpl<N, double>>(
+              std::make_unique<TrivialAction>(population->Get(0), 0.0),
+              score_dist(*population->GetRandomGenerator()), next,
+              RandomFeatures<N, double>(population->GetRandomGenerator()),
+              learner_.get()));
+      next = experiences_.back().get();
+    }
+  }
+
+  cvc::sarsa::SARSALearner<N>* GetLearner() { return learner_.get(); }
+  cvc::sarsa::ExperienceImpl<N, double>* Head() {
+    return experiences_.back().get();
+  }
+
+ private:
+  std::unique_ptr<cvc::sarsa::SARSALearner<N>> learner_;
+  // the head (oldest) is last
+  std::vector<std::unique_ptr<cvc::sarsa::ExperienceImpl<N, double>>>
+      experiences_;
+};
+
+void NSteps(benchmark::internal::Benchmark* b) {
+  for (int n_steps : {1, 4, 16}) {
+    b->Arg(n_steps);
+  }
+}
+
+template <size_t N>
+void BM_LearnerComputeDiscountedRewards(benchmark::State& state) {
+  Population population(2);
+  ExperienceChain<N> chain(state.range(0), &population);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        chain.GetLearner()->ComputeDiscountedRewards(chain.Head()));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_LearnerComputeDiscountedRewards,
+                   cvc::sarsa::kStandardFeatures)->Apply(NSteps);
+BENCHMARK_TEMPLATE(BM_LearnerComputeDiscountedRewards,
+                   cvc::sarsa::kTargetFeatures)->Apply(NSteps);
+
+template <size_t N>
+void BM_LearnerLearn(benchmark::State& state) {
+  Population population(2);
+  ExperienceChain<N> chain(state.range(0), &population);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        chain.GetLearner()->Learn(population.GetCVC(), chain.Head()));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_LearnerLearn, cvc::sarsa::kStandardFeatures)
+    ->Apply(NSteps);
+BENCHMARK_TEMPLATE(BM_LearnerLearn, cvc::sarsa::kTargetFeatures)
+    ->Apply(NSteps);
+
+// policies, choosing among range(0) candidates
+
+void Candidates(benchmark::internal::Benchmark* b) {
+  for (int candidates : {2, 8, 64, 1024}) {
+    b->Arg(candidates);
+  }
+}
+
+template <class Policy>
+std::unique_ptr<Policy> CreatePolicy(Logger* logger);
+
+template <>
+std::unique_ptr<cvc::sarsa::GreedyPolicy> CreatePolicy(Logger* logger) {
+  return std::make_unique<cvc::sarsa::GreedyPolicy>();
+}
+
+template <>
+std::unique_ptr<cvc::sarsa::EpsilonGreedyPolicy> CreatePolicy(Logger* logger) {
+  return std::make_unique<cvc::sarsa::EpsilonGreedyPolicy>(0.1, logger);
+}
+
+template <>
+std::unique_ptr<cvc::sarsa::DecayingEpsilonGreedyPolicy> CreatePolicy(
+    Logger* logger) {
+  return std::make_unique<cvc::sarsa::DecayingEpsilonGreedyPolicy>(0.5, 1.0,
+                                                                   logger);
+}
+
+template <>
+std::unique_ptr<cvc::sarsa::SoftmaxPolicy> CreatePolicy(Logger* logger) {
+  return std::make_unique<cvc::sarsa::SoftmaxPolicy>(1.0, logger);
+}
+
+template <>
+std::unique_ptr<cvc::sarsa::AnnealingSoftmaxPolicy> CreatePolicy(
+    Logger* logger) {
+  return std::make_unique<cvc::sarsa::AnnealingSoftmaxPolicy>(1.0, logger);
+}
+
+template <>
+std::unique_ptr<cvc::sarsa::GradSensitiveSoftmaxPolicy> CreatePolicy(
+    Logger* logger) {
+  return std::make_unique<cvc::sarsa::GradSensitiveSoftmaxPolicy>(
+      1.0, 0.99, 1.0, logger);
+}
+
+template <class Policy>
+void BM_SARSAPolicyChooseAction(benchmark::State& state) {
+  Population population(2);
+  auto policy = CreatePolicy<Policy>(population.GetLogger());
+  auto learner = cvc::sarsa::SARSALearner<cvc::sarsa::kStandardFeatures>::
+      Create(0, kLearningRate, kDiscount, kBeta1, kBeta2,
+             *population.GetRandomGenerator(), population.GetLogger());
+
+  std::vector<std::vector<std::unique_ptr<cvc::sarsa::Experience>>> batches(
+      kCandidateBatches);
+  size_t next = batches.size();
+  for (auto _ : state) {
+    if (next == batches.size()) {
+      state.PauseTiming();
+      for (auto& candidates : batches) {
+        candidates.clear();
+        for (int i = 0; i < state.range(0); i++) {
+          candidates.push_back(learner->WrapAction(
+              RandomFeatures<cvc::sarsa::kStandardFeatures, double>(
+                  population.GetRandomGenerator()),
+              std::make_unique<TrivialAction>(population.Get(0), 0.0)));
+        }
+      }
+      next = 0;
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(policy->ChooseAction(
+        &batches[next++], population.GetCVC(), population.Get(0)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_SARSAPolicyChooseAction, cvc::sarsa::GreedyPolicy)
+    ->Apply(Candidates);
+BENCHMARK_TEMPLATE(BM_SARSAPolicyChooseAction, cvc::sarsa::EpsilonGreedyPolicy)
+    ->Apply(Candidates);
+BENCHMARK_TEMPLATE(BM_SARSAPolicyChooseAction,
+                   cvc::sarsa::DecayingEpsilonGreedyPolicy)
+    ->Apply(Candidates);
+BENCHMARK_TEMPLATE(BM_SARSAPolicyChooseAction, cvc::sarsa::SoftmaxPolicy)
+    ->Apply(Candidates);
+BENCHMARK_TEMPLATE(BM_SARSAPolicyChooseAction,
+                   cvc::sarsa::AnnealingSoftmaxPolicy)
+    ->Apply(Candidates);
+BENCHMARK_TEMPLATE(BM_SARSAPolicyChooseAction,
+                   cvc::sarsa::GradSensitiveSoftmaxPolicy)
+    ->Apply(Candidates);
+
+void BM_ProbDistPolicyChooseAction(benchmark::State& state) {
+  Population population(2);
+  ProbDistPolicy policy;
+  std::uniform_real_distribution<> score_dist(0.0, 1.0);
+
+  std::vector<std::vector<std::unique_ptr<Action>>> batches(kCandidateBatches);
+  size_t next = batches.size();
+  for (auto _ : state) {
+    if (next == batches.size()) {
+      state.PauseTiming();
+      for (auto& candidates : batches) {
+        candidates.clear();
+        for (int i = 0; i < state.range(0); i++) {
+          candidates.push_back(std::make_unique<TrivialAction>(
+              population.Get(0),
+              score_dist(*population.GetRandomGenerator())));
+        }
+      }
+      next = 0;
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(policy.ChooseAction(
+        &batches[next++], population.GetCVC(), population.Get(0)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProbDistPolicyChooseAction)->Apply(Candidates);
+
+// action factories, one character per iteration, round robin over the
+// population. per tick shared work (FeatureService, HeuristicContext) is done
+// before timing starts, so this is the marginal cost of each character
+
+template <class Factory>
+void BM_SARSAFactoryEnumerateActions(benchmark::State& state) {
+  Population population(state.range(0));
+  cvc::sarsa::FeatureService features;
+  Factory factory(
+      Factory::CreateLearner(0, kLearningRate, kDiscount, kBeta1, kBeta2,
+                             population.GetRandomGenerator(),
+                             population.GetLogger()),
+      &features);
+  features.ForCharacters(population.GetCVC());
+
+  std::vector<std::unique_ptr<cvc::sarsa::Experience>> actions;
+  size_t i = 0;
+  for (auto _ : state) {
+    actions.clear();
+    benchmark::DoNotOptimize(factory.EnumerateActions(
+        population.GetCVC(), population.Get(i++), &actions));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_SARSAFactoryEnumerateActions,
+                   cvc::sarsa::SARSAGiveActionFactory<>)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_SARSAFactoryEnumerateActions,
+                   cvc::sarsa::SARSAAskActionFactory<>)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_SARSAFactoryEnumerateActions,
+                   cvc::sarsa::SARSAWorkActionFactory<>)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_SARSAFactoryEnumerateActions,
+                   cvc::sarsa::SARSATrivialActionFactory<>)
+    ->Apply(PairPopulations);
+
+template <class Factory>
+void BM_SARSAFactoryRespond(benchmark::State& state) {
+  Population population(state.range(0));
+  cvc::sarsa::FeatureService features;
+  Factory factory(
+      Factory::CreateLearner(0, kLearningRate, kDiscount, kBeta1, kBeta2,
+                             population.GetRandomGenerator(),
+                             population.GetLogger()),
+      &features);
+  features.ForCharacters(population.GetCVC());
+
+  // everyone is asked by the next character along
+  std::vector<std::unique_ptr<AskAction>> asks;
+  for (size_t i = 0; i < population.Size(); i++) {
+    asks.push_back(std::make_unique<AskAction>(
+        population.Get(i + 1), 0.0, population.Get(i), 10.0));
+  }
+
+  std::vector<std::unique_ptr<cvc::sarsa::Experience>> actions;
+  size_t i = 0;
+  for (auto _ : state) {
+    actions.clear();
+    Action* ask = asks[i % asks.size()].get();
+    benchmark::DoNotOptimize(factory.Respond(
+        population.GetCVC(), population.Get(i), ask, &actions));
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_SARSAFactoryRespond,
+                   cvc::sarsa::SARSAAskSuccessResponseFactory<>)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_SARSAFactoryRespond,
+                   cvc::sarsa::SARSAAskFailureResponseFactory<>)
+    ->Apply(PairPopulations);
+
+template <class Factory>
+void BM_HeuristicFactoryEnumerateActions(benchmark::State& state) {
+  Population population(state.range(0));
+  HeuristicContext context;
+  Factory factory(&context);
+  context.MeanMoney(population.GetCVC());
+
+  std::vector<std::unique_ptr<Action>> actions;
+  size_t i = 0;
+  for (auto _ : state) {
+    actions.clear();
+    benchmark::DoNotOptimize(factory.EnumerateActions(
+        population.GetCVC(), population.Get(i++), &actions));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_HeuristicFactoryEnumerateActions, GiveActionFactory)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_HeuristicFactoryEnumerateActions, AskActionFactory)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_HeuristicFactoryEnumerateActions, WorkActionFactory)
+    ->Apply(PairPopulations);
+
+// crunchedin factories, over a job market like main's: every character has a
+// cv, one in kCharactersPerOrg founds an organization and most of the rest
+// work at the one closest to their culture, but every kUnemployedEvery-th
+// stays unemployed so there's founding to do too
+class JobMarket {
+ public:
+  static const size_t kCharactersPerOrg = 10;
+  static const size_t kUnemployedEvery = 4;
+
+  JobMarket(Population* population) {
+    std::mt19937* random_generator = population->GetRandomGenerator();
+    std::normal_distribution<> dist(0.0, 1.0);
+    for (size_t i = 0; i < population->Size(); i++) {
+      std::array<double, cvc::crunchedin::CULTURE_DIMENSIONS> culture;
+      double magnitude = 0.0;
+      for (double& value : culture) {
+        value = dist(*random_generator);
+        magnitude += value * value;
+      }
+      for (double& value : culture) {
+        value /= sqrt(magnitude);
+      }
+      crunchedin_.AddCurriculumVitae(population->Get(i), culture);
+    }
+
+    size_t num_orgs =
+        std::max((size_t)1, population->Size() / kCharactersPerOrg);
+    for (size_t cv = 0; cv < num_orgs; cv++) {
+      crunchedin_.FoundOrganization(crunchedin_.GetCulture(cv), cv, 0);
+    }
+    std::vector<cvc::crunchedin::OrgId> closest;
+    for (size_t cv = num_orgs; cv < population->Size(); cv++) {
+      if (0 == cv % kUnemployedEvery) {
+        continue;
+      }
+      crunchedin_.FindOrganizations(crunchedin_.GetCulture(cv), 1, &closest);
+      crunchedin_.StartRole(closest.empty() ? cv % num_orgs : closest[0], cv,
+                            0);
+    }
+  }
+
+  cvc::crunchedin::CrunchedIn* Get() { return &crunchedin_; }
+
+ private:
+  cvc::crunchedin::CrunchedIn crunchedin_;
+};
+
+template <class Factory>
+void BM_CrunchedInFactoryEnumerateActions(benchmark::State& state) {
+  Population population(state.range(0));
+  JobMarket market(&population);
+  Factory factory(
+      Factory::CreateLearner(0, kLearningRate, kDiscount, kBeta1, kBeta2,
+                             population.GetRandomGenerator(),
+                             population.GetLogger()),
+      market.Get());
+
+  std::vector<std::unique_ptr<cvc::sarsa::Experience>> actions;
+  size_t i = 0;
+  for (auto _ : state) {
+    actions.clear();
+    benchmark::DoNotOptimize(factory.EnumerateActions(
+        population.GetCVC(), population.Get(i++), &actions));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_CrunchedInFactoryEnumerateActions,
+                   cvc::crunchedin::WorkActionFactory<>)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_CrunchedInFactoryEnumerateActions,
+                   cvc::crunchedin::ApplyActionFactory<>)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_CrunchedInFactoryEnumerateActions,
+                   cvc::crunchedin::FoundActionFactory<>)
+    ->Apply(PairPopulations);
+
+template <class Factory>
+void BM_CrunchedInFactoryRespond(benchmark::State& state) {
+  Population population(state.range(0));
+  JobMarket market(&population);
+  cvc::crunchedin::CrunchedIn* crunchedin = market.Get();
+  Factory factory(
+      Factory::CreateLearner(0, kLearningRate, kDiscount, kBeta1, kBeta2,
+                             population.GetRandomGenerator(),
+                             population.GetLogger()),
+      crunchedin);
+
+  // everyone applies to an organization other than their own, whose ceo
+  // responds
+  std::vector<std::unique_ptr<cvc::crunchedin::ApplyAction>> applications;
+  for (size_t cv = 0; cv < population.Size(); cv++) {
+    cvc::crunchedin::OrgId org =
+        (cv + 1) % crunchedin->NumOrganizationIds();
+    applications.push_back(std::make_unique<cvc::crunchedin::ApplyAction>(
+        population.Get(cv), 0.0, crunchedin, cv, org));
+  }
+
+  std::vector<std::unique_ptr<cvc::sarsa::Experience>> actions;
+  size_t i = 0;
+  for (auto _ : state) {
+    actions.clear();
+    cvc::crunchedin::ApplyAction* application =
+        applications[i++ % applications.size()].get();
+    benchmark::DoNotOptimize(
+        factory.Respond(population.GetCVC(), application->GetTarget(),
+                        application, &actions));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_CrunchedInFactoryRespond,
+                   cvc::crunchedin::HireResponseFactory<>)
+    ->Apply(PairPopulations);
+BENCHMARK_TEMPLATE(BM_CrunchedInFactoryRespond,
+                   cvc::crunchedin::RejectResponseFactory<>)
+    ->Apply(PairPopulations);
+
+// the shared per tick pass itself
+void BM_HeuristicContextRefresh(benchmark::State& state) {
+  Population population(state.range(0));
+  CVC* cvc = population.GetCVC();
+  HeuristicContext context;
+  for (auto _ : state) {
+    cvc->Tick();
+    benchmark::DoNotOptimize(context.MeanMoney(cvc));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_HeuristicContextRefresh)
+    ->Apply(PairPopulations)
+    ->Unit(benchmark::kMillisecond);
+
+} //namespace
+
+int main(int argc, char** argv) {
+  // JSON unless asked otherwise, later flags win
+  std::vector<char*> args(argv, argv + argc);
+  char json_format[] = "--benchmark_format=json";
+  args.insert(args.begin() + 1, json_format);
+  int num_args = args.size();
+  benchmark::Initialize(&num_args, args.data());
+  if (benchmark::ReportUnrecognizedArguments(num_args, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
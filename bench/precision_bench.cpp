@@ -0,0 +1,193 @@
+// compares learner precisions: double and float training, int8 and fp16
+// quantized inference
+//
+// each learner fits the same synthetic linear target, we report the mean loss
+// over the last epoch and Learn/Score throughput. quantized learners are
+// exported from the trained double learner and report their score error
+// against it instead of a loss.
+//
+// usage: precision_bench [num_samples] [num_epochs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/util.h"
+#include "../src/core.h"
+#include "../src/sarsa/checkpoint.h"
+#include "../src/sarsa/sarsa_learner.h"
+
+namespace {
+
+const size_t kNumFeatures = 10;
+
+class NoopAction : public Action {
+ public:
+  NoopAction() : Action("Noop", nullptr, 1.0) {}
+
+  bool IsValid(const CVC* gamestate) { return true; }
+  void TakeEffect(CVC* gamestate) {}
+};
+
+struct Sample {
+  std::array<double, kNumFeatures> features_;
+  double target_;
+};
+
+std::vector<Sample> GenerateSamples(size_t num_samples,
+                                    std::mt19937* random_generator) {
+  std::uniform_real_distribution<> weight_dist(-1.0, 1.0);
+  std::normal_distribution<> feature_dist(0.0, 1.0);
+  std::normal_distribution<> noise_dist(0.0, 0.1);
+
+  std::array<double, kNumFeatures> true_weights;
+  for (size_t i = 0; i < kNumFeatures; i++) {
+    true_weights[i] = weight_dist(*random_generator);
+  }
+
+  std::vector<Sample> samples(num_samples);
+  for (Sample& sample : samples) {
+    sample.target_ = noise_dist(*random_generator);
+    for (size_t i = 0; i < kNumFeatures; i++) {
+      //first feature is the bias term
+      sample.features_[i] = 0 == i ? 1.0 : feature_dist(*random_generator);
+      sample.target_ += true_weights[i] * sample.features_[i];
+    }
+  }
+  return samples;
+}
+
+template <typename T>
+std::array<T, kNumFeatures> Convert(
+    const std::array<double, kNumFeatures>& features) {
+  std::array<T, kNumFeatures> converted;
+  for (size_t i = 0; i < kNumFeatures; i++) {
+    converted[i] = features[i];
+  }
+  return converted;
+}
+
+double Seconds(std::chrono::high_resolution_clock::time_point start) {
+  std::chrono::duration<double> d =
+      std::chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+// times scoring every sample, returns scores per second
+template <typename T>
+double TimeScore(const cvc::sarsa::Learner<kNumFeatures, T>& learner,
+                 const std::vector<Sample>& samples, double* checksum) {
+  std::vector<std::array<T, kNumFeatures>> features;
+  for (const Sample& sample : samples) {
+    features.push_back(Convert<T>(sample.features_));
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  double sum = 0.0;
+  for (const auto& f : features) {
+    sum += learner.Score(f);
+  }
+  double seconds = Seconds(start);
+  //keep the loop from being optimized away
+  *checksum += sum;
+  return features.size() / seconds;
+}
+
+// g = 0 turns SARSA into plain regression against the sample target
+template <typename T>
+void BenchTraining(const char* name, const std::vector<Sample>& samples,
+                   size_t num_epochs, Logger* logger,
+                   std::unique_ptr<cvc::sarsa::SARSALearner<kNumFeatures, T>>*
+                       trained) {
+  std::mt19937 random_generator(0);
+  std::unique_ptr<cvc::sarsa::SARSALearner<kNumFeatures, T>> learner =
+      cvc::sarsa::SARSALearner<kNumFeatures, T>::Create(
+          0, 0.01, 0.0, 0.9, 0.999, random_generator, logger);
+  CVC cvc;
+
+  double loss = 0.0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t epoch = 0; epoch < num_epochs; epoch++) {
+    loss = 0.0;
+    for (const Sample& sample : samples) {
+      std::array<T, kNumFeatures> features = Convert<T>(sample.features_);
+      cvc::sarsa::ExperienceImpl<kNumFeatures, T> next(
+          std::make_unique<NoopAction>(), sample.target_, nullptr, features,
+          learner.get());
+      cvc::sarsa::ExperienceImpl<kNumFeatures, T> experience(
+          std::make_unique<NoopAction>(), 0.0, &next, features,
+          learner.get());
+      double dL_dy = learner->Learn(&cvc, &experience);
+      loss += (dL_dy / 2.0) * (dL_dy / 2.0);
+    }
+  }
+  double learns_per_sec = num_epochs * samples.size() / Seconds(start);
+
+  double checksum = 0.0;
+  double scores_per_sec = TimeScore<T>(*learner, samples, &checksum);
+
+  printf("%s\t%f\t%.0f\t%.0f\t-\t(%f)\n", name, loss / samples.size(),
+         learns_per_sec, scores_per_sec, checksum);
+  *trained = std::move(learner);
+}
+
+void BenchQuantized(const char* name, cvc::sarsa::WeightFormat format,
+                    cvc::sarsa::SARSALearner<kNumFeatures>* reference,
+                    const std::vector<Sample>& samples, Logger* logger) {
+  std::string path =
+      "/tmp/precision_bench." + std::to_string(getpid()) + "." + name;
+  cvc::sarsa::QuantizedLearner<kNumFeatures> learner(0);
+  if (!cvc::sarsa::SaveQuantizedCheckpoint(path.c_str(), {{"l", reference}},
+                                           format, logger) ||
+      !cvc::sarsa::LoadCheckpoint(path.c_str(), {{"l", &learner}}, logger)) {
+    unlink(path.c_str());
+    logger->Log(ERROR, "could not round trip %s export\n", name);
+    return;
+  }
+  unlink(path.c_str());
+
+  double error = 0.0;
+  for (const Sample& sample : samples) {
+    error += std::abs(reference->Score(sample.features_) -
+                      learner.Score(Convert<float>(sample.features_)));
+  }
+
+  double checksum = 0.0;
+  double scores_per_sec = TimeScore<float>(learner, samples, &checksum);
+
+  printf("%s\t-\t-\t%.0f\t%g\t(%f)\n", name, scores_per_sec,
+         error / samples.size(), checksum);
+}
+
+} //namespace
+
+int main(int argc, char** argv) {
+  size_t num_samples = argc > 1 ? atoi(argv[1]) : 100000;
+  size_t num_epochs = argc > 2 ? atoi(argv[2]) : 5;
+
+  Logger logger;
+  // Learn logs every step at INFO
+  Logger learn_logger("learner", stderr, WARN);
+
+  std::mt19937 random_generator(0);
+  std::vector<Sample> samples = GenerateSamples(num_samples, &random_generator);
+
+  printf("precision\tloss\tlearns/sec\tscores/sec\tscore_error\t(checksum)\n");
+  std::unique_ptr<cvc::sarsa::SARSALearner<kNumFeatures, double>> reference;
+  std::unique_ptr<cvc::sarsa::SARSALearner<kNumFeatures, float>> single;
+  BenchTraining<double>("double", samples, num_epochs, &learn_logger,
+                        &reference);
+  BenchTraining<float>("float", samples, num_epochs, &learn_logger, &single);
+  BenchQuantized("fp16", cvc::sarsa::kFp16Weights, reference.get(), samples,
+                 &logger);
+  BenchQuantized("int8", cvc::sarsa::kInt8Weights, reference.get(), samples,
+                 &logger);
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+// compares best-target search strategies for the Ask factory: scanning every
+// target, the exact target index and the approximate index at a few
+// candidate budgets
+//
+// for each population size we report microseconds per character, targets
+// scored per character and recall@1, the fraction of characters whose best
+// target matches the scan's, averaged over a few randomly initialized
+// learners
+//
+// usage: target_index_bench [population...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "../src/util.h"
+#include "../src/core.h"
+#include "../src/action.h"
+#include "../src/sarsa/feature_service.h"
+#include "../src/sarsa/sarsa_action_factories.h"
+
+namespace {
+
+const int kNumLearners = 5;
+
+typedef cvc::sarsa::SARSAAskActionFactory<> Factory;
+
+double Seconds(std::chrono::high_resolution_clock::time_point start) {
+  std::chrono::duration<double> d =
+      std::chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+struct Result {
+  double seconds_ = 0.0;
+  size_t scored_ = 0;
+  size_t matches_ = 0;
+};
+
+// finds everyone's best target, recording it in best if it's empty or
+// counting matches against it otherwise
+void Search(Factory* factory, CVC* cvc, std::vector<Character*>* best,
+            Result* result) {
+  std::vector<Character*> characters = cvc->GetCharacters();
+  bool reference = best->empty();
+  std::vector<std::unique_ptr<cvc::sarsa::Experience>> actions;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (Character* character : characters) {
+    factory->EnumerateActions(cvc, character, &actions);
+  }
+  result->seconds_ += Seconds(start);
+
+  for (size_t i = 0; i < characters.size(); i++) {
+    Character* target = ((AskAction*)actions[i]->action_.get())->GetTarget();
+    if (reference) {
+      best->push_back(target);
+    } else if ((*best)[i] == target) {
+      result->matches_++;
+    }
+  }
+}
+
+void BenchPopulation(size_t population, Logger* logger) {
+  std::mt19937 random_generator(population);
+  std::uniform_real_distribution<> money_dist(10.0, 1000.0);
+  std::uniform_int_distribution<> background_dist(0, 10);
+  std::uniform_int_distribution<> language_dist(0, 5);
+  std::vector<std::unique_ptr<Character>> characters;
+  std::vector<Character*> character_ptrs;
+  for (size_t i = 0; i < population; i++) {
+    characters.push_back(
+        std::make_unique<Character>(i, money_dist(random_generator)));
+    characters.back()->traits_[kBackground] = background_dist(random_generator);
+    characters.back()->traits_[kLanguage] = language_dist(random_generator);
+    character_ptrs.push_back(characters.back().get());
+  }
+  CVC cvc(character_ptrs, logger, random_generator);
+
+  cvc::sarsa::FeatureService features;
+  // the per tick feature pass is shared by every strategy, leave it out
+  features.Global(&cvc);
+
+  std::vector<size_t> budgets = {8, 32, 128};
+  Result scan;
+  Result exact;
+  std::vector<Result> approximate(budgets.size());
+  for (int seed = 0; seed < kNumLearners; seed++) {
+    auto create = [&features, seed, logger](cvc::sarsa::TargetSearch search,
+                                            size_t max_candidates) {
+      std::mt19937 learner_generator(seed);
+      auto factory = std::make_unique<Factory>(
+          Factory::CreateLearner(0, 0.01, 0.9, 0.9, 0.999, &learner_generator,
+                                 logger),
+          &features);
+      factory->SetTargetSearch(search, max_candidates);
+      return factory;
+    };
+
+    std::vector<Character*> best;
+    Search(create(cvc::sarsa::kScanTargets, 0).get(), &cvc, &best, &scan);
+    scan.scored_ += population * (population - 1);
+    scan.matches_ += population;
+
+    auto factory = create(cvc::sarsa::kExactTargetIndex, 0);
+    Search(factory.get(), &cvc, &best, &exact);
+    exact.scored_ += factory->GetIndexScored();
+
+    for (size_t i = 0; i < budgets.size(); i++) {
+      factory = create(cvc::sarsa::kApproximateTargetIndex, budgets[i]);
+      Search(factory.get(), &cvc, &best, &approximate[i]);
+      approximate[i].scored_ += factory->GetIndexScored();
+    }
+  }
+
+  auto report = [population](const char* name, const Result& result) {
+    double searches = (double)population * kNumLearners;
+    printf("%zu\t%s\t%.2f\t%.1f\t%.4f\n", population, name,
+           result.seconds_ / searches * 1e6, result.scored_ / searches,
+           result.matches_ / searches);
+  };
+  report("scan", scan);
+  report("exact", exact);
+  for (size_t i = 0; i < budgets.size(); i++) {
+    std::string name = "approx" + std::to_string(budgets[i]);
+    report(name.c_str(), approximate[i]);
+  }
+}
+
+} //namespace
+
+int main(int argc, char** argv) {
+  Logger logger("bench", stderr, WARN);
+
+  std::vector<size_t> populations;
+  for (int i = 1; i < argc; i++) {
+    populations.push_back(atoi(argv[i]));
+  }
+  if (populations.empty()) {
+    populations = {100, 1000, 5000};
+  }
+
+  printf("population\tsearch\tus/character\tscored/character\trecall@1\n");
+  for (size_t population : populations) {
+    BenchPopulation(population, &logger);
+  }
+  return 0;
+}
@@ -0,0 +1,163 @@
+"""Reads columnar logs written by main --columnar-log (see src/columnar_log.h).
+
+    import cvc_columnar
+    learn = cvc_columnar.read_table("/tmp/cvc.learn.cols")
+    df = cvc_columnar.to_pandas(learn)
+    rewards = df.groupby("actor").reward.mean()
+
+the action, learn and policy tables all have an actor column (-1 where
+there was none) to join them on per character.
+
+the file is memory mapped, raw double columns are numpy views straight into
+the mapping, XOR encoded ones are decoded with a vectorized shift and
+cumulative XOR and int columns with one vectorized add per row group, so
+large logs load in seconds. pass columns= to read only some of them.
+"""
+
+import mmap
+import struct
+
+import numpy as np
+
+MAGIC = b"CVCCOLS\0"
+
+INT_COLUMN = 1
+DOUBLE_COLUMN = 2
+STRING_COLUMN = 3
+DOUBLE_LIST_COLUMN = 4
+
+# offset, count, base, width, shift, see ColumnarChunk
+CHUNK = struct.Struct("<QQqII")
+INT_DTYPES = {1: np.uint8, 2: np.uint16, 4: np.uint32, 8: np.uint64}
+
+
+class Table:
+    """columns by name: numpy arrays, plus for string columns the dictionary
+    to decode their codes and for double lists the per row lengths"""
+
+    def __init__(self):
+        self.columns = {}
+        self.types = {}
+        self.dictionary = []
+        self.lengths = {}
+
+    def strings(self, name):
+        """the values of a string column, as a numpy array of str"""
+        return np.array(self.dictionary, dtype=object)[self.columns[name]]
+
+    def lists(self, name):
+        """the rows of a double list column, as views of its values"""
+        offsets = np.concatenate(([0], np.cumsum(self.lengths[name])))
+        values = self.columns[name]
+        return [values[offsets[i]:offsets[i + 1]]
+                for i in range(len(offsets) - 1)]
+
+
+def _read_string(buffer, offset):
+    (length,) = struct.unpack_from("<H", buffer, offset)
+    offset += 2
+    return bytes(buffer[offset:offset + length]).decode(), offset + length
+
+
+def _ints(buffer, chunk):
+    offset, count, base, width, _ = chunk
+    if width == 0:
+        return np.full(count, base, dtype=np.int64)
+    differences = np.frombuffer(buffer, dtype=INT_DTYPES[width], count=count,
+                                offset=offset)
+    # wraps around like the writer's unsigned subtraction did
+    return (differences.astype(np.uint64) + np.uint64(base & (2**64 - 1))
+            ).view(np.int64)
+
+
+def _doubles(buffer, chunk):
+    offset, count, base, width, shift = chunk
+    if width == 8:
+        return np.frombuffer(buffer, dtype=np.float64, count=count,
+                             offset=offset)
+    base = np.uint64(base & (2**64 - 1))
+    if width == 0:
+        return np.full(count, base, dtype=np.uint64).view(np.float64)
+    xors = np.frombuffer(buffer, dtype=INT_DTYPES[width], count=count,
+                         offset=offset).astype(np.uint64)
+    xors <<= np.uint64(8 * shift)
+    return (np.bitwise_xor.accumulate(xors) ^ base).view(np.float64)
+
+
+def read_table(path, columns=None):
+    with open(path, "rb") as f:
+        buffer = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    if buffer[:8] != MAGIC or buffer[-8:] != MAGIC:
+        raise ValueError("%s is not a columnar log" % path)
+    (offset,) = struct.unpack_from("<Q", buffer, len(buffer) - 16)
+
+    table = Table()
+    (num_columns,) = struct.unpack_from("<I", buffer, offset)
+    offset += 4
+    schema = []
+    for _ in range(num_columns):
+        column_type = buffer[offset]
+        name, offset = _read_string(buffer, offset + 1)
+        schema.append((name, column_type))
+    (dictionary_size,) = struct.unpack_from("<I", buffer, offset)
+    offset += 4
+    for _ in range(dictionary_size):
+        entry, offset = _read_string(buffer, offset)
+        table.dictionary.append(entry)
+
+    wanted = [name for name, _ in schema
+              if columns is None or name in columns]
+    parts = {name: [] for name in wanted}
+    lengths = {name: [] for name in wanted}
+    (num_row_groups,) = struct.unpack_from("<I", buffer, offset)
+    offset += 4
+    for _ in range(num_row_groups):
+        offset += 8  # rows, the chunks' counts say the same
+        for name, column_type in schema:
+            chunk = CHUNK.unpack_from(buffer, offset)
+            offset += CHUNK.size
+            if column_type == DOUBLE_LIST_COLUMN:
+                values = CHUNK.unpack_from(buffer, offset)
+                offset += CHUNK.size
+            if name not in parts:
+                continue
+            if column_type == DOUBLE_COLUMN:
+                parts[name].append(_doubles(buffer, chunk))
+            elif column_type == DOUBLE_LIST_COLUMN:
+                lengths[name].append(_ints(buffer, chunk))
+                parts[name].append(_doubles(buffer, values))
+            else:
+                parts[name].append(_ints(buffer, chunk))
+
+    for name, column_type in schema:
+        if name not in parts:
+            continue
+        table.types[name] = column_type
+        dtype = np.float64 if column_type in (
+            DOUBLE_COLUMN, DOUBLE_LIST_COLUMN) else np.int64
+        if len(parts[name]) == 1:
+            # a single row group stays a view of the mapping
+            table.columns[name] = parts[name][0]
+        else:
+            table.columns[name] = (np.concatenate(parts[name])
+                                   if parts[name] else np.array([], dtype))
+        if column_type == DOUBLE_LIST_COLUMN:
+            table.lengths[name] = (np.concatenate(lengths[name])
+                                   if lengths[name]
+                                   else np.array([], np.int64))
+    return table
+
+
+def to_pandas(table):
+    """a DataFrame of the table's scalar columns, strings decoded as
+    categoricals (double lists are left out, see Table.lists)"""
+    import pandas as pd
+
+    data = {}
+    for name, values in table.columns.items():
+        column_type = table.types[name]
+        if column_type == STRING_COLUMN:
+            data[name] = pd.Categorical.from_codes(values, table.dictionary)
+        elif column_type != DOUBLE_LIST_COLUMN:
+            data[name] = values
+    return pd.DataFrame(data)
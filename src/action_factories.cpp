@@ -1,37 +1,106 @@
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <algorithm>
+#include <limits>
 #include <cassert>
 
 #include "core.h"
 #include "action_factories.h"
 
+const size_t HeuristicContext::kNone;
+
+void HeuristicContext::Refresh(CVC* cvc) {
+  if (cvc == cvc_ && cvc->Now() == tick_) {
+    return;
+  }
+  cvc_ = cvc;
+  tick_ = cvc->Now();
+
+  characters_ = cvc->GetCharacters();
+  size_t n = characters_.size();
+  index_.clear();
+  // summed in the same order as CVC::ComputeStats, so the mean is identical
+  double money = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    index_[characters_[i]] = i;
+    money += characters_[i]->GetMoney();
+  }
+  mean_money_ = money / (double)n;
+
+  by_money_.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    by_money_[i] = i;
+  }
+  std::sort(by_money_.begin(), by_money_.end(), [this](size_t a, size_t b) {
+    double money_a = characters_[a]->GetMoney();
+    double money_b = characters_[b]->GetMoney();
+    return money_a > money_b || (money_a == money_b && a < b);
+  });
+
+  // one pass over every pair, observers in order so the earliest wins ties
+  std::vector<double> lowest_opinion(n, std::numeric_limits<double>::max());
+  least_liking_poor_observer_.assign(n, kNone);
+  has_positive_opinion_.assign(n, false);
+  for (size_t i = 0; i < n; i++) {
+    Character* observer = characters_[i];
+    bool poor = observer->GetMoney() <= mean_money_;
+    for (size_t j = 0; j < n; j++) {
+      double opinion = observer->GetOpinionOf(characters_[j]);
+      if (opinion > 0.0) {
+        has_positive_opinion_[j] = true;
+      }
+      if (poor && i != j && opinion < lowest_opinion[j]) {
+        lowest_opinion[j] = opinion;
+        least_liking_poor_observer_[j] = i;
+      }
+    }
+  }
+}
+
+size_t HeuristicContext::Index(Character* character) const {
+  auto index = index_.find(character);
+  assert(index != index_.end());
+  return index->second;
+}
+
+double HeuristicContext::MeanMoney(CVC* cvc) {
+  Refresh(cvc);
+  return mean_money_;
+}
+
+Character* HeuristicContext::RichestOther(CVC* cvc, Character* character) {
+  Refresh(cvc);
+  for (size_t i : by_money_) {
+    // at most two iterations
+    if (characters_[i] != character) {
+      return characters_[i];
+    }
+  }
+  return nullptr;
+}
+
+Character* HeuristicContext::LeastLikingPoorObserver(CVC* cvc,
+                                                     Character* character) {
+  Refresh(cvc);
+  size_t observer = least_liking_poor_observer_[Index(character)];
+  return kNone == observer ? nullptr : characters_[observer];
+}
+
+bool HeuristicContext::HasPositiveOpinion(CVC* cvc, Character* character) {
+  Refresh(cvc);
+  return has_positive_opinion_[Index(character)];
+}
+
 double GiveActionFactory::EnumerateActions(
     CVC* cvc, Character* character,
     std::vector<std::unique_ptr<Action>>* actions) {
   double score = 0.0;
 
-  Character* best_target = NULL;
-  double worst_opinion = std::numeric_limits<double>::max();
   if (character->GetMoney() > 10.0) {
-    for (Character* target : cvc->GetCharacters()) {
-      // skip self
-      if (character == target) {
-        continue;
-      }
-
-      // skip if target has above average money
-      if (target->GetMoney() > cvc->GetMoneyStats().mean_) {
-        continue;
-      }
-
-      // pick the character that likes us the least
-      double opinion = target->GetOpinionOf(character);
-      if (opinion < worst_opinion) {
-        worst_opinion = opinion;
-        best_target = target;
-      }
-    }
+    // someone with at most average money, who likes us the least
+    Character* best_target =
+        context_->LeastLikingPoorObserver(cvc, character);
     if (best_target) {
       actions->push_back(std::make_unique<GiveAction>(
           character, 0.4, best_target, 10.0));
@@ -46,33 +115,11 @@ double AskActionFactory::EnumerateActions(
     std::vector<std::unique_ptr<Action>>* actions) {
   double score = 0.0;
 
-  Character* best_target = NULL;
-  double best_money = 0.0;
-  for (Character* target : cvc->GetCharacters()) {
-    // skip self
-    if (character == target) {
-      continue;
-    }
-
-    //if the character has no money, skip
-    if (target->GetMoney() < 10.0) {
-      continue;
-    }
-
-    // TODO: this is problematic if opinion is negative, it's hard to every get
-    // an ask action
-    /*if(target->GetOpinionOf(character) < 0) {
-      continue;
-    }*/
-
-    // pick the character that has the most money
-    double money = target->GetMoney();
-    if (money > best_money) {
-      best_money = money;
-      best_target = target;
-    }
-  }
-  if (best_target) {
+  // pick the character that has the most money, if they have any to give
+  // TODO: this is problematic if opinion is negative, it's hard to every get
+  // an ask action
+  Character* best_target = context_->RichestOther(cvc, character);
+  if (best_target && best_target->GetMoney() >= 10.0) {
     actions->push_back(std::make_unique<AskAction>(
         character, 0.4, best_target, 10.0));
     score = 0.4;
@@ -117,11 +164,9 @@ double AskResponseFactory::Respond(
 double WorkActionFactory::EnumerateActions(
     CVC* cvc, Character* character,
     std::vector<std::unique_ptr<Action>>* actions) {
-  for (Character* target : cvc->GetCharacters()) {
-    if(target->GetOpinionOf(character) > 0.0) {
-      actions->push_back(std::make_unique<WorkAction>(character, 0.1));
-      return 0.3;
-    }
+  if (context_->HasPositiveOpinion(cvc, character)) {
+    actions->push_back(std::make_unique<WorkAction>(character, 0.1));
+    return 0.3;
   }
   return 0.0;
 }
@@ -1,6 +1,7 @@
 #ifndef ACTION_FACTORIES_H_
 #define ACTION_FACTORIES_H_
 
+#include <limits>
 #include <unordered_map>
 #include <vector>
 #include <string>
@@ -8,6 +9,48 @@
 #include "core.h"
 #include "decision_engine.h"
 
+// what the heuristic factories need to know about everyone, worked out once
+// a tick in one pass over the population and shared by every heuristic agent,
+// so each agent decides in constant time rather than scanning everyone
+// (several times) itself.
+// values are snapshots from the first request in a tick, game state doesn't
+// change while agents choose actions.
+// not thread safe
+class HeuristicContext {
+ public:
+  // mean money, the same as CVC::GetMoneyStats().mean_ (which this avoids
+  // computing, along with all the opinion stats that come with it)
+  double MeanMoney(CVC* cvc);
+  // the richest character other than character, ties go to the earliest in
+  // CVC::GetCharacters, null if there's no one else
+  Character* RichestOther(CVC* cvc, Character* character);
+  // of the characters (other than character) with at most mean money, the
+  // one with the lowest opinion of character, ties go to the earliest, null
+  // if there are none
+  Character* LeastLikingPoorObserver(CVC* cvc, Character* character);
+  // whether anyone (character included) has a positive opinion of character
+  bool HasPositiveOpinion(CVC* cvc, Character* character);
+
+ private:
+  static const size_t kNone = std::numeric_limits<size_t>::max();
+
+  // starts over if the tick (or game) changed since the last request
+  void Refresh(CVC* cvc);
+  size_t Index(Character* character) const;
+
+  CVC* cvc_ = nullptr;
+  int tick_ = -1;
+
+  double mean_money_ = 0.0;
+  std::vector<Character*> characters_;
+  std::unordered_map<const Character*, size_t> index_;
+  // indices of characters_, richest first (ties by index)
+  std::vector<size_t> by_money_;
+  // by index, kNone if there's no such observer
+  std::vector<size_t> least_liking_poor_observer_;
+  std::vector<bool> has_positive_opinion_;
+};
+
 // Creates and scores action instances for a specific type of action
 class ActionFactory {
  public:
@@ -45,12 +88,13 @@ class HeuristicAgent : public Agent {
 
   Action* ChooseAction(CVC* cvc) override {
     // list the choices of actions
-    std::vector<std::unique_ptr<Action>> actions;
-    action_factory_->EnumerateActions(cvc, character_, &actions);
+    action_factory_->EnumerateActions(cvc, character_, &candidates_);
 
     // choose one according to the policy and store it, along with this agent in
     // a partial Action which we will fill out later
-    next_action_ = policy_->ChooseAction(&actions, cvc, character_);
+    next_action_ = policy_->ChooseAction(&candidates_, cvc, character_);
+    // drop the rest, keeping the storage for next tick
+    candidates_.clear();
     return next_action_.get();
   }
 
@@ -59,9 +103,9 @@ class HeuristicAgent : public Agent {
      /*responses_.push_back(std::make_unique<TrivialAction>(character_, 0.0,
                                          std::vector<double>({})));*/
      //TODO: handle responses to different kinds of actions
-     std::vector<std::unique_ptr<Action>> actions;
-     response_factory_->Respond(cvc, character_, action, &actions);
-     responses_.push_back(policy_->ChooseAction(&actions, cvc, character_));
+     response_factory_->Respond(cvc, character_, action, &candidates_);
+     responses_.push_back(policy_->ChooseAction(&candidates_, cvc, character_));
+     candidates_.clear();
      return responses_.back().get();
   }
 
@@ -80,21 +124,34 @@ class HeuristicAgent : public Agent {
   ActionPolicy* policy_;
 
   std::vector<std::unique_ptr<Action>> responses_;
+  // candidates for the action or response being chosen, kept between ticks so
+  // their storage is reused
+  std::vector<std::unique_ptr<Action>> candidates_;
   std::unique_ptr<Action> next_action_;
 };
 
 class GiveActionFactory : public ActionFactory {
  public:
+  GiveActionFactory(HeuristicContext* context) : context_(context) {}
+
   double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<Action>>* actions) override;
+
+ private:
+  HeuristicContext* context_;
 };
 
 class AskActionFactory : public ActionFactory {
  public:
+  AskActionFactory(HeuristicContext* context) : context_(context) {}
+
   double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<Action>>* actions) override;
+
+ private:
+  HeuristicContext* context_;
 };
 
 class AskResponseFactory : public ResponseFactory {
@@ -105,9 +162,14 @@ class AskResponseFactory : public ResponseFactory {
 
 class WorkActionFactory : public ActionFactory {
  public:
+  WorkActionFactory(HeuristicContext* context) : context_(context) {}
+
   double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<Action>>* actions) override;
+
+ private:
+  HeuristicContext* context_;
 };
 
 class TrivialActionFactory : public ActionFactory {
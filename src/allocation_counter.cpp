@@ -0,0 +1,70 @@
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "allocation_counter.h"
+
+namespace {
+
+// the binary log allocates from its own thread
+struct ScopeCounts {
+  std::atomic<uint64_t> allocations_;
+  std::atomic<uint64_t> bytes_;
+};
+
+ScopeCounts scope_counts[kMaxAllocationScopes];
+std::atomic<bool> counting(false);
+std::atomic<bool> hook_installed(false);
+thread_local int current_scope = 0;
+
+}
+
+bool AllocationHookInstalled() {
+  return hook_installed.load(std::memory_order_relaxed);
+}
+
+void SetAllocationCounting(bool enabled) {
+  counting.store(enabled, std::memory_order_relaxed);
+}
+
+bool IsAllocationCounting() {
+  return counting.load(std::memory_order_relaxed);
+}
+
+void SetAllocationScope(int scope) {
+  assert(scope >= 0 && scope < kMaxAllocationScopes);
+  current_scope = scope;
+}
+
+AllocationCounts GetAllocationCounts(int scope) {
+  assert(scope >= 0 && scope < kMaxAllocationScopes);
+  AllocationCounts counts;
+  counts.allocations_ =
+      scope_counts[scope].allocations_.load(std::memory_order_relaxed);
+  counts.bytes_ = scope_counts[scope].bytes_.load(std::memory_order_relaxed);
+  return counts;
+}
+
+AllocationCounts GetAllocationCounts() {
+  AllocationCounts counts;
+  for (int scope = 0; scope < kMaxAllocationScopes; scope++) {
+    AllocationCounts scope_counts = GetAllocationCounts(scope);
+    counts.allocations_ += scope_counts.allocations_;
+    counts.bytes_ += scope_counts.bytes_;
+  }
+  return counts;
+}
+
+void SetAllocationHookInstalled() {
+  hook_installed.store(true, std::memory_order_relaxed);
+}
+
+void CountAllocation(size_t bytes) {
+  if (!counting.load(std::memory_order_relaxed)) {
+    return;
+  }
+  ScopeCounts& counts = scope_counts[current_scope];
+  counts.allocations_.fetch_add(1, std::memory_order_relaxed);
+  counts.bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
@@ -0,0 +1,39 @@
+#ifndef ALLOCATION_COUNTER_H_
+#define ALLOCATION_COUNTER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocation counts
+//
+// counts allocations made through operator new (in any form) and the bytes
+// requested, while counting is enabled. the counting operator new lives in
+// allocation_hook.cpp, which only executables that want counts link in (main
+// does), everything else allocates as usual and sees no counts.
+//
+// counts are attributed to the calling thread's current scope, e.g. the
+// DecisionEngine phase that's running (see AllocationRecorder). scope 0 is
+// everything outside a scope, including other threads
+struct AllocationCounts {
+  uint64_t allocations_ = 0;
+  uint64_t bytes_ = 0;
+};
+
+const int kMaxAllocationScopes = 16;
+
+// whether allocation_hook.cpp is linked in, if not counts are always zero
+bool AllocationHookInstalled();
+// off by default, counting costs a couple of atomic adds per allocation
+void SetAllocationCounting(bool enabled);
+bool IsAllocationCounting();
+// scope is in [0, kMaxAllocationScopes)
+void SetAllocationScope(int scope);
+// totals since counting was first enabled, over every scope or for one
+AllocationCounts GetAllocationCounts();
+AllocationCounts GetAllocationCounts(int scope);
+
+// for allocation_hook.cpp
+void SetAllocationHookInstalled();
+void CountAllocation(size_t bytes);
+
+#endif
@@ -0,0 +1,103 @@
+// replaces the global operator new and delete with ones that count every
+// allocation (see allocation_counter.h) and otherwise behave like the
+// standard ones. link this into an executable to count its allocations
+#include <stdlib.h>
+#include <cstddef>
+#include <new>
+
+#include "allocation_counter.h"
+
+namespace {
+
+void* Allocate(size_t size) {
+  CountAllocation(size);
+  // malloc(0) may return null, new never does
+  void* p = malloc(size > 0 ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* AllocateAligned(size_t size, std::align_val_t alignment) {
+  CountAllocation(size);
+  size_t align = static_cast<size_t>(alignment);
+  if (align < sizeof(void*)) {
+    align = sizeof(void*);
+  }
+  void* p = nullptr;
+  if (0 != posix_memalign(&p, align, size > 0 ? size : 1)) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+struct InstallHook {
+  InstallHook() { SetAllocationHookInstalled(); }
+} install_hook;
+
+}
+
+void* operator new(size_t size) { return Allocate(size); }
+void* operator new[](size_t size) { return Allocate(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return Allocate(size);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return Allocate(size);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return AllocateAligned(size, alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return AllocateAligned(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  try {
+    return AllocateAligned(size, alignment);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+void* operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  try {
+    return AllocateAligned(size, alignment);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+// everything above comes from malloc or posix_memalign
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+void operator delete(void* p, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  free(p);
+}
+void operator delete[](void* p, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  free(p);
+}
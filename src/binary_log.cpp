@@ -0,0 +1,699 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "util.h"
+#include "binary_log.h"
+
+namespace {
+
+// how often the writer drains buffers when nobody asks it to
+const std::chrono::milliseconds kWriterPeriod(1);
+
+std::atomic<uint64_t> next_log_id(1);
+
+bool IsFlag(char c) {
+  return '-' == c || '+' == c || ' ' == c || '#' == c || '0' == c ||
+         '\'' == c;
+}
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool IsLengthModifier(char c) {
+  return 'h' == c || 'l' == c || 'L' == c || 'q' == c || 'j' == c ||
+         'z' == c || 'Z' == c || 't' == c;
+}
+
+// appends a fixed size value to a record
+template <typename V>
+size_t Put(char* record, size_t offset, V value) {
+  memcpy(record + offset, &value, sizeof(value));
+  return offset + sizeof(value);
+}
+
+// appends an unsigned LEB128 varint, most integers we log take a byte or two
+size_t PutVarint(char* record, size_t offset, uint64_t value) {
+  while (value >= 0x80) {
+    record[offset++] = (char)(value | 0x80);
+    value >>= 7;
+  }
+  record[offset++] = (char)value;
+  return offset;
+}
+
+// zigzag, so small negative numbers stay small
+uint64_t ZigZag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t UnZigZag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+const size_t kMaxVarintBytes = 10;
+
+// far more distinct formats than any program has, ids beyond this are corrupt
+const uint64_t kMaxFormats = 1 << 20;
+
+// appends a length prefixed string, cut short to fit in capacity
+size_t PutString(char* record, size_t offset, size_t capacity,
+                 const char* value) {
+  if (!value) {
+    value = "(null)";
+  }
+  size_t length = strlen(value);
+  size_t room = capacity - offset - sizeof(uint16_t);
+  if (length > room) {
+    length = room;
+  }
+  if (length > UINT16_MAX) {
+    length = UINT16_MAX;
+  }
+  offset = Put(record, offset, (uint16_t)length);
+  memcpy(record + offset, value, length);
+  return offset + length;
+}
+
+} //namespace
+
+bool ParseLogFormat(const char* format, std::vector<BinaryLogArg>* args,
+                    std::vector<BinaryLogConversion>* conversions) {
+  args->clear();
+  conversions->clear();
+  for (size_t i = 0; format[i]; i++) {
+    if ('%' != format[i]) {
+      continue;
+    }
+    BinaryLogConversion conversion;
+    conversion.begin_ = i;
+    conversion.first_arg_ = args->size();
+    i++;
+    if ('%' == format[i]) {
+      conversion.end_ = i + 1;
+      conversion.num_args_ = 0;
+      conversions->push_back(conversion);
+      continue;
+    }
+
+    while (IsFlag(format[i])) {
+      i++;
+    }
+    if ('*' == format[i]) {
+      args->push_back({kSignedArg, kDefaultLength});
+      i++;
+    }
+    while (IsDigit(format[i])) {
+      i++;
+    }
+    if ('.' == format[i]) {
+      i++;
+      if ('*' == format[i]) {
+        args->push_back({kSignedArg, kDefaultLength});
+        i++;
+      }
+      while (IsDigit(format[i])) {
+        i++;
+      }
+    }
+
+    BinaryLogArgLength length = kDefaultLength;
+    while (IsLengthModifier(format[i])) {
+      switch (format[i]) {
+        case 'l':
+          length = kLongLength == length ? kLongLongLength : kLongLength;
+          break;
+        case 'q':
+          length = kLongLongLength;
+          break;
+        case 'L':
+          length = kLongDoubleLength;
+          break;
+        case 'j':
+          length = kIntMaxLength;
+          break;
+        case 'z':
+        case 'Z':
+          length = kSizeLength;
+          break;
+        case 't':
+          length = kPtrDiffLength;
+          break;
+        default:
+          // h and hh arguments are promoted to int
+          break;
+      }
+      i++;
+    }
+
+    switch (format[i]) {
+      case 'd':
+      case 'i':
+      case 'c':
+        args->push_back({kSignedArg, length});
+        break;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+        args->push_back({kUnsignedArg, length});
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+        args->push_back({kDoubleArg, length});
+        break;
+      case 's':
+        args->push_back({kStringArg, length});
+        break;
+      case 'p':
+        args->push_back({kPointerArg, length});
+        break;
+      default:
+        // %n, wide characters, or a truncated format
+        return false;
+    }
+    conversion.end_ = i + 1;
+    conversion.num_args_ = args->size() - conversion.first_arg_;
+    conversions->push_back(conversion);
+  }
+  return true;
+}
+
+struct BinaryLog::Format {
+  uint32_t id_;
+  std::vector<BinaryLogArg> args_;
+  // bytes of an event with every string empty, the rest of kMaxRecordBytes is
+  // shared by the strings
+  size_t fixed_bytes_;
+};
+
+namespace {
+
+// the most an argument takes, not counting string contents
+size_t FixedBytes(const BinaryLogArg& arg) {
+  switch (arg.kind_) {
+    case kStringArg:
+      return sizeof(uint16_t);
+    case kDoubleArg:
+      return sizeof(double);
+    default:
+      return kMaxVarintBytes;
+  }
+}
+
+} //namespace
+
+// a single producer (the thread that owns it), single consumer (whoever holds
+// the log's mutex_) ring of bytes
+// the producer only publishes whole records, so draining [tail_, head_)
+// always writes whole records
+struct BinaryLog::Buffer {
+  explicit Buffer(size_t bytes) : data_(bytes), mask_(bytes - 1) {
+    assert(0 == (bytes & mask_));
+  }
+
+  bool TryWrite(const char* data, size_t length) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    if (data_.size() - (head - tail) < length) {
+      return false;
+    }
+    size_t begin = head & mask_;
+    size_t first = std::min(length, data_.size() - begin);
+    memcpy(&data_[begin], data, first);
+    memcpy(&data_[0], data + first, length - first);
+    head_.store(head + length, std::memory_order_release);
+    return true;
+  }
+
+  void Drain(FILE* file) {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (head == tail) {
+      return;
+    }
+    size_t begin = tail & mask_;
+    size_t length = head - tail;
+    size_t first = std::min(length, data_.size() - begin);
+    fwrite(&data_[begin], 1, first, file);
+    fwrite(&data_[0], 1, length - first, file);
+    tail_.store(head, std::memory_order_release);
+  }
+
+  size_t Used() const {
+    return head_.load(std::memory_order_relaxed) -
+           tail_.load(std::memory_order_relaxed);
+  }
+
+  std::vector<char> data_;
+  const size_t mask_;
+  std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> tail_{0};
+
+  // formats this thread has already defined in the log, by the addresses of
+  // the logger name and format. only touched by the producer
+  struct KeyHash {
+    size_t operator()(const std::pair<const char*, const char*>& key) const {
+      return std::hash<const char*>()(key.first) * 31 +
+             std::hash<const char*>()(key.second);
+    }
+  };
+  std::unordered_map<std::pair<const char*, const char*>, const Format*,
+                     KeyHash>
+      formats_;
+};
+
+std::unique_ptr<BinaryLog> BinaryLog::Open(const char* path, Logger* logger,
+                                           size_t buffer_bytes) {
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    logger->Log(ERROR, "could not open binary log %s\n", path);
+    return nullptr;
+  }
+  return std::make_unique<BinaryLog>(file, buffer_bytes);
+}
+
+BinaryLog::BinaryLog(FILE* file, size_t buffer_bytes)
+    : log_id_(next_log_id++), file_(file), buffer_bytes_(buffer_bytes) {
+  // records must fit in a buffer
+  assert(buffer_bytes_ >= kMaxRecordBytes);
+  assert(0 == (buffer_bytes_ & (buffer_bytes_ - 1)));
+  fwrite(kBinaryLogMagic, 1, sizeof(kBinaryLogMagic), file_);
+  writer_ = std::thread(&BinaryLog::Run, this);
+}
+
+BinaryLog::~BinaryLog() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  fclose(file_);
+}
+
+BinaryLog::Buffer* BinaryLog::ThreadBuffer() {
+  thread_local std::vector<std::pair<uint64_t, Buffer*>> buffers;
+  for (const auto& buffer : buffers) {
+    if (buffer.first == log_id_) {
+      return buffer.second;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffers_.push_back(std::make_unique<Buffer>(buffer_bytes_));
+  buffers.emplace_back(log_id_, buffers_.back().get());
+  return buffers_.back().get();
+}
+
+const BinaryLog::Format* BinaryLog::LookupFormat(Buffer* buffer,
+                                                 const char* logger_name,
+                                                 const char* format) {
+  auto cached = buffer->formats_.find({logger_name, format});
+  if (cached != buffer->formats_.end()) {
+    return cached->second;
+  }
+
+  // first use on this thread, find (or assign) the id
+  const Format* f;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string key = std::string(logger_name) + '\0' + format;
+    auto id = format_ids_.find(key);
+    if (id != format_ids_.end()) {
+      f = formats_[id->second].get();
+    } else {
+      auto parsed = std::make_unique<Format>();
+      parsed->id_ = formats_.size();
+      std::vector<BinaryLogConversion> conversions;
+      bool valid = ParseLogFormat(format, &parsed->args_, &conversions);
+      parsed->fixed_bytes_ = sizeof(uint8_t) + kMaxVarintBytes;
+      for (const BinaryLogArg& arg : parsed->args_) {
+        parsed->fixed_bytes_ += FixedBytes(arg);
+      }
+      assert(valid);
+      assert(parsed->fixed_bytes_ <= kMaxRecordBytes);
+      if (!valid || parsed->fixed_bytes_ > kMaxRecordBytes) {
+        // log the format itself, without arguments
+        parsed->args_.clear();
+        parsed->fixed_bytes_ = sizeof(uint8_t) + kMaxVarintBytes;
+      }
+      format_ids_[key] = parsed->id_;
+      formats_.push_back(std::move(parsed));
+      f = formats_.back().get();
+    }
+  }
+
+  // and define it ahead of this thread's events
+  char record[kMaxRecordBytes];
+  size_t n = Put(record, 0, kFormatRecord);
+  n = PutVarint(record, n, f->id_);
+  n = PutString(record, n, kMaxRecordBytes / 2, logger_name);
+  n = PutString(record, n, kMaxRecordBytes, format);
+  Write(buffer, record, n);
+  buffer->formats_[{logger_name, format}] = f;
+  return f;
+}
+
+void BinaryLog::Record(const char* logger_name, const char* format,
+                       va_list args) {
+  Buffer* buffer = ThreadBuffer();
+  const Format* f = LookupFormat(buffer, logger_name, format);
+
+  char record[kMaxRecordBytes];
+  size_t n = Put(record, 0, kEventRecord);
+  n = PutVarint(record, n, f->id_);
+  // bytes still needed by the arguments after the current one
+  size_t reserved = f->fixed_bytes_ - n;
+  for (const BinaryLogArg& arg : f->args_) {
+    reserved -= FixedBytes(arg);
+    switch (arg.kind_) {
+      case kSignedArg: {
+        int64_t value;
+        switch (arg.length_) {
+          case kLongLength: value = va_arg(args, long); break;
+          case kLongLongLength: value = va_arg(args, long long); break;
+          case kSizeLength: value = va_arg(args, ptrdiff_t); break;
+          case kIntMaxLength: value = va_arg(args, intmax_t); break;
+          case kPtrDiffLength: value = va_arg(args, ptrdiff_t); break;
+          default: value = va_arg(args, int); break;
+        }
+        n = PutVarint(record, n, ZigZag(value));
+        break;
+      }
+      case kUnsignedArg: {
+        uint64_t value;
+        switch (arg.length_) {
+          case kLongLength: value = va_arg(args, unsigned long); break;
+          case kLongLongLength:
+            value = va_arg(args, unsigned long long);
+            break;
+          case kSizeLength: value = va_arg(args, size_t); break;
+          case kIntMaxLength: value = va_arg(args, uintmax_t); break;
+          case kPtrDiffLength: value = va_arg(args, ptrdiff_t); break;
+          default: value = va_arg(args, unsigned int); break;
+        }
+        n = PutVarint(record, n, value);
+        break;
+      }
+      case kDoubleArg: {
+        double value = kLongDoubleLength == arg.length_
+                           ? (double)va_arg(args, long double)
+                           : va_arg(args, double);
+        n = Put(record, n, value);
+        break;
+      }
+      case kStringArg:
+        n = PutString(record, n, kMaxRecordBytes - reserved,
+                      va_arg(args, const char*));
+        break;
+      case kPointerArg:
+        n = PutVarint(record, n, (uint64_t)(uintptr_t)va_arg(args, void*));
+        break;
+    }
+  }
+  Write(buffer, record, n);
+}
+
+void BinaryLog::Write(Buffer* buffer, const char* data, size_t length) {
+  while (!buffer->TryWrite(data, length)) {
+    // full, wait for the writer
+    wake_.notify_one();
+    std::this_thread::yield();
+  }
+  if (buffer->Used() > buffer_bytes_ / 2) {
+    wake_.notify_one();
+  }
+}
+
+void BinaryLog::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DrainLocked();
+  fflush(file_);
+}
+
+void BinaryLog::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    wake_.wait_for(lock, kWriterPeriod);
+    DrainLocked();
+  }
+  DrainLocked();
+  fflush(file_);
+}
+
+void BinaryLog::DrainLocked() {
+  for (const std::unique_ptr<Buffer>& buffer : buffers_) {
+    buffer->Drain(file_);
+  }
+}
+
+namespace {
+
+// sequential reads from a binary log
+class LogReader {
+ public:
+  explicit LogReader(FILE* file) : file_(file) {}
+
+  template <typename V>
+  bool Get(V* value) {
+    return 1 == fread(value, sizeof(V), 1, file_);
+  }
+
+  bool GetVarint(uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      int c = fgetc(file_);
+      if (EOF == c) {
+        return false;
+      }
+      *value |= (uint64_t)(c & 0x7f) << shift;
+      if (!(c & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool GetString(std::string* value) {
+    uint16_t length;
+    if (!Get(&length)) {
+      return false;
+    }
+    value->resize(length);
+    return 0 == length || 1 == fread(&(*value)[0], length, 1, file_);
+  }
+
+ private:
+  FILE* file_;
+};
+
+struct DecodedFormat {
+  std::string logger_name_;
+  std::string format_;
+  std::vector<BinaryLogArg> args_;
+  std::vector<BinaryLogConversion> conversions_;
+};
+
+struct DecodedArg {
+  int64_t signed_;
+  uint64_t unsigned_;
+  double double_;
+  std::string string_;
+};
+
+// prints one conversion with its arguments, replacing * widths and precisions
+// with their values and length modifiers with the widths we stored
+void PrintConversion(FILE* out, const std::string& format,
+                     const BinaryLogConversion& conversion,
+                     const std::vector<BinaryLogArg>& args,
+                     const std::vector<DecodedArg>& values) {
+  if (0 == conversion.num_args_) {
+    // %%
+    fputc('%', out);
+    return;
+  }
+  std::string spec;
+  size_t arg = conversion.first_arg_;
+  size_t i = conversion.begin_;
+  spec += format[i++];
+  while (IsFlag(format[i])) {
+    spec += format[i++];
+  }
+  if ('*' == format[i]) {
+    spec += std::to_string(values[arg++].signed_);
+    i++;
+  }
+  while (IsDigit(format[i])) {
+    spec += format[i++];
+  }
+  if ('.' == format[i]) {
+    std::string precision = ".";
+    i++;
+    if ('*' == format[i]) {
+      int64_t value = values[arg++].signed_;
+      // a negative precision is taken as if it were omitted
+      precision = value < 0 ? "" : "." + std::to_string(value);
+      i++;
+    }
+    while (IsDigit(format[i])) {
+      precision += format[i++];
+    }
+    spec += precision;
+  }
+  while (IsLengthModifier(format[i])) {
+    i++;
+  }
+  char conversion_char = format[i];
+  const DecodedArg& value = values[arg];
+  switch (args[arg].kind_) {
+    case kSignedArg:
+      if ('c' == conversion_char) {
+        spec += conversion_char;
+        fprintf(out, spec.c_str(), (int)value.signed_);
+      } else {
+        spec += "ll";
+        spec += conversion_char;
+        fprintf(out, spec.c_str(), (long long)value.signed_);
+      }
+      break;
+    case kUnsignedArg:
+      spec += "ll";
+      spec += conversion_char;
+      fprintf(out, spec.c_str(), (unsigned long long)value.unsigned_);
+      break;
+    case kDoubleArg:
+      spec += conversion_char;
+      fprintf(out, spec.c_str(), value.double_);
+      break;
+    case kStringArg:
+      spec += conversion_char;
+      fprintf(out, spec.c_str(), value.string_.c_str());
+      break;
+    case kPointerArg:
+      spec += conversion_char;
+      fprintf(out, spec.c_str(), (void*)(uintptr_t)value.unsigned_);
+      break;
+  }
+}
+
+} //namespace
+
+bool DecodeBinaryLog(FILE* in, FILE* out, const char* only_logger,
+                     Logger* logger) {
+  LogReader reader(in);
+  char magic[sizeof(kBinaryLogMagic)];
+  if (!reader.Get(&magic) ||
+      0 != memcmp(magic, kBinaryLogMagic, sizeof(magic))) {
+    logger->Log(ERROR, "not a binary log\n");
+    return false;
+  }
+
+  std::vector<DecodedFormat> formats;
+  std::vector<DecodedArg> values;
+  uint8_t kind;
+  while (reader.Get(&kind)) {
+    uint64_t id;
+    if (!reader.GetVarint(&id)) {
+      logger->Log(ERROR, "binary log is truncated\n");
+      return false;
+    }
+
+    if (kFormatRecord == kind) {
+      DecodedFormat format;
+      if (!reader.GetString(&format.logger_name_) ||
+          !reader.GetString(&format.format_)) {
+        logger->Log(ERROR, "binary log is truncated\n");
+        return false;
+      }
+      if (!ParseLogFormat(format.format_.c_str(), &format.args_,
+                          &format.conversions_)) {
+        // recorded without arguments, print it as is
+        format.args_.clear();
+        format.conversions_.clear();
+      }
+      if (id > kMaxFormats) {
+        logger->Log(ERROR, "binary log has an invalid format id %llu\n",
+                    (unsigned long long)id);
+        return false;
+      }
+      if (formats.size() <= id) {
+        formats.resize(id + 1);
+      }
+      formats[id] = std::move(format);
+      continue;
+    }
+
+    if (kEventRecord != kind || id >= formats.size() ||
+        formats[id].format_.empty()) {
+      logger->Log(ERROR,
+                  "binary log has an invalid record (kind %u id %llu)\n",
+                  kind, (unsigned long long)id);
+      return false;
+    }
+    const DecodedFormat& format = formats[id];
+    values.resize(format.args_.size());
+    for (size_t i = 0; i < format.args_.size(); i++) {
+      bool read = false;
+      switch (format.args_[i].kind_) {
+        case kSignedArg:
+          read = reader.GetVarint(&values[i].unsigned_);
+          values[i].signed_ = UnZigZag(values[i].unsigned_);
+          break;
+        case kUnsignedArg:
+        case kPointerArg:
+          read = reader.GetVarint(&values[i].unsigned_);
+          break;
+        case kDoubleArg:
+          read = reader.Get(&values[i].double_);
+          break;
+        case kStringArg:
+          read = reader.GetString(&values[i].string_);
+          break;
+      }
+      if (!read) {
+        logger->Log(ERROR, "binary log is truncated\n");
+        return false;
+      }
+    }
+
+    if (only_logger && format.logger_name_ != only_logger) {
+      continue;
+    }
+    fprintf(out, "%s\t", format.logger_name_.c_str());
+    size_t literal = 0;
+    for (const BinaryLogConversion& conversion : format.conversions_) {
+      fwrite(format.format_.data() + literal, 1, conversion.begin_ - literal,
+             out);
+      PrintConversion(out, format.format_, conversion, format.args_, values);
+      literal = conversion.end_;
+    }
+    fwrite(format.format_.data() + literal, 1,
+           format.format_.size() - literal, out);
+  }
+  return true;
+}
+
+void RecordBinaryLog(BinaryLog* log, const char* logger_name,
+                     const char* format, va_list args) {
+  log->Record(logger_name, format, args);
+}
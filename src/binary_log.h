@@ -0,0 +1,150 @@
+#ifndef BINARY_LOG_H_
+#define BINARY_LOG_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+
+// Asynchronous binary logging
+//
+// Logger::Log formats and writes every event as it happens. a Logger with a
+// BinaryLog (see Logger::SetBinaryLog) instead appends a compact record, an id
+// for its format string plus the raw arguments, to a lock-free ring buffer
+// owned by the calling thread. a background thread drains the buffers to the
+// file, so logging costs a few stores rather than a formatted write and a
+// syscall. formatting is deferred to DecodeBinaryLog (and the decode_log
+// tool), which turns records back into exactly the text Logger would have
+// written.
+//
+// file layout (native byte order):
+//  char magic[8]                   kBinaryLogMagic
+//  records, each starting with a uint8_t BinaryLogRecordKind:
+//   kFormatRecord  varint id, uint16_t length + logger name,
+//                  uint16_t length + format
+//   kEventRecord   varint id, then the arguments in format order:
+//                  LEB128 varints for integers, chars and pointers (zigzag
+//                  encoded if signed), double for floating point,
+//                  uint16_t length + bytes for strings
+// each thread writes a format's definition before its first event with it and
+// each thread's records reach the file in order, so definitions always come
+// before the events that use them.
+
+const char kBinaryLogMagic[8] = {'C', 'V', 'C', 'B', 'L', 'O', 'G', '\0'};
+
+enum BinaryLogRecordKind : uint8_t {
+  kFormatRecord = 1,
+  kEventRecord = 2,
+};
+
+// the arguments a printf format consumes, in order
+enum BinaryLogArgKind : uint8_t {
+  kSignedArg,
+  kUnsignedArg,
+  kDoubleArg,
+  kStringArg,
+  kPointerArg,
+};
+
+// length modifiers we need to know to read an argument from a va_list
+enum BinaryLogArgLength : uint8_t {
+  kDefaultLength,
+  kLongLength,
+  kLongLongLength,
+  kSizeLength,
+  kIntMaxLength,
+  kPtrDiffLength,
+  kLongDoubleLength,
+};
+
+struct BinaryLogArg {
+  BinaryLogArgKind kind_;
+  BinaryLogArgLength length_;
+};
+
+// one conversion of a format, format[begin_, end_), consuming args
+// [first_arg_, first_arg_ + num_args_) (a * width or precision is an argument
+// of its own). %% is a conversion with no arguments
+struct BinaryLogConversion {
+  size_t begin_;
+  size_t end_;
+  size_t first_arg_;
+  size_t num_args_;
+};
+
+// returns false if format has a conversion we can't record (e.g. %n)
+bool ParseLogFormat(const char* format, std::vector<BinaryLogArg>* args,
+                    std::vector<BinaryLogConversion>* conversions);
+
+class BinaryLog {
+ public:
+  // returns nullptr (and logs why) if path can't be written
+  // each thread that logs gets a ring buffer of buffer_bytes, threads block
+  // (rather than drop records) while their buffer is full
+  static std::unique_ptr<BinaryLog> Open(const char* path, Logger* logger,
+                                         size_t buffer_bytes = 1 << 20);
+
+  BinaryLog(FILE* file, size_t buffer_bytes);
+  // drains everything and closes the file
+  ~BinaryLog();
+
+  BinaryLog(const BinaryLog&) = delete;
+  BinaryLog& operator=(const BinaryLog&) = delete;
+
+  // what Logger::Log does with a BinaryLog, safe to call from any thread
+  // formats are cached by address, so logger_name and format must be string
+  // literals (or otherwise outlive the log and never change)
+  void Record(const char* logger_name, const char* format, va_list args);
+
+  // writes out everything recorded so far (by any thread)
+  void Flush();
+
+  // records too large for a ring buffer are truncated (strings are cut short)
+  static const size_t kMaxRecordBytes = 4096;
+
+ private:
+  struct Buffer;
+  struct Format;
+
+  Buffer* ThreadBuffer();
+  const Format* LookupFormat(Buffer* buffer, const char* logger_name,
+                             const char* format);
+  void Write(Buffer* buffer, const char* data, size_t length);
+  void Run();
+  // requires mutex_
+  void DrainLocked();
+
+  // distinguishes logs for threads' cached buffers, in case a log is
+  // destroyed and another created at the same address
+  const uint64_t log_id_;
+  FILE* file_;
+  const size_t buffer_bytes_;
+
+  // guards buffers_, formats_, the file and stopping_
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+  // logger name + '\0' + format to format id
+  std::unordered_map<std::string, uint32_t> format_ids_;
+  std::vector<std::unique_ptr<Format>> formats_;
+  bool stopping_ = false;
+  std::thread writer_;
+};
+
+// writes the text Logger would have written for each event in the binary log
+// in, only those of only_logger if it isn't null
+// returns false (and logs why) if in isn't a valid binary log, events decoded
+// before the problem are still written
+bool DecodeBinaryLog(FILE* in, FILE* out, const char* only_logger,
+                     Logger* logger);
+
+#endif
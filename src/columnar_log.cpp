@@ -0,0 +1,609 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util.h"
+#include "event_log.h"
+#include "columnar_log.h"
+
+namespace {
+
+// chunks start on a cache line, which is more than any reader's alignment
+const size_t kChunkAlignment = 64;
+
+const char kPadding[kChunkAlignment] = {};
+
+// the fewest bytes that hold every value in [0, range]
+uint32_t IntWidth(uint64_t range) {
+  if (0 == range) {
+    return 0;
+  } else if (range <= UINT8_MAX) {
+    return 1;
+  } else if (range <= UINT16_MAX) {
+    return 2;
+  } else if (range <= UINT32_MAX) {
+    return 4;
+  }
+  return 8;
+}
+
+bool IsIntWidth(uint32_t width) {
+  return 0 == width || 1 == width || 2 == width || 4 == width || 8 == width;
+}
+
+uint64_t DoubleBits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// reads the footer, every read is bounds checked
+class FooterReader {
+ public:
+  FooterReader(const char* begin, const char* end)
+      : next_(begin), end_(end) {}
+
+  template <typename V>
+  bool Get(V* value) {
+    if ((size_t)(end_ - next_) < sizeof(V)) {
+      return false;
+    }
+    memcpy(value, next_, sizeof(V));
+    next_ += sizeof(V);
+    return true;
+  }
+
+  bool GetString(std::string* value) {
+    uint16_t length;
+    if (!Get(&length) || (size_t)(end_ - next_) < length) {
+      return false;
+    }
+    value->assign(next_, length);
+    next_ += length;
+    return true;
+  }
+
+ private:
+  const char* next_;
+  const char* end_;
+};
+
+} //namespace
+
+std::unique_ptr<ColumnarWriter> ColumnarWriter::Open(
+    const char* path, std::vector<ColumnarColumn> schema, Logger* logger,
+    size_t row_group_rows) {
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    logger->Log(ERROR, "could not open columnar log %s\n", path);
+    return nullptr;
+  }
+  return std::make_unique<ColumnarWriter>(file, std::move(schema),
+                                          row_group_rows);
+}
+
+ColumnarWriter::ColumnarWriter(FILE* file, std::vector<ColumnarColumn> schema,
+                               size_t row_group_rows)
+    : file_(file), row_group_rows_(row_group_rows) {
+  assert(row_group_rows_ > 0);
+  assert(!schema.empty());
+  for (ColumnarColumn& column : schema) {
+    columns_.push_back({std::move(column), {}, {}});
+  }
+  fwrite(kColumnarMagic, 1, sizeof(kColumnarMagic), file_);
+  offset_ = sizeof(kColumnarMagic);
+}
+
+ColumnarWriter::~ColumnarWriter() {
+  // a partial row is dropped
+  WriteRowGroup();
+  WriteFooter();
+  fclose(file_);
+}
+
+ColumnarWriter::Column* ColumnarWriter::NextColumn(ColumnarType type) {
+  assert(next_column_ < columns_.size());
+  Column* column = &columns_[next_column_++];
+  assert(column->schema_.type_ == type);
+  return column;
+}
+
+void ColumnarWriter::AppendInt(int64_t value) {
+  NextColumn(kIntColumn)->ints_.push_back(value);
+}
+
+void ColumnarWriter::AppendDouble(double value) {
+  NextColumn(kDoubleColumn)->doubles_.push_back(value);
+}
+
+void ColumnarWriter::AppendString(const char* value) {
+  Column* column = NextColumn(kStringColumn);
+  if (!value) {
+    value = "(null)";
+  }
+  // the same few (literal) ids are appended over and over, so try the code
+  // last seen at this address before hashing the content
+  auto seen = seen_codes_.find(value);
+  if (seen != seen_codes_.end() &&
+      0 == strcmp(dictionary_[seen->second].c_str(), value)) {
+    column->ints_.push_back(seen->second);
+    return;
+  }
+  std::string key(value, strnlen(value, UINT16_MAX));
+  auto code = codes_.find(key);
+  if (code == codes_.end()) {
+    code = codes_.emplace(key, (uint32_t)dictionary_.size()).first;
+    dictionary_.push_back(key);
+  }
+  seen_codes_[value] = code->second;
+  column->ints_.push_back(code->second);
+}
+
+void ColumnarWriter::AppendDoubles(const double* values, size_t count) {
+  Column* column = NextColumn(kDoubleListColumn);
+  column->ints_.push_back((int64_t)count);
+  column->doubles_.insert(column->doubles_.end(), values, values + count);
+}
+
+void ColumnarWriter::EndRow() {
+  assert(next_column_ == columns_.size());
+  next_column_ = 0;
+  rows_++;
+  if (rows_ == row_group_rows_) {
+    WriteRowGroup();
+  }
+}
+
+void ColumnarWriter::Pad() {
+  size_t padding = (kChunkAlignment - offset_ % kChunkAlignment) %
+                   kChunkAlignment;
+  fwrite(kPadding, 1, padding, file_);
+  offset_ += padding;
+}
+
+void ColumnarWriter::WriteInts(const std::vector<int64_t>& values) {
+  Pad();
+  int64_t base = 0;
+  uint32_t width = 0;
+  if (!values.empty()) {
+    auto min_max = std::minmax_element(values.begin(), values.end());
+    base = *min_max.first;
+    width = IntWidth((uint64_t)*min_max.second - (uint64_t)base);
+  }
+  chunks_.push_back({offset_, values.size(), base, width, 0});
+  if (0 == width) {
+    return;
+  }
+
+  // the low width bytes of each (little endian) difference
+  std::vector<char> encoded(values.size() * width);
+  for (size_t i = 0; i < values.size(); i++) {
+    uint64_t difference = (uint64_t)values[i] - (uint64_t)base;
+    memcpy(encoded.data() + i * width, &difference, width);
+  }
+  fwrite(encoded.data(), 1, encoded.size(), file_);
+  offset_ += encoded.size();
+}
+
+void ColumnarWriter::WriteDoubles(const std::vector<double>& values) {
+  Pad();
+  // which bytes of the XORs with the previous value are ever set
+  uint64_t base = values.empty() ? 0 : DoubleBits(values[0]);
+  uint64_t set_bits = 0;
+  uint64_t previous = base;
+  for (double value : values) {
+    uint64_t bits = DoubleBits(value);
+    set_bits |= bits ^ previous;
+    previous = bits;
+  }
+  uint32_t shift = 0 == set_bits ? 0 : __builtin_ctzll(set_bits) / 8;
+  uint32_t width = IntWidth(set_bits >> (8 * shift));
+
+  if (sizeof(double) == width) {
+    chunks_.push_back({offset_, values.size(), 0, sizeof(double), 0});
+    fwrite(values.data(), sizeof(double), values.size(), file_);
+    offset_ += values.size() * sizeof(double);
+    return;
+  }
+  chunks_.push_back({offset_, values.size(), (int64_t)base, width, shift});
+  if (0 == width) {
+    return;
+  }
+
+  // the width bytes of each (little endian) XOR from shift up
+  std::vector<char> encoded(values.size() * width);
+  previous = base;
+  for (size_t i = 0; i < values.size(); i++) {
+    uint64_t bits = DoubleBits(values[i]);
+    uint64_t shifted = (bits ^ previous) >> (8 * shift);
+    memcpy(encoded.data() + i * width, &shifted, width);
+    previous = bits;
+  }
+  fwrite(encoded.data(), 1, encoded.size(), file_);
+  offset_ += encoded.size();
+}
+
+void ColumnarWriter::WriteRowGroup() {
+  if (0 == rows_) {
+    return;
+  }
+  row_group_rows_written_.push_back(rows_);
+  for (Column& column : columns_) {
+    // a partial row (only possible when closing) is cut off
+    column.ints_.resize(std::min(column.ints_.size(), rows_));
+    switch (column.schema_.type_) {
+      case kIntColumn:
+      case kStringColumn:
+        WriteInts(column.ints_);
+        break;
+      case kDoubleColumn:
+        column.doubles_.resize(std::min(column.doubles_.size(), rows_));
+        WriteDoubles(column.doubles_);
+        break;
+      case kDoubleListColumn: {
+        WriteInts(column.ints_);
+        size_t values = 0;
+        for (int64_t length : column.ints_) {
+          values += length;
+        }
+        column.doubles_.resize(values);
+        WriteDoubles(column.doubles_);
+        break;
+      }
+    }
+    column.ints_.clear();
+    column.doubles_.clear();
+  }
+  rows_ = 0;
+  next_column_ = 0;
+}
+
+void ColumnarWriter::WriteFooter() {
+  uint64_t footer_offset = offset_;
+  std::vector<char> footer;
+  auto put = [&footer](const void* value, size_t length) {
+    footer.insert(footer.end(), (const char*)value,
+                  (const char*)value + length);
+  };
+  auto put_string = [&put](const std::string& value) {
+    uint16_t length = (uint16_t)value.size();
+    put(&length, sizeof(length));
+    put(value.data(), length);
+  };
+
+  uint32_t num_columns = columns_.size();
+  put(&num_columns, sizeof(num_columns));
+  for (const Column& column : columns_) {
+    uint8_t type = column.schema_.type_;
+    put(&type, sizeof(type));
+    put_string(column.schema_.name_);
+  }
+
+  uint32_t dictionary_size = dictionary_.size();
+  put(&dictionary_size, sizeof(dictionary_size));
+  for (const std::string& entry : dictionary_) {
+    put_string(entry);
+  }
+
+  uint32_t num_row_groups = row_group_rows_written_.size();
+  put(&num_row_groups, sizeof(num_row_groups));
+  size_t chunks_per_row_group =
+      num_row_groups > 0 ? chunks_.size() / num_row_groups : 0;
+  for (size_t i = 0; i < num_row_groups; i++) {
+    put(&row_group_rows_written_[i], sizeof(uint64_t));
+    put(&chunks_[i * chunks_per_row_group],
+        chunks_per_row_group * sizeof(ColumnarChunk));
+  }
+
+  put(&footer_offset, sizeof(footer_offset));
+  put(kColumnarMagic, sizeof(kColumnarMagic));
+  fwrite(footer.data(), 1, footer.size(), file_);
+  offset_ += footer.size();
+}
+
+std::unique_ptr<ColumnarReader> ColumnarReader::Open(const char* path,
+                                                     Logger* logger) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    logger->Log(ERROR, "could not open columnar log %s\n", path);
+    return nullptr;
+  }
+  struct stat st;
+  if (0 != fstat(fd, &st) || st.st_size == 0) {
+    logger->Log(ERROR, "columnar log %s is empty\n", path);
+    close(fd);
+    return nullptr;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == data) {
+    logger->Log(ERROR, "could not map columnar log %s\n", path);
+    return nullptr;
+  }
+
+  std::unique_ptr<ColumnarReader> reader(
+      new ColumnarReader((const char*)data, st.st_size));
+  if (!reader->ReadFooter(logger)) {
+    logger->Log(ERROR, "%s is not a valid columnar log\n", path);
+    return nullptr;
+  }
+  return reader;
+}
+
+ColumnarReader::ColumnarReader(const char* data, size_t size)
+    : data_(data), size_(size) {}
+
+ColumnarReader::~ColumnarReader() { munmap((void*)data_, size_); }
+
+bool ColumnarReader::ReadFooter(Logger* logger) {
+  const size_t kTrailer = sizeof(uint64_t) + sizeof(kColumnarMagic);
+  if (size_ < sizeof(kColumnarMagic) + kTrailer ||
+      0 != memcmp(data_, kColumnarMagic, sizeof(kColumnarMagic)) ||
+      0 != memcmp(data_ + size_ - sizeof(kColumnarMagic), kColumnarMagic,
+                  sizeof(kColumnarMagic))) {
+    logger->Log(ERROR, "columnar log magic is missing\n");
+    return false;
+  }
+  uint64_t footer_offset;
+  memcpy(&footer_offset, data_ + size_ - kTrailer, sizeof(footer_offset));
+  if (footer_offset < sizeof(kColumnarMagic) ||
+      footer_offset > size_ - kTrailer) {
+    logger->Log(ERROR, "columnar log footer offset is invalid\n");
+    return false;
+  }
+
+  FooterReader footer(data_ + footer_offset, data_ + size_ - kTrailer);
+  uint32_t num_columns;
+  if (!footer.Get(&num_columns) || 0 == num_columns) {
+    logger->Log(ERROR, "columnar log has no columns\n");
+    return false;
+  }
+  for (uint32_t i = 0; i < num_columns; i++) {
+    uint8_t type;
+    ColumnarColumn column;
+    if (!footer.Get(&type) || !footer.GetString(&column.name_) ||
+        type < kIntColumn || type > kDoubleListColumn) {
+      logger->Log(ERROR, "columnar log has an invalid column\n");
+      return false;
+    }
+    column.type_ = (ColumnarType)type;
+    columns_.push_back(column);
+    column_chunks_.push_back(chunks_per_row_group_);
+    chunks_per_row_group_ += kDoubleListColumn == type ? 2 : 1;
+  }
+
+  uint32_t dictionary_size;
+  if (!footer.Get(&dictionary_size)) {
+    logger->Log(ERROR, "columnar log footer is truncated\n");
+    return false;
+  }
+  dictionary_.resize(dictionary_size);
+  for (std::string& entry : dictionary_) {
+    if (!footer.GetString(&entry)) {
+      logger->Log(ERROR, "columnar log footer is truncated\n");
+      return false;
+    }
+  }
+
+  uint32_t num_row_groups;
+  if (!footer.Get(&num_row_groups)) {
+    logger->Log(ERROR, "columnar log footer is truncated\n");
+    return false;
+  }
+  for (uint32_t i = 0; i < num_row_groups; i++) {
+    RowGroup row_group = {0, chunks_.size()};
+    if (!footer.Get(&row_group.rows_)) {
+      logger->Log(ERROR, "columnar log footer is truncated\n");
+      return false;
+    }
+    row_groups_.push_back(row_group);
+    for (size_t j = 0; j < chunks_per_row_group_; j++) {
+      ColumnarChunk chunk;
+      if (!footer.Get(&chunk)) {
+        logger->Log(ERROR, "columnar log footer is truncated\n");
+        return false;
+      }
+      chunks_.push_back(chunk);
+    }
+
+    // every chunk must lie before the footer, with a row per value (except
+    // list values) and a width its column's type allows
+    for (size_t column = 0; column < columns_.size(); column++) {
+      bool list = kDoubleListColumn == columns_[column].type_;
+      bool ints = kIntColumn == columns_[column].type_ ||
+                  kStringColumn == columns_[column].type_;
+      const ColumnarChunk& first =
+          chunks_[row_group.first_chunk_ + column_chunks_[column]];
+      for (size_t j = 0; j < (list ? 2u : 1u); j++) {
+        const ColumnarChunk& chunk = (&first)[j];
+        bool int_chunk = ints || (list && 0 == j);
+        bool valid_width = IsIntWidth(chunk.width_);
+        if (int_chunk) {
+          valid_width = valid_width && 0 == chunk.shift_;
+        } else if (sizeof(double) == chunk.width_) {
+          // raw doubles are used in place
+          valid_width =
+              0 == chunk.shift_ && 0 == chunk.offset_ % sizeof(double);
+        } else {
+          // XORs must fit in a double once shifted
+          valid_width =
+              valid_width && chunk.shift_ <= sizeof(double) - chunk.width_;
+        }
+        bool valid_count = (list && 1 == j) || chunk.count_ == row_group.rows_;
+        if (!valid_width || !valid_count || chunk.offset_ > footer_offset ||
+            chunk.count_ > footer_offset ||
+            chunk.count_ * chunk.width_ > footer_offset - chunk.offset_) {
+          logger->Log(ERROR, "columnar log has an invalid chunk\n");
+          return false;
+        }
+      }
+      if (kStringColumn == columns_[column].type_) {
+        for (size_t row = 0; row < row_group.rows_; row++) {
+          if ((uint64_t)GetInt(i, column, row) >= dictionary_.size()) {
+            logger->Log(ERROR, "columnar log has an invalid string code\n");
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+int ColumnarReader::FindColumn(const char* name) const {
+  for (size_t i = 0; i < columns_.size(); i++) {
+    if (columns_[i].name_ == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const ColumnarChunk& ColumnarReader::IntChunk(size_t row_group,
+                                              size_t column) const {
+  assert(row_group < row_groups_.size());
+  assert(column < columns_.size());
+  assert(kDoubleColumn != columns_[column].type_);
+  return chunks_[row_groups_[row_group].first_chunk_ + column_chunks_[column]];
+}
+
+const ColumnarChunk& ColumnarReader::DoubleChunk(size_t row_group,
+                                                 size_t column) const {
+  assert(row_group < row_groups_.size());
+  assert(column < columns_.size());
+  size_t chunk =
+      row_groups_[row_group].first_chunk_ + column_chunks_[column];
+  if (kDoubleListColumn == columns_[column].type_) {
+    // after the lengths
+    chunk++;
+  } else {
+    assert(kDoubleColumn == columns_[column].type_);
+  }
+  return chunks_[chunk];
+}
+
+int64_t ColumnarReader::GetInt(size_t row_group, size_t column,
+                               size_t row) const {
+  const ColumnarChunk& chunk = IntChunk(row_group, column);
+  assert(row < chunk.count_);
+  uint64_t difference = 0;
+  memcpy(&difference, data_ + chunk.offset_ + row * chunk.width_,
+         chunk.width_);
+  return (int64_t)((uint64_t)chunk.base_ + difference);
+}
+
+const double* ColumnarReader::GetDoubles(size_t row_group, size_t column,
+                                         std::vector<double>* decoded) const {
+  const ColumnarChunk& chunk = DoubleChunk(row_group, column);
+  if (sizeof(double) == chunk.width_) {
+    return (const double*)(data_ + chunk.offset_);
+  }
+  decoded->resize(chunk.count_);
+  uint64_t bits = (uint64_t)chunk.base_;
+  const char* next = data_ + chunk.offset_;
+  for (size_t i = 0; i < chunk.count_; i++, next += chunk.width_) {
+    uint64_t shifted = 0;
+    memcpy(&shifted, next, chunk.width_);
+    bits ^= shifted << (8 * chunk.shift_);
+    memcpy(&(*decoded)[i], &bits, sizeof(bits));
+  }
+  return decoded->data();
+}
+
+size_t ColumnarReader::NumDoubles(size_t row_group, size_t column) const {
+  return DoubleChunk(row_group, column).count_;
+}
+
+std::unique_ptr<ColumnarEventLog> ColumnarEventLog::Open(
+    const char* path_prefix, Logger* logger, size_t row_group_rows) {
+  std::string prefix(path_prefix);
+  std::unique_ptr<ColumnarWriter> actions = ColumnarWriter::Open(
+      (prefix + ".action.cols").c_str(),
+      {{"tick", kIntColumn},
+       {"actor", kIntColumn},
+       {"actor_score", kDoubleColumn},
+       {"action_id", kStringColumn},
+       {"score", kDoubleColumn},
+       {"valid", kIntColumn}},
+      logger, row_group_rows);
+  std::unique_ptr<ColumnarWriter> learns = ColumnarWriter::Open(
+      (prefix + ".learn.cols").c_str(),
+      {{"tick", kIntColumn},
+       {"action_id", kStringColumn},
+       {"learner_id", kIntColumn},
+       {"actor", kIntColumn},
+       {"loss", kDoubleColumn},
+       {"dL_dy", kDoubleColumn},
+       {"prediction", kDoubleColumn},
+       {"target", kDoubleColumn},
+       {"reward", kDoubleColumn},
+       {"features", kDoubleListColumn}},
+      logger, row_group_rows);
+  std::unique_ptr<ColumnarWriter> policies = ColumnarWriter::Open(
+      (prefix + ".policy.cols").c_str(),
+      {{"tick", kIntColumn},
+       {"actor", kIntColumn},
+       {"action_id", kStringColumn},
+       {"score", kDoubleColumn},
+       {"probability", kDoubleColumn},
+       {"rank", kIntColumn},
+       {"num_options", kIntColumn}},
+      logger, row_group_rows);
+  if (!actions || !learns || !policies) {
+    return nullptr;
+  }
+  return std::make_unique<ColumnarEventLog>(
+      std::move(actions), std::move(learns), std::move(policies));
+}
+
+ColumnarEventLog::ColumnarEventLog(std::unique_ptr<ColumnarWriter> actions,
+                                   std::unique_ptr<ColumnarWriter> learns,
+                                   std::unique_ptr<ColumnarWriter> policies)
+    : actions_(std::move(actions)),
+      learns_(std::move(learns)),
+      policies_(std::move(policies)) {}
+
+void ColumnarEventLog::LogAction(const ActionEvent& event) {
+  actions_->AppendInt(event.tick_);
+  actions_->AppendInt(event.actor_);
+  actions_->AppendDouble(event.actor_score_);
+  actions_->AppendString(event.action_id_);
+  actions_->AppendDouble(event.score_);
+  actions_->AppendInt(event.valid_);
+  actions_->EndRow();
+}
+
+void ColumnarEventLog::LogLearn(const LearnEvent& event) {
+  learns_->AppendInt(event.tick_);
+  learns_->AppendString(event.action_id_);
+  learns_->AppendInt(event.learner_id_);
+  learns_->AppendInt(event.actor_);
+  learns_->AppendDouble(event.loss_);
+  learns_->AppendDouble(event.dL_dy_);
+  learns_->AppendDouble(event.prediction_);
+  learns_->AppendDouble(event.target_);
+  learns_->AppendDouble(event.reward_);
+  learns_->AppendDoubles(event.features_, event.num_features_);
+  learns_->EndRow();
+}
+
+void ColumnarEventLog::LogPolicy(const PolicyEvent& event) {
+  policies_->AppendInt(event.tick_);
+  policies_->AppendInt(event.actor_);
+  policies_->AppendString(event.action_id_);
+  policies_->AppendDouble(event.score_);
+  policies_->AppendDouble(event.probability_);
+  policies_->AppendInt(event.rank_);
+  policies_->AppendInt(event.num_options_);
+  policies_->EndRow();
+}
@@ -0,0 +1,218 @@
+#ifndef COLUMNAR_LOG_H_
+#define COLUMNAR_LOG_H_
+
+#include <stdio.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+#include "event_log.h"
+
+// Columnar event logs
+//
+// tab separated logs are slow to write and slower to parse for long runs. a
+// columnar log is a table with a fixed schema of typed columns, written in
+// row groups of up to row_group_rows rows. within a row group each column is
+// one contiguous chunk:
+//  int columns are frame of reference encoded: value - base in the fewest of
+//   0, 1, 2, 4 or 8 bytes that hold every value in the chunk (0 when every
+//   value is base), so ticks, ids and counts mostly take a byte or two
+//  double columns are XOR encoded, like Gorilla but byte aligned: each
+//   value's bits XORed with the previous value's (the first's with base), of
+//   which every value keeps the same 0, 1, 2 or 4 bytes starting shift bytes
+//   up. neighbouring values mostly share sign, exponent and high mantissa
+//   bits and repeats XOR to zero, so e.g. constant or 0/1 features take no
+//   bytes at all. a chunk this wouldn't shrink is raw doubles (width 8)
+//  string columns are int columns of codes into the file's dictionary
+//  double list columns are two chunks: an int chunk of each row's length and
+//   a double chunk of every row's values, concatenated
+// every chunk starts 64 byte aligned, so a reader can map the file and use
+// raw double chunks in place (e.g. numpy.frombuffer), and decode int chunks
+// with a single vectorized add and XOR encoded chunks with a vectorized
+// shift and cumulative XOR, see ColumnarReader and notebooks/cvc_columnar.py.
+//
+// file layout (native byte order, which is little endian where we run):
+//  char magic[8]                    kColumnarMagic
+//  row groups, each a chunk per column (two for double lists)
+//  footer:
+//   uint32_t num_columns
+//    per column: uint8_t ColumnarType, uint16_t length + name
+//   uint32_t dictionary size
+//    per entry: uint16_t length + string
+//   uint32_t num_row_groups
+//    per row group: uint64_t num_rows, then a ColumnarChunk per chunk
+//  uint64_t offset of the footer
+//  char magic[8]                    kColumnarMagic
+
+const char kColumnarMagic[8] = {'C', 'V', 'C', 'C', 'O', 'L', 'S', '\0'};
+
+enum ColumnarType : uint8_t {
+  kIntColumn = 1,
+  kDoubleColumn = 2,
+  kStringColumn = 3,
+  kDoubleListColumn = 4,
+};
+
+struct ColumnarColumn {
+  std::string name_;
+  ColumnarType type_;
+};
+
+// where a chunk is and how to decode it
+struct ColumnarChunk {
+  uint64_t offset_;
+  // values in the chunk, rows except for the values of a double list
+  uint64_t count_;
+  // added to every value of an int chunk, the bits XORed with the first
+  // value of an XOR encoded double chunk
+  int64_t base_;
+  // bytes per value, 0 for a chunk whose values are all base_, 8 for raw
+  // doubles
+  uint32_t width_;
+  // the lowest byte of the XORs an XOR encoded double chunk keeps
+  uint32_t shift_;
+};
+static_assert(sizeof(ColumnarChunk) == 32, "ColumnarChunk is a file format");
+
+class ColumnarWriter {
+ public:
+  static const size_t kDefaultRowGroupRows = 1 << 16;
+
+  // returns nullptr (and logs why) if path can't be written
+  static std::unique_ptr<ColumnarWriter> Open(
+      const char* path, std::vector<ColumnarColumn> schema, Logger* logger,
+      size_t row_group_rows = kDefaultRowGroupRows);
+
+  ColumnarWriter(FILE* file, std::vector<ColumnarColumn> schema,
+                 size_t row_group_rows);
+  // writes the last row group and the footer and closes the file
+  ~ColumnarWriter();
+
+  ColumnarWriter(const ColumnarWriter&) = delete;
+  ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+  // a row is one Append per column, in schema order, then EndRow
+  void AppendInt(int64_t value);
+  void AppendDouble(double value);
+  // codes are assigned by content, so value needn't outlive the call
+  void AppendString(const char* value);
+  void AppendDoubles(const double* values, size_t count);
+  void EndRow();
+
+ private:
+  struct Column {
+    ColumnarColumn schema_;
+    // ints, string codes or list lengths
+    std::vector<int64_t> ints_;
+    std::vector<double> doubles_;
+  };
+
+  Column* NextColumn(ColumnarType type);
+  void WriteRowGroup();
+  void WriteInts(const std::vector<int64_t>& values);
+  void WriteDoubles(const std::vector<double>& values);
+  void Pad();
+  void WriteFooter();
+
+  FILE* file_;
+  const size_t row_group_rows_;
+  uint64_t offset_ = 0;
+  std::vector<Column> columns_;
+  size_t next_column_ = 0;
+  size_t rows_ = 0;
+
+  std::unordered_map<std::string, uint32_t> codes_;
+  // a cache of codes_, checked against the content before it's used
+  std::unordered_map<const char*, uint32_t> seen_codes_;
+  std::vector<std::string> dictionary_;
+
+  std::vector<uint64_t> row_group_rows_written_;
+  std::vector<ColumnarChunk> chunks_;
+};
+
+// reads a columnar log in place from a read only mapping of the file
+class ColumnarReader {
+ public:
+  // returns nullptr (and logs why) if path isn't a valid columnar log
+  static std::unique_ptr<ColumnarReader> Open(const char* path,
+                                              Logger* logger);
+
+  ~ColumnarReader();
+
+  ColumnarReader(const ColumnarReader&) = delete;
+  ColumnarReader& operator=(const ColumnarReader&) = delete;
+
+  const std::vector<ColumnarColumn>& GetColumns() const { return columns_; }
+  // -1 if there's no such column
+  int FindColumn(const char* name) const;
+  const std::vector<std::string>& GetDictionary() const {
+    return dictionary_;
+  }
+
+  size_t NumRowGroups() const { return row_groups_.size(); }
+  size_t NumRows(size_t row_group) const {
+    return row_groups_[row_group].rows_;
+  }
+
+  // value of an int column, a string column's code or a double list's length
+  int64_t GetInt(size_t row_group, size_t column, size_t row) const;
+  // the values of a double column, or every value of a double list column.
+  // raw chunks point into the mapping, encoded ones are decoded into decoded
+  const double* GetDoubles(size_t row_group, size_t column,
+                           std::vector<double>* decoded) const;
+  // the number of doubles GetDoubles points to
+  size_t NumDoubles(size_t row_group, size_t column) const;
+
+ private:
+  struct RowGroup {
+    uint64_t rows_;
+    // index of the row group's first chunk
+    size_t first_chunk_;
+  };
+
+  ColumnarReader(const char* data, size_t size);
+  bool ReadFooter(Logger* logger);
+  // the chunk holding column's ints (or list lengths), and its doubles
+  const ColumnarChunk& IntChunk(size_t row_group, size_t column) const;
+  const ColumnarChunk& DoubleChunk(size_t row_group, size_t column) const;
+
+  const char* data_;
+  size_t size_;
+  std::vector<ColumnarColumn> columns_;
+  // where each column's chunks are within a row group's
+  std::vector<size_t> column_chunks_;
+  size_t chunks_per_row_group_ = 0;
+  std::vector<std::string> dictionary_;
+  std::vector<RowGroup> row_groups_;
+  std::vector<ColumnarChunk> chunks_;
+};
+
+// writes action, learn and policy events to three columnar logs,
+// path_prefix.action.cols, path_prefix.learn.cols and path_prefix.policy.cols
+// each with an actor column, so they can be joined per character
+class ColumnarEventLog : public EventLog {
+ public:
+  // returns nullptr (and logs why) if any of the logs can't be written
+  static std::unique_ptr<ColumnarEventLog> Open(
+      const char* path_prefix, Logger* logger,
+      size_t row_group_rows = ColumnarWriter::kDefaultRowGroupRows);
+
+  ColumnarEventLog(std::unique_ptr<ColumnarWriter> actions,
+                   std::unique_ptr<ColumnarWriter> learns,
+                   std::unique_ptr<ColumnarWriter> policies);
+
+  void LogAction(const ActionEvent& event) override;
+  void LogLearn(const LearnEvent& event) override;
+  void LogPolicy(const PolicyEvent& event) override;
+
+ private:
+  std::unique_ptr<ColumnarWriter> actions_;
+  std::unique_ptr<ColumnarWriter> learns_;
+  std::unique_ptr<ColumnarWriter> policies_;
+};
+
+#endif
@@ -55,6 +55,16 @@ double Character::GetFreshOpinionOf(const Character* target) {
   return GetOpinionOf(target);
 }
 
+size_t Character::MemoryBytes() const {
+  size_t bytes = sizeof(*this) + HashMapBytes(traits_) +
+                 HashMapBytes(relationships_) + HashMapBytes(opinion_cache);
+  for (const auto& relationships : relationships_) {
+    bytes += ListBytes(relationships.second) +
+             relationships.second.size() * sizeof(RelationshipModifier);
+  }
+  return bytes;
+}
+
 double Character::GetOpinionOf(const Character* target) {
   auto cached_opinion = opinion_cache.find(target->GetId());
   if(cached_opinion != opinion_cache.end()) {
@@ -110,7 +120,10 @@ CVC::CVC(std::vector<Character*> characters, Logger* logger,
       logger_(logger),
       random_generator_(random_generator) {}
 
-std::vector<Character*> CVC::GetCharacters() const { return characters_; }
+size_t CVC::MemoryBytes() const {
+  return sizeof(*this) + VectorBytes(characters_) +
+         HashMapBytes(opinion_of_stats_) + HashMapBytes(opinion_by_stats_);
+}
 
 void CVC::LogState() {
   logger_->Log(INFO, "tick %d: invalid actions: %d avg money: %f (%f) avg opinion %f (%f)\n", this->ticks_, this->invalid_actions_, GetMoneyStats().mean_, GetMoneyStats().stdev_, GetOpinionStats().mean_, GetOpinionStats().stdev_);
@@ -11,6 +11,7 @@
 #include <cstdio>
 
 #include "util.h"
+#include "memory_footprint.h"
 
 enum CharacterTraitId {
   kBackground,
@@ -33,22 +34,35 @@ struct RelationshipModifier {
   // TODO: some explanatory string about why
 };
 
-class Character {
+class Character : public MemoryFootprint {
  public:
   Character(CharacterId id, double money_);
   CharacterId GetId() const { return this->id_; }
 
   double GetMoney() const { return this->money_; }
-  void SetMoney(double money) { this->money_ = money; }
+  void SetMoney(double money) {
+    this->money_ = money;
+    score_dirty_ = true;
+  }
 
+  // the score is the character's agent's objective (see Agent::CurrentScore),
+  // cached until something it depends on changes and marks it dirty
   double GetScore() const { return this->score_; }
-  void SetScore(double score) { this->score_ = score; }
+  void SetScore(double score) {
+    this->score_ = score;
+    score_dirty_ = false;
+  }
+  bool IsScoreDirty() const { return score_dirty_; }
+  void MarkScoreDirty() { score_dirty_ = true; }
 
   void AddRelationship(std::unique_ptr<RelationshipModifier> relationship);
   void ExpireRelationships(int now);
   double GetOpinionOf(const Character* target);
   double GetFreshOpinionOf(const Character* target);
 
+  // traits, relationships and the opinion cache
+  size_t MemoryBytes() const override;
+
   std::unordered_map<CharacterTraitId, CharacterTrait> traits_;
 
  private:
@@ -58,6 +72,7 @@ class Character {
   int end_tick_ = std::numeric_limits<int>::max();*/
   double money_;
   double score_;
+  bool score_dirty_ = true;
 
   std::unordered_map<CharacterId, std::list<std::unique_ptr<RelationshipModifier>>>
       relationships_;
@@ -66,16 +81,21 @@ class Character {
 };
 
 // Holds game state
-class CVC {
+class CVC : public MemoryFootprint {
  public:
   CVC() {}
   CVC(std::vector<Character*> characters,
       Logger *logger, std::mt19937 random_generator);
 
-  std::vector<Character*> GetCharacters() const;
+  const std::vector<Character*>& GetCharacters() const {
+    return characters_;
+  }
 
   void LogState();
 
+  // the character list and opinion stats, characters report their own
+  size_t MemoryBytes() const override;
+
   //features
   const Stats& GetOpinionStats();
   const Stats& GetOpinionOfStats(CharacterId id);
@@ -0,0 +1,231 @@
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#include "../core.h"
+#include "culture.h"
+#include "crunchedin.h"
+
+namespace cvc::crunchedin {
+
+CvId CrunchedIn::AddCurriculumVitae(Character* character,
+                                    const Culture& culture) {
+  CvId cv = cv_character_.size();
+  cv_character_.push_back(character);
+  cv_culture_.push_back(culture);
+  cv_total_contribution_.push_back(0.0);
+  cv_pending_contribution_.push_back(0.0);
+  cv_last_role_.push_back(kNoId);
+  cv_num_roles_.push_back(0);
+
+  CharacterId id = character->GetId();
+  assert(id >= 0);
+  if ((size_t)id >= cv_by_character_.size()) {
+    cv_by_character_.resize(id + 1, kNoId);
+  }
+  assert(kNoId == cv_by_character_[id]);
+  cv_by_character_[id] = cv;
+  return cv;
+}
+
+OrgId CrunchedIn::FoundOrganization(const Culture& culture, CvId founder,
+                                    int tick) {
+  OrgId org = org_culture_.size();
+  org_culture_.push_back(culture);
+  org_ceo_.push_back(kNoId);
+  org_start_tick_.push_back(tick);
+  org_end_tick_.push_back(kNoEndTick);
+  org_contributions_.push_back(0.0);
+  org_staff_.emplace_back();
+
+  StartRole(org, founder, tick);
+  org_ceo_[org] = founder;
+  culture_index_.Insert(org, org_culture_[org]);
+  return org;
+}
+
+RoleId CrunchedIn::StartRole(OrgId org, CvId cv, int tick) {
+  assert(!IsDissolved(org));
+  // roles record their org's contributions so far
+  SettleContributions();
+  RoleId current = GetCurrentRole(cv);
+  // a ceo leaving dissolves the org, so there's no moving within an org
+  assert(kNoId == current || role_org_[current] != org);
+  if (kNoId != current) {
+    EndRole(current, tick);
+  }
+
+  RoleId role = role_cv_.size();
+  role_cv_.push_back(cv);
+  role_org_.push_back(org);
+  role_start_tick_.push_back(tick);
+  role_end_tick_.push_back(kNoEndTick);
+  role_contribution_.push_back(0.0);
+  role_contributions_at_start_.push_back(org_contributions_[org]);
+  role_contributions_at_end_.push_back(0.0);
+  // we assume culture vectors are unit vectors
+  role_culture_alignment_.push_back(std::min(
+      1.0, std::max(-1.0, cv_culture_[cv].Dot(org_culture_[org]))));
+  role_culture_fit_.push_back(cv_culture_[cv].Product(org_culture_[org]));
+  role_pending_.push_back(0.0);
+  role_previous_.push_back(cv_last_role_[cv]);
+
+  cv_last_role_[cv] = role;
+  cv_num_roles_[cv]++;
+  org_staff_[org].push_back(role);
+  return role;
+}
+
+void CrunchedIn::EndRole(RoleId role, int tick) {
+  assert(kNoEndTick == role_end_tick_[role]);
+  SettleContributions();
+  OrgId org = role_org_[role];
+  role_end_tick_[role] = tick;
+  role_contributions_at_end_[role] = org_contributions_[org];
+
+  std::vector<RoleId>& staff = org_staff_[org];
+  auto position = std::find(staff.begin(), staff.end(), role);
+  assert(position != staff.end());
+  *position = staff.back();
+  staff.pop_back();
+
+  if (org_ceo_[org] == role_cv_[role]) {
+    Dissolve(org, tick);
+  }
+}
+
+void CrunchedIn::Dissolve(OrgId org, int tick) {
+  assert(!IsDissolved(org));
+  SettleContributions();
+  culture_index_.Remove(org);
+  org_ceo_[org] = kNoId;
+  org_end_tick_[org] = tick;
+  for (RoleId role : org_staff_[org]) {
+    role_end_tick_[role] = tick;
+    role_contributions_at_end_[role] = org_contributions_[org];
+  }
+  org_staff_[org].clear();
+}
+
+namespace {
+
+// contribution is scaled by cosine similarity (itself scaled to (0,1] )
+inline double ContributionScale(double alignment) {
+  //scale to (0,1]
+  return alignment * 0.5 + 0.5;
+}
+
+}
+
+double CrunchedIn::ScaleContribution(RoleId role, double contribution) const {
+  double scale = role_culture_alignment_[role];
+  assert(scale >= -1.0);
+  assert(scale <= 1.0);
+
+  double actual_contribution = contribution * ContributionScale(scale);
+
+  assert(actual_contribution <= contribution);
+  assert(actual_contribution >= 0.0);
+  return actual_contribution;
+}
+
+void CrunchedIn::Contribute(RoleId role, double contribution) {
+  double actual_contribution = ScaleContribution(role, contribution);
+  CvId cv = role_cv_[role];
+  role_contribution_[role] += actual_contribution;
+  org_contributions_[role_org_[role]] += actual_contribution;
+  cv_total_contribution_[cv] += actual_contribution;
+  // the character's score may depend on its contributions
+  cv_character_[cv]->MarkScoreDirty();
+}
+
+void CrunchedIn::QueueContribution(RoleId role, double contribution) {
+  double actual_contribution = ScaleContribution(role, contribution);
+  CvId cv = role_cv_[role];
+  pending_roles_.push_back(role);
+  pending_contributions_.push_back(actual_contribution);
+  cv_pending_contribution_[cv] += actual_contribution;
+  // the character's score may depend on its contributions
+  cv_character_[cv]->MarkScoreDirty();
+}
+
+void CrunchedIn::SettleContributions() {
+  const size_t n = pending_roles_.size();
+  if (0 == n) {
+    return;
+  }
+
+  // sum per role first, in the order they were queued, so org and cv totals
+  // are added to once per role rather than once per contribution. a role
+  // whose sum is still zero may be listed again, which is harmless since its
+  // sum is cleared once it's added below
+  const RoleId* roles = pending_roles_.data();
+  const double* contributions = pending_contributions_.data();
+  for (size_t i = 0; i < n; i++) {
+    RoleId role = roles[i];
+    if (0.0 == role_pending_[role]) {
+      settling_roles_.push_back(role);
+    }
+    role_pending_[role] += contributions[i];
+  }
+
+  // then one pass adding each role's sum to its role, org and cv totals
+  for (RoleId role : settling_roles_) {
+    double sum = role_pending_[role];
+    CvId cv = role_cv_[role];
+    role_contribution_[role] += sum;
+    org_contributions_[role_org_[role]] += sum;
+    cv_total_contribution_[cv] += sum;
+    cv_pending_contribution_[cv] = 0.0;
+    role_pending_[role] = 0.0;
+  }
+
+  settling_roles_.clear();
+  pending_roles_.clear();
+  pending_contributions_.clear();
+}
+
+size_t CrunchedIn::MemoryBytes() const {
+  size_t bytes =
+      sizeof(*this) + VectorBytes(org_culture_) + VectorBytes(org_ceo_) +
+      VectorBytes(org_start_tick_) + VectorBytes(org_end_tick_) +
+      VectorBytes(org_contributions_) + VectorBytes(org_staff_) +
+      VectorBytes(role_cv_) + VectorBytes(role_org_) +
+      VectorBytes(role_start_tick_) + VectorBytes(role_end_tick_) +
+      VectorBytes(role_contribution_) +
+      VectorBytes(role_contributions_at_start_) +
+      VectorBytes(role_contributions_at_end_) +
+      VectorBytes(role_culture_alignment_) + VectorBytes(role_culture_fit_) +
+      VectorBytes(cv_character_) + VectorBytes(cv_culture_) +
+      VectorBytes(cv_total_contribution_) +
+      VectorBytes(cv_pending_contribution_) + VectorBytes(role_previous_) +
+      VectorBytes(cv_last_role_) + VectorBytes(cv_num_roles_) +
+      VectorBytes(cv_by_character_) + VectorBytes(pending_roles_) +
+      VectorBytes(pending_contributions_) + VectorBytes(role_pending_) +
+      VectorBytes(settling_roles_);
+  for (const std::vector<RoleId>& staff : org_staff_) {
+    bytes += VectorBytes(staff);
+  }
+  // the index itself is already counted as part of this
+  bytes += culture_index_.MemoryBytes() - sizeof(culture_index_);
+  return bytes;
+}
+
+void CrunchedIn::GetRoles(CvId cv, std::vector<RoleId>* roles) const {
+  roles->resize(cv_num_roles_[cv]);
+  // the chain runs newest first
+  size_t i = roles->size();
+  for (RoleId role = cv_last_role_[cv]; kNoId != role;
+       role = role_previous_[role]) {
+    (*roles)[--i] = role;
+  }
+  assert(0 == i);
+}
+
+void CrunchedIn::FindOrganizations(const Culture& culture, size_t k,
+                                   std::vector<OrgId>* orgs) {
+  culture_index_.Query(culture, k, orgs);
+}
+
+} //namespace cvc::crunchedin
@@ -1,138 +1,250 @@
 #ifndef CRUNCHEDIN_H_
 #define CRUNCHEDIN_H_
 
+#include <cassert>
+#include <cstdint>
 #include <limits>
 #include <vector>
 #include <algorithm>
 
 #include "../core.h"
 #include "../action.h"
+#include "../settlement.h"
+#include "culture.h"
+#include "culture_index.h"
 
 namespace cvc::crunchedin {
 
-const size_t CULTURE_DIMENSIONS = 2;
-
-class CurriculumVitae;
-struct Role;
-
-struct Organization {
-  Organization(std::array<double, CULTURE_DIMENSIONS> culture)
-      : culture_(culture) {}
-
-  CurriculumVitae* ceo_;
-  std::vector<Role*> current_staff_;
-  int start_tick_ = 0;
-  int end_tick_ = std::numeric_limits<int>::max();
+// organizations, roles and curricula vitae are dense integer ids into the
+// columns of CrunchedIn, assigned in order of creation and never reused
+typedef int32_t OrgId;
+typedef int32_t RoleId;
+typedef int32_t CvId;
+
+const int32_t kNoId = -1;
+const int kNoEndTick = std::numeric_limits<int>::max();
+
+// the job market, stored column by column
+//
+// a curriculum vitae (cv) is the crunchedin representation of a character:
+// their culture, the roles they've had and the sum of their contributions.
+// organizations are founded by a character who becomes their ceo, hire
+// characters away from other organizations and are dissolved when their ceo
+// leaves. a role is one character's tenure at one organization.
+//
+// every attribute is a column indexed by id, so e.g. all role contributions
+// are one contiguous array. nothing points into the columns, so they can
+// grow, be copied as a snapshot or written out as they are. updates aren't
+// independent per id though: a role's contributions also add to its org's and
+// cv's totals, which other roles share, so contributions are settled in one
+// place (see below) rather than by each role.
+//
+// every organization that hasn't been dissolved is in an index of cultures,
+// so characters can find organizations that suit them without looking at all
+// of them.
+//
+// work is settled in batches: WorkActions only queue their contributions and
+// Settle adds them all up after the tick's actions have been evaluated, first
+// per role (in the order they were queued) and then each role's sum to its
+// organization and cv. the totals come out as if each had been added as it
+// was queued, up to rounding. starting or ending a role settles first, since
+// roles record their organization's contributions, and scoring adds the cv's
+// pending contributions to its settled total rather than settling
+class CrunchedIn : public Settlement, public MemoryFootprint {
+ public:
+  // characters have at most one cv
+  CvId AddCurriculumVitae(Character* character, const Culture& culture);
+
+  OrgId FoundOrganization(const Culture& culture, CvId founder, int tick);
+  // ends cv's current role, if any
+  RoleId StartRole(OrgId org, CvId cv, int tick);
+  // a ceo leaving dissolves their organization
+  void EndRole(RoleId role, int tick);
+  // ends everyone's role
+  void Dissolve(OrgId org, int tick);
+
+  // contribution is scaled by how well the cultures fit and counts towards
+  // the role, its organization and its cv
+  void Contribute(RoleId role, double contribution);
+  // Contribute, once contributions are next settled
+  void QueueContribution(RoleId role, double contribution);
+  // queued (and scaled) contributions to cv's roles not yet settled
+  double PendingContribution(CvId cv) const {
+    return cv_pending_contribution_[cv];
+  }
+  // applies every queued contribution
+  void SettleContributions();
+  // implementation of Settlement
+  void Settle(CVC* cvc) override { SettleContributions(); }
+
+  // every column and the culture index
+  size_t MemoryBytes() const override;
+
+  // up to k organizations that haven't been dissolved, most similar culture
+  // first (approximately, see CultureIndex)
+  void FindOrganizations(const Culture& culture, size_t k,
+                         std::vector<OrgId>* orgs);
+
+  // organizations that haven't been dissolved
+  size_t NumOrganizations() const { return culture_index_.Size(); }
+  // every one ever founded, dissolved or not, have ids below this
+  size_t NumOrganizationIds() const { return org_culture_.size(); }
+  size_t NumRoles() const { return role_cv_.size(); }
+  size_t NumCurriculaVitae() const { return cv_character_.size(); }
+
+  // kNoId if character has no cv
+  CvId GetCurriculumVitae(const Character* character) const {
+    CharacterId id = character->GetId();
+    if (id < 0 || (size_t)id >= cv_by_character_.size()) {
+      return kNoId;
+    }
+    return cv_by_character_[id];
+  }
 
-  std::array<double, CULTURE_DIMENSIONS> culture_;
+  Character* GetCharacter(CvId cv) const { return cv_character_[cv]; }
+  const Culture& GetCulture(CvId cv) const { return cv_culture_[cv]; }
+  // the sum of contributions over all roles
+  double TotalContribution(CvId cv) const {
+    return cv_total_contribution_[cv];
+  }
+  // every role cv has had, oldest first
+  void GetRoles(CvId cv, std::vector<RoleId>* roles) const;
+  size_t GetNumRoles(CvId cv) const { return cv_num_roles_[cv]; }
+  // kNoId if cv has never had a role
+  RoleId GetLastRole(CvId cv) const { return cv_last_role_[cv]; }
+  // cv's role before this one, kNoId for their first
+  RoleId GetPreviousRole(RoleId role) const { return role_previous_[role]; }
+  // kNoId if the character isn't employed
+  RoleId GetCurrentRole(CvId cv) const {
+    RoleId role = cv_last_role_[cv];
+    if (kNoId == role || kNoEndTick != role_end_tick_[role]) {
+      return kNoId;
+    }
+    return role;
+  }
 
+  // dissolved orgs have no ceo or staff and can't hire
+  bool IsDissolved(OrgId org) const {
+    return kNoEndTick != org_end_tick_[org];
+  }
+  // kNoId once dissolved
+  CvId GetCEO(OrgId org) const { return org_ceo_[org]; }
+  const Culture& GetOrgCulture(OrgId org) const { return org_culture_[org]; }
+  const std::vector<RoleId>& GetStaff(OrgId org) const {
+    return org_staff_[org];
+  }
+  int GetOrgStartTick(OrgId org) const { return org_start_tick_[org]; }
+  int GetOrgEndTick(OrgId org) const { return org_end_tick_[org]; }
   //TODO: contributions is a placeholder for the total score for this org
   //    in the future this ought to be a more complicated function of products,
   //    customers, sales, etc.
-  double contributions_ = 0.0;
-};
-
-struct Role {
-  Role(Organization* org, CurriculumVitae* cv, int start_tick)
-      : cv_(cv), org_(org), start_tick_(start_tick) {
-    contributions_at_start_ = org_->contributions_;
+  double GetOrgContributions(OrgId org) const {
+    return org_contributions_[org];
   }
 
-  CurriculumVitae* cv_;
-  Organization* org_;
-  int start_tick_;
-  int end_tick_ = std::numeric_limits<int>::max();
-
+  CvId GetRoleCV(RoleId role) const { return role_cv_[role]; }
+  OrgId GetRoleOrg(RoleId role) const { return role_org_[role]; }
+  int GetRoleStartTick(RoleId role) const { return role_start_tick_[role]; }
+  // kNoEndTick while the role lasts
+  int GetRoleEndTick(RoleId role) const { return role_end_tick_[role]; }
   //TODO: contribution is a placeholder for contributions by this character
   //    in the future this ought to be a more complicated function of stuff
   //    this character has done
-  double contribution_ = 0.0;
-
+  double GetRoleContribution(RoleId role) const {
+    return role_contribution_[role];
+  }
   //represents how "good" the org was when this character had this role
   //together represents how much the org improved during the character's tenure
   //useful to understand the character's role in that improvement, e.g.
-  //contribution_ / (contributions_at_end_ - contributions_at_start_)
-  //the value of corp contributions at start/end from this role
-  //end is meaningless unless end_tick_ <= CVC.Now()
-  double contributions_at_start_;
-  double contributions_at_end_;
-};
-
-//records career history, but also the crunchedin representation of a character
-class CurriculumVitae {
- public:
-  CurriculumVitae(std::array<double, CULTURE_DIMENSIONS> culture)
-      : culture_(culture) {}
-
-  double TotalContribution() const {
-    double score = 0.0;
-    for(auto& role: roles_) {
-      score += role->contribution_;
-    }
-    return score;
+  //contribution / (contributions at end - contributions at start)
+  //end is meaningless until the role has ended
+  double GetContributionsAtStart(RoleId role) const {
+    return role_contributions_at_start_[role];
   }
-
-  void Contribute(Role* role, double contribution) {
-    assert(this == role->cv_);
-    // contribution is scaled by cosine similarity (itself scaled to (0,1] )
-    double scale = 0.0;
-    for (size_t i = 0; i < CULTURE_DIMENSIONS; i++) {
-      scale += culture_[i] * role->org_->culture_[i];
-    }
-    // we assume culture vectors are unit vectors
-    assert(scale >= -1.0);
-    assert(scale <= 1.0);
-
-    //scale to (0,1]
-    scale *= 0.5;
-    scale += 0.5;
-
-    double actual_contribution = contribution * scale;
-
-    assert(actual_contribution <= contribution);
-    assert(actual_contribution >= 0.0);
-
-    role->contribution_ += actual_contribution;
-    role->org_->contributions_ += actual_contribution;
+  double GetContributionsAtEnd(RoleId role) const {
+    return role_contributions_at_end_[role];
   }
-
-  std::array<double, CULTURE_DIMENSIONS> GetCulture() const {
-    return culture_;
+  //cosine similarity of the character's and org's cultures (both unit
+  //vectors), clamped to [-1, 1] against rounding in narrow storage.
+  //cultures don't change, so it's worked out once when the role starts
+  double GetCultureAlignment(RoleId role) const {
+    return role_culture_alignment_[role];
   }
-
-  Role* GetCurrentRole() const {
-    return roles_.back().get();
+  //the per dimension product of the two cultures
+  const Culture& GetCultureFit(RoleId role) const {
+    return role_culture_fit_[role];
   }
 
-  std::vector<std::unique_ptr<Role>> roles_;
-  std::array<double, CULTURE_DIMENSIONS> culture_;
-};
-
-struct CrunchedIn {
-  std::vector<std::unique_ptr<Organization>> orgs_;
-  std::vector<std::unique_ptr<CurriculumVitae>> cvs_;
-  std::unordered_map<Character*, CurriculumVitae*> cv_lookup_;
+ private:
+  // contribution scaled by how well role's cultures fit
+  double ScaleContribution(RoleId role, double contribution) const;
+
+  // organization columns
+  std::vector<Culture> org_culture_;
+  std::vector<CvId> org_ceo_;
+  std::vector<int> org_start_tick_;
+  std::vector<int> org_end_tick_;
+  std::vector<double> org_contributions_;
+  // the current roles at each organization
+  std::vector<std::vector<RoleId>> org_staff_;
+
+  // role columns
+  std::vector<CvId> role_cv_;
+  std::vector<OrgId> role_org_;
+  std::vector<int> role_start_tick_;
+  std::vector<int> role_end_tick_;
+  std::vector<double> role_contribution_;
+  std::vector<double> role_contributions_at_start_;
+  std::vector<double> role_contributions_at_end_;
+  std::vector<double> role_culture_alignment_;
+  std::vector<Culture> role_culture_fit_;
+  // the cv's role history, as a chain back from cv_last_role_
+  std::vector<RoleId> role_previous_;
+
+  // cv columns
+  std::vector<Character*> cv_character_;
+  std::vector<Culture> cv_culture_;
+  std::vector<double> cv_total_contribution_;
+  // zero whenever nothing is queued
+  std::vector<double> cv_pending_contribution_;
+  std::vector<RoleId> cv_last_role_;
+  std::vector<uint32_t> cv_num_roles_;
+
+  // by character id, kNoId for characters without a cv
+  std::vector<CvId> cv_by_character_;
+
+  CultureIndex<OrgId> culture_index_;
+
+  // queued contributions, already scaled, in the order they were queued
+  std::vector<RoleId> pending_roles_;
+  std::vector<double> pending_contributions_;
+  // per role sums of the queued contributions while settling, zero otherwise
+  std::vector<double> role_pending_;
+  // roles with queued contributions, in the order they were first queued
+  std::vector<RoleId> settling_roles_;
 };
 
 class WorkAction : public Action {
  public:
-  WorkAction(Character* character, double score, Role* role,
-             double contribution)
+  WorkAction(Character* character, double score, CrunchedIn* crunchedin,
+             RoleId role, double contribution)
       : Action("CrunchedInWork", character, score),
+        crunchedin_(crunchedin),
         role_(role),
         contribution_(contribution) {}
 
   bool IsValid(const CVC* cvc) override {
     //make sure we're still employed
-    return cvc->Now() < role_->end_tick_;
+    return cvc->Now() < crunchedin_->GetRoleEndTick(role_);
   }
 
   void TakeEffect(CVC* gamestate) override {
-    role_->cv_->Contribute(role_, contribution_);
+    crunchedin_->QueueContribution(role_, contribution_);
   }
 
  private:
-  Role* role_;
+  CrunchedIn* crunchedin_;
+  RoleId role_;
   double contribution_;
 };
 
@@ -141,35 +253,100 @@ class ContributionScorer {
   ContributionScorer(CrunchedIn* crunchedin) : crunchedin_(crunchedin) {}
 
   double Score(CVC* cvc, Character* character) {
-    assert(crunchedin_->cv_lookup_.find(character) !=
-           crunchedin_->cv_lookup_.end());
-    CurriculumVitae* cv = crunchedin_->cv_lookup_[character];
-    assert(cv);
-    return std::max(cv->TotalContribution(),character->GetMoney());
+    CvId cv = crunchedin_->GetCurriculumVitae(character);
+    assert(kNoId != cv);
+    // responses are scored while actions are still being evaluated, so count
+    // the work queued so far without settling it
+    return std::max(crunchedin_->TotalContribution(cv) +
+                        crunchedin_->PendingContribution(cv),
+                    character->GetMoney());
   }
 
  private:
   CrunchedIn* crunchedin_;
 };
 
-/*class ApplyAction : public Action {
+// apply to the ceo of an organization, who may hire the applicant
+class ApplyAction : public Action {
  public:
-  ApplyAction(Character* actor, double score, Character* target, Role* role)
-      : Action(__FUNCTION__, actor, target, score),
+  ApplyAction(Character* actor, double score, CrunchedIn* crunchedin,
+              CvId applicant, OrgId org)
+      : Action("CrunchedInApply", actor,
+               crunchedin->GetCharacter(crunchedin->GetCEO(org)), score),
+        crunchedin_(crunchedin),
+        applicant_(applicant),
+        org_(org) {}
 
-        bool IsValid(const CVC* cvc) override {
-    return true;
+  bool IsValid(const CVC* cvc) override {
+    // the org is still hiring, under the same ceo, and we don't work there
+    if (crunchedin_->IsDissolved(org_) ||
+        crunchedin_->GetCharacter(crunchedin_->GetCEO(org_)) != GetTarget()) {
+      return false;
+    }
+    RoleId role = crunchedin_->GetCurrentRole(applicant_);
+    return kNoId == role || crunchedin_->GetRoleOrg(role) != org_;
   }
 
+  bool RequiresResponse() override { return true; }
+
   void TakeEffect(CVC* gamestate) override {
-    //...just requires a response...
+    //no effect other than submitting the application
   }
 
-  bool RequiresResponse() { return true; }
+  CvId GetApplicant() const { return applicant_; }
+  OrgId GetOrganization() const { return org_; }
 
  private:
+  CrunchedIn* crunchedin_;
+  CvId applicant_;
+  OrgId org_;
+};
+
+// a ceo's positive response to an application
+class HireAction : public Action {
+ public:
+  HireAction(Character* actor, double score, ApplyAction* application,
+             CrunchedIn* crunchedin)
+      : Action("CrunchedInHire", actor, application->GetActor(), score),
+        application_(application),
+        crunchedin_(crunchedin) {}
+
+  bool IsValid(const CVC* cvc) override {
+    return application_->IsValid(cvc);
+  }
+
+  void TakeEffect(CVC* gamestate) override {
+    crunchedin_->StartRole(application_->GetOrganization(),
+                           application_->GetApplicant(), gamestate->Now());
+  }
 
-};*/
+ private:
+  ApplyAction* application_;
+  CrunchedIn* crunchedin_;
+};
+
+// found an organization with the founder's culture, for the unemployed
+class FoundAction : public Action {
+ public:
+  FoundAction(Character* actor, double score, CrunchedIn* crunchedin,
+              CvId founder)
+      : Action("CrunchedInFound", actor, score),
+        crunchedin_(crunchedin),
+        founder_(founder) {}
+
+  bool IsValid(const CVC* cvc) override {
+    return kNoId == crunchedin_->GetCurrentRole(founder_);
+  }
+
+  void TakeEffect(CVC* gamestate) override {
+    crunchedin_->FoundOrganization(crunchedin_->GetCulture(founder_), founder_,
+                                   gamestate->Now());
+  }
+
+ private:
+  CrunchedIn* crunchedin_;
+  CvId founder_;
+};
 
 } //namespace cvc::crunchedin
 
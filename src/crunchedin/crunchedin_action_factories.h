@@ -4,52 +4,277 @@
 #include <vector>
 #include <memory>
 #include <array>
+#include <cmath>
 
 #include "crunchedin.h"
 #include "../sarsa/sarsa_agent.h"
 #include "../sarsa/sarsa_learner.h"
+#include "../sarsa/feature_schema.h"
 
 namespace cvc::crunchedin {
 
-const size_t work_action_features = CULTURE_DIMENSIONS + 2;
+// what work features are extracted from
+struct WorkFeatureContext {
+  const CrunchedIn* crunchedin_;
+  CvId cv_;
+  RoleId role_;
+};
+
+//TODO: current cash?
+struct CashFeature : sarsa::DeadFeature {
+  static constexpr const char* kName = "cash";
+};
+
+// product of character culture and org culture, per dimension
+struct CultureFitFeature : sarsa::Feature {
+  static constexpr const char* kName = "culture_fit";
+  static constexpr size_t kWidth = CULTURE_DIMENSIONS;
+
+  template <typename T>
+  static void Extract(const WorkFeatureContext& context, T* out) {
+    // worked out when the role started
+    context.crunchedin_->GetCultureFit(context.role_).CopyTo(out);
+  }
+};
+
+typedef sarsa::FeatureSchema<sarsa::BiasFeature, CashFeature,
+                             CultureFitFeature>
+    WorkActionSchema;
+
+// what application features are extracted from, for both the applicant and
+// the ceo responding
+struct ApplicationFeatureContext {
+  const CrunchedIn* crunchedin_;
+  CvId applicant_;
+  OrgId org_;
+};
+
+// 1 if the applicant has a job
+struct EmployedFeature : sarsa::Feature {
+  static constexpr const char* kName = "employed";
+
+  template <typename T>
+  static void Extract(const ApplicationFeatureContext& context, T* out) {
+    out[0] = kNoId == context.crunchedin_->GetCurrentRole(context.applicant_)
+                 ? 0.0
+                 : 1.0;
+  }
+};
+
+struct LogStaffFeature : sarsa::Feature {
+  static constexpr const char* kName = "log_staff";
+
+  template <typename T>
+  static void Extract(const ApplicationFeatureContext& context, T* out) {
+    out[0] = log(1.0 + context.crunchedin_->GetStaff(context.org_).size());
+  }
+};
+
+// product of applicant culture and org culture, per dimension
+struct ApplicantFitFeature : sarsa::Feature {
+  static constexpr const char* kName = "applicant_fit";
+  static constexpr size_t kWidth = CULTURE_DIMENSIONS;
+
+  template <typename T>
+  static void Extract(const ApplicationFeatureContext& context, T* out) {
+    const CrunchedIn* crunchedin = context.crunchedin_;
+    crunchedin->GetCulture(context.applicant_)
+        .Product(crunchedin->GetOrgCulture(context.org_))
+        .CopyTo(out);
+  }
+};
+
+typedef sarsa::FeatureSchema<sarsa::BiasFeature, EmployedFeature,
+                             LogStaffFeature, ApplicantFitFeature>
+    ApplicationSchema;
+
+struct FoundingFeatureContext {
+  const CrunchedIn* crunchedin_;
+};
+
+struct LogOrganizationsFeature : sarsa::Feature {
+  static constexpr const char* kName = "log_organizations";
+
+  template <typename T>
+  static void Extract(const FoundingFeatureContext& context, T* out) {
+    out[0] = log(1.0 + context.crunchedin_->NumOrganizations());
+  }
+};
+
+typedef sarsa::FeatureSchema<sarsa::BiasFeature, LogOrganizationsFeature>
+    FoundingSchema;
+
+const size_t work_action_features = WorkActionSchema::kNumFeatures;
+template <typename T = double>
 class WorkActionFactory
-    : public sarsa::SARSAActionFactory<work_action_features> {
+    : public sarsa::SARSAActionFactory<WorkActionSchema, T> {
  public:
-  WorkActionFactory(sarsa::SARSALearner<work_action_features> learner,
-                    CrunchedIn* crunchedin)
-      : sarsa::SARSAActionFactory<work_action_features>(learner),
+  WorkActionFactory(
+      std::unique_ptr<sarsa::Learner<work_action_features, T>> learner,
+      CrunchedIn* crunchedin)
+      : sarsa::SARSAActionFactory<WorkActionSchema, T>(std::move(learner)),
         crunchedin_(crunchedin) {}
 
   double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<sarsa::Experience>>* actions) override {
-    std::array<double, work_action_features> features;
-
     //the character better exist in crunchedin
-    assert(crunchedin_->cv_lookup_.find(character) !=
-           crunchedin_->cv_lookup_.end());
-    CurriculumVitae* cv = crunchedin_->cv_lookup_[character];
+    CvId cv = crunchedin_->GetCurriculumVitae(character);
+    assert(kNoId != cv);
 
-    Role* role = cv->GetCurrentRole();
-    if (!role) {
+    // nothing to do without a job
+    RoleId role = crunchedin_->GetCurrentRole(cv);
+    if (kNoId == role) {
       return 0.0;
     }
 
-    //first feature is always bias term
-    features[0] = 1.0;
-    features[1] = 0.0; //TODO: current cash?
+    actions->push_back(this->learner_->WrapAction(
+        WorkActionSchema::Extract<T>(
+            WorkFeatureContext{crunchedin_, cv, role}),
+        std::make_unique<WorkAction>(character, 0.0, crunchedin_, role,
+                                     2.0)));
+    return actions->back()->action_->GetScore();
+  }
+ private:
+  CrunchedIn* crunchedin_;
+};
+
 
-    //next features are product of character culture and org culture
-    size_t i=2;
-    for(size_t j=0; j<CULTURE_DIMENSIONS; j++, i++) {
-      features[i] =
-          cv->GetCulture()[j] * role->org_->culture_[j];
+// applications to the (at most) num_candidates organizations whose cultures
+// are closest to the character's, found with the culture index
+template <typename T = double>
+class ApplyActionFactory
+    : public sarsa::SARSAActionFactory<ApplicationSchema, T> {
+ public:
+  ApplyActionFactory(
+      std::unique_ptr<sarsa::Learner<ApplicationSchema::kNumFeatures, T>>
+          learner,
+      CrunchedIn* crunchedin, size_t num_candidates = 3)
+      : sarsa::SARSAActionFactory<ApplicationSchema, T>(std::move(learner)),
+        crunchedin_(crunchedin),
+        num_candidates_(num_candidates) {}
+
+  double EnumerateActions(
+      CVC* cvc, Character* character,
+      std::vector<std::unique_ptr<sarsa::Experience>>* actions) override {
+    CvId cv = crunchedin_->GetCurriculumVitae(character);
+    assert(kNoId != cv);
+    RoleId role = crunchedin_->GetCurrentRole(cv);
+
+    // one more, in case our own org is among them
+    crunchedin_->FindOrganizations(crunchedin_->GetCulture(cv),
+                                   num_candidates_ + 1, &candidates_);
+    double best = 0.0;
+    size_t applications = 0;
+    for (OrgId org : candidates_) {
+      if (applications == num_candidates_) {
+        break;
+      }
+      if (kNoId != role && crunchedin_->GetRoleOrg(role) == org) {
+        continue;
+      }
+      actions->push_back(this->learner_->WrapAction(
+          ApplicationSchema::Extract<T>(
+              ApplicationFeatureContext{crunchedin_, cv, org}),
+          std::make_unique<ApplyAction>(character, 0.0, crunchedin_, cv,
+                                        org)));
+      double score = actions->back()->action_->GetScore();
+      best = 0 == applications ? score : std::max(best, score);
+      applications++;
+    }
+    return best;
+  }
+
+ private:
+  CrunchedIn* crunchedin_;
+  size_t num_candidates_;
+  std::vector<OrgId> candidates_;
+};
+
+// unemployed characters can found their own organization
+template <typename T = double>
+class FoundActionFactory
+    : public sarsa::SARSAActionFactory<FoundingSchema, T> {
+ public:
+  FoundActionFactory(
+      std::unique_ptr<sarsa::Learner<FoundingSchema::kNumFeatures, T>>
+          learner,
+      CrunchedIn* crunchedin)
+      : sarsa::SARSAActionFactory<FoundingSchema, T>(std::move(learner)),
+        crunchedin_(crunchedin) {}
+
+  double EnumerateActions(
+      CVC* cvc, Character* character,
+      std::vector<std::unique_ptr<sarsa::Experience>>* actions) override {
+    CvId cv = crunchedin_->GetCurriculumVitae(character);
+    assert(kNoId != cv);
+    if (kNoId != crunchedin_->GetCurrentRole(cv)) {
+      return 0.0;
     }
 
-    actions->push_back(learner_.WrapAction(
-        features, std::make_unique<WorkAction>(character, 0.0, role, 2.0)));
+    actions->push_back(this->learner_->WrapAction(
+        FoundingSchema::Extract<T>(FoundingFeatureContext{crunchedin_}),
+        std::make_unique<FoundAction>(character, 0.0, crunchedin_, cv)));
+    return actions->back()->action_->GetScore();
+  }
+
+ private:
+  CrunchedIn* crunchedin_;
+};
+
+// the ceo hires the applicant
+template <typename T = double>
+class HireResponseFactory
+    : public sarsa::SARSAResponseFactory<ApplicationSchema, T> {
+ public:
+  HireResponseFactory(
+      std::unique_ptr<sarsa::Learner<ApplicationSchema::kNumFeatures, T>>
+          learner,
+      CrunchedIn* crunchedin)
+      : sarsa::SARSAResponseFactory<ApplicationSchema, T>(std::move(learner)),
+        crunchedin_(crunchedin) {}
+
+  double Respond(
+      CVC* cvc, Character* character, Action* action,
+      std::vector<std::unique_ptr<sarsa::Experience>>* actions) override {
+    ApplyAction* application = (ApplyAction*)action;
+    actions->push_back(this->learner_->WrapAction(
+        ApplicationSchema::Extract<T>(ApplicationFeatureContext{
+            crunchedin_, application->GetApplicant(),
+            application->GetOrganization()}),
+        std::make_unique<HireAction>(character, 0.0, application,
+                                     crunchedin_)));
+    return actions->back()->action_->GetScore();
+  }
+
+ private:
+  CrunchedIn* crunchedin_;
+};
+
+// the ceo turns the applicant down
+template <typename T = double>
+class RejectResponseFactory
+    : public sarsa::SARSAResponseFactory<ApplicationSchema, T> {
+ public:
+  RejectResponseFactory(
+      std::unique_ptr<sarsa::Learner<ApplicationSchema::kNumFeatures, T>>
+          learner,
+      CrunchedIn* crunchedin)
+      : sarsa::SARSAResponseFactory<ApplicationSchema, T>(std::move(learner)),
+        crunchedin_(crunchedin) {}
+
+  double Respond(
+      CVC* cvc, Character* character, Action* action,
+      std::vector<std::unique_ptr<sarsa::Experience>>* actions) override {
+    ApplyAction* application = (ApplyAction*)action;
+    actions->push_back(this->learner_->WrapAction(
+        ApplicationSchema::Extract<T>(ApplicationFeatureContext{
+            crunchedin_, application->GetApplicant(),
+            application->GetOrganization()}),
+        std::make_unique<TrivialResponse>(character, 0.0)));
     return actions->back()->action_->GetScore();
   }
+
  private:
   CrunchedIn* crunchedin_;
 };
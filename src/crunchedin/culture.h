@@ -0,0 +1,144 @@
+#ifndef CULTURE_H_
+#define CULTURE_H_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// culture size and storage precision are chosen at compile time, see the
+// CULTURE_DIMENSIONS and CULTURE_PRECISION cmake options
+#ifndef CVC_CULTURE_DIMENSIONS
+#define CVC_CULTURE_DIMENSIONS 2
+#endif
+
+namespace cvc::crunchedin {
+
+const size_t CULTURE_DIMENSIONS = CVC_CULTURE_DIMENSIONS;
+
+// brain float: the top half of a float, same range with an 8 bit mantissa
+struct BFloat16 {
+  BFloat16() = default;
+  BFloat16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // round to nearest even
+    bits += 0x7fff + ((bits >> 16) & 1);
+    bits_ = bits >> 16;
+  }
+
+  operator float() const {
+    uint32_t bits = (uint32_t)bits_ << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  uint16_t bits_ = 0;
+};
+
+#if defined(CVC_CULTURE_BFLOAT16)
+typedef BFloat16 CultureScalar;
+#elif defined(CVC_CULTURE_FLOAT)
+typedef float CultureScalar;
+#else
+typedef double CultureScalar;
+#endif
+
+// bytes in the widest vectors the compiler targets
+#if defined(__AVX512F__)
+const size_t kCultureVectorBytes = 64;
+#elif defined(__AVX__)
+const size_t kCultureVectorBytes = 32;
+#else
+const size_t kCultureVectorBytes = 16;
+#endif
+
+// what T is summed in, narrow types are widened to float
+template <typename T>
+using CultureWide = typename std::conditional<std::is_same<T, double>::value,
+                                              double, float>::type;
+
+// independent partial sums per dot product of T, one vector's worth
+template <typename T>
+constexpr size_t CultureLanes() {
+  return kCultureVectorBytes / sizeof(CultureWide<T>);
+}
+
+const size_t kCultureLanes = CultureLanes<CultureScalar>();
+
+// sum_i a[i] * b[i] for n a multiple of CultureLanes<T>()
+// the lanes don't depend on each other, so the inner loop vectorizes (like
+// DenseBlock in mlp_learner.h)
+template <typename T>
+double CultureDot(const T* __restrict a, const T* __restrict b, size_t n) {
+  constexpr size_t kLanes = CultureLanes<T>();
+  assert(0 == n % kLanes);
+  typedef CultureWide<T> Wide;
+  Wide lanes[kLanes] = {};
+  for (size_t i = 0; i < n; i += kLanes) {
+    for (size_t j = 0; j < kLanes; j++) {
+      lanes[j] += (Wide)a[i + j] * (Wide)b[i + j];
+    }
+  }
+  double sum = 0.0;
+  for (size_t j = 0; j < kLanes; j++) {
+    sum += lanes[j];
+  }
+  return sum;
+}
+
+// a culture vector, zero padded to a whole vector of lanes and aligned to
+// its size (up to a cache line), so the dot product runs over full aligned
+// vectors without padding every culture to the widest block
+class Culture {
+ public:
+  static constexpr size_t kPadded =
+      (CULTURE_DIMENSIONS + kCultureLanes - 1) / kCultureLanes * kCultureLanes;
+  static constexpr size_t kBytes = kPadded * sizeof(CultureScalar);
+  // the largest power of two dividing kBytes, so it doesn't add padding
+  static constexpr size_t kAlignment =
+      (kBytes & (~kBytes + 1)) < 64 ? (kBytes & (~kBytes + 1)) : 64;
+
+  Culture() { values_.fill(CultureScalar()); }
+  Culture(const std::array<double, CULTURE_DIMENSIONS>& values) : Culture() {
+    for (size_t i = 0; i < CULTURE_DIMENSIONS; i++) {
+      values_[i] = (CultureScalar)values[i];
+    }
+  }
+
+  double operator[](size_t i) const {
+    assert(i < CULTURE_DIMENSIONS);
+    return values_[i];
+  }
+
+  double Dot(const Culture& other) const {
+    return CultureDot(values_.data(), other.values_.data(), kPadded);
+  }
+
+  // the element wise product
+  Culture Product(const Culture& other) const {
+    Culture product;
+    for (size_t i = 0; i < CULTURE_DIMENSIONS; i++) {
+      product.values_[i] =
+          (CultureScalar)((double)values_[i] * (double)other.values_[i]);
+    }
+    return product;
+  }
+
+  template <typename T>
+  void CopyTo(T* out) const {
+    for (size_t i = 0; i < CULTURE_DIMENSIONS; i++) {
+      out[i] = values_[i];
+    }
+  }
+
+ private:
+  alignas(kAlignment) std::array<CultureScalar, kPadded> values_;
+};
+
+} //namespace cvc::crunchedin
+
+#endif
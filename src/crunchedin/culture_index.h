@@ -0,0 +1,196 @@
+#ifndef CULTURE_INDEX_H_
+#define CULTURE_INDEX_H_
+
+#include <array>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../memory_footprint.h"
+#include "culture.h"
+
+namespace cvc::crunchedin {
+
+// Approximate nearest culture index
+//
+// finds the items whose cultures are most similar (largest dot product, i.e.
+// cosine similarity for unit vectors) to a query without scanning every item.
+// this is random hyperplane LSH: each of num_tables tables hashes a culture
+// to the signs of its dot products with bits random hyperplanes, so similar
+// cultures tend to share a bucket. a query looks in its own bucket and the
+// bits buckets one sign away in every table, then ranks what it found by
+// exact similarity. more tables find more of the true neighbours, more bits
+// make buckets (and so queries) smaller.
+//
+// Item is a small, hashable handle (e.g. a pointer or an id)
+template <class Item>
+class CultureIndex {
+ public:
+  static const size_t kMaxBits = 32;
+
+  CultureIndex(size_t num_tables = 8, size_t bits = 6, uint32_t seed = 0)
+      : num_tables_(num_tables), bits_(bits), tables_(num_tables) {
+    assert(num_tables_ > 0);
+    assert(bits_ > 0 && bits_ <= kMaxBits);
+    std::mt19937 random_generator(seed);
+    std::normal_distribution<> dist(0.0, 1.0);
+    for (size_t i = 0; i < num_tables_ * bits_; i++) {
+      std::array<double, CULTURE_DIMENSIONS> hyperplane;
+      for (double& x : hyperplane) {
+        x = dist(random_generator);
+      }
+      hyperplanes_.emplace_back(hyperplane);
+    }
+  }
+
+  size_t Size() const { return slot_lookup_.size(); }
+
+  // see MemoryFootprint
+  size_t MemoryBytes() const {
+    size_t bytes = sizeof(*this) + VectorBytes(hyperplanes_) +
+                   VectorBytes(tables_) + VectorBytes(entries_) +
+                   VectorBytes(free_slots_) + HashMapBytes(slot_lookup_) +
+                   VectorBytes(marks_) + VectorBytes(candidates_) +
+                   VectorBytes(scored_);
+    for (const auto& table : tables_) {
+      bytes += HashMapBytes(table);
+      for (const auto& bucket : table) {
+        bytes += VectorBytes(bucket.second);
+      }
+    }
+    for (const Entry& entry : entries_) {
+      bytes += VectorBytes(entry.signatures_);
+    }
+    return bytes;
+  }
+
+  void Insert(Item item, const Culture& culture) {
+    assert(slot_lookup_.find(item) == slot_lookup_.end());
+    size_t slot;
+    if (free_slots_.empty()) {
+      slot = entries_.size();
+      entries_.push_back({item, culture, {}});
+      marks_.push_back(0);
+    } else {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+      entries_[slot] = {item, culture, {}};
+    }
+    slot_lookup_[item] = slot;
+
+    Entry& entry = entries_[slot];
+    entry.signatures_.resize(num_tables_);
+    for (size_t table = 0; table < num_tables_; table++) {
+      entry.signatures_[table] = Signature(table, culture);
+      tables_[table][entry.signatures_[table]].push_back(slot);
+    }
+  }
+
+  void Remove(Item item) {
+    auto found = slot_lookup_.find(item);
+    assert(found != slot_lookup_.end());
+    size_t slot = found->second;
+    slot_lookup_.erase(found);
+
+    const Entry& entry = entries_[slot];
+    for (size_t table = 0; table < num_tables_; table++) {
+      auto bucket = tables_[table].find(entry.signatures_[table]);
+      assert(bucket != tables_[table].end());
+      std::vector<size_t>& slots = bucket->second;
+      auto position = std::find(slots.begin(), slots.end(), slot);
+      assert(position != slots.end());
+      *position = slots.back();
+      slots.pop_back();
+      if (slots.empty()) {
+        tables_[table].erase(bucket);
+      }
+    }
+    free_slots_.push_back(slot);
+  }
+
+  // up to k items, most similar to culture first. approximate: a near item
+  // may be missed if it shares no probed bucket with culture
+  void Query(const Culture& culture, size_t k, std::vector<Item>* nearest) {
+    nearest->clear();
+    candidates_.clear();
+    epoch_++;
+    for (size_t table = 0; table < num_tables_; table++) {
+      uint32_t signature = Signature(table, culture);
+      Probe(table, signature);
+      for (size_t bit = 0; bit < bits_; bit++) {
+        Probe(table, signature ^ ((uint32_t)1 << bit));
+      }
+    }
+
+    scored_.clear();
+    for (size_t slot : candidates_) {
+      scored_.push_back({culture.Dot(entries_[slot].culture_), slot});
+    }
+    size_t n = std::min(k, scored_.size());
+    // ties go to the earlier slot, so results don't depend on probe order
+    std::partial_sort(scored_.begin(), scored_.begin() + n, scored_.end(),
+                      [](const std::pair<double, size_t>& a,
+                         const std::pair<double, size_t>& b) {
+                        return a.first > b.first ||
+                               (a.first == b.first && a.second < b.second);
+                      });
+    for (size_t i = 0; i < n; i++) {
+      nearest->push_back(entries_[scored_[i].second].item_);
+    }
+  }
+
+ private:
+  struct Entry {
+    Item item_;
+    Culture culture_;
+    std::vector<uint32_t> signatures_;
+  };
+
+  uint32_t Signature(size_t table, const Culture& culture) const {
+    uint32_t signature = 0;
+    for (size_t bit = 0; bit < bits_; bit++) {
+      if (culture.Dot(hyperplanes_[table * bits_ + bit]) >= 0.0) {
+        signature |= (uint32_t)1 << bit;
+      }
+    }
+    return signature;
+  }
+
+  // adds the bucket's slots to the candidates, each slot once per query
+  void Probe(size_t table, uint32_t signature) {
+    auto bucket = tables_[table].find(signature);
+    if (bucket == tables_[table].end()) {
+      return;
+    }
+    for (size_t slot : bucket->second) {
+      if (marks_[slot] != epoch_) {
+        marks_[slot] = epoch_;
+        candidates_.push_back(slot);
+      }
+    }
+  }
+
+  const size_t num_tables_;
+  const size_t bits_;
+  std::vector<Culture> hyperplanes_;
+  // per table, signature to the slots of entries in that bucket
+  std::vector<std::unordered_map<uint32_t, std::vector<size_t>>> tables_;
+
+  std::vector<Entry> entries_;
+  std::vector<size_t> free_slots_;
+  std::unordered_map<Item, size_t> slot_lookup_;
+
+  // query scratch, marks_[slot] == epoch_ if the slot is already a candidate
+  std::vector<uint64_t> marks_;
+  uint64_t epoch_ = 0;
+  std::vector<size_t> candidates_;
+  std::vector<std::pair<double, size_t>> scored_;
+};
+
+} //namespace cvc::crunchedin
+
+#endif
@@ -10,6 +10,27 @@
 #include "core.h"
 #include "decision_engine.h"
 #include "action.h"
+#include "event_log.h"
+
+const char* EnginePhaseName(EnginePhase phase) {
+  switch (phase) {
+    case kEvaluatePhase:
+      return "evaluate";
+    case kSettlePhase:
+      return "settle";
+    case kScorePhase:
+      return "score";
+    case kTickPhase:
+      return "tick";
+    case kChoosePhase:
+      return "choose";
+    case kLearnPhase:
+      return "learn";
+    default:
+      assert(false);
+      return "unknown";
+  }
+}
 
 std::unique_ptr<DecisionEngine> DecisionEngine::Create(
     std::vector<Agent*> agents, CVC* cvc, Logger* action_log) {
@@ -46,18 +67,31 @@ void DecisionEngine::RunOneGameLoop() {
   EvaluateQueuedActions();
 
   // 2. tick the game forward
+  BeginPhase(kTickPhase);
   cvc_->Tick();
+  EndPhase(kTickPhase);
 
   // 3. choose independent actions for characters, a'
+  BeginPhase(kChoosePhase);
   ChooseActions();
+  EndPhase(kChoosePhase);
 
   // 4. learn from experiences accumulated during this tick
+  BeginPhase(kLearnPhase);
   Learn();
+  EndPhase(kLearnPhase);
+
+  for (PhaseObserver* observer : phase_observers_) {
+    observer->EndTick(cvc_);
+  }
 }
 
 void DecisionEngine::EvaluateQueuedActions() {
-  // go through list of all the queued actions
-  for (auto& action : queued_actions_) {
+  BeginPhase(kEvaluatePhase);
+  // go through list of all the queued actions, by index since responses are
+  // queued (and evaluated) as we go
+  for (size_t i = 0; i < queued_actions_.size(); i++) {
+    Action* action = queued_actions_[i];
 
     // ensure the action is still valid in the current state
     if (!action->IsValid(cvc_)) {
@@ -73,8 +107,6 @@ void DecisionEngine::EvaluateQueuedActions() {
         assert(agent_lookup_.find(action->GetTarget()) != agent_lookup_.end());
         Agent* responding_agent = agent_lookup_[action->GetTarget()];
 
-        std::vector<std::unique_ptr<Action>> responses;
-
         //TODO: agents should always be able to explicitly respond
         Action* response = responding_agent->Respond(cvc_, action);
         assert(response);
@@ -93,21 +125,83 @@ void DecisionEngine::EvaluateQueuedActions() {
     // learn from, to maintain the contract with the Agent
 
   }
-  //actions evaluated, so dump the list
+  //actions evaluated, so dump the list, keeping its capacity for next tick
   queued_actions_.clear();
+  EndPhase(kEvaluatePhase);
+
+  //apply whatever the actions left to settle
+  BeginPhase(kSettlePhase);
+  for (Settlement* settlement : settlements_) {
+    settlement->Settle(cvc_);
+  }
+  EndPhase(kSettlePhase);
 
-  //convenient place to score all the characters
+  //convenient place to score all the characters, only those whose score
+  //changed are actually rescored
+  BeginPhase(kScorePhase);
   for (Agent* agent : agents_) {
-    agent->GetCharacter()->SetScore(agent->Score(cvc_));
+    agent->CurrentScore(cvc_);
+  }
+  EndPhase(kScorePhase);
+}
+
+void DecisionEngine::AddBatchScorer(BatchScorer* scorer) {
+  batch_scorers_.push_back(scorer);
+}
+
+void DecisionEngine::AddSettlement(Settlement* settlement) {
+  settlements_.push_back(settlement);
+}
+
+void DecisionEngine::AddPhaseObserver(PhaseObserver* observer) {
+  phase_observers_.push_back(observer);
+}
+
+Action* DecisionEngine::ChooseAction(Agent* agent) {
+  if (phase_observers_.empty()) {
+    return agent->ChooseAction(cvc_);
+  }
+  for (PhaseObserver* observer : phase_observers_) {
+    observer->BeginDecision();
+  }
+  Action* action = agent->ChooseAction(cvc_);
+  for (PhaseObserver* observer : phase_observers_) {
+    observer->EndDecision();
   }
+  return action;
+}
 
+void DecisionEngine::SetDecisionBatchSize(size_t decision_batch_size) {
+  assert(decision_batch_size > 0);
+  decision_batch_size_ = decision_batch_size;
 }
 
 void DecisionEngine::ChooseActions() {
-  // go through list of all characters
-  for (Agent* agent : agents_) {
-    Action* a = agent->ChooseAction(cvc_);
-    queued_actions_.push_back(a);
+  if (batch_scorers_.empty()) {
+    // go through list of all characters
+    for (Agent* agent : agents_) {
+      Action* a = ChooseAction(agent);
+      queued_actions_.push_back(a);
+    }
+    return;
+  }
+
+  // prepare a group of agents, score everything they queued in one go and
+  // then let them choose. agents still choose in order, so anything they draw
+  // from the random generator comes out the same as without batching
+  for (size_t start = 0; start < agents_.size();
+       start += decision_batch_size_) {
+    size_t end = std::min(agents_.size(), start + decision_batch_size_);
+    for (size_t i = start; i < end; i++) {
+      agents_[i]->PrepareAction(cvc_);
+    }
+    for (BatchScorer* scorer : batch_scorers_) {
+      scorer->ScorePending(cvc_);
+    }
+    for (size_t i = start; i < end; i++) {
+      Action* a = ChooseAction(agents_[i]);
+      queued_actions_.push_back(a);
+    }
   }
 }
 
@@ -118,6 +212,12 @@ void DecisionEngine::Learn() {
 }
 
 void DecisionEngine::LogInvalidAction(const Action* action) {
+    if (EventLog* events = action_log_->GetEventLog()) {
+      events->LogAction({cvc_->Now(), action->GetActor()->GetId(),
+                         action->GetActor()->GetScore(), action->GetActionId(),
+                         action->GetScore(), false});
+      return;
+    }
     action_log_->Log(INFO, "%d\t%d\t%f\t%s\t%s\t%f\n", cvc_->Now(),
             action->GetActor()->GetId(), action->GetActor()->GetScore(),
             "INVALID", action->GetActionId(), action->GetScore());
@@ -130,6 +230,12 @@ void DecisionEngine::LogAction(const Action* action) {
   //  action id
   //  action score
   //  feature vector
+  if (EventLog* events = action_log_->GetEventLog()) {
+    events->LogAction({cvc_->Now(), action->GetActor()->GetId(),
+                       action->GetActor()->GetScore(), action->GetActionId(),
+                       action->GetScore(), true});
+    return;
+  }
   action_log_->Log(INFO, "%d\t%d\t%f\t%s\t%f\n", cvc_->Now(),
             action->GetActor()->GetId(), action->GetActor()->GetScore(),
             action->GetActionId(), action->GetScore());
@@ -3,11 +3,11 @@
 
 #include <memory>
 #include <vector>
-#include <list>
 #include <functional>
 
 #include "core.h"
 #include "action.h"
+#include "settlement.h"
 
 // An agent acts on behalf of a character in CVC
 // It must be able to, given the current game state choose an "independent"
@@ -29,9 +29,25 @@ class Agent {
   // to us to manage it. this is true for the contained action as well.
   virtual Action* ChooseAction(CVC* cvc) = 0;
   virtual Action* Respond(CVC* cvc, Action* action) = 0;
+  // optional first phase of ChooseAction
+  // the engine prepares a group of agents, runs its BatchScorers and then calls
+  // ChooseAction on the same agents in the same order. game state doesn't
+  // change in between, so agents can queue up scoring work here and pick up
+  // the results in ChooseAction.
+  virtual void PrepareAction(CVC* cvc) {}
   virtual void Learn(CVC* cvc) = 0;
+  // the agent's objective, which may only depend on state that marks the
+  // character's score dirty when it changes (e.g. Character::SetMoney)
   virtual double Score(CVC* cvc) = 0;
 
+  // Score, recomputed only if the character's score is dirty
+  double CurrentScore(CVC* cvc) {
+    if (character_->IsScoreDirty()) {
+      character_->SetScore(Score(cvc));
+    }
+    return character_->GetScore();
+  }
+
   Character* GetCharacter() const { return character_; }
 
  protected:
@@ -39,6 +55,43 @@ class Agent {
   Character* character_;
 };
 
+// scores work queued up by agents in Agent::PrepareAction, so a model shared
+// by many agents can score all of their candidates in one pass rather than
+// agent by agent
+class BatchScorer {
+ public:
+  virtual ~BatchScorer() {}
+
+  virtual void ScorePending(CVC* cvc) = 0;
+};
+
+// the parts of DecisionEngine::RunOneGameLoop, in the order they run
+enum EnginePhase {
+  kEvaluatePhase, // queued actions and their responses take effect
+  kSettlePhase,
+  kScorePhase,
+  kTickPhase,
+  kChoosePhase, // including preparing and batch scoring
+  kLearnPhase,
+  kNumEnginePhases
+};
+
+const char* EnginePhaseName(EnginePhase phase);
+
+// watches DecisionEngine run, e.g. to time or account for each phase
+class PhaseObserver {
+ public:
+  virtual ~PhaseObserver() {}
+
+  virtual void BeginPhase(EnginePhase phase) {}
+  virtual void EndPhase(EnginePhase phase) {}
+  // around each Agent::ChooseAction, within kChoosePhase
+  virtual void BeginDecision() {}
+  virtual void EndDecision() {}
+  // after everything in RunOneGameLoop, cvc has already ticked
+  virtual void EndTick(CVC* cvc) {}
+};
+
 class DecisionEngine {
  public:
   static std::unique_ptr<DecisionEngine> Create(std::vector<Agent*> agents,
@@ -58,11 +111,36 @@ class DecisionEngine {
   //    * those agents are given a chance to learn from experiences
   void RunOneGameLoop();
 
+  // batch scorers run between preparing and choosing actions, with none
+  // registered agents just choose one after the other
+  void AddBatchScorer(BatchScorer* scorer);
+  // how many agents are prepared (and scored) together, bounds the memory
+  // batch scorers need for pending work
+  void SetDecisionBatchSize(size_t decision_batch_size);
+
+  // settlements run in the order they were added
+  void AddSettlement(Settlement* settlement);
+
+  // observers are told about phases in the order they were added
+  void AddPhaseObserver(PhaseObserver* observer);
+
  private:
   void ChooseActions();
   void EvaluateQueuedActions();
   void Learn();
 
+  void BeginPhase(EnginePhase phase) {
+    for (PhaseObserver* observer : phase_observers_) {
+      observer->BeginPhase(phase);
+    }
+  }
+  void EndPhase(EnginePhase phase) {
+    for (PhaseObserver* observer : phase_observers_) {
+      observer->EndPhase(phase);
+    }
+  }
+  Action* ChooseAction(Agent* agent);
+
   void LogInvalidAction(const Action* action);
   void LogAction(const Action* action);
 
@@ -73,13 +151,18 @@ class DecisionEngine {
   // represents the next set of actions we're going to take
   // note, these are partial experiences which haven't played out and don't
   // have a next action assigned
-  std::list<Action*> queued_actions_;
+  std::vector<Action*> queued_actions_;
 
   // a lookup from a character to the decision making capacity for that
   // character, the agent controlling that character.
   // this lookup MUST be maintained in the face of characters entering or
   // leaving the game.
   std::unordered_map<Character*, Agent*> agent_lookup_;
+
+  std::vector<BatchScorer*> batch_scorers_;
+  std::vector<Settlement*> settlements_;
+  std::vector<PhaseObserver*> phase_observers_;
+  size_t decision_batch_size_ = 16;
 };
 
 #endif
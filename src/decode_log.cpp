@@ -0,0 +1,26 @@
+#include <stdio.h>
+
+#include "util.h"
+#include "binary_log.h"
+
+// decode_log binary_log [logger_name]
+// writes the text logs recorded in a binary log (see main --binary-log) to
+// stdout, e.g. decode_log /tmp/cvc_log learner > /tmp/learn_log recreates the
+// learn log
+int main(int argc, char** argv) {
+  Logger logger;
+  if (argc < 2 || argc > 3) {
+    logger.Log(ERROR, "usage: %s binary_log [logger_name]\n", argv[0]);
+    return 1;
+  }
+
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) {
+    logger.Log(ERROR, "could not open %s\n", argv[1]);
+    return 1;
+  }
+  bool decoded =
+      DecodeBinaryLog(in, stdout, argc > 2 ? argv[2] : nullptr, &logger);
+  fclose(in);
+  return decoded ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+#ifndef EVENT_LOG_H_
+#define EVENT_LOG_H_
+
+#include <cstddef>
+
+// Structured events
+//
+// the action, learn and policy logs are mostly read back for analysis, which
+// wants typed fields rather than tab separated text. a Logger with an
+// EventLog (see Logger::SetEventLog) hands these events to it instead of
+// formatting the corresponding line. events are passed by reference and only
+// valid for the duration of the call.
+
+// an action taken by a character (DecisionEngine::LogAction), or one that
+// turned out to be invalid when it came to take effect
+struct ActionEvent {
+  int tick_;
+  int actor_;
+  double actor_score_;
+  const char* action_id_;
+  double score_;
+  bool valid_;
+};
+
+// one learning step for an action (the learners' Learn)
+struct LearnEvent {
+  int tick_;
+  const char* action_id_;
+  int learner_id_;
+  // who took the action, -1 if it had no actor
+  int actor_;
+  double loss_;
+  double dL_dy_;
+  // the learner's score for the action before the update
+  double prediction_;
+  // what it learned towards
+  double target_;
+  // the realized reward, the change in the actor's score
+  double reward_;
+  const double* features_;
+  size_t num_features_;
+};
+
+// an option chosen by a policy
+struct PolicyEvent {
+  int tick_;
+  // -1 if the policy didn't know who was choosing
+  int actor_;
+  const char* action_id_;
+  double score_;
+  // the probability the policy chose it with
+  double probability_;
+  // how many options scored strictly higher
+  size_t rank_;
+  size_t num_options_;
+};
+
+// not thread safe
+class EventLog {
+ public:
+  virtual ~EventLog() {}
+  virtual void LogAction(const ActionEvent& event) = 0;
+  virtual void LogLearn(const LearnEvent& event) = 0;
+  virtual void LogPolicy(const PolicyEvent& event) = 0;
+};
+
+#endif
@@ -5,46 +5,120 @@
 #include <unordered_map>
 #include <deque>
 #include <chrono>
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
 
+#include "binary_log.h"
+#include "columnar_log.h"
+#include "windowed_log.h"
 #include "core.h"
 #include "decision_engine.h"
 #include "action_factories.h"
+#include "scenario.h"
+#include "perf_report.h"
 #include "sarsa/sarsa_agent.h"
 #include "sarsa/sarsa_learner.h"
+#include "sarsa/mlp_learner.h"
 #include "sarsa/sarsa_action_factories.h"
+#include "sarsa/feature_service.h"
+#include "sarsa/checkpoint.h"
 #include "crunchedin/crunchedin.h"
 #include "crunchedin/crunchedin_action_factories.h"
 
+// hidden layer sizes for --mlp, zero for the second means a single layer
+const size_t kMLPHidden1 = 16;
+const size_t kMLPHidden2 = 0;
+
 class ActionsFactory {
  public:
   ActionsFactory() {}
 
-  ActionsFactory(double n, double g, double b1, double b2,
+  // lambda of zero means plain n-step SARSA learners, otherwise SARSA(lambda)
+  // learners with the given trace decay
+  ActionsFactory(double n, double g, double lambda, double b1, double b2,
                  std::mt19937* random_generator, Logger* learn_logger)
       : n_(n),
         g_(g),
+        lambda_(lambda),
         b1_(b1),
         b2_(b2),
         random_generator_(random_generator),
         learn_logger_(learn_logger) {}
 
+  // name identifies the factory's learner in checkpoints
   template <class AF>
-  AF CreateFactory() {
-    return AF(AF::CreateLearner(num_learners_++, n_, g_, b1_, b2_,
-                                random_generator_, learn_logger_));
+  AF CreateFactory(const char* name) {
+    return AF(CreateLearner<AF>(name));
   }
 
   template <class AF, class B, typename... Args>
-  std::unique_ptr<B> CreateFactoryPtr(Args&&... args) {
-    return std::make_unique<AF>(
-        AF::CreateLearner(num_learners_++, n_, g_, b1_, b2_, random_generator_,
-                          learn_logger_),
-        std::forward<Args>(args)...);
+  std::unique_ptr<B> CreateFactoryPtr(const char* name, Args&&... args) {
+    return std::make_unique<AF>(CreateLearner<AF>(name),
+                                std::forward<Args>(args)...);
   }
+
+  // learners created after this are inference only and must be loaded from a
+  // quantized checkpoint
+  void SetQuantized(bool quantized) { quantized_ = quantized; }
+
+  // learners created after this are MLPs instead of linear models
+  void SetMLP(bool mlp) { mlp_ = mlp; }
+
+  // plain SARSA learners created after this get a table of 2^log2_rows hashed
+  // feature weights (none if zero), see cvc::sarsa::HashedFeatures
+  void SetHashedFeatures(int log2_rows) { hashed_rows_ = log2_rows; }
+
+  const std::unordered_map<std::string, cvc::sarsa::Checkpointable*>&
+  GetLearners() const {
+    return learners_;
+  }
+
+  const std::vector<const MemoryFootprint*>& GetLearnerFootprints() const {
+    return learner_footprints_;
+  }
+
  private:
+  template <class AF>
+  auto CreateLearner(const char* name) {
+    std::unique_ptr<
+        cvc::sarsa::Learner<AF::kNumFeatures, typename AF::Scalar>> learner;
+    if (quantized_) {
+      learner = AF::CreateQuantizedLearner(num_learners_++);
+    } else if (mlp_) {
+      learner = cvc::sarsa::MLPLearner<AF::kNumFeatures, kMLPHidden1,
+                                       kMLPHidden2, typename AF::Scalar>::
+          Create(num_learners_++, n_, g_, b1_, b2_, *random_generator_,
+                 learn_logger_);
+    } else if (lambda_ > 0.0) {
+      learner = AF::CreateLambdaLearner(num_learners_++, n_, g_, lambda_, b1_,
+                                        b2_, random_generator_, learn_logger_);
+    } else {
+      auto sarsa = cvc::sarsa::SARSALearner<AF::kNumFeatures,
+                                            typename AF::Scalar>::
+          Create(num_learners_++, n_, g_, b1_, b2_, *random_generator_,
+                 learn_logger_);
+      if (hashed_rows_ > 0) {
+        sarsa->EnableHashedFeatures(hashed_rows_);
+      }
+      learner = std::move(sarsa);
+    }
+    assert(learners_.find(name) == learners_.end());
+    learners_[name] = learner.get();
+    learner_footprints_.push_back(learner.get());
+    return learner;
+  }
+
+  std::unordered_map<std::string, cvc::sarsa::Checkpointable*> learners_;
+  std::vector<const MemoryFootprint*> learner_footprints_;
+
   int num_learners_ = 0;
+  bool quantized_ = false;
+  bool mlp_ = false;
+  int hashed_rows_ = 0;
   double n_;
   double g_;
+  double lambda_ = 0.0;
   double b1_;
   double b2_;
   std::mt19937* random_generator_;
@@ -53,59 +127,72 @@ class ActionsFactory {
 
 class CVCSetup {
  public:
-  CVCSetup()
-      : random_generator_(rd_()),
+  // hyperparameters and log paths come from scenario
+  // quantized setups run int8/fp16 exported learners, which implies single
+  // precision and frozen agents. mlp setups use MLPLearners throughout
+  // target_search picks how Give/Ask find their best target (see
+  // cvc::sarsa::TargetSearch). hashed_feature_bits > 0 gives the Give/Ask
+  // learners (and responses to Ask) a 2^bits row table of per target weights
+  CVCSetup(const Scenario& scenario, bool single_precision = false,
+           bool quantized = false, bool mlp = false,
+           cvc::sarsa::TargetSearch target_search = cvc::sarsa::kScanTargets,
+           size_t max_target_candidates = 0, int hashed_feature_bits = 0)
+      : random_generator_(scenario.seed_ ? scenario.seed_ : rd_()),
         money_dist_(10.0, 25.0),
         background_dist_(0, 10),
         language_dist_(0, 5),
+        gaf_(&heuristic_context_),
+        aaf_(&heuristic_context_),
+        waf_(&heuristic_context_),
         cf_({{"WorkAction", &waf_},
              {"GiveAction", &gaf_},
              {"AskAction", &aaf_},
              {"TrivialAction", &taf_}}),
        contribution_scorer_(&crunchedin_) {
-
-    learn_log_ = fopen("/tmp/learn_log", "a");
+    policy_greedy_initial_e_ = scenario.initial_epsilon_;
+    policy_greedy_scale_ = scenario.epsilon_scale_;
+    n_ = scenario.learning_rate_;
+    b1_ = scenario.adam_beta1_;
+    b2_ = scenario.adam_beta2_;
+    g_ = scenario.discount_;
+    n_steps_ = scenario.n_steps_;
+    lambda_ = scenario.lambda_;
+
+    learn_log_ = fopen(scenario.learn_log_.c_str(), "a");
     setvbuf(learn_log_, NULL, _IOLBF, 1024*10);
     learn_logger_ = Logger("learner", learn_log_, INFO);
 
-    policy_log_ = fopen("/tmp/policy_log", "a");
+    policy_log_ = fopen(scenario.policy_log_.c_str(), "a");
     setvbuf(policy_log_, NULL, _IOLBF, 1024*10);
     policy_logger_ = Logger("policy", policy_log_, WARN);
 
-    action_log_ = fopen("/tmp/action_log", "a");
+    action_log_ = fopen(scenario.action_log_.c_str(), "a");
     setvbuf(action_log_, NULL, _IOLBF, 1024*10);
     action_logger_ = Logger("action", action_log_, INFO);
 
-    f_ = ActionsFactory(n_, g_, b1_, b2_, &random_generator_, &learn_logger_);
-
-    sarsa_action_factories_.push_back(
-        f_.CreateFactoryPtr<cvc::sarsa::SARSAGiveActionFactory,
-                            cvc::sarsa::ActionFactory>());
-    sarsa_action_factories_.push_back(
-        f_.CreateFactoryPtr<cvc::sarsa::SARSAAskActionFactory,
-                            cvc::sarsa::ActionFactory>());
-    sarsa_action_factories_.push_back(
-        f_.CreateFactoryPtr<cvc::sarsa::SARSATrivialActionFactory,
-                            cvc::sarsa::ActionFactory>());
-    sarsa_action_factories_.push_back(
-        f_.CreateFactoryPtr<cvc::sarsa::SARSAWorkActionFactory,
-                            cvc::sarsa::ActionFactory>());
-    sarsa_action_factories_.push_back(
-        f_.CreateFactoryPtr<cvc::crunchedin::WorkActionFactory,
-                            cvc::sarsa::ActionFactory>(&crunchedin_));
-
-    sarsa_response_factories_.push_back(
-        f_.CreateFactoryPtr<cvc::sarsa::SARSAAskSuccessResponseFactory,
-                            cvc::sarsa::ResponseFactory>());
-    sarsa_response_factories_.push_back(
-        f_.CreateFactoryPtr<cvc::sarsa::SARSAAskFailureResponseFactory,
-                            cvc::sarsa::ResponseFactory>());
+    f_ = ActionsFactory(n_, g_, lambda_, b1_, b2_, &random_generator_,
+                        &learn_logger_);
+    f_.SetQuantized(quantized);
+    f_.SetMLP(mlp);
+    frozen_ = quantized;
+
+    // learners train in single or double precision
+    if (single_precision || quantized) {
+      CreateSARSAFactories<float>(target_search, max_target_candidates,
+                                  hashed_feature_bits);
+    } else {
+      CreateSARSAFactories<double>(target_search, max_target_candidates,
+                                   hashed_feature_bits);
+    }
 
     sarsa_response_map_ =
         std::unordered_map<std::string, std::set<cvc::sarsa::ResponseFactory*>>(
             {{"AskAction",
               {sarsa_response_factories_[0].get(),
-               sarsa_response_factories_[1].get()}}});
+               sarsa_response_factories_[1].get()}},
+             {"CrunchedInApply",
+              {sarsa_response_factories_[2].get(),
+               sarsa_response_factories_[3].get()}}});
 
     learning_policy_ = cvc::sarsa::DecayingEpsilonGreedyPolicy(
       policy_greedy_initial_e_, policy_greedy_scale_, &policy_logger_);
@@ -117,9 +204,52 @@ class CVCSetup {
     fclose(policy_log_);
   }
 
-  void SetupCrunchedIn() {
-    crunchedin_.orgs_.emplace_back(
-        std::make_unique<cvc::crunchedin::Organization>(GenCulture()));
+  // the first num_organizations learning agents found an organization,
+  // everyone else starts out at the one closest to their culture
+  void SetupCrunchedIn(size_t num_organizations) {
+    assert(num_organizations > 0);
+    assert(num_organizations <= crunchedin_.NumCurriculaVitae());
+    for (size_t cv = 0; cv < num_organizations; cv++) {
+      crunchedin_.FoundOrganization(GenCulture(), cv, 0);
+    }
+
+    std::vector<cvc::crunchedin::OrgId> closest;
+    for (size_t cv = 0; cv < crunchedin_.NumCurriculaVitae(); cv++) {
+      if (cv >= num_organizations) {
+        crunchedin_.FindOrganizations(crunchedin_.GetCulture(cv), 1,
+                                      &closest);
+        // the index may miss every organization, fall back to any of them
+        crunchedin_.StartRole(
+            closest.empty() ? cv % num_organizations : closest[0], cv, 0);
+      }
+
+      double scale =
+          crunchedin_.GetCultureAlignment(crunchedin_.GetCurrentRole(cv));
+      logger_.Log(INFO, "%d has theoretical max\t%f\t(%f)\n",
+                  crunchedin_.GetCharacter(cv)->GetId(),
+                  scale * 2.0 * 10000.0, scale);
+    }
+  }
+
+  // learn, policy and action events are recorded in log instead of their
+  // text logs (decode_log turns them back into text)
+  void SetBinaryLog(BinaryLog* log) {
+    learn_logger_.SetBinaryLog(log);
+    policy_logger_.SetBinaryLog(log);
+    action_logger_.SetBinaryLog(log);
+  }
+
+  // learn, policy and action events go to events instead of their text logs
+  void SetEventLog(EventLog* events) {
+    learn_logger_.SetEventLog(events);
+    policy_logger_.SetEventLog(events);
+    action_logger_.SetEventLog(events);
+  }
+
+  // learning agents added after this only use (and never update) the
+  // learners, e.g. for evaluating a trained checkpoint
+  void SetFrozen(bool frozen) {
+    frozen_ = frozen;
   }
 
   void AddHeuristicAgents(size_t num_heuristic_agents) {
@@ -146,30 +276,17 @@ class CVCSetup {
                                          i + num_characters,
                                          money_dist_(random_generator_)))
                          .get();
-      a_.push_back(std::make_unique<
-                   cvc::sarsa::SARSAAgent<cvc::crunchedin::ContributionScorer>>(
+      auto agent = std::make_unique<
+          cvc::sarsa::SARSAAgent<cvc::crunchedin::ContributionScorer>>(
           &contribution_scorer_, c, action_factories, sarsa_response_map_,
-          &learning_policy_, n_steps_));
-
-      //TODO: crunchedin setup
-
-      cvc::crunchedin::CurriculumVitae* cv =
-          crunchedin_.cvs_
-              .emplace_back(std::make_unique<cvc::crunchedin::CurriculumVitae>(
-                  GenCulture()))
-              .get();
-      crunchedin_.cv_lookup_[c] = cv;
-
-      cvc::crunchedin::Role* role =
-          cv->roles_.emplace_back(std::make_unique<cvc::crunchedin::Role>(
-              crunchedin_.orgs_.back().get(), cv, 0)).get();
-
-      double scale = 0.0;
-      for (size_t i = 0; i < cvc::crunchedin::CULTURE_DIMENSIONS; i++) {
-        scale += cv->culture_[i] * role->org_->culture_[i];
-      }
-      logger_.Log(INFO, "%d has theoretical max\t%f\t(%f)\n", c->GetId(),
-                  scale * 2.0 * 10000.0, scale);
+          frozen_ ? (cvc::sarsa::SARSAActionPolicy*)&greedy_policy_
+                  : &learning_policy_,
+          lambda_ > 0.0 ? 1 : n_steps_, frozen_);
+      learning_agent_footprints_.push_back(agent.get());
+      a_.push_back(std::move(agent));
+
+      // jobs are handed out by SetupCrunchedIn
+      crunchedin_.AddCurriculumVitae(c, GenCulture());
     }
   }
 
@@ -186,17 +303,119 @@ class CVCSetup {
 
     cvc_ = CVC(characters, &logger_, random_generator_);
     d_ = DecisionEngine(agents, &cvc_, &action_logger_);
+    // learners are shared by all agents, so score everyone's candidates
+    // together
+    for (auto& factory : sarsa_action_factories_) {
+      d_.AddBatchScorer(factory.get());
+    }
+    // work is added up once all of a tick's actions have been evaluated
+    d_.AddSettlement(&crunchedin_);
+  }
+
+  // restores learner state from a checkpoint, if there is one at path.
+  // false if any learner wasn't restored
+  bool LoadCheckpoint(const char* path) {
+    std::vector<std::string> not_restored;
+    bool loaded = cvc::sarsa::LoadCheckpoint(path, f_.GetLearners(), &logger_,
+                                             &not_restored);
+    // frozen agents would serve the untrained weights of whatever is missing
+    for (const std::string& learner : not_restored) {
+      logger_.Log(frozen_ ? ERROR : WARN, "%s starts from scratch\n",
+                  learner.c_str());
+    }
+    return loaded;
+  }
+
+  bool SaveCheckpoint(const char* path) {
+    return cvc::sarsa::SaveCheckpoint(path, f_.GetLearners(), &logger_);
+  }
+
+  bool ExportQuantized(const char* path, cvc::sarsa::WeightFormat format) {
+    return cvc::sarsa::SaveQuantizedCheckpoint(path, f_.GetLearners(), format,
+                                               &logger_);
   }
 
   CVC* GetCVC() {
     return &cvc_;
   }
 
+  // the game state, characters, learning agents, learners and crunchedin
+  void AddMemorySubsystems(MemoryReport* report) {
+    report->AddSubsystem("cvc", {&cvc_});
+    std::vector<const MemoryFootprint*> characters;
+    for (auto& character : c_) {
+      characters.push_back(character.get());
+    }
+    report->AddSubsystem("characters", characters);
+    report->AddSubsystem("sarsa_agents", learning_agent_footprints_);
+    report->AddSubsystem("sarsa_learners", f_.GetLearnerFootprints());
+    report->AddSubsystem("crunchedin", {&crunchedin_});
+  }
+
   DecisionEngine* GetDecisionEngine() {
     return &d_;
   }
 
  private:
+  template <typename T>
+  void CreateSARSAFactories(cvc::sarsa::TargetSearch target_search,
+                            size_t max_target_candidates,
+                            int hashed_feature_bits) {
+    // only the factories about a target have hashed features
+    f_.SetHashedFeatures(hashed_feature_bits);
+    auto give =
+        f_.CreateFactoryPtr<cvc::sarsa::SARSAGiveActionFactory<T>,
+                            cvc::sarsa::SARSAGiveActionFactory<T>>(
+            "GiveAction", &features_);
+    give->SetTargetSearch(target_search, max_target_candidates);
+    sarsa_action_factories_.push_back(std::move(give));
+    auto ask =
+        f_.CreateFactoryPtr<cvc::sarsa::SARSAAskActionFactory<T>,
+                            cvc::sarsa::SARSAAskActionFactory<T>>(
+            "AskAction", &features_);
+    ask->SetTargetSearch(target_search, max_target_candidates);
+    sarsa_action_factories_.push_back(std::move(ask));
+    f_.SetHashedFeatures(0);
+    sarsa_action_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::sarsa::SARSATrivialActionFactory<T>,
+                            cvc::sarsa::ActionFactory>("TrivialAction",
+                                                       &features_));
+    sarsa_action_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::sarsa::SARSAWorkActionFactory<T>,
+                            cvc::sarsa::ActionFactory>("WorkAction",
+                                                       &features_));
+    sarsa_action_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::crunchedin::WorkActionFactory<T>,
+                            cvc::sarsa::ActionFactory>("CrunchedInWork",
+                                                       &crunchedin_));
+    sarsa_action_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::crunchedin::ApplyActionFactory<T>,
+                            cvc::sarsa::ActionFactory>("CrunchedInApply",
+                                                       &crunchedin_));
+    sarsa_action_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::crunchedin::FoundActionFactory<T>,
+                            cvc::sarsa::ActionFactory>("CrunchedInFound",
+                                                       &crunchedin_));
+
+    f_.SetHashedFeatures(hashed_feature_bits);
+    sarsa_response_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::sarsa::SARSAAskSuccessResponseFactory<T>,
+                            cvc::sarsa::ResponseFactory>("AskSuccessResponse",
+                                                         &features_));
+    sarsa_response_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::sarsa::SARSAAskFailureResponseFactory<T>,
+                            cvc::sarsa::ResponseFactory>("AskFailureResponse",
+                                                         &features_));
+    f_.SetHashedFeatures(0);
+    sarsa_response_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::crunchedin::HireResponseFactory<T>,
+                            cvc::sarsa::ResponseFactory>("CrunchedInHire",
+                                                         &crunchedin_));
+    sarsa_response_factories_.push_back(
+        f_.CreateFactoryPtr<cvc::crunchedin::RejectResponseFactory<T>,
+                            cvc::sarsa::ResponseFactory>("CrunchedInReject",
+                                                         &crunchedin_));
+  }
 
   std::array<double, cvc::crunchedin::CULTURE_DIMENSIONS> GenCulture() {
     std::uniform_real_distribution<> dist(-1.0, 1.0);
@@ -226,6 +445,7 @@ class CVCSetup {
 
   std::vector<std::unique_ptr<Character>> c_;
   std::vector<std::unique_ptr<Agent>> a_;
+  std::vector<const MemoryFootprint*> learning_agent_footprints_;
 
   CVC cvc_;
   DecisionEngine d_;
@@ -239,6 +459,7 @@ class CVCSetup {
   Logger policy_logger_;
 
   //heuristic agent state
+  HeuristicContext heuristic_context_;
   GiveActionFactory gaf_;
   AskActionFactory aaf_;
   WorkActionFactory waf_;
@@ -247,21 +468,24 @@ class CVCSetup {
   AskResponseFactory rf_;
   ProbDistPolicy pdp_;
 
-  //learning agent state
+  //learning agent state, see Scenario
   //double policy_greedy_e = 0.05;
-  double policy_greedy_initial_e_ = 0.5;
-  double policy_greedy_scale_ = 0.1;
+  double policy_greedy_initial_e_;
+  double policy_greedy_scale_;
   //double policy_temperature_ = 0.2;
   //double policy_initial_temperature_ = 50.0;
   //double policy_decay_ = 0.001;
   //double policy_scale_ = 0.001;
-  double n_ = 0.001;
-  double b1_ = 0.9;
-  double b2_= 0.999;
-  double g_= 0.9;
-  int n_steps_ = 100;
+  double n_;
+  double b1_;
+  double b2_;
+  double g_;
+  int n_steps_;
+  double lambda_;
 
   ActionsFactory f_;
+  // shared by every sarsa factory
+  cvc::sarsa::FeatureService features_;
 
   std::vector<std::unique_ptr<cvc::sarsa::ActionFactory>>
       sarsa_action_factories_;
@@ -271,6 +495,8 @@ class CVCSetup {
       sarsa_response_map_;
 
   cvc::sarsa::DecayingEpsilonGreedyPolicy learning_policy_;
+  cvc::sarsa::GreedyPolicy greedy_policy_;
+  bool frozen_ = false;
 
   cvc::sarsa::MoneyScorer money_scorer_;
   cvc::crunchedin::ContributionScorer contribution_scorer_;
@@ -278,32 +504,93 @@ class CVCSetup {
   cvc::crunchedin::CrunchedIn crunchedin_;
 };
 
-int main(int argc, char** argv) {
-  Logger logger;
-  logger.Log(INFO, "setting up Characters\n");
+// how main runs, beyond the Scenario
+struct RunOptions {
+  const char* checkpoint_path = nullptr;
+  const char* int8_path = nullptr;
+  const char* fp16_path = nullptr;
+  bool frozen = false;
+  bool single_precision = false;
+  bool quantized = false;
+  bool mlp = false;
+  cvc::sarsa::TargetSearch target_search = cvc::sarsa::kScanTargets;
+  size_t max_target_candidates = 0;
+  int hashed_feature_bits = 0;
+  BinaryLog* binary_log = nullptr;
+  EventLog* event_log = nullptr;
+};
 
-  int num_heuristic_agents = 0;
-  int num_learning_agents = 25;
-  CVCSetup setup;
-  setup.SetupCrunchedIn();
-  setup.AddHeuristicAgents(num_heuristic_agents);
-  setup.AddLearningAgents(num_learning_agents);
+// sets up and runs scenario with learning_agents learning agents, recording
+// its performance in perf if it isn't null. false if it couldn't be run
+bool RunScenario(const Scenario& scenario, int learning_agents,
+                 const RunOptions& options, PerfRecorder* perf,
+                 Logger* logger) {
+  CVCSetup setup(scenario, options.single_precision, options.quantized,
+                 options.mlp, options.target_search,
+                 options.max_target_candidates, options.hashed_feature_bits);
+  setup.SetBinaryLog(options.binary_log);
+  setup.SetEventLog(options.event_log);
+  setup.SetFrozen(options.frozen);
+  setup.AddHeuristicAgents(scenario.heuristic_agents_);
+  setup.AddLearningAgents(learning_agents);
+  setup.SetupCrunchedIn(scenario.organizations_);
   setup.SetupEnvironment();
 
+  // optionally warm start from (and save back to) a checkpoint
+  if (options.checkpoint_path) {
+    if (!setup.LoadCheckpoint(options.checkpoint_path) && options.frozen) {
+      logger->Log(ERROR,
+                  "frozen runs need every learner restored from checkpoint "
+                  "%s\n",
+                  options.checkpoint_path);
+      return false;
+    }
+  }
+
   CVC* cvc = setup.GetCVC();
   DecisionEngine* d = setup.GetDecisionEngine();
+  if (perf) {
+    d->AddPhaseObserver(perf);
+  }
+  std::unique_ptr<FILE, decltype(&fclose)> allocation_log(nullptr, fclose);
+  Logger allocation_logger;
+  AllocationRecorder allocations;
+  MemoryReport memory(scenario.memory_window_, logger);
+  if (scenario.memory_window_ > 0) {
+    setup.AddMemorySubsystems(&memory);
+    d->AddPhaseObserver(&memory);
+  }
+  if (!scenario.allocation_log_.empty()) {
+    allocation_log.reset(fopen(scenario.allocation_log_.c_str(), "a"));
+    if (!allocation_log) {
+      logger->Log(ERROR, "could not open %s\n",
+                  scenario.allocation_log_.c_str());
+      return false;
+    }
+    allocation_logger = Logger("allocations", allocation_log.get(), INFO);
+    d->AddPhaseObserver(&allocations);
+  }
 
   //run the simulation
 
-  logger.Log(INFO, "running the game loop\n");
+  logger->Log(INFO, "running the game loop\n");
   auto start_tick = std::chrono::high_resolution_clock::now();
+  if (perf) {
+    perf->Start();
+  }
+  if (allocation_log) {
+    allocations.Start();
+  }
 
   cvc->LogState();
-  int num_ticks = 10000;
+  int num_ticks = scenario.ticks_;
   for (; cvc->Now() < num_ticks;) {
     d->RunOneGameLoop();
+    if (allocation_log) {
+      allocations.LogTick(cvc, &allocation_logger);
+    }
 
-    if(cvc->Now() % 10000 == 0) {
+    if(cvc->Now() % scenario.log_state_every_ == 0) {
       cvc->LogState();
     }
   }
@@ -312,7 +599,231 @@ int main(int argc, char** argv) {
   auto end_tick = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> loop_duration = end_tick - start_tick;
 
-  logger.Log(INFO, "ran in %f seconds (%f ticks/sec)\n", loop_duration.count(), ((double)num_ticks)/loop_duration.count());
+  logger->Log(INFO, "ran in %f seconds (%f ticks/sec)\n",
+              loop_duration.count(),
+              ((double)num_ticks) / loop_duration.count());
+
+  // frozen runs didn't change the learners, nothing to save
+  if (options.checkpoint_path && !options.frozen) {
+    setup.SaveCheckpoint(options.checkpoint_path);
+  }
+  if (options.int8_path) {
+    setup.ExportQuantized(options.int8_path, cvc::sarsa::kInt8Weights);
+  }
+  if (options.fp16_path) {
+    setup.ExportQuantized(options.fp16_path, cvc::sarsa::kFp16Weights);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  Logger logger;
+  logger.Log(INFO, "setting up Characters\n");
+
+  // main [checkpoint] [--config path] [--set key=value]
+  //      [--perf-report path] [--sweep n,n,...]
+  //      [--frozen] [--float] [--quantized] [--mlp]
+  //      [--export-int8 path] [--export-fp16 path]
+  //      [--target-index] [--approx-targets n] [--hashed-features bits]
+  //      [--binary-log path] [--columnar-log prefix]
+  //      [--summary-log ticks] [--sample-events m]
+  // --config reads a scenario (population, ticks, hyperparameters, log
+  // paths, see scenario.h) and --set overrides one value of it, later ones
+  // win
+  // --perf-report writes a JSON report of the run's performance to path
+  // (see perf_report.h), same as --set perf_report=path
+  // --sweep runs once per population size (learning agents), e.g. to see
+  // how the perf report scales, same as --set sweep=n,n,...
+  // --float trains in single precision
+  // --mlp uses small neural networks instead of linear models
+  // --quantized runs (frozen) from an int8 or fp16 exported checkpoint
+  // --export-* write inference only copies of the learners after the run
+  // --target-index finds Give/Ask targets with the exact target index,
+  // --approx-targets with the approximate one, scoring at most n targets
+  // --hashed-features lets Give/Ask learn per target values in a table of
+  // 2^bits hashed weights
+  // --binary-log records the learn, policy and action logs in path, in the
+  // background, instead of writing them as text (see decode_log)
+  // --columnar-log writes learn, policy and action events to columnar logs
+  // prefix.*.cols instead (see notebooks/cvc_columnar.py)
+  // --summary-log writes summaries of those events every ticks ticks to
+  // the summary log instead (see windowed_log.h), and with --sample-events
+  // every m-th event of each kind to the columnar logs
+  Scenario scenario;
+  RunOptions options;
+  const char* binary_log_path = nullptr;
+  const char* columnar_log_prefix = nullptr;
+  int summary_ticks = 0;
+  size_t sample_every = 0;
+  for (int i = 1; i < argc; i++) {
+    if (0 == strcmp("--config", argv[i]) && i + 1 < argc) {
+      if (!scenario.Read(argv[++i], &logger)) {
+        return 1;
+      }
+    } else if (0 == strcmp("--set", argv[i]) && i + 1 < argc) {
+      if (!scenario.Set(argv[++i], &logger)) {
+        return 1;
+      }
+    } else if (0 == strcmp("--perf-report", argv[i]) && i + 1 < argc) {
+      scenario.perf_report_ = argv[++i];
+    } else if (0 == strcmp("--sweep", argv[i]) && i + 1 < argc) {
+      if (!scenario.Set("sweep", argv[++i], &logger)) {
+        return 1;
+      }
+    } else if (0 == strcmp("--frozen", argv[i])) {
+      options.frozen = true;
+    } else if (0 == strcmp("--float", argv[i])) {
+      options.single_precision = true;
+    } else if (0 == strcmp("--quantized", argv[i])) {
+      options.quantized = true;
+      options.frozen = true;
+    } else if (0 == strcmp("--mlp", argv[i])) {
+      options.mlp = true;
+    } else if (0 == strcmp("--export-int8", argv[i]) && i + 1 < argc) {
+      options.int8_path = argv[++i];
+    } else if (0 == strcmp("--export-fp16", argv[i]) && i + 1 < argc) {
+      options.fp16_path = argv[++i];
+    } else if (0 == strcmp("--target-index", argv[i])) {
+      options.target_search = cvc::sarsa::kExactTargetIndex;
+    } else if (0 == strcmp("--approx-targets", argv[i]) && i + 1 < argc) {
+      options.target_search = cvc::sarsa::kApproximateTargetIndex;
+      options.max_target_candidates = atoi(argv[++i]);
+    } else if (0 == strcmp("--hashed-features", argv[i]) && i + 1 < argc) {
+      options.hashed_feature_bits = atoi(argv[++i]);
+      if (options.hashed_feature_bits <= 0 ||
+          options.hashed_feature_bits > 30) {
+        logger.Log(ERROR, "--hashed-features needs between 1 and 30 bits\n");
+        return 1;
+      }
+    } else if (0 == strcmp("--binary-log", argv[i]) && i + 1 < argc) {
+      binary_log_path = argv[++i];
+    } else if (0 == strcmp("--columnar-log", argv[i]) && i + 1 < argc) {
+      columnar_log_prefix = argv[++i];
+    } else if (0 == strcmp("--summary-log", argv[i]) && i + 1 < argc) {
+      summary_ticks = atoi(argv[++i]);
+      if (summary_ticks <= 0) {
+        logger.Log(ERROR, "--summary-log needs a positive number of ticks\n");
+        return 1;
+      }
+    } else if (0 == strcmp("--sample-events", argv[i]) && i + 1 < argc) {
+      sample_every = atoi(argv[++i]);
+    } else {
+      options.checkpoint_path = argv[i];
+    }
+  }
+  if (!scenario.Validate(&logger)) {
+    return 1;
+  }
+
+  if (options.frozen && !options.checkpoint_path) {
+    logger.Log(ERROR, "--frozen requires a checkpoint\n");
+    return 1;
+  }
+
+  if (options.quantized && options.mlp) {
+    logger.Log(ERROR, "only linear learners can be quantized\n");
+    return 1;
+  }
+
+  if (cvc::sarsa::kApproximateTargetIndex == options.target_search &&
+      0 == options.max_target_candidates) {
+    logger.Log(ERROR, "--approx-targets needs a positive candidate count\n");
+    return 1;
+  }
+
+  if (options.hashed_feature_bits > 0 && (options.quantized || options.mlp)) {
+    logger.Log(ERROR, "only linear learners have hashed features\n");
+    return 1;
+  }
+
+  // each run would save over the last
+  if (!scenario.sweep_.empty() &&
+      ((options.checkpoint_path && !options.frozen) || options.int8_path ||
+       options.fp16_path)) {
+    logger.Log(ERROR, "sweeps can't save checkpoints or exports\n");
+    return 1;
+  }
+  // each run restarts at tick 0, so runs would be mixed up in shared logs
+  if (!scenario.sweep_.empty() &&
+      (binary_log_path || columnar_log_prefix || summary_ticks > 0)) {
+    logger.Log(ERROR,
+               "sweeps can't write binary, columnar or summary logs\n");
+    return 1;
+  }
+
+  // outlives setup, so every event is written before it's closed
+  std::unique_ptr<BinaryLog> binary_log;
+  if (binary_log_path) {
+    binary_log = BinaryLog::Open(binary_log_path, &logger);
+    if (!binary_log) {
+      return 1;
+    }
+  }
+  if (sample_every > 0 && (0 == summary_ticks || !columnar_log_prefix)) {
+    logger.Log(ERROR,
+               "--sample-events needs --summary-log and --columnar-log\n");
+    return 1;
+  }
+
+  std::unique_ptr<ColumnarEventLog> columnar_log;
+  if (columnar_log_prefix) {
+    columnar_log = ColumnarEventLog::Open(columnar_log_prefix, &logger);
+    if (!columnar_log) {
+      return 1;
+    }
+  }
+  EventLog* event_log = columnar_log.get();
+  // summaries are written as the log is destroyed, so the file and logger
+  // go after
+  std::unique_ptr<FILE, decltype(&fclose)> summary_log(nullptr, fclose);
+  Logger summary_logger;
+  std::unique_ptr<WindowedEventLog> windowed_log;
+  if (summary_ticks > 0) {
+    summary_log.reset(fopen(scenario.summary_log_.c_str(), "a"));
+    if (!summary_log) {
+      logger.Log(ERROR, "could not open %s\n", scenario.summary_log_.c_str());
+      return 1;
+    }
+    summary_logger = Logger("summary", summary_log.get(), INFO);
+    windowed_log = std::make_unique<WindowedEventLog>(
+        summary_ticks, &summary_logger, columnar_log.get(), sample_every);
+    event_log = windowed_log.get();
+  }
+  options.binary_log = binary_log.get();
+  options.event_log = event_log;
+
+  FILE* perf_report = nullptr;
+  if (!scenario.perf_report_.empty()) {
+    perf_report = fopen(scenario.perf_report_.c_str(), "w");
+    if (!perf_report) {
+      logger.Log(ERROR, "could not open %s\n", scenario.perf_report_.c_str());
+      return 1;
+    }
+    fprintf(perf_report, "{\n  \"runs\": [");
+  }
+
+  std::vector<int> populations = scenario.sweep_;
+  if (populations.empty()) {
+    populations.push_back(scenario.learning_agents_);
+  }
+  bool ok = true;
+  for (size_t i = 0; ok && i < populations.size(); i++) {
+    std::unique_ptr<PerfRecorder> perf;
+    if (perf_report) {
+      perf = std::make_unique<PerfRecorder>(
+          scenario.heuristic_agents_ + populations[i], scenario.perf_window_);
+    }
+    ok = RunScenario(scenario, populations[i], options, perf.get(), &logger);
+    if (ok && perf) {
+      fprintf(perf_report, "%s\n    ", i > 0 ? "," : "");
+      perf->WriteJSON(perf_report, "    ");
+    }
+  }
+
+  if (perf_report) {
+    fprintf(perf_report, "\n  ]\n}\n");
+    fclose(perf_report);
+  }
 
-  return 0;
+  return ok ? 0 : 1;
 }
@@ -0,0 +1,62 @@
+#ifndef MEMORY_FOOTPRINT_H_
+#define MEMORY_FOOTPRINT_H_
+
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Memory footprint
+//
+// a subsystem's bytes: the object itself plus everything it owns on the heap.
+// worked out from container sizes and capacities rather than counted
+// allocations, so it needs no allocation hook, but it's an estimate: nodes of
+// lists, sets and hash tables are their payload plus their links, without
+// allocator overhead. cheap enough to sample every so often, not every tick.
+// see MemoryReport for live and peak bytes by subsystem
+class MemoryFootprint {
+ public:
+  virtual ~MemoryFootprint() {}
+
+  virtual size_t MemoryBytes() const = 0;
+};
+
+// heap bytes of containers, not counting what their elements own
+
+template <typename T>
+size_t VectorBytes(const std::vector<T>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+template <typename T>
+size_t ListBytes(const std::list<T>& l) {
+  return l.size() * (sizeof(T) + 2 * sizeof(void*));
+}
+
+template <typename T>
+size_t SetBytes(const std::set<T>& s) {
+  // red-black tree nodes have a color and three links
+  return s.size() * (sizeof(T) + 4 * sizeof(void*));
+}
+
+template <typename K, typename V, typename H>
+size_t HashMapBytes(const std::unordered_map<K, V, H>& m) {
+  // a bucket array of pointers and a singly linked node per entry
+  return m.bucket_count() * sizeof(void*) +
+         m.size() * (sizeof(std::pair<const K, V>) + sizeof(void*));
+}
+
+template <typename T>
+size_t DequeBytes(const std::deque<T>& d) {
+  // elements live in 512 byte chunks (or one element per chunk if bigger)
+  // reached through a map of chunk pointers
+  const size_t chunk_bytes = sizeof(T) < 512 ? 512 : sizeof(T);
+  const size_t per_chunk = chunk_bytes / sizeof(T);
+  const size_t chunks = d.size() / per_chunk + 1;
+  return chunks * (chunk_bytes + sizeof(void*));
+}
+
+#endif
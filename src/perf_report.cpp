@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+#include "core.h"
+#include "decision_engine.h"
+#include "allocation_counter.h"
+#include "perf_report.h"
+
+const size_t LatencyHistogram::kNumBuckets;
+
+size_t LatencyHistogram::Bucket(uint64_t ns) {
+  if (ns < 4) {
+    return ns;
+  }
+  // the top bit picks the power of two, the next two the quarter
+  size_t msb = 63 - __builtin_clzll(ns);
+  return msb * 4 + ((ns >> (msb - 2)) & 3);
+}
+
+uint64_t LatencyHistogram::BucketLowerBound(size_t bucket) {
+  assert(bucket < kNumBuckets);
+  if (bucket < 8) {
+    return bucket;
+  }
+  size_t msb = bucket / 4;
+  return (uint64_t)(4 + bucket % 4) << (msb - 2);
+}
+
+void LatencyHistogram::Record(uint64_t ns) {
+  buckets_[Bucket(ns)]++;
+  count_++;
+  sum_ns_ += ns;
+  if (ns > max_ns_) {
+    max_ns_ = ns;
+  }
+}
+
+uint64_t LatencyHistogram::QuantileNs(double q) const {
+  if (0 == count_) {
+    return 0;
+  }
+  // the rank of the quantile, at least the first
+  uint64_t rank = (uint64_t)(q * (count_ - 1)) + 1;
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < kNumBuckets; bucket++) {
+    seen += buckets_[bucket];
+    if (seen >= rank) {
+      return BucketLowerBound(bucket);
+    }
+  }
+  return max_ns_;
+}
+
+const int AllocationRecorder::kOther;
+const int AllocationRecorder::kNumScopes;
+
+void AllocationRecorder::Start() {
+  SetAllocationCounting(true);
+  for (int scope = 0; scope < kNumScopes; scope++) {
+    start_[scope] = GetAllocationCounts(CounterScope(scope));
+    last_tick_[scope] = AllocationCounts();
+  }
+  previous_ = start_;
+  ticks_ = 0;
+  max_tick_allocations_ = 0;
+}
+
+void AllocationRecorder::BeginPhase(EnginePhase phase) {
+  SetAllocationScope(CounterScope(phase));
+}
+
+void AllocationRecorder::EndPhase(EnginePhase phase) {
+  SetAllocationScope(CounterScope(kOther));
+}
+
+void AllocationRecorder::EndTick(CVC* cvc) {
+  ticks_++;
+  uint64_t tick_allocations = 0;
+  for (int scope = 0; scope < kNumScopes; scope++) {
+    AllocationCounts counts = GetAllocationCounts(CounterScope(scope));
+    last_tick_[scope].allocations_ =
+        counts.allocations_ - previous_[scope].allocations_;
+    last_tick_[scope].bytes_ = counts.bytes_ - previous_[scope].bytes_;
+    previous_[scope] = counts;
+    tick_allocations += last_tick_[scope].allocations_;
+  }
+  if (tick_allocations > max_tick_allocations_) {
+    max_tick_allocations_ = tick_allocations;
+  }
+}
+
+AllocationCounts AllocationRecorder::LastTick() const {
+  AllocationCounts total;
+  for (const AllocationCounts& counts : last_tick_) {
+    total.allocations_ += counts.allocations_;
+    total.bytes_ += counts.bytes_;
+  }
+  return total;
+}
+
+AllocationCounts AllocationRecorder::Total(int scope) const {
+  AllocationCounts total;
+  total.allocations_ =
+      previous_[scope].allocations_ - start_[scope].allocations_;
+  total.bytes_ = previous_[scope].bytes_ - start_[scope].bytes_;
+  return total;
+}
+
+AllocationCounts AllocationRecorder::Total() const {
+  AllocationCounts total;
+  for (int scope = 0; scope < kNumScopes; scope++) {
+    AllocationCounts counts = Total(scope);
+    total.allocations_ += counts.allocations_;
+    total.bytes_ += counts.bytes_;
+  }
+  return total;
+}
+
+void AllocationRecorder::LogTick(CVC* cvc, Logger* logger) const {
+  // a fixed size line, formatted on the stack so logging doesn't allocate
+  char line[32 + kNumScopes * 2 * 21];
+  int length = snprintf(line, sizeof(line), "%d", cvc->Now());
+  for (const AllocationCounts& counts : last_tick_) {
+    length += snprintf(line + length, sizeof(line) - length, "\t%llu\t%llu",
+                       (unsigned long long)counts.allocations_,
+                       (unsigned long long)counts.bytes_);
+  }
+  logger->Log(INFO, "%s\n", line);
+}
+
+const char* AllocationRecorder::ScopeName(int scope) {
+  if (kOther == scope) {
+    return "other";
+  }
+  return EnginePhaseName((EnginePhase)scope);
+}
+
+MemoryReport::MemoryReport(int window, Logger* logger)
+    : window_(window), logger_(logger) {
+  assert(window_ >= 0);
+}
+
+void MemoryReport::AddSubsystem(const char* name,
+                                std::vector<const MemoryFootprint*> parts) {
+  subsystems_.push_back({name, std::move(parts), 0, 0});
+}
+
+void MemoryReport::Sample() {
+  live_bytes_ = 0;
+  for (Subsystem& subsystem : subsystems_) {
+    subsystem.live_bytes_ = 0;
+    for (const MemoryFootprint* part : subsystem.parts_) {
+      subsystem.live_bytes_ += part->MemoryBytes();
+    }
+    subsystem.peak_bytes_ =
+        std::max(subsystem.peak_bytes_, subsystem.live_bytes_);
+    live_bytes_ += subsystem.live_bytes_;
+  }
+  peak_bytes_ = std::max(peak_bytes_, live_bytes_);
+}
+
+void MemoryReport::Log(CVC* cvc) const {
+  size_t characters = std::max((size_t)1, cvc->GetCharacters().size());
+  for (const Subsystem& subsystem : subsystems_) {
+    logger_->Log(INFO,
+                 "tick %d memory %s: %zu bytes (peak %zu) %f per character\n",
+                 cvc->Now(), subsystem.name_, subsystem.live_bytes_,
+                 subsystem.peak_bytes_,
+                 (double)subsystem.live_bytes_ / characters);
+  }
+  logger_->Log(INFO,
+               "tick %d memory total: %zu bytes (peak %zu) %f per character\n",
+               cvc->Now(), live_bytes_, peak_bytes_,
+               (double)live_bytes_ / characters);
+}
+
+void MemoryReport::EndTick(CVC* cvc) {
+  if (window_ > 0 && 0 == cvc->Now() % window_) {
+    Sample();
+    Log(cvc);
+  }
+}
+
+PerfRecorder::PerfRecorder(size_t population, int window)
+    : population_(population), window_(window) {
+  assert(window_ > 0);
+  ResetPeakRSS();
+  Start();
+}
+
+void PerfRecorder::Start() {
+  start_ = Clock::now();
+  window_start_ = start_;
+  last_tick_ = start_;
+  phase_seconds_ = {};
+  decision_latency_ = LatencyHistogram();
+  ticks_ = 0;
+  samples_.clear();
+  allocations_.Start();
+  window_start_allocations_ = 0;
+}
+
+void PerfRecorder::BeginPhase(EnginePhase phase) {
+  allocations_.BeginPhase(phase);
+  phase_start_[phase] = Clock::now();
+}
+
+void PerfRecorder::EndPhase(EnginePhase phase) {
+  std::chrono::duration<double> d = Clock::now() - phase_start_[phase];
+  phase_seconds_[phase] += d.count();
+  allocations_.EndPhase(phase);
+}
+
+void PerfRecorder::BeginDecision() {
+  decision_start_ = Clock::now();
+}
+
+void PerfRecorder::EndDecision() {
+  decision_latency_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               Clock::now() - decision_start_)
+                               .count());
+}
+
+void PerfRecorder::EndTick(CVC* cvc) {
+  ticks_++;
+  last_tick_ = Clock::now();
+  allocations_.EndTick(cvc);
+  if (0 == ticks_ % window_) {
+    std::chrono::duration<double> d = last_tick_ - window_start_;
+    uint64_t allocations = allocations_.Total().allocations_;
+    samples_.push_back(
+        {cvc->Now(), window_ / d.count(),
+         (double)(allocations - window_start_allocations_) / window_});
+    window_start_ = last_tick_;
+    window_start_allocations_ = allocations;
+  }
+}
+
+double PerfRecorder::Seconds() const {
+  std::chrono::duration<double> d = last_tick_ - start_;
+  return d.count();
+}
+
+bool PerfRecorder::ResetPeakRSS() {
+  // "5" resets the high water mark to the current resident set size
+  FILE* clear_refs = fopen("/proc/self/clear_refs", "w");
+  if (!clear_refs) {
+    return false;
+  }
+  bool reset = 1 == fwrite("5", 1, 1, clear_refs);
+  return 0 == fclose(clear_refs) && reset;
+}
+
+long PerfRecorder::PeakRSSKb() {
+  // VmHWM follows ResetPeakRSS, ru_maxrss never goes down
+  FILE* status = fopen("/proc/self/status", "r");
+  if (status) {
+    char line[256];
+    long peak_kb = -1;
+    while (fgets(line, sizeof(line), status)) {
+      if (0 == strncmp(line, "VmHWM:", 6)) {
+        peak_kb = atol(line + 6);
+        break;
+      }
+    }
+    fclose(status);
+    if (peak_kb >= 0) {
+      return peak_kb;
+    }
+  }
+  struct rusage usage;
+  if (0 != getrusage(RUSAGE_SELF, &usage)) {
+    return -1;
+  }
+  // kilobytes on linux
+  return usage.ru_maxrss;
+}
+
+void PerfRecorder::WriteJSON(FILE* out, const char* indent) const {
+  double seconds = Seconds();
+  fprintf(out, "{\n");
+  fprintf(out, "%s  \"population\": %zu,\n", indent, population_);
+  fprintf(out, "%s  \"ticks\": %d,\n", indent, ticks_);
+  fprintf(out, "%s  \"seconds\": %f,\n", indent, seconds);
+  fprintf(out, "%s  \"ticks_per_second\": %f,\n", indent,
+          seconds > 0.0 ? ticks_ / seconds : 0.0);
+
+  bool counted = AllocationHookInstalled();
+  fprintf(out, "%s  \"ticks_per_second_over_time\": [", indent);
+  for (size_t i = 0; i < samples_.size(); i++) {
+    fprintf(out, "%s\n%s    {\"tick\": %d, \"ticks_per_second\": %f",
+            i > 0 ? "," : "", indent, samples_[i].tick_,
+            samples_[i].ticks_per_second_);
+    if (counted) {
+      fprintf(out, ", \"allocations_per_tick\": %f",
+              samples_[i].allocations_per_tick_);
+    }
+    fprintf(out, "}");
+  }
+  if (samples_.empty()) {
+    fprintf(out, "],\n");
+  } else {
+    fprintf(out, "\n%s  ],\n", indent);
+  }
+
+  fprintf(out, "%s  \"phase_seconds\": {", indent);
+  for (int phase = 0; phase < kNumEnginePhases; phase++) {
+    fprintf(out, "%s\n%s    \"%s\": %f", phase > 0 ? "," : "", indent,
+            EnginePhaseName((EnginePhase)phase), phase_seconds_[phase]);
+  }
+  fprintf(out, "\n%s  },\n", indent);
+
+  const LatencyHistogram& latency = decision_latency_;
+  fprintf(out, "%s  \"decision_latency_us\": {\n", indent);
+  fprintf(out, "%s    \"count\": %llu,\n", indent,
+          (unsigned long long)latency.Count());
+  fprintf(out, "%s    \"mean\": %f,\n", indent, latency.MeanNs() / 1e3);
+  fprintf(out, "%s    \"p50\": %f,\n", indent, latency.QuantileNs(0.5) / 1e3);
+  fprintf(out, "%s    \"p90\": %f,\n", indent, latency.QuantileNs(0.9) / 1e3);
+  fprintf(out, "%s    \"p99\": %f,\n", indent,
+          latency.QuantileNs(0.99) / 1e3);
+  fprintf(out, "%s    \"p999\": %f,\n", indent,
+          latency.QuantileNs(0.999) / 1e3);
+  fprintf(out, "%s    \"max\": %f\n", indent, latency.MaxNs() / 1e3);
+  fprintf(out, "%s  },\n", indent);
+
+  fprintf(out, "%s  \"peak_rss_kb\": %ld,\n", indent, PeakRSSKb());
+  if (counted && ticks_ > 0) {
+    AllocationCounts total = allocations_.Total();
+    fprintf(out, "%s  \"allocations_per_tick\": %f,\n", indent,
+            (double)total.allocations_ / ticks_);
+    fprintf(out, "%s  \"allocated_bytes_per_tick\": %f,\n", indent,
+            (double)total.bytes_ / ticks_);
+    fprintf(out, "%s  \"max_allocations_per_tick\": %llu,\n", indent,
+            (unsigned long long)allocations_.MaxTickAllocations());
+    fprintf(out, "%s  \"allocations_per_tick_by_phase\": {", indent);
+    for (int scope = 0; scope < AllocationRecorder::kNumScopes; scope++) {
+      AllocationCounts counts = allocations_.Total(scope);
+      fprintf(out,
+              "%s\n%s    \"%s\": {\"allocations\": %f, \"bytes\": %f}",
+              scope > 0 ? "," : "", indent,
+              AllocationRecorder::ScopeName(scope),
+              (double)counts.allocations_ / ticks_,
+              (double)counts.bytes_ / ticks_);
+    }
+    fprintf(out, "\n%s  }\n", indent);
+  } else {
+    fprintf(out, "%s  \"allocations_per_tick\": null,\n", indent);
+    fprintf(out, "%s  \"allocated_bytes_per_tick\": null\n", indent);
+  }
+  fprintf(out, "%s}", indent);
+}
@@ -0,0 +1,218 @@
+#ifndef PERF_REPORT_H_
+#define PERF_REPORT_H_
+
+#include <stdio.h>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core.h"
+#include "decision_engine.h"
+#include "allocation_counter.h"
+#include "memory_footprint.h"
+
+// Latency histogram
+//
+// counts durations in nanoseconds in buckets a quarter of a power of two
+// wide, so percentiles come out within 25% (below) of the true value, in
+// constant memory however many are recorded
+class LatencyHistogram {
+ public:
+  static const size_t kNumBuckets = 64 * 4;
+
+  void Record(uint64_t ns);
+
+  uint64_t Count() const { return count_; }
+  double MeanNs() const { return count_ ? (double)sum_ns_ / count_ : 0.0; }
+  uint64_t MaxNs() const { return max_ns_; }
+  // the lower bound of the bucket holding the q-th quantile, q in [0, 1]
+  uint64_t QuantileNs(double q) const;
+
+  static size_t Bucket(uint64_t ns);
+  static uint64_t BucketLowerBound(size_t bucket);
+
+ private:
+  std::array<uint64_t, kNumBuckets> buckets_ = {};
+  uint64_t count_ = 0;
+  uint64_t sum_ns_ = 0;
+  uint64_t max_ns_ = 0;
+};
+
+// Heap allocations per DecisionEngine phase
+//
+// counts allocations (see allocation_counter.h) in each phase of every tick,
+// plus those outside any phase, e.g. between ticks or on other threads.
+// Start enables counting. without the allocation hook linked in every count
+// is zero
+class AllocationRecorder : public PhaseObserver {
+ public:
+  // phases, then everything else
+  static const int kOther = kNumEnginePhases;
+  static const int kNumScopes = kNumEnginePhases + 1;
+
+  // enables counting and starts over
+  void Start();
+
+  // implementation of PhaseObserver
+  void BeginPhase(EnginePhase phase) override;
+  void EndPhase(EnginePhase phase) override;
+  void EndTick(CVC* cvc) override;
+
+  int Ticks() const { return ticks_; }
+  // scope is a phase or kOther
+  const AllocationCounts& LastTick(int scope) const {
+    return last_tick_[scope];
+  }
+  AllocationCounts LastTick() const;
+  // since Start
+  AllocationCounts Total(int scope) const;
+  AllocationCounts Total() const;
+  // the most allocations in any one tick since Start
+  uint64_t MaxTickAllocations() const { return max_tick_allocations_; }
+
+  // logs one line for the last tick: the tick then allocations and bytes
+  // for each phase and other
+  void LogTick(CVC* cvc, Logger* logger) const;
+
+  static const char* ScopeName(int scope);
+
+ private:
+  // counter scopes are 0 for other and phase + 1 for phases
+  static int CounterScope(int scope) {
+    return kOther == scope ? 0 : scope + 1;
+  }
+
+  std::array<AllocationCounts, kNumScopes> start_;
+  std::array<AllocationCounts, kNumScopes> previous_;
+  std::array<AllocationCounts, kNumScopes> last_tick_;
+  int ticks_ = 0;
+  uint64_t max_tick_allocations_ = 0;
+};
+
+// Memory footprint by subsystem
+//
+// every window ticks, adds up the MemoryBytes of each subsystem's parts (e.g.
+// every character) and logs the live bytes of each, the most seen in any
+// sample and bytes per character, which is what scales to bigger runs. peaks
+// are of samples, so a spike between them is missed
+class MemoryReport : public PhaseObserver {
+ public:
+  // window of zero only samples when asked to
+  MemoryReport(int window, Logger* logger);
+
+  // parts must outlive the report
+  void AddSubsystem(const char* name,
+                    std::vector<const MemoryFootprint*> parts);
+
+  void Sample();
+  // logs the last sample, one line per subsystem and one for the total
+  void Log(CVC* cvc) const;
+
+  // implementation of PhaseObserver, samples and logs every window ticks
+  void EndTick(CVC* cvc) override;
+
+  size_t NumSubsystems() const { return subsystems_.size(); }
+  const char* Name(size_t subsystem) const {
+    return subsystems_[subsystem].name_;
+  }
+  size_t LiveBytes(size_t subsystem) const {
+    return subsystems_[subsystem].live_bytes_;
+  }
+  size_t PeakBytes(size_t subsystem) const {
+    return subsystems_[subsystem].peak_bytes_;
+  }
+  // of every subsystem
+  size_t LiveBytes() const { return live_bytes_; }
+  size_t PeakBytes() const { return peak_bytes_; }
+
+ private:
+  struct Subsystem {
+    const char* name_;
+    std::vector<const MemoryFootprint*> parts_;
+    size_t live_bytes_;
+    size_t peak_bytes_;
+  };
+
+  int window_;
+  Logger* logger_;
+  std::vector<Subsystem> subsystems_;
+  size_t live_bytes_ = 0;
+  size_t peak_bytes_ = 0;
+};
+
+// Performance of a run
+//
+// observes a DecisionEngine and records wall time per phase, how long each
+// agent takes to choose an action, ticks per second every window ticks, peak
+// resident memory and, with the allocation hook linked in (see
+// allocation_counter.h), heap allocations per tick and phase. WriteJSON
+// writes it all as one JSON object.
+//
+// timing calls the clock twice per phase and per decision, so only observe
+// runs that are being measured
+class PerfRecorder : public PhaseObserver {
+ public:
+  // population is just reported
+  PerfRecorder(size_t population, int window);
+
+  // marks the start of the measured run
+  void Start();
+
+  // implementation of PhaseObserver
+  void BeginPhase(EnginePhase phase) override;
+  void EndPhase(EnginePhase phase) override;
+  void BeginDecision() override;
+  void EndDecision() override;
+  void EndTick(CVC* cvc) override;
+
+  int Ticks() const { return ticks_; }
+  double Seconds() const;
+  double PhaseSeconds(EnginePhase phase) const {
+    return phase_seconds_[phase];
+  }
+  const LatencyHistogram& GetDecisionLatency() const {
+    return decision_latency_;
+  }
+  const AllocationRecorder& GetAllocations() const { return allocations_; }
+
+  // writes the report as a JSON object, each line after the first starting
+  // with indent
+  void WriteJSON(FILE* out, const char* indent) const;
+
+  // the process's peak resident set size, in kilobytes, since the last
+  // ResetPeakRSS, which constructing a recorder does, so each run of a sweep
+  // reports its own. where it can't be reset (not linux, or before 4.0) it's
+  // the peak since the process started
+  static long PeakRSSKb();
+  // false if the peak couldn't be reset
+  static bool ResetPeakRSS();
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Sample {
+    int tick_;
+    double ticks_per_second_;
+    double allocations_per_tick_;
+  };
+
+  size_t population_;
+  int window_;
+
+  Clock::time_point start_;
+  Clock::time_point window_start_;
+  Clock::time_point last_tick_;
+  std::array<Clock::time_point, kNumEnginePhases> phase_start_;
+  std::array<double, kNumEnginePhases> phase_seconds_ = {};
+  Clock::time_point decision_start_;
+  LatencyHistogram decision_latency_;
+
+  int ticks_ = 0;
+  std::vector<Sample> samples_;
+  AllocationRecorder allocations_;
+  uint64_t window_start_allocations_ = 0;
+};
+
+#endif
@@ -0,0 +1,712 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../util.h"
+#include "checkpoint.h"
+
+namespace cvc::sarsa {
+
+namespace {
+
+size_t AlignUp(size_t offset) {
+  return (offset + kCheckpointAlignment - 1) & ~(kCheckpointAlignment - 1);
+}
+
+size_t TableEnd(size_t num_sections) {
+  return AlignUp(sizeof(CheckpointHeader) +
+                 num_sections * sizeof(CheckpointSectionEntry));
+}
+
+} //namespace
+
+uint64_t Checksum(const void* data, size_t length) {
+  // FNV-1a, 64 bit
+  const unsigned char* bytes = (const unsigned char*)data;
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (0xff == exponent) {
+    // inf or nan (keep nans quiet)
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+
+  int half_exponent = (int)exponent - 127 + 15;
+  if (half_exponent >= 0x1f) {
+    // overflow to inf
+    return sign | 0x7c00;
+  }
+  if (half_exponent <= 0) {
+    // subnormal or zero
+    if (half_exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    uint32_t shift = 14 - half_exponent;
+    uint32_t half_mantissa = mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half_mantissa & 1))) {
+      half_mantissa++;
+    }
+    return sign | half_mantissa;
+  }
+
+  uint32_t half = sign | (half_exponent << 10) | (mantissa >> 13);
+  uint32_t remainder = mantissa & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    // may carry into the exponent, which is still correct
+    half++;
+  }
+  return half;
+}
+
+float HalfToFloat(uint16_t value) {
+  uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+
+  uint32_t bits;
+  if (0 == exponent) {
+    if (0 == mantissa) {
+      bits = sign;
+    } else {
+      // subnormal, renormalize
+      exponent = 127 - 15 + 1;
+      while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        exponent--;
+      }
+      mantissa &= 0x3ff;
+      bits = sign | (exponent << 23) | (mantissa << 13);
+    }
+  } else if (0x1f == exponent) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  }
+
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+void CheckpointWriter::BeginSection(const char* name, uint32_t kind,
+                                    uint32_t num_features) {
+  assert(!in_section_);
+  assert(strlen(name) < kCheckpointNameLength);
+
+  data_.resize(AlignUp(data_.size()), 0);
+
+  CheckpointSectionEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  strncpy(entry.name_, name, kCheckpointNameLength - 1);
+  entry.kind_ = kind;
+  entry.num_features_ = num_features;
+  // relative to the start of the payload area until we know the table size
+  entry.offset_ = data_.size();
+  sections_.push_back(entry);
+  in_section_ = true;
+}
+
+void CheckpointWriter::Append(const void* data, size_t length) {
+  assert(in_section_);
+  const char* bytes = (const char*)data;
+  data_.insert(data_.end(), bytes, bytes + length);
+}
+
+void CheckpointWriter::Align() {
+  assert(in_section_);
+  data_.resize(AlignUp(data_.size()), 0);
+}
+
+void CheckpointWriter::EndSection() {
+  assert(in_section_);
+  CheckpointSectionEntry& entry = sections_.back();
+  entry.length_ = data_.size() - entry.offset_;
+  entry.checksum_ = Checksum(data_.data() + entry.offset_, entry.length_);
+  in_section_ = false;
+}
+
+bool CheckpointWriter::Commit(const char* path, Logger* logger) {
+  assert(!in_section_);
+
+  size_t payload_start = TableEnd(sections_.size());
+  std::vector<CheckpointSectionEntry> table(sections_);
+  for (CheckpointSectionEntry& entry : table) {
+    entry.offset_ += payload_start;
+  }
+
+  CheckpointHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic_, kCheckpointMagic, sizeof(header.magic_));
+  header.version_ = kCheckpointVersion;
+  header.num_sections_ = table.size();
+  header.file_size_ = payload_start + data_.size();
+  header.table_checksum_ =
+      Checksum(table.data(), table.size() * sizeof(CheckpointSectionEntry));
+
+  std::string tmp_path = std::string(path) + ".tmp." + std::to_string(getpid());
+  FILE* out = fopen(tmp_path.c_str(), "w");
+  if (!out) {
+    logger->Log(WARN, "could not open checkpoint %s for writing\n",
+                tmp_path.c_str());
+    return false;
+  }
+
+  std::vector<char> padding(payload_start - sizeof(header) -
+                                table.size() * sizeof(CheckpointSectionEntry),
+                            0);
+  bool ok = 1 == fwrite(&header, sizeof(header), 1, out);
+  ok = ok && table.size() == fwrite(table.data(),
+                                    sizeof(CheckpointSectionEntry),
+                                    table.size(), out);
+  ok = ok && padding.size() == fwrite(padding.data(), 1, padding.size(), out);
+  ok = ok && data_.size() == fwrite(data_.data(), 1, data_.size(), out);
+  ok = ok && 0 == fflush(out);
+  ok = ok && 0 == fsync(fileno(out));
+  ok = (0 == fclose(out)) && ok;
+
+  if (!ok || 0 != rename(tmp_path.c_str(), path)) {
+    logger->Log(WARN, "failed writing checkpoint %s\n", path);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<Checkpoint> Checkpoint::Open(const char* path,
+                                             Logger* logger) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    logger->Log(INFO, "no checkpoint at %s\n", path);
+    return nullptr;
+  }
+
+  struct stat st;
+  if (0 != fstat(fd, &st) || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+    logger->Log(WARN, "checkpoint %s is truncated\n", path);
+    close(fd);
+    return nullptr;
+  }
+
+  size_t size = st.st_size;
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == mapping) {
+    logger->Log(WARN, "could not map checkpoint %s\n", path);
+    return nullptr;
+  }
+
+  // from here on the Checkpoint owns the mapping
+  std::unique_ptr<Checkpoint> checkpoint =
+      std::make_unique<Checkpoint>(mapping, size);
+  const CheckpointHeader* header = checkpoint->header_;
+
+  if (0 != memcmp(header->magic_, kCheckpointMagic, sizeof(header->magic_))) {
+    logger->Log(WARN, "%s is not a checkpoint\n", path);
+    return nullptr;
+  }
+  if (kCheckpointVersion != header->version_) {
+    logger->Log(WARN, "checkpoint %s has version %u, expected %u\n", path,
+                header->version_, kCheckpointVersion);
+    return nullptr;
+  }
+  if (size != header->file_size_ ||
+      size < TableEnd(header->num_sections_)) {
+    logger->Log(WARN, "checkpoint %s is truncated\n", path);
+    return nullptr;
+  }
+  if (header->table_checksum_ !=
+      Checksum(checkpoint->sections_,
+               header->num_sections_ * sizeof(CheckpointSectionEntry))) {
+    logger->Log(WARN, "checkpoint %s has a corrupt section table\n", path);
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < header->num_sections_; i++) {
+    const CheckpointSectionEntry* section = checkpoint->GetSection(i);
+    if (section->offset_ % kCheckpointAlignment ||
+        section->offset_ > size || section->length_ > size - section->offset_) {
+      logger->Log(WARN, "checkpoint %s section %u is out of bounds\n", path, i);
+      return nullptr;
+    }
+    if (section->checksum_ !=
+        Checksum(checkpoint->SectionData(section), section->length_)) {
+      logger->Log(WARN, "checkpoint %s section %.*s is corrupt\n", path,
+                  (int)kCheckpointNameLength, section->name_);
+      return nullptr;
+    }
+  }
+
+  return checkpoint;
+}
+
+Checkpoint::Checkpoint(void* mapping, size_t size)
+    : mapping_(mapping),
+      size_(size),
+      data_((const char*)mapping),
+      header_((const CheckpointHeader*)mapping),
+      sections_((const CheckpointSectionEntry*)(data_ +
+                                                sizeof(CheckpointHeader))) {}
+
+Checkpoint::~Checkpoint() { munmap(mapping_, size_); }
+
+const CheckpointSectionEntry* Checkpoint::FindSection(const char* name) const {
+  for (uint32_t i = 0; i < NumSections(); i++) {
+    if (0 == strncmp(name, sections_[i].name_, kCheckpointNameLength)) {
+      return &sections_[i];
+    }
+  }
+  return nullptr;
+}
+
+bool ViewLinearLearner(const Checkpoint& checkpoint, const char* name,
+                       size_t num_features, LinearLearnerView* view,
+                       Logger* logger) {
+  const CheckpointSectionEntry* section = checkpoint.FindSection(name);
+  if (!section) {
+    logger->Log(WARN, "checkpoint has no section for %s\n", name);
+    return false;
+  }
+  if (kLinearLearnerSection != section->kind_ ||
+      num_features != section->num_features_) {
+    logger->Log(WARN,
+                "checkpoint section %s has kind %u with %u features, "
+                "expected kind %u with %zu features\n",
+                name, section->kind_, section->num_features_,
+                kLinearLearnerSection, num_features);
+    return false;
+  }
+
+  size_t array_size = AlignUp(num_features * sizeof(double));
+  size_t weights_offset = AlignUp(sizeof(LearnerSectionHeader));
+  size_t m_offset = weights_offset + array_size;
+  size_t r_offset = m_offset + array_size;
+  size_t stats_offset = r_offset + array_size;
+  size_t expected_length =
+      stats_offset + num_features * sizeof(FeatureStatsRecord);
+  if (section->length_ < expected_length) {
+    logger->Log(WARN, "checkpoint section %s is too short\n", name);
+    return false;
+  }
+
+  const char* data = checkpoint.SectionData(section);
+  view->header_ = (const LearnerSectionHeader*)data;
+  view->weights_ = (const double*)(data + weights_offset);
+  view->m_ = (const double*)(data + m_offset);
+  view->r_ = (const double*)(data + r_offset);
+  view->feature_stats_ = (const FeatureStatsRecord*)(data + stats_offset);
+  return true;
+}
+
+void WriteLinearLearner(CheckpointWriter* writer, const char* name,
+                        const LearnerSectionHeader& header,
+                        const double* weights, const double* m,
+                        const double* r, const Stats* feature_stats) {
+  size_t num_features = header.num_features_;
+  writer->BeginSection(name, kLinearLearnerSection, num_features);
+  writer->Append(&header, sizeof(header));
+  writer->Align();
+  writer->Append(weights, num_features * sizeof(double));
+  writer->Align();
+  writer->Append(m, num_features * sizeof(double));
+  writer->Align();
+  writer->Append(r, num_features * sizeof(double));
+  writer->Align();
+  for (size_t i = 0; i < num_features; i++) {
+    FeatureStatsRecord record;
+    record.n_ = feature_stats[i].n_;
+    record.sum_ = feature_stats[i].sum_;
+    record.ss_ = feature_stats[i].ss_;
+    record.min_ = feature_stats[i].min_;
+    record.max_ = feature_stats[i].max_;
+    writer->Append(&record, sizeof(record));
+  }
+  writer->EndSection();
+}
+
+bool ViewMLPLearner(const Checkpoint& checkpoint, const char* name,
+                    size_t num_features, size_t hidden1, size_t hidden2,
+                    MLPLearnerView* view, Logger* logger) {
+  const CheckpointSectionEntry* section = checkpoint.FindSection(name);
+  if (!section) {
+    logger->Log(WARN, "checkpoint has no section for %s\n", name);
+    return false;
+  }
+  if (kMLPLearnerSection != section->kind_ ||
+      num_features != section->num_features_) {
+    logger->Log(WARN,
+                "checkpoint section %s has kind %u with %u features, "
+                "expected kind %u with %zu features\n",
+                name, section->kind_, section->num_features_,
+                kMLPLearnerSection, num_features);
+    return false;
+  }
+  if (section->length_ < sizeof(MLPSectionHeader)) {
+    logger->Log(WARN, "checkpoint section %s is too short\n", name);
+    return false;
+  }
+
+  const char* data = checkpoint.SectionData(section);
+  const MLPSectionHeader* header = (const MLPSectionHeader*)data;
+  if (hidden1 != header->hidden1_ || hidden2 != header->hidden2_) {
+    logger->Log(WARN,
+                "checkpoint section %s has hidden layers %u, %u, expected "
+                "%zu, %zu\n",
+                name, header->hidden1_, header->hidden2_, hidden1, hidden2);
+    return false;
+  }
+
+  size_t array_size = AlignUp(header->num_params_ * sizeof(double));
+  size_t params_offset = AlignUp(sizeof(MLPSectionHeader));
+  size_t m_offset = params_offset + array_size;
+  size_t r_offset = m_offset + array_size;
+  if (section->length_ < r_offset + header->num_params_ * sizeof(double)) {
+    logger->Log(WARN, "checkpoint section %s is too short\n", name);
+    return false;
+  }
+
+  view->header_ = header;
+  view->params_ = (const double*)(data + params_offset);
+  view->m_ = (const double*)(data + m_offset);
+  view->r_ = (const double*)(data + r_offset);
+  return true;
+}
+
+void WriteMLPLearner(CheckpointWriter* writer, const char* name,
+                     const MLPSectionHeader& header, const double* params,
+                     const double* m, const double* r) {
+  size_t num_params = header.num_params_;
+  writer->BeginSection(name, kMLPLearnerSection, header.num_features_);
+  writer->Append(&header, sizeof(header));
+  writer->Align();
+  writer->Append(params, num_params * sizeof(double));
+  writer->Align();
+  writer->Append(m, num_params * sizeof(double));
+  writer->Align();
+  writer->Append(r, num_params * sizeof(double));
+  writer->EndSection();
+}
+
+namespace {
+
+std::string FeatureNamesSection(const char* name) {
+  return std::string(name) + kFeatureNamesSuffix;
+}
+
+} //namespace
+
+void WriteFeatureNames(CheckpointWriter* writer, const char* name,
+                       const std::vector<std::string>& names) {
+  writer->BeginSection(FeatureNamesSection(name).c_str(), kFeatureNamesSection,
+                       names.size());
+  for (const std::string& feature : names) {
+    writer->Append(feature.c_str(), feature.size() + 1);
+  }
+  writer->EndSection();
+}
+
+bool ReadFeatureNames(const Checkpoint& checkpoint, const char* name,
+                      std::vector<std::string>* names, Logger* logger) {
+  std::string section_name = FeatureNamesSection(name);
+  const CheckpointSectionEntry* section =
+      checkpoint.FindSection(section_name.c_str());
+  if (!section) {
+    return false;
+  }
+  if (kFeatureNamesSection != section->kind_) {
+    logger->Log(WARN, "checkpoint section %s has kind %u, expected %u\n",
+                section_name.c_str(), section->kind_, kFeatureNamesSection);
+    return false;
+  }
+
+  names->clear();
+  const char* data = checkpoint.SectionData(section);
+  const char* end = data + section->length_;
+  while (data < end && names->size() < section->num_features_) {
+    const char* terminator = (const char*)memchr(data, '\0', end - data);
+    if (!terminator) {
+      break;
+    }
+    names->emplace_back(data, terminator);
+    data = terminator + 1;
+  }
+  if (names->size() != section->num_features_) {
+    logger->Log(WARN, "checkpoint section %s is truncated\n",
+                section_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+std::string HashedTableSection(const char* name) {
+  return std::string(name) + kHashedTableSuffix;
+}
+
+} //namespace
+
+bool ViewHashedTable(const Checkpoint& checkpoint, const char* name,
+                     size_t num_rows, HashedTableView* view, Logger* logger) {
+  std::string section_name = HashedTableSection(name);
+  const CheckpointSectionEntry* section =
+      checkpoint.FindSection(section_name.c_str());
+  if (!section) {
+    return false;
+  }
+  if (kHashedTableSection != section->kind_ ||
+      section->length_ < sizeof(HashedTableHeader)) {
+    logger->Log(WARN, "checkpoint section %s has kind %u, expected %u\n",
+                section_name.c_str(), section->kind_, kHashedTableSection);
+    return false;
+  }
+
+  const char* data = checkpoint.SectionData(section);
+  const HashedTableHeader* header = (const HashedTableHeader*)data;
+  if (num_rows != header->num_rows_) {
+    logger->Log(WARN, "checkpoint section %s has %u rows, expected %zu\n",
+                section_name.c_str(), header->num_rows_, num_rows);
+    return false;
+  }
+
+  size_t array_size = AlignUp(num_rows * sizeof(double));
+  size_t weights_offset = AlignUp(sizeof(HashedTableHeader));
+  size_t m_offset = weights_offset + array_size;
+  size_t r_offset = m_offset + array_size;
+  size_t t_offset = r_offset + array_size;
+  if (section->length_ < t_offset + num_rows * sizeof(int64_t)) {
+    logger->Log(WARN, "checkpoint section %s is too short\n",
+                section_name.c_str());
+    return false;
+  }
+
+  view->header_ = header;
+  view->weights_ = (const double*)(data + weights_offset);
+  view->m_ = (const double*)(data + m_offset);
+  view->r_ = (const double*)(data + r_offset);
+  view->t_ = (const int64_t*)(data + t_offset);
+  return true;
+}
+
+void WriteHashedTable(CheckpointWriter* writer, const char* name,
+                      const HashedTableHeader& header, const double* weights,
+                      const double* m, const double* r, const int64_t* t) {
+  size_t num_rows = header.num_rows_;
+  writer->BeginSection(HashedTableSection(name).c_str(), kHashedTableSection,
+                       0);
+  writer->Append(&header, sizeof(header));
+  writer->Align();
+  writer->Append(weights, num_rows * sizeof(double));
+  writer->Align();
+  writer->Append(m, num_rows * sizeof(double));
+  writer->Align();
+  writer->Append(r, num_rows * sizeof(double));
+  writer->Align();
+  writer->Append(t, num_rows * sizeof(int64_t));
+  writer->EndSection();
+}
+
+bool ViewQuantizedLinear(const Checkpoint& checkpoint, const char* name,
+                         size_t num_features, QuantizedLinearView* view,
+                         Logger* logger) {
+  const CheckpointSectionEntry* section = checkpoint.FindSection(name);
+  if (!section) {
+    logger->Log(WARN, "checkpoint has no section for %s\n", name);
+    return false;
+  }
+
+  size_t weight_size;
+  if (kInt8LinearSection == section->kind_) {
+    view->format_ = kInt8Weights;
+    weight_size = sizeof(int8_t);
+  } else if (kFp16LinearSection == section->kind_) {
+    view->format_ = kFp16Weights;
+    weight_size = sizeof(uint16_t);
+  } else {
+    logger->Log(WARN, "checkpoint section %s has kind %u, not quantized\n",
+                name, section->kind_);
+    return false;
+  }
+  if (num_features != section->num_features_) {
+    logger->Log(WARN,
+                "checkpoint section %s has %u features, expected %zu\n", name,
+                section->num_features_, num_features);
+    return false;
+  }
+
+  size_t weights_offset = AlignUp(sizeof(QuantizedSectionHeader));
+  if (section->length_ < weights_offset + num_features * weight_size) {
+    logger->Log(WARN, "checkpoint section %s is too short\n", name);
+    return false;
+  }
+
+  const char* data = checkpoint.SectionData(section);
+  view->header_ = (const QuantizedSectionHeader*)data;
+  view->int8_weights_ = nullptr;
+  view->fp16_weights_ = nullptr;
+  if (kInt8Weights == view->format_) {
+    view->int8_weights_ = (const int8_t*)(data + weights_offset);
+  } else {
+    view->fp16_weights_ = (const uint16_t*)(data + weights_offset);
+  }
+  return true;
+}
+
+void WriteQuantizedLinear(CheckpointWriter* writer, const char* name,
+                          int32_t learner_id, const double* weights,
+                          size_t num_features, WeightFormat format) {
+  QuantizedSectionHeader header;
+  memset(&header, 0, sizeof(header));
+  header.learner_id_ = learner_id;
+  header.num_features_ = num_features;
+  header.scale_ = 1.0;
+
+  if (kInt8Weights == format) {
+    // symmetric quantization against the largest weight
+    double max_weight = 0.0;
+    for (size_t i = 0; i < num_features; i++) {
+      max_weight = std::max(max_weight, std::abs(weights[i]));
+    }
+    if (max_weight > 0.0) {
+      header.scale_ = max_weight / 127.0;
+    }
+  }
+
+  writer->BeginSection(
+      name, kInt8Weights == format ? kInt8LinearSection : kFp16LinearSection,
+      num_features);
+  writer->Append(&header, sizeof(header));
+  writer->Align();
+  for (size_t i = 0; i < num_features; i++) {
+    if (kInt8Weights == format) {
+      int8_t q = (int8_t)std::lround(weights[i] / header.scale_);
+      writer->Append(&q, sizeof(q));
+    } else {
+      uint16_t h = FloatToHalf((float)weights[i]);
+      writer->Append(&h, sizeof(h));
+    }
+  }
+  writer->EndSection();
+}
+
+bool SaveCheckpoint(
+    const char* path,
+    const std::unordered_map<std::string, Checkpointable*>& learners,
+    Logger* logger) {
+  CheckpointWriter writer;
+  for (const auto& learner : learners) {
+    learner.second->WriteCheckpoint(&writer, learner.first.c_str());
+    if (!learner.second->GetFeatureNames().empty()) {
+      WriteFeatureNames(&writer, learner.first.c_str(),
+                        learner.second->GetFeatureNames());
+    }
+  }
+  return writer.Commit(path, logger);
+}
+
+bool SaveQuantizedCheckpoint(
+    const char* path,
+    const std::unordered_map<std::string, Checkpointable*>& learners,
+    WeightFormat format, Logger* logger) {
+  CheckpointWriter writer;
+  for (const auto& learner : learners) {
+    if (!learner.second->WriteQuantizedCheckpoint(&writer,
+                                                  learner.first.c_str(),
+                                                  format)) {
+      logger->Log(WARN, "%s can't be quantized, leaving it out\n",
+                  learner.first.c_str());
+    } else if (!learner.second->GetFeatureNames().empty()) {
+      WriteFeatureNames(&writer, learner.first.c_str(),
+                        learner.second->GetFeatureNames());
+    }
+  }
+  return writer.Commit(path, logger);
+}
+
+namespace {
+
+// restores one learner, remapping its features by name if their layout
+// changed since the checkpoint. false if it wasn't restored
+bool LoadLearner(const Checkpoint& checkpoint, const char* name,
+                 Checkpointable* learner, Logger* logger) {
+  const std::vector<std::string>& names = learner->GetFeatureNames();
+  std::vector<std::string> file_names;
+  if (names.empty() ||
+      !ReadFeatureNames(checkpoint, name, &file_names, logger) ||
+      names == file_names) {
+    return learner->ReadCheckpoint(checkpoint, name, logger);
+  }
+
+  //the feature layout changed since the checkpoint, match features by name
+  std::unordered_map<std::string, int> file_index;
+  for (size_t i = 0; i < file_names.size(); i++) {
+    file_index[file_names[i]] = i;
+  }
+  std::vector<int> file_features(names.size(), -1);
+  for (size_t i = 0; i < names.size(); i++) {
+    auto index = file_index.find(names[i]);
+    if (index == file_index.end()) {
+      logger->Log(INFO, "%s feature %s is new, keeping its current state\n",
+                  name, names[i].c_str());
+      continue;
+    }
+    file_features[i] = index->second;
+    file_index.erase(index);
+  }
+  for (const auto& dropped : file_index) {
+    logger->Log(INFO, "%s feature %s is no longer used, dropping it\n", name,
+                dropped.first.c_str());
+  }
+  return learner->ReadRemappedCheckpoint(checkpoint, name, file_features,
+                                         file_names.size(), logger);
+}
+
+}
+
+bool LoadCheckpoint(
+    const char* path,
+    const std::unordered_map<std::string, Checkpointable*>& learners,
+    Logger* logger, std::vector<std::string>* not_restored) {
+  std::unique_ptr<Checkpoint> checkpoint = Checkpoint::Open(path, logger);
+  if (!checkpoint) {
+    return false;
+  }
+  bool restored_all = true;
+  for (const auto& learner : learners) {
+    if (!LoadLearner(*checkpoint, learner.first.c_str(), learner.second,
+                     logger)) {
+      logger->Log(WARN, "%s was not restored from %s\n",
+                  learner.first.c_str(), path);
+      if (not_restored) {
+        not_restored->push_back(learner.first);
+      }
+      restored_all = false;
+    }
+  }
+  return restored_all;
+}
+
+} //namespace cvc::sarsa
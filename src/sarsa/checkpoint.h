@@ -0,0 +1,356 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../util.h"
+
+namespace cvc::sarsa {
+
+// Binary model checkpoints
+//
+// layout (native byte order, every offset is from the start of the file):
+//
+//  CheckpointHeader                    64 bytes
+//  CheckpointSectionEntry[n]           128 bytes each
+//  section payloads                    each starting on a 64 byte boundary
+//
+// each section carries a FNV-1a checksum of its payload and the section table
+// carries a checksum of itself, so corrupt or truncated files are rejected
+// instead of silently loading garbage.
+// files are written to a temporary file and renamed into place, so readers
+// never observe a partially written checkpoint. Readers mmap the file
+// read-only, so a model can be shared by many processes and parts of it used
+// in place without copying (see LinearLearnerView).
+
+const char kCheckpointMagic[8] = {'C', 'V', 'C', 'C', 'K', 'P', 'T', '\0'};
+const uint32_t kCheckpointVersion = 1;
+const size_t kCheckpointAlignment = 64;
+const size_t kCheckpointNameLength = 64;
+
+enum CheckpointSectionKind : uint32_t {
+  kLinearLearnerSection = 1,
+  kInt8LinearSection = 2,
+  kFp16LinearSection = 3,
+  kMLPLearnerSection = 4,
+  kFeatureNamesSection = 5,
+  kHashedTableSection = 6,
+};
+
+// storage formats for quantized (inference only) weight exports
+enum WeightFormat {
+  kInt8Weights,
+  kFp16Weights,
+};
+
+struct CheckpointHeader {
+  char magic_[8];
+  uint32_t version_;
+  uint32_t num_sections_;
+  uint64_t file_size_;
+  uint64_t table_checksum_;
+  uint8_t reserved_[32];
+};
+static_assert(sizeof(CheckpointHeader) == 64, "header must be 64 bytes");
+
+struct CheckpointSectionEntry {
+  char name_[kCheckpointNameLength];
+  uint32_t kind_;
+  uint32_t num_features_;
+  uint64_t offset_;
+  uint64_t length_;
+  uint64_t checksum_;
+  uint8_t reserved_[32];
+};
+static_assert(sizeof(CheckpointSectionEntry) == 128,
+              "section entries must be 128 bytes");
+
+// linear learner section payload:
+//  LearnerSectionHeader
+//  double weights[N]              (64 byte aligned)
+//  double m[N]                    (64 byte aligned) ADAM first moment
+//  double r[N]                    (64 byte aligned) ADAM second moment
+//  FeatureStatsRecord stats[N]    (64 byte aligned)
+struct LearnerSectionHeader {
+  int32_t learner_id_;
+  uint32_t num_features_;
+  int64_t t_; //ADAM step count
+  double n_;
+  double g_;
+  double b1_;
+  double b2_;
+  double epsilon_;
+  double lambda_; //zero if the learner doesn't use eligibility traces
+};
+static_assert(sizeof(LearnerSectionHeader) == 64,
+              "learner header must be 64 bytes");
+
+struct FeatureStatsRecord {
+  int64_t n_;
+  double sum_;
+  double ss_;
+  double min_;
+  double max_;
+};
+
+// quantized linear section payload:
+//  QuantizedSectionHeader
+//  int8_t or uint16_t (IEEE half) weights[N]     (64 byte aligned)
+// int8 weights are symmetric, w_i ~= scale * q_i, fp16 weights ignore scale
+struct QuantizedSectionHeader {
+  int32_t learner_id_;
+  uint32_t num_features_;
+  double scale_;
+  uint8_t reserved_[48];
+};
+static_assert(sizeof(QuantizedSectionHeader) == 64,
+              "quantized header must be 64 bytes");
+
+// mlp learner section payload:
+//  MLPSectionHeader
+//  double params[P]               (64 byte aligned)
+//  double m[P]                    (64 byte aligned) ADAM first moment
+//  double r[P]                    (64 byte aligned) ADAM second moment
+// P is num_params_, the layout of params is up to the learner (see
+// MLPLearner), hidden sizes are recorded so mismatched models are rejected
+struct MLPSectionHeader {
+  int32_t learner_id_;
+  uint32_t num_features_;
+  int64_t t_; //ADAM step count
+  double n_;
+  double g_;
+  double b1_;
+  double b2_;
+  double epsilon_;
+  uint16_t hidden1_;
+  uint16_t hidden2_; //zero if there's only one hidden layer
+  uint32_t num_params_;
+};
+static_assert(sizeof(MLPSectionHeader) == 64, "mlp header must be 64 bytes");
+
+// feature names section payload, written next to the section of any learner
+// that knows its feature names, named after it plus kFeatureNamesSuffix:
+//  char names[]                   num_features_ NUL terminated names
+const char kFeatureNamesSuffix[] = ".features";
+
+// hashed feature table section payload, written next to the section of a
+// learner with a hashed table (see hashed_features.h), named after it plus
+// kHashedTableSuffix:
+//  HashedTableHeader
+//  double weights[S]              (64 byte aligned)
+//  double m[S]                    (64 byte aligned) ADAM first moment
+//  double r[S]                    (64 byte aligned) ADAM second moment
+//  int64_t t[S]                   (64 byte aligned) step of each row's last
+//                                 update
+// S is num_rows_, a power of two
+const char kHashedTableSuffix[] = ".hashed";
+
+struct HashedTableHeader {
+  uint32_t num_rows_;
+  uint32_t reserved0_;
+  double max_weight_; //largest |weight| seen, bounds hashed scores
+  uint8_t reserved_[48];
+};
+static_assert(sizeof(HashedTableHeader) == 64,
+              "hashed table header must be 64 bytes");
+
+uint64_t Checksum(const void* data, size_t length);
+
+// IEEE 754 binary16 conversions, round to nearest even
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+// accumulates sections in memory and writes them out in one go
+class CheckpointWriter {
+ public:
+  void BeginSection(const char* name, uint32_t kind, uint32_t num_features);
+  void Append(const void* data, size_t length);
+  // pads the current section so the next Append is 64 byte aligned
+  void Align();
+  void EndSection();
+
+  // atomically replaces path with the sections written so far
+  bool Commit(const char* path, Logger* logger);
+
+ private:
+  std::vector<CheckpointSectionEntry> sections_;
+  std::vector<char> data_;
+  bool in_section_ = false;
+};
+
+// a read-only, memory mapped checkpoint
+class Checkpoint {
+ public:
+  // returns nullptr (and logs why) if the file is missing or invalid
+  static std::unique_ptr<Checkpoint> Open(const char* path, Logger* logger);
+
+  Checkpoint(void* mapping, size_t size);
+  ~Checkpoint();
+
+  Checkpoint(const Checkpoint&) = delete;
+  Checkpoint& operator=(const Checkpoint&) = delete;
+
+  uint32_t NumSections() const { return header_->num_sections_; }
+  const CheckpointSectionEntry* GetSection(uint32_t i) const {
+    return &sections_[i];
+  }
+  const CheckpointSectionEntry* FindSection(const char* name) const;
+  const char* SectionData(const CheckpointSectionEntry* section) const {
+    return data_ + section->offset_;
+  }
+
+ private:
+  void* mapping_;
+  size_t size_;
+  const char* data_;
+  const CheckpointHeader* header_;
+  const CheckpointSectionEntry* sections_;
+};
+
+// points into a mapped linear learner section, valid as long as the
+// Checkpoint it came from
+struct LinearLearnerView {
+  const LearnerSectionHeader* header_;
+  const double* weights_;
+  const double* m_;
+  const double* r_;
+  const FeatureStatsRecord* feature_stats_;
+};
+
+bool ViewLinearLearner(const Checkpoint& checkpoint, const char* name,
+                       size_t num_features, LinearLearnerView* view,
+                       Logger* logger);
+
+void WriteLinearLearner(CheckpointWriter* writer, const char* name,
+                        const LearnerSectionHeader& header,
+                        const double* weights, const double* m,
+                        const double* r, const Stats* feature_stats);
+
+struct MLPLearnerView {
+  const MLPSectionHeader* header_;
+  const double* params_;
+  const double* m_;
+  const double* r_;
+};
+
+bool ViewMLPLearner(const Checkpoint& checkpoint, const char* name,
+                    size_t num_features, size_t hidden1, size_t hidden2,
+                    MLPLearnerView* view, Logger* logger);
+
+void WriteMLPLearner(CheckpointWriter* writer, const char* name,
+                     const MLPSectionHeader& header, const double* params,
+                     const double* m, const double* r);
+
+void WriteFeatureNames(CheckpointWriter* writer, const char* name,
+                       const std::vector<std::string>& names);
+
+// returns false if the checkpoint has no (valid) feature names for name
+bool ReadFeatureNames(const Checkpoint& checkpoint, const char* name,
+                      std::vector<std::string>* names, Logger* logger);
+
+struct HashedTableView {
+  const HashedTableHeader* header_;
+  const double* weights_;
+  const double* m_;
+  const double* r_;
+  const int64_t* t_;
+};
+
+// returns false if the checkpoint has no (valid) hashed table for name
+bool ViewHashedTable(const Checkpoint& checkpoint, const char* name,
+                     size_t num_rows, HashedTableView* view, Logger* logger);
+
+void WriteHashedTable(CheckpointWriter* writer, const char* name,
+                      const HashedTableHeader& header, const double* weights,
+                      const double* m, const double* r, const int64_t* t);
+
+struct QuantizedLinearView {
+  const QuantizedSectionHeader* header_;
+  WeightFormat format_;
+  // one of these is set, depending on format_
+  const int8_t* int8_weights_;
+  const uint16_t* fp16_weights_;
+};
+
+bool ViewQuantizedLinear(const Checkpoint& checkpoint, const char* name,
+                         size_t num_features, QuantizedLinearView* view,
+                         Logger* logger);
+
+void WriteQuantizedLinear(CheckpointWriter* writer, const char* name,
+                          int32_t learner_id, const double* weights,
+                          size_t num_features, WeightFormat format);
+
+// anything that can save and restore its state in a checkpoint section
+class Checkpointable {
+ public:
+  virtual ~Checkpointable() {}
+
+  virtual void WriteCheckpoint(CheckpointWriter* writer,
+                               const char* name) const = 0;
+  // returns false (leaving state untouched) if the section is missing or
+  // doesn't match
+  virtual bool ReadCheckpoint(const Checkpoint& checkpoint, const char* name,
+                              Logger* logger) = 0;
+
+  // writes a reduced precision, inference only copy of the model
+  // returns false if the model doesn't support the format
+  virtual bool WriteQuantizedCheckpoint(CheckpointWriter* writer,
+                                        const char* name,
+                                        WeightFormat format) const {
+    return false;
+  }
+
+  // like ReadCheckpoint, for a section written with a different feature
+  // layout. file_features[i] is the section's index for our feature i, or -1
+  // if the section doesn't have it (those features keep their current state)
+  virtual bool ReadRemappedCheckpoint(const Checkpoint& checkpoint,
+                                      const char* name,
+                                      const std::vector<int>& file_features,
+                                      size_t num_file_features,
+                                      Logger* logger) {
+    logger->Log(WARN, "%s can't be remapped to a new feature layout\n", name);
+    return false;
+  }
+
+  // names of the model's input features, if known. they're saved with the
+  // model so checkpoints from a different layout can be detected and
+  // remapped by name
+  void SetFeatureNames(std::vector<std::string> names) {
+    feature_names_ = std::move(names);
+  }
+  const std::vector<std::string>& GetFeatureNames() const {
+    return feature_names_;
+  }
+
+ private:
+  std::vector<std::string> feature_names_;
+};
+
+bool SaveCheckpoint(
+    const char* path,
+    const std::unordered_map<std::string, Checkpointable*>& learners,
+    Logger* logger);
+
+bool SaveQuantizedCheckpoint(
+    const char* path,
+    const std::unordered_map<std::string, Checkpointable*>& learners,
+    WeightFormat format, Logger* logger);
+
+// loads every learner found in the checkpoint, learners without a section (or
+// whose section they reject) keep their current state and are logged and
+// added to not_restored, if it isn't null. learners whose feature names
+// differ from the ones recorded with their section are remapped by name.
+// returns false if the file itself couldn't be used or any learner wasn't
+// restored.
+bool LoadCheckpoint(
+    const char* path,
+    const std::unordered_map<std::string, Checkpointable*>& learners,
+    Logger* logger, std::vector<std::string>* not_restored = nullptr);
+
+} //namespace cvc::sarsa
+
+#endif
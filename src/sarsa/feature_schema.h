@@ -0,0 +1,140 @@
+#ifndef FEATURE_SCHEMA_H_
+#define FEATURE_SCHEMA_H_
+
+#include <array>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace cvc::sarsa {
+
+// Compile time feature layouts
+//
+// a feature is a type with a name, a width (how many slots it fills) and an
+// Extract that fills them from some context:
+//
+//  struct LogMoneyFeature : Feature {
+//    static constexpr const char* kName = "log_money";
+//    template <typename T, class Context>
+//    static void Extract(const Context& context, T* out) { ... }
+//  };
+//
+// a FeatureSchema lists features once, everything else (the number of
+// features, each feature's offset, extraction and the names recorded in
+// checkpoints) is derived from that list. features that are always zero
+// (e.g. placeholders for features we haven't worked out yet) derive from
+// DeadFeature and are dropped from the schema, so they cost no storage, no
+// dot product terms and no ADAM updates.
+
+struct Feature {
+  static constexpr size_t kWidth = 1;
+  static constexpr bool kDead = false;
+};
+
+struct DeadFeature : Feature {
+  static constexpr bool kDead = true;
+
+  template <typename T, class Context>
+  static void Extract(const Context& context, T* out) {}
+};
+
+// the first feature of every schema
+struct BiasFeature : Feature {
+  static constexpr const char* kName = "bias";
+
+  template <typename T, class Context>
+  static void Extract(const Context& context, T* out) {
+    out[0] = 1.0;
+  }
+};
+
+template <class... Features>
+struct FeatureList {};
+
+namespace internal {
+
+template <class List, class... Features>
+struct LiveFeatures;
+
+template <class... Live>
+struct LiveFeatures<FeatureList<Live...>> {
+  typedef FeatureList<Live...> type;
+};
+
+template <class... Live, class First, class... Rest>
+struct LiveFeatures<FeatureList<Live...>, First, Rest...> {
+  typedef typename std::conditional<
+      First::kDead, LiveFeatures<FeatureList<Live...>, Rest...>,
+      LiveFeatures<FeatureList<Live..., First>, Rest...>>::type::type type;
+};
+
+template <class F, class... Features>
+struct OffsetOf;
+
+template <class F, class... Rest>
+struct OffsetOf<F, F, Rest...> {
+  static constexpr size_t value = 0;
+};
+
+template <class F, class First, class... Rest>
+struct OffsetOf<F, First, Rest...> {
+  static constexpr size_t value = First::kWidth + OffsetOf<F, Rest...>::value;
+};
+
+template <class F>
+struct OffsetOf<F> {
+  static_assert(sizeof(F) == 0, "feature is not in the schema (or is dead)");
+};
+
+template <class List>
+struct Layout;
+
+template <class... Features>
+struct Layout<FeatureList<Features...>> {
+  static constexpr size_t kNumFeatures = (Features::kWidth + ... + 0);
+
+  template <class F>
+  static constexpr size_t Offset() {
+    return OffsetOf<F, Features...>::value;
+  }
+
+  template <typename T, class Context>
+  static std::array<T, kNumFeatures> Extract(const Context& context) {
+    std::array<T, kNumFeatures> features;
+    T* out = features.data();
+    ((Features::Extract(context, out), out += Features::kWidth), ...);
+    return features;
+  }
+
+  static std::vector<std::string> Names() {
+    std::vector<std::string> names;
+    (AppendNames<Features>(&names), ...);
+    return names;
+  }
+
+ private:
+  // wide features are named name[i]
+  template <class F>
+  static void AppendNames(std::vector<std::string>* names) {
+    if (1 == F::kWidth) {
+      names->push_back(F::kName);
+      return;
+    }
+    for (size_t i = 0; i < F::kWidth; i++) {
+      names->push_back(std::string(F::kName) + "[" + std::to_string(i) + "]");
+    }
+  }
+};
+
+} //namespace internal
+
+// the live features of Features..., in order
+template <class... Features>
+struct FeatureSchema
+    : internal::Layout<
+          typename internal::LiveFeatures<FeatureList<>, Features...>::type> {
+};
+
+} //namespace cvc::sarsa
+
+#endif
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "../core.h"
+#include "feature_service.h"
+
+namespace cvc::sarsa {
+
+namespace {
+
+// money is heavy tailed, keep it on a log scale so it doesn't swamp the other
+// features
+double LogMoney(double money) {
+  return std::log1p(std::max(money, 0.0));
+}
+
+// opinions are sums of +/-25ish modifiers
+double ScaleOpinion(double opinion) {
+  return opinion / 100.0;
+}
+
+} //namespace
+
+void FeatureService::Refresh(CVC* cvc) {
+  if (cvc == cvc_ && cvc->Now() == tick_) {
+    return;
+  }
+  cvc_ = cvc;
+  tick_ = cvc->Now();
+
+  characters_ = cvc->GetCharacters();
+  size_t n = characters_.size();
+  index_.clear();
+  CharacterFeatures empty = CharacterFeatures();
+  empty.min_opinion_by_ = empty.min_opinion_of_ =
+      std::numeric_limits<double>::infinity();
+  empty.max_opinion_by_ = empty.max_opinion_of_ =
+      -std::numeric_limits<double>::infinity();
+  character_features_.assign(n, empty);
+  opinions_.assign(n * n, 0.0);
+  by_money_sorted_ = false;
+  row_character_ = nullptr;
+
+  // one pass over every pair, using the characters' cached opinions (which
+  // they keep up to date as relationships change) rather than recomputing
+  // them like CVC::ComputeStats does
+  double money = 0.0;
+  double opinion = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    Character* character = characters_[i];
+    index_[character] = i;
+    money += character->GetMoney();
+    character_features_[i].log_money_ = LogMoney(character->GetMoney());
+    for (size_t j = 0; j < n; j++) {
+      if (i == j) {
+        continue;
+      }
+      double opinion_of = character->GetOpinionOf(characters_[j]);
+      opinions_[i * n + j] = ScaleOpinion(opinion_of);
+      CharacterFeatures& by = character_features_[i];
+      CharacterFeatures& of = character_features_[j];
+      by.opinion_by_ += opinion_of;
+      by.min_opinion_by_ = std::min(by.min_opinion_by_, opinion_of);
+      by.max_opinion_by_ = std::max(by.max_opinion_by_, opinion_of);
+      of.opinion_of_ += opinion_of;
+      of.min_opinion_of_ = std::min(of.min_opinion_of_, opinion_of);
+      of.max_opinion_of_ = std::max(of.max_opinion_of_, opinion_of);
+      opinion += opinion_of;
+    }
+  }
+
+  for (CharacterFeatures& features : character_features_) {
+    if (n > 1) {
+      features.opinion_by_ = ScaleOpinion(features.opinion_by_ / (n - 1));
+      features.opinion_of_ = ScaleOpinion(features.opinion_of_ / (n - 1));
+      features.min_opinion_by_ = ScaleOpinion(features.min_opinion_by_);
+      features.max_opinion_by_ = ScaleOpinion(features.max_opinion_by_);
+      features.min_opinion_of_ = ScaleOpinion(features.min_opinion_of_);
+      features.max_opinion_of_ = ScaleOpinion(features.max_opinion_of_);
+    } else {
+      features = CharacterFeatures();
+      features.log_money_ = LogMoney(characters_[0]->GetMoney());
+    }
+  }
+  global_.log_mean_money_ = n > 0 ? LogMoney(money / n) : 0.0;
+  global_.mean_opinion_ = n > 1 ? ScaleOpinion(opinion / (n * (n - 1))) : 0.0;
+}
+
+const FeatureService::GlobalFeatures& FeatureService::Global(CVC* cvc) {
+  Refresh(cvc);
+  return global_;
+}
+
+const FeatureService::CharacterFeatures& FeatureService::ForCharacter(
+    CVC* cvc, Character* character) {
+  Refresh(cvc);
+  auto index = index_.find(character);
+  assert(index != index_.end());
+  return character_features_[index->second];
+}
+
+const std::vector<FeatureService::CharacterFeatures>&
+FeatureService::ForCharacters(CVC* cvc) {
+  Refresh(cvc);
+  return character_features_;
+}
+
+FeatureService::PairFeatures FeatureService::ForPair(CVC* cvc,
+                                                     Character* character,
+                                                     Character* target) {
+  Refresh(cvc);
+  auto target_index = index_.find(target);
+  assert(target_index != index_.end());
+  size_t j = target_index->second;
+  if (character == row_character_) {
+    return row_[j];
+  }
+
+  auto index = index_.find(character);
+  assert(index != index_.end());
+  size_t i = index->second;
+  size_t n = characters_.size();
+  PairFeatures features;
+  features.opinion_of_target_ = opinions_[i * n + j];
+  features.target_opinion_ = opinions_[j * n + i];
+  features.target_log_money_ = character_features_[j].log_money_;
+  return features;
+}
+
+const std::vector<FeatureService::PairFeatures>& FeatureService::ForTargets(
+    CVC* cvc, Character* character) {
+  Refresh(cvc);
+  if (character == row_character_) {
+    return row_;
+  }
+
+  auto index = index_.find(character);
+  assert(index != index_.end());
+  size_t c = index->second;
+  size_t n = characters_.size();
+  row_.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    PairFeatures& features = row_[i];
+    if (i == c) {
+      features = PairFeatures();
+      continue;
+    }
+    features.opinion_of_target_ = opinions_[c * n + i];
+    features.target_opinion_ = opinions_[i * n + c];
+    features.target_log_money_ = character_features_[i].log_money_;
+  }
+  row_character_ = character;
+  return row_;
+}
+
+const std::vector<Character*>& FeatureService::Characters(CVC* cvc) {
+  Refresh(cvc);
+  return characters_;
+}
+
+const std::vector<size_t>& FeatureService::ByMoney(CVC* cvc) {
+  Refresh(cvc);
+  if (by_money_sorted_) {
+    return by_money_;
+  }
+
+  if (by_money_.size() != characters_.size()) {
+    by_money_.resize(characters_.size());
+    for (size_t i = 0; i < by_money_.size(); i++) {
+      by_money_[i] = i;
+    }
+  }
+  auto less = [this](size_t a, size_t b) {
+    double money_a = character_features_[a].log_money_;
+    double money_b = character_features_[b].log_money_;
+    return money_a < money_b || (money_a == money_b && a < b);
+  };
+  // give up on the repair if the order changed a lot (e.g. the first tick)
+  size_t moves = 0;
+  size_t max_moves = 8 * by_money_.size();
+  for (size_t i = 1; i < by_money_.size() && moves <= max_moves; i++) {
+    size_t index = by_money_[i];
+    size_t j = i;
+    for (; j > 0 && less(index, by_money_[j - 1]); j--, moves++) {
+      by_money_[j] = by_money_[j - 1];
+    }
+    by_money_[j] = index;
+  }
+  if (moves > max_moves) {
+    std::sort(by_money_.begin(), by_money_.end(), less);
+  }
+  by_money_sorted_ = true;
+  return by_money_;
+}
+
+} //namespace cvc::sarsa
@@ -0,0 +1,89 @@
+#ifndef FEATURE_SERVICE_H_
+#define FEATURE_SERVICE_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "../core.h"
+
+namespace cvc::sarsa {
+
+// features shared by every sarsa factory, so each is computed at most once a
+// tick no matter how many factories or targets ask for it
+//
+// global and per character features are computed together, once per tick, in
+// a single pass over the population, which also keeps every pair's opinion.
+// pair features are read from those, a whole row of targets at a time,
+// memoized for the most recent character (Give and Ask enumerate the same
+// character back to back, so they share a row).
+// values are snapshots from the first request in a tick, like CVC's own stats,
+// opinions included, so a pair's money and opinions agree even when they're
+// asked for while actions are evaluated (e.g. responses). changes made by
+// those actions show up next tick. the opinions take n^2 doubles.
+// not thread safe
+class FeatureService {
+ public:
+  struct GlobalFeatures {
+    double log_mean_money_;
+    double mean_opinion_; //scaled to roughly [-1, 1]
+  };
+
+  struct CharacterFeatures {
+    double log_money_;
+    double opinion_by_; //mean opinion character has of others
+    double opinion_of_; //mean opinion others have of character
+    // ranges of the above, bounds on this character's pair features
+    double min_opinion_by_;
+    double max_opinion_by_;
+    double min_opinion_of_;
+    double max_opinion_of_;
+  };
+
+  struct PairFeatures {
+    double opinion_of_target_;
+    double target_opinion_; //target's opinion of character
+    double target_log_money_;
+  };
+
+  const GlobalFeatures& Global(CVC* cvc);
+  const CharacterFeatures& ForCharacter(CVC* cvc, Character* character);
+  // everyone's features, indexed like Characters
+  const std::vector<CharacterFeatures>& ForCharacters(CVC* cvc);
+  PairFeatures ForPair(CVC* cvc, Character* character, Character* target);
+  // character's features towards everyone, in CVC::GetCharacters order
+  // the entry for character itself is meaningless
+  // valid until the next call with a different character or tick
+  const std::vector<PairFeatures>& ForTargets(CVC* cvc, Character* character);
+
+  // the characters features are indexed by, CVC::GetCharacters as of this tick
+  const std::vector<Character*>& Characters(CVC* cvc);
+  // indices of Characters in ascending order of log_money_ (ties by index)
+  // kept from tick to tick and repaired with an insertion sort, which is
+  // close to linear since only a few characters' money changes each tick
+  const std::vector<size_t>& ByMoney(CVC* cvc);
+
+ private:
+  // starts over if the tick (or game) changed since the last request
+  void Refresh(CVC* cvc);
+
+  CVC* cvc_ = nullptr;
+  int tick_ = -1;
+
+  GlobalFeatures global_;
+
+  std::vector<Character*> characters_;
+  std::unordered_map<const Character*, size_t> index_;
+  std::vector<CharacterFeatures> character_features_;
+  // scaled opinion of characters_[i] of characters_[j] at i * n + j
+  std::vector<double> opinions_;
+
+  std::vector<size_t> by_money_;
+  bool by_money_sorted_ = false;
+
+  Character* row_character_ = nullptr;
+  std::vector<PairFeatures> row_;
+};
+
+} //namespace cvc::sarsa
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef HASHED_FEATURES_H_
+#define HASHED_FEATURES_H_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+namespace cvc::sarsa {
+
+// Sparse features hashed into a fixed size weight table
+//
+// dense feature vectors can't hold one-hot features over identities (which
+// target, which organization, which trait) since N would grow with the
+// population. instead each active sparse feature is a hashed key, learners
+// with a hashed table (see SARSALearner::EnableHashedFeatures) add
+// table[key % size] * value to the dense score and only update the rows of
+// the active keys, so the cost is proportional to the number of active
+// features, not the size of the table. unrelated keys may collide, which the
+// dense features have to make up for.
+
+// what a hashed key identifies, so equal ids of different kinds don't share a
+// row
+enum HashedFeatureKind : uint32_t {
+  kTargetIdentityFeature = 1,
+  kActorTargetFeature = 2,
+};
+
+inline uint32_t HashFeature(HashedFeatureKind kind, uint64_t id) {
+  // splitmix64 finalizer
+  uint64_t x = id + 0x9e3779b97f4a7c15ULL * (1 + (uint64_t)kind);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x = x ^ (x >> 31);
+  return (uint32_t)x;
+}
+
+inline uint32_t HashFeature(HashedFeatureKind kind, uint32_t a, uint32_t b) {
+  return HashFeature(kind, ((uint64_t)a << 32) | b);
+}
+
+// the (few) active hashed features of one experience
+struct HashedFeatures {
+  static constexpr size_t kMaxActive = 4;
+
+  void Add(uint32_t key, double value = 1.0) {
+    assert(count_ < kMaxActive);
+    keys_[count_] = key;
+    values_[count_] = value;
+    count_++;
+  }
+
+  size_t Size() const { return count_; }
+
+  std::array<uint32_t, kMaxActive> keys_;
+  std::array<double, kMaxActive> values_;
+  size_t count_ = 0;
+};
+
+} //namespace cvc::sarsa
+
+#endif
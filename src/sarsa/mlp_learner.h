@@ -0,0 +1,328 @@
+#ifndef MLP_LEARNER_H_
+#define MLP_LEARNER_H_
+
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <random>
+
+#include "../util.h"
+#include "../core.h"
+#include "checkpoint.h"
+#include "sarsa_learner.h"
+
+namespace cvc::sarsa {
+
+// rows of a batch that go through the whole network together. a block of
+// activations for every layer plus the (small) weight matrices stay in L1, so
+// each layer reads its input straight out of cache
+const size_t kMLPBlockRows = 16;
+
+// y = relu?(x * w + b) for one block of R rows
+// activations within a block are stored feature major (x is In x R and y is
+// Out x R), so the inner loop runs over rows against a broadcast weight and
+// vectorizes whatever the layer shape. w is In x Out, b is Out. a single row
+// (R of 1) is just a feature vector, summed in the same order as in a block
+template <size_t In, size_t Out, size_t R = kMLPBlockRows, typename T>
+void DenseBlock(const T* __restrict x, const T* __restrict w,
+                const T* __restrict b, bool relu, T* __restrict y) {
+  for (size_t o = 0; o < Out; o++) {
+    T* __restrict y_o = y + o * R;
+    for (size_t r = 0; r < R; r++) {
+      y_o[r] = b[o];
+    }
+    for (size_t i = 0; i < In; i++) {
+      const T w_io = w[i * Out + o];
+      const T* __restrict x_i = x + i * R;
+      for (size_t r = 0; r < R; r++) {
+        y_o[r] += w_io * x_i[r];
+      }
+    }
+    if (relu) {
+      for (size_t r = 0; r < R; r++) {
+        y_o[r] = y_o[r] > 0 ? y_o[r] : 0;
+      }
+    }
+  }
+}
+
+// Q-function approximated by a small multilayer perceptron:
+//  N features -> H1 ReLU units -> (optionally) H2 ReLU units -> score
+// trained with the same n-step SARSA target and ADAM optimizer as
+// SARSALearner, so it can be swapped in for any factory's linear learner.
+// every parameter lives in one flat array (see the offsets below), which
+// keeps the optimizer and checkpointing to a single loop/copy.
+template <size_t N, size_t H1, size_t H2 = 0, typename T = double>
+class MLPLearner : public Learner<N, T> {
+ public:
+  static_assert(H1 > 0, "need at least one hidden layer");
+  static_assert(sizeof(std::array<T, N>) == N * sizeof(T),
+                "feature vectors must be packed to be read as a matrix");
+
+  static constexpr size_t kLastHidden = H2 > 0 ? H2 : H1;
+
+  // parameter layout, every matrix is input major
+  static constexpr size_t kW1 = 0;
+  static constexpr size_t kB1 = kW1 + N * H1;
+  static constexpr size_t kW2 = kB1 + H1;
+  static constexpr size_t kB2 = kW2 + H1 * H2;
+  static constexpr size_t kW3 = kB2 + H2;
+  static constexpr size_t kB3 = kW3 + kLastHidden;
+  static constexpr size_t kNumParams = kB3 + 1;
+
+  //creates a randomly initialized learner
+  static std::unique_ptr<MLPLearner> Create(int learner_id, double n, double g,
+                                            double b1, double b2,
+                                            std::mt19937& random_generator,
+                                            Logger* learn_logger) {
+    std::array<T, kNumParams> params;
+    params.fill(0.0);
+
+    // He initialization for the ReLU layers, small positive biases so units
+    // start out alive
+    std::uniform_real_distribution<> w1_dist(-sqrt(6.0 / N), sqrt(6.0 / N));
+    for (size_t i = 0; i < N * H1; i++) {
+      params[kW1 + i] = w1_dist(random_generator);
+    }
+    for (size_t i = 0; i < H1; i++) {
+      params[kB1 + i] = 0.01;
+    }
+    std::uniform_real_distribution<> w2_dist(-sqrt(6.0 / H1), sqrt(6.0 / H1));
+    for (size_t i = 0; i < H1 * H2; i++) {
+      params[kW2 + i] = w2_dist(random_generator);
+    }
+    for (size_t i = 0; i < H2; i++) {
+      params[kB2 + i] = 0.01;
+    }
+    std::uniform_real_distribution<> w3_dist(-sqrt(1.0 / kLastHidden),
+                                             sqrt(1.0 / kLastHidden));
+    for (size_t i = 0; i < kLastHidden; i++) {
+      params[kW3 + i] = w3_dist(random_generator);
+    }
+
+    return std::make_unique<MLPLearner>(learner_id, n, g, b1, b2, params,
+                                        learn_logger);
+  }
+
+  MLPLearner(int learner_id, double n, double g, double b1, double b2,
+             const std::array<T, kNumParams>& params, Logger* learn_logger)
+      : learner_id_(learner_id),
+        n_(n),
+        g_(g),
+        params_(params),
+        b1_(b1),
+        b2_(b2),
+        learn_logger_(learn_logger) {
+    m_.fill(0.0);
+    r_.fill(0.0);
+  }
+
+  double Learn(CVC* cvc, ExperienceImpl<N, T>* experience) override {
+    Action* action = experience->action_.get();
+    assert(action);
+
+    //same loss and target as SARSALearner, (y_hat - y)^2 against the n-step
+    //return, backpropagated through the hidden layers
+    //a single row, so it's forwarded as a one row block, no padding
+    const T* x = experience->features_.data();
+    std::array<T, H1> h1;
+    std::array<T, H2> h2;
+    T y;
+    Forward<1>(x, h1.data(), h2.data(), &y);
+
+    double updated_score = y;
+    double truth_estimate = DiscountedReturn(experience, g_);
+    double loss = pow(updated_score - truth_estimate, 2);
+    double dL_dy = 2 * (updated_score - truth_estimate);
+    assert(!std::isinf(dL_dy));
+
+    LogLearnStep(learn_logger_, cvc, learner_id_, experience,
+                 experience->features_, loss, dL_dy, updated_score,
+                 truth_estimate);
+
+    std::array<T, kNumParams> grad;
+    Backward(x, h1.data(), h2.data(), dL_dy, &grad);
+    ApplyGradient(grad);
+
+    return dL_dy;
+  }
+
+  double Score(const std::array<T, N> features) const override {
+    double score;
+    ScoreBatch(&features, 1, &score);
+    return score;
+  }
+
+  void ScoreBatch(const std::array<T, N>* features, size_t count,
+                  double* scores) const override {
+    const size_t R = kMLPBlockRows;
+    std::array<T, N * R> x;
+    std::array<T, H1 * R> h1;
+    std::array<T, H2 * R> h2;
+    std::array<T, R> y;
+    for (size_t start = 0; start < count; start += R) {
+      size_t rows = std::min(R, count - start);
+      // transpose into a feature major block, zero padding a partial block
+      for (size_t r = 0; r < R; r++) {
+        for (size_t i = 0; i < N; i++) {
+          x[i * R + r] = r < rows ? features[start + r][i] : 0;
+        }
+      }
+      Forward(x.data(), h1.data(), h2.data(), y.data());
+      for (size_t r = 0; r < rows; r++) {
+        assert(!std::isinf(y[r]));
+        assert(!std::isnan(y[r]));
+        scores[start + r] = y[r];
+      }
+    }
+  }
+
+  void WriteCheckpoint(CheckpointWriter* writer,
+                       const char* name) const override {
+    MLPSectionHeader header;
+    memset(&header, 0, sizeof(header));
+    header.learner_id_ = learner_id_;
+    header.num_features_ = N;
+    header.t_ = t_;
+    header.n_ = n_;
+    header.g_ = g_;
+    header.b1_ = b1_;
+    header.b2_ = b2_;
+    header.epsilon_ = epsilon_;
+    header.hidden1_ = H1;
+    header.hidden2_ = H2;
+    header.num_params_ = kNumParams;
+    // sections always hold doubles, whatever precision we train in
+    std::array<double, kNumParams> params;
+    std::array<double, kNumParams> m;
+    std::array<double, kNumParams> r;
+    for (size_t i = 0; i < kNumParams; i++) {
+      params[i] = params_[i];
+      m[i] = m_[i];
+      r[i] = r_[i];
+    }
+    WriteMLPLearner(writer, name, header, params.data(), m.data(), r.data());
+  }
+
+  bool ReadCheckpoint(const Checkpoint& checkpoint, const char* name,
+                      Logger* logger) override {
+    MLPLearnerView view;
+    if (!ViewMLPLearner(checkpoint, name, N, H1, H2, &view, logger)) {
+      return false;
+    }
+    if (kNumParams != view.header_->num_params_) {
+      logger->Log(WARN, "checkpoint section %s has %u parameters, expected "
+                  "%zu\n", name, view.header_->num_params_, kNumParams);
+      return false;
+    }
+
+    t_ = view.header_->t_;
+    for (size_t i = 0; i < kNumParams; i++) {
+      params_[i] = view.params_[i];
+      m_[i] = view.m_[i];
+      r_[i] = view.r_[i];
+    }
+    return true;
+  }
+
+  size_t MemoryBytes() const override { return sizeof(*this); }
+
+ private:
+  // scores one feature major block of R rows, keeping the hidden activations
+  // in h1 and h2 (H1 x R and H2 x R)
+  template <size_t R = kMLPBlockRows>
+  void Forward(const T* x, T* h1, T* h2, T* y) const {
+    DenseBlock<N, H1, R>(x, &params_[kW1], &params_[kB1], true, h1);
+    const T* last = h1;
+    if constexpr (H2 > 0) {
+      DenseBlock<H1, H2, R>(h1, &params_[kW2], &params_[kB2], true, h2);
+      last = h2;
+    }
+    DenseBlock<kLastHidden, 1, R>(last, &params_[kW3], &params_[kB3], false,
+                                  y);
+  }
+
+  // gradient of the loss w.r.t. every parameter for a single row, given the
+  // activations from Forward and dL/dy
+  void Backward(const T* x, const T* h1, const T* h2, double dL_dy,
+                std::array<T, kNumParams>* grad) const {
+    const T* last = H2 > 0 ? h2 : h1;
+    const T d_y = dL_dy;
+
+    // output layer, the ReLU derivative is 1 where the unit was active
+    std::array<T, kLastHidden> d_last;
+    for (size_t j = 0; j < kLastHidden; j++) {
+      (*grad)[kW3 + j] = d_y * last[j];
+      d_last[j] = last[j] > 0 ? d_y * params_[kW3 + j] : 0;
+    }
+    (*grad)[kB3] = d_y;
+
+    std::array<T, H1> d_h1;
+    if constexpr (H2 > 0) {
+      for (size_t i = 0; i < H1; i++) {
+        T sum = 0;
+        for (size_t j = 0; j < H2; j++) {
+          (*grad)[kW2 + i * H2 + j] = h1[i] * d_last[j];
+          sum += params_[kW2 + i * H2 + j] * d_last[j];
+        }
+        d_h1[i] = h1[i] > 0 ? sum : 0;
+      }
+      for (size_t j = 0; j < H2; j++) {
+        (*grad)[kB2 + j] = d_last[j];
+      }
+    } else {
+      d_h1 = d_last;
+    }
+
+    for (size_t k = 0; k < N; k++) {
+      for (size_t i = 0; i < H1; i++) {
+        (*grad)[kW1 + k * H1 + i] = x[k] * d_h1[i];
+      }
+    }
+    for (size_t i = 0; i < H1; i++) {
+      (*grad)[kB1 + i] = d_h1[i];
+    }
+  }
+
+  // one ADAM step, as in SARSALearner::ApplyGradient
+  void ApplyGradient(const std::array<T, kNumParams>& grad) {
+    t_ += 1;
+    double m_correction = 1.0 - pow(b1_, t_);
+    double r_correction = 1.0 - pow(b2_, t_);
+    for (size_t i = 0; i < kNumParams; i++) {
+      m_[i] = b1_*m_[i] + (1.0-b1_)*grad[i];
+      r_[i] = b2_*r_[i] + (1.0-b2_)*(grad[i] * grad[i]);
+      double m_hat = m_[i] / m_correction;
+      double r_hat = r_[i] / r_correction;
+      double update = n_ * m_hat / sqrt(r_hat + epsilon_);
+
+      assert(!std::isinf(update));
+      assert(!std::isnan(update));
+      params_[i] = params_[i] - update;
+    }
+  }
+
+  int learner_id_;
+
+  double n_; //learning rate
+  double g_; //discount factor
+  std::array<T, kNumParams> params_;
+
+  //adam optimizer params and state
+  double b1_;
+  double b2_;
+  double epsilon_ = .000000001; //10^-8
+  int t_ = 0;
+  std::array<T, kNumParams> m_;
+  std::array<T, kNumParams> r_;
+
+  Logger* learn_logger_;
+};
+
+} //namespace cvc::sarsa
+
+#endif
@@ -4,16 +4,103 @@
 #include <random>
 #include <limits>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <memory>
 
 #include "../core.h"
 #include "../action.h"
+#include "../event_log.h"
 #include "sarsa_learner.h"
 #include "sarsa_action_factories.h"
 
 namespace cvc::sarsa {
 
+namespace {
+
+// values ExpBlock works on at once, a few vectors' worth
+const size_t kSoftmaxBlock = 8;
+
+// the smallest argument ExpBlock takes, whose exp is still a normal double
+const double kMinExpBlock = -708.0;
+
+// exp(x[i]) for kMinExpBlock <= x[i] <= 0, to about 1e-15 relative, as plain
+// arithmetic the compiler vectorizes (libm's exp is a call per value without
+// -ffast-math, and clamping here would be a branch it won't vectorize).
+// x = n ln2 + r with |r| <= ln2 / 2, then e^r by its Taylor series and 2^n
+// straight into the exponent bits. y may be x
+void ExpBlock(const double* x, double* y) {
+  const double kLog2e = 1.4426950408889634;
+  const double kLn2Hi = 6.93147180369123816490e-01;
+  const double kLn2Lo = 1.90821492927058770002e-10;
+  // adding this rounds to an integer held in the low mantissa bits
+  const double kRound = 6755399441055744.0;
+  for (size_t i = 0; i < kSoftmaxBlock; i++) {
+    double v = x[i];
+    double shifted = v * kLog2e + kRound;
+    double n = shifted - kRound;
+    double r = (v - n * kLn2Hi) - n * kLn2Lo;
+    double p = 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+    uint64_t bits;
+    memcpy(&bits, &shifted, sizeof(bits));
+    bits = (bits + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    y[i] = p * scale;
+  }
+}
+
+// how many options score strictly higher than (*actions)[choice]
+size_t ChoiceRank(const std::vector<std::unique_ptr<Experience>>& actions,
+                  size_t choice) {
+  double score = actions[choice]->action_->GetScore();
+  size_t rank = 0;
+  for (const std::unique_ptr<Experience>& experience : actions) {
+    if (experience->action_->GetScore() > score) {
+      rank++;
+    }
+  }
+  return rank;
+}
+
+void LogChoice(EventLog* events, CVC* cvc, Character* character,
+               const std::vector<std::unique_ptr<Experience>>& actions,
+               size_t choice, size_t rank, double probability) {
+  events->LogPolicy({cvc->Now(), character ? character->GetId() : -1,
+                     actions[choice]->action_->GetActionId(),
+                     actions[choice]->action_->GetScore(), probability, rank,
+                     actions.size()});
+}
+
+} //namespace
+
+std::unique_ptr<Experience> GreedyPolicy::ChooseAction(
+    std::vector<std::unique_ptr<Experience>>* actions, CVC* cvc,
+    Character* character) {
+  assert(actions->size() > 0);
+
+  std::unique_ptr<Experience>* best_action = &actions->front();
+  for (std::unique_ptr<Experience>& experience : *actions) {
+    if (experience->action_->GetScore() >
+        (*best_action)->action_->GetScore()) {
+      best_action = &experience;
+    }
+  }
+  return std::move(*best_action);
+}
+
 std::unique_ptr<Experience> EpsilonGreedyPolicy::ChooseAction(
     std::vector<std::unique_ptr<Experience>>* actions, CVC* cvc,
     Character* character) {
@@ -22,33 +109,51 @@ std::unique_ptr<Experience> EpsilonGreedyPolicy::ChooseAction(
 
   assert(actions->size() > 0);
 
+  // with an EventLog only the choice is logged, as an event
+  EventLog* events = logger_->GetEventLog();
+
   //best or random?
   std::uniform_real_distribution<> dist(0.0, 1.0);
   double e = dist(*cvc->GetRandomGenerator());
   double best_score = std::numeric_limits<double>::lowest();
   std::unique_ptr<Experience>* best_action = nullptr;
   if(dist(*cvc->GetRandomGenerator()) > epsilon_) {
-    logger_->Log(INFO, "choosing best (%f > %f)\n", e, epsilon_);
+    if (!events) {
+      logger_->Log(INFO, "choosing best (%f > %f)\n", e, epsilon_);
+    }
     //best choice
     for(std::unique_ptr<Experience>& experience : *actions) {
-      logger_->Log(INFO, "option %s with score %f\n",
-                   experience->action_->GetActionId(),
-                   experience->action_->GetScore());
+      if (!events) {
+        logger_->Log(INFO, "option %s with score %f\n",
+                     experience->action_->GetActionId(),
+                     experience->action_->GetScore());
+      }
       if(experience->action_->GetScore() > best_score) {
         best_score = experience->action_->GetScore();
         best_action = &experience;
       }
     }
   } else {
-    logger_->Log(INFO, "choosing random (%f >= %f)\n", e, epsilon_);
+    if (!events) {
+      logger_->Log(INFO, "choosing random (%f >= %f)\n", e, epsilon_);
+    }
     //random choice
     int choice = dist(*cvc->GetRandomGenerator()) * actions->size();
     best_score = (*actions)[choice]->action_->GetScore();
     best_action = &(*actions)[choice];
   }
   assert(best_action);
-  logger_->Log(INFO, "chose %s with score %f\n",
-               (*best_action)->action_->GetActionId(), best_score);
+  if (events) {
+    // the best option (ties aside) also comes up when choosing at random
+    size_t choice = best_action - actions->data();
+    size_t rank = ChoiceRank(*actions, choice);
+    double prob = epsilon_ / actions->size() + (0 == rank ? 1.0 - epsilon_
+                                                          : 0.0);
+    LogChoice(events, cvc, character, *actions, choice, rank, prob);
+  } else {
+    logger_->Log(INFO, "chose %s with score %f\n",
+                 (*best_action)->action_->GetActionId(), best_score);
+  }
   return std::move(*best_action);
 }
 
@@ -56,9 +161,8 @@ std::unique_ptr<Experience> SoftmaxPolicy::ChooseAction(
     std::vector<std::unique_ptr<Experience>>* actions, CVC* cvc,
     Character* character) {
   assert(actions->size() > 0);
-
-  double scores[actions->size()];
-  double sum_score = 0.0;
+  assert(temperature_ > 0.0);
+  size_t count = actions->size();
 
   //sort by score so index corresponds to ordering
   //however, this is quite slow if there are a lot of choices
@@ -68,36 +172,69 @@ std::unique_ptr<Experience> SoftmaxPolicy::ChooseAction(
               return a->action_->GetScore() > b->action_->GetScore();
             });*/
 
-  for (size_t i = 0; i < actions->size(); i++) {
-    scores[i] = exp((*actions)[i]->action_->GetScore() / temperature_);
-    assert(!std::isinf(scores[i]));
-    assert(!std::isnan(scores[i]));
-    sum_score += scores[i];
+  // the scores are gathered in one tight pass, which is what a large
+  // candidate set spends its time on: every option is two pointers away, and
+  // independent loads let the cpu have many cache misses in flight at once.
+  // the rest runs over the contiguous, cached scratch (per thread, reused)
+  thread_local std::vector<double> scratch;
+  size_t padded = (count + kSoftmaxBlock - 1) / kSoftmaxBlock * kSoftmaxBlock;
+  scratch.resize(padded);
+  double* weights = scratch.data();
+  double max_score = std::numeric_limits<double>::lowest();
+  for (size_t i = 0; i < count; i++) {
+    weights[i] = (*actions)[i]->action_->GetScore();
+    assert(!std::isnan(weights[i]));
+    max_score = std::max(max_score, weights[i]);
   }
 
+  // exp((s_i - max) / t) is at most 1, so this can't overflow however low the
+  // temperature, and the best option contributes exactly 1 so the sum can't
+  // underflow to zero either. options more than 708 temperatures below the
+  // best weigh 2^-1021 rather than nothing, padding isn't summed
+  double inverse_temperature = 1.0 / temperature_;
+  for (size_t i = 0; i < count; i++) {
+    weights[i] =
+        std::max(kMinExpBlock, (weights[i] - max_score) * inverse_temperature);
+  }
+  for (size_t i = count; i < padded; i++) {
+    weights[i] = kMinExpBlock;
+  }
+  double sum_score = 0.0;
+  for (size_t start = 0; start < padded; start += kSoftmaxBlock) {
+    ExpBlock(weights + start, weights + start);
+  }
+  for (size_t i = 0; i < count; i++) {
+    sum_score += weights[i];
+  }
+  assert(sum_score >= 1.0);
+  assert(!std::isinf(sum_score));
+
   // TODO: this is very sensitive to have the best option overwhelmed by
   // numerous "similar" actions (e.g. a single work action compared to an ask
   // action for every other character)
 
-  // choose one according to softmax
+  // choose one according to softmax, by inverse cdf
   std::uniform_real_distribution<> dist(0.0, 1.0);
-  double choice = dist(*cvc->GetRandomGenerator());
-  double sum_prob = 0.0;
-
-  for (size_t i = 0; i < actions->size(); i++) {
-    sum_prob += scores[i]/sum_score;
-    if (choice < sum_prob) {
-      logger_->Log(INFO,
-                   "%d chose %s with score %f with prob %f (choice %f temp %f) at "
-                   "position %zu of %zu\n", cvc->Now(),
-                   (*actions)[i]->action_->GetActionId(),
-                   (*actions)[i]->action_->GetScore(), scores[i] / sum_score,
-                   choice, temperature_, i, actions->size());
-      assert((*actions)[i]->action_->IsValid(cvc));
-      return std::move((*actions)[i]);
-    }
+  double pick = dist(*cvc->GetRandomGenerator()) * sum_score;
+  size_t i = 0;
+  while (i + 1 < count && pick >= weights[i]) {
+    pick -= weights[i];
+    i++;
+  }
+  double prob = weights[i] / sum_score;
+  if (EventLog* events = logger_->GetEventLog()) {
+    LogChoice(events, cvc, character, *actions, i, ChoiceRank(*actions, i),
+              prob);
+  } else {
+    logger_->Log(INFO,
+                 "%d chose %s with score %f with prob %f (temp %f) at "
+                 "position %zu of %zu\n", cvc->Now(),
+                 (*actions)[i]->action_->GetActionId(),
+                 (*actions)[i]->action_->GetScore(), prob, temperature_, i,
+                 count);
   }
-  abort();
+  assert((*actions)[i]->action_->IsValid(cvc));
+  return std::move((*actions)[i]);
 }
 
 std::unique_ptr<Experience> AnnealingSoftmaxPolicy::ChooseAction(
@@ -3,129 +3,555 @@
 
 #include <vector>
 #include <unordered_map>
+#include <utility>
 #include <random>
 #include <memory>
 #include <set>
 #include <cassert>
 #include <array>
 #include <limits>
+#include <algorithm>
+#include <functional>
+#include <cmath>
 
 #include "../decision_engine.h"
 #include "sarsa_agent.h"
 #include "sarsa_learner.h"
+#include "feature_service.h"
+#include "feature_schema.h"
+#include "hashed_features.h"
 
 namespace cvc::sarsa {
 
-template <size_t N>
-std::array<double, N> StandardFeatures(CVC* cvc, Character* character,
-                                       std::array<double, N> features) {
-  features[0] = 1.0; //bias
-  features[1] = 0.0;//character->GetMoney();//log(character->GetMoney());
-  features[2] = 0.0;//log(cvc->GetMoneyStats().mean_);
-  features[3] = 0.0;//cvc->GetOpinionStats().mean_/100.0;
-  features[4] = 0.0;//cvc->GetOpinionByStats(character->GetId()).mean_/100.0;
-  features[5] = 0.0;//cvc->GetOpinionOfStats(character->GetId()).mean_/100.0;
-
-  return features;
+// what the sarsa features are extracted from, everything has been computed
+// (once per tick) by a FeatureService. pair_ is only needed by features about
+// a target
+struct FeatureContext {
+  const FeatureService::GlobalFeatures* global_;
+  const FeatureService::CharacterFeatures* own_;
+  const FeatureService::PairFeatures* pair_;
+};
+
+inline FeatureContext MakeFeatureContext(
+    FeatureService* service, CVC* cvc, Character* character,
+    const FeatureService::PairFeatures* pair = nullptr) {
+  return {&service->Global(cvc), &service->ForCharacter(cvc, character), pair};
 }
 
-template <size_t N>
-std::array<double, N> TargetFeatures(CVC* cvc, Character* character,
-                                     Character* target,
-                                     std::array<double, N> features) {
-  StandardFeatures(cvc, character, features);
-  features[6] = 0.0;//character->GetOpinionOf(target) / 100.0;
-  features[7] = 0.0;//target->GetOpinionOf(character) / 100.0;
-  features[8] = 0.0;//target->GetMoney();//log(target->GetMoney());
-  //TODO: this should be relationship between character and target money
-  features[9] = 0.0;
-
-  return features;
+struct LogMoneyFeature : Feature {
+  static constexpr const char* kName = "log_money";
+  template <typename T>
+  static void Extract(const FeatureContext& context, T* out) {
+    out[0] = context.own_->log_money_;
+  }
+};
+
+struct LogMeanMoneyFeature : Feature {
+  static constexpr const char* kName = "log_mean_money";
+  template <typename T>
+  static void Extract(const FeatureContext& context, T* out) {
+    out[0] = context.global_->log_mean_money_;
+  }
+};
+
+struct MeanOpinionFeature : Feature {
+  static constexpr const char* kName = "mean_opinion";
+  template <typename T>
+  static void Extract(const FeatureContext& context, T* out) {
+    out[0] = context.global_->mean_opinion_;
+  }
+};
+
+struct OpinionByFeature : Feature {
+  static constexpr const char* kName = "opinion_by";
+  template <typename T>
+  static void Extract(const FeatureContext& context, T* out) {
+    out[0] = context.own_->opinion_by_;
+  }
+};
+
+struct OpinionOfFeature : Feature {
+  static constexpr const char* kName = "opinion_of";
+  template <typename T>
+  static void Extract(const FeatureContext& context, T* out) {
+    out[0] = context.own_->opinion_of_;
+  }
+};
+
+struct OpinionOfTargetFeature : Feature {
+  static constexpr const char* kName = "opinion_of_target";
+  template <typename T>
+  static void Extract(const FeatureContext& context, T* out) {
+    out[0] = context.pair_->opinion_of_target_;
+  }
+};
+
+struct TargetOpinionFeature : Feature {
+  static constexpr const char* kName = "target_opinion";
+  template <typename T>
+  static void Extract(const FeatureContext& context, T* out) {
+    out[0] = context.pair_->target_opinion_;
+  }
+};
+
+struct TargetLogMoneyFeature : Feature {
+  static constexpr const char* kName = "target_log_money";
+  template <typename T>
+  static void Extract(const FeatureContext& context, T* out) {
+    out[0] = context.pair_->target_log_money_;
+  }
+};
+
+//TODO: this should be relationship between character and target money
+struct MoneyRelationshipFeature : DeadFeature {
+  static constexpr const char* kName = "money_relationship";
+};
+
+// every sarsa schema starts with the standard features
+template <class... Extra>
+using SARSASchema =
+    FeatureSchema<BiasFeature, LogMoneyFeature, LogMeanMoneyFeature,
+                  MeanOpinionFeature, OpinionByFeature, OpinionOfFeature,
+                  Extra...>;
+
+typedef SARSASchema<> StandardSchema;
+// features about a character and one of the other characters
+typedef SARSASchema<OpinionOfTargetFeature, TargetOpinionFeature,
+                    TargetLogMoneyFeature, MoneyRelationshipFeature>
+    TargetSchema;
+
+const size_t kStandardFeatures = StandardSchema::kNumFeatures;
+const size_t kTargetFeatures = TargetSchema::kNumFeatures;
+
+// hashed one-hot features for who the target is, globally and to character,
+// for learners with a hashed table
+inline HashedFeatures TargetIdentityFeatures(Character* character,
+                                             Character* target) {
+  HashedFeatures hashed;
+  hashed.Add(HashFeature(kTargetIdentityFeature, (uint64_t)target->GetId()));
+  hashed.Add(HashFeature(kActorTargetFeature, (uint32_t)character->GetId(),
+                         (uint32_t)target->GetId()));
+  return hashed;
 }
 
-class SARSAGiveActionFactory : public SARSAActionFactory<10> {
+// candidate targets and their features, scored all at once
+template <size_t N, typename T>
+struct CandidateBatch {
+  // per thread scratch space, reused across calls so enumerating candidates
+  // doesn't allocate once the buffers have grown to the population size
+  static CandidateBatch* ThreadLocal() {
+    thread_local CandidateBatch batch;
+    batch.Clear();
+    return &batch;
+  }
+
+  void Clear() {
+    targets_.clear();
+    features_.clear();
+    hashed_.clear();
+    scores_.clear();
+  }
+
+  size_t Size() const { return targets_.size(); }
+
+  void Add(Character* target, const std::array<T, N>& features) {
+    targets_.push_back(target);
+    features_.push_back(features);
+  }
+
+  // hashed_ is only kept once some candidate has hashed features
+  void Add(Character* target, const std::array<T, N>& features,
+           const HashedFeatures& hashed) {
+    hashed_.resize(Size());
+    Add(target, features);
+    hashed_.push_back(hashed);
+  }
+
+  // one ScoreBatch call over the whole feature matrix, the linear learner
+  // scores it in blocks of rows (see SARSALearner::ScoreBatch), hashed
+  // features are looked up per candidate after
+  void Score(const Learner<N, T>* learner) {
+    scores_.resize(Size());
+    learner->ScoreBatch(features_.data(), Size(), scores_.data());
+    for (size_t i = 0; i < hashed_.size(); i++) {
+      scores_[i] += learner->ScoreHashed(hashed_[i]);
+    }
+  }
+
+  // wraps candidate i, with its hashed features if it has any
+  std::unique_ptr<Experience> Wrap(Learner<N, T>* learner, size_t i,
+                                   std::unique_ptr<Action> action) const {
+    if (i < hashed_.size()) {
+      return learner->WrapAction(features_[i], hashed_[i], std::move(action),
+                                 scores_[i]);
+    }
+    return learner->WrapAction(features_[i], std::move(action), scores_[i]);
+  }
+
+  std::vector<Character*> targets_;
+  std::vector<std::array<T, N>> features_;
+  std::vector<HashedFeatures> hashed_;
+  std::vector<double> scores_;
+  std::vector<size_t> order_;
+};
+
+// materializes experiences only for the best top_k of the scored candidates
+// [begin, end) of batch (best first, ties go to the earlier candidate),
+// make_action builds the action for a target
+// returns the best score, or 0.0 if there were no candidates
+template <size_t N, typename T, class MakeAction>
+double MaterializeBest(Learner<N, T>* learner, CandidateBatch<N, T>* batch,
+                       size_t begin, size_t end, size_t top_k,
+                       MakeAction make_action,
+                       std::vector<std::unique_ptr<Experience>>* actions) {
+  if (begin == end) {
+    return 0.0;
+  }
+  assert(batch->scores_.size() >= end);
+  const std::vector<double>& scores = batch->scores_;
+
+  if (top_k <= 1) {
+    size_t best = begin;
+    for (size_t i = begin + 1; i < end; i++) {
+      if (scores[i] > scores[best]) {
+        best = i;
+      }
+    }
+    actions->push_back(
+        batch->Wrap(learner, best, make_action(batch->targets_[best])));
+    return scores[best];
+  }
+
+  std::vector<size_t>& order = batch->order_;
+  order.clear();
+  for (size_t i = begin; i < end; i++) {
+    order.push_back(i);
+  }
+  size_t k = std::min(top_k, end - begin);
+  std::partial_sort(order.begin(), order.begin() + k, order.end(),
+                    [&scores](size_t a, size_t b) {
+                      return scores[a] > scores[b] ||
+                             (scores[a] == scores[b] && a < b);
+                    });
+  for (size_t i = 0; i < k; i++) {
+    size_t candidate = order[i];
+    actions->push_back(batch->Wrap(learner, candidate,
+                                   make_action(batch->targets_[candidate])));
+  }
+  return scores[order[0]];
+}
+
+// how SARSATargetActionFactory finds its best targets
+enum TargetSearch {
+  // score every target
+  kScanTargets,
+  // best first over targets ordered by their money feature, stopping once no
+  // remaining target can beat the best found so far. exact (up to rounding)
+  kExactTargetIndex,
+  // like kExactTargetIndex, but gives up after max_candidates targets
+  kApproximateTargetIndex,
+};
+
+// an action directed at one of the other characters, the best target(s)
+// according to the learner are offered to the policy
+// candidates are either scored per character in EnumerateActions or, when
+// registered with the DecisionEngine as a BatchScorer, queued for a whole
+// group of characters in PrepareActions and scored in one ScorePending pass
+// top_k > 1 offers the policy the best few targets rather than just the best
+//
+// with a linear learner a target's score is a constant for the character, plus
+// its two opinion features, plus its money feature. the opinion features are
+// bounded by the character's opinion ranges, so walking targets in order of
+// their money term gives an upper bound on every target not yet scored. the
+// target indexes use that to skip most targets, other learners always scan
+//
+// learners with a hashed table also learn per target values (see
+// TargetIdentityFeatures), which the index bounds by the learner's HashedBound
+template <typename T>
+class SARSATargetActionFactory : public SARSAActionFactory<TargetSchema, T> {
  public:
-  SARSAGiveActionFactory(SARSALearner<10> learner)
-      : SARSAActionFactory<10>(learner) {}
+  SARSATargetActionFactory(std::unique_ptr<Learner<kTargetFeatures, T>> learner,
+                           FeatureService* features, size_t top_k)
+      : SARSAActionFactory<TargetSchema, T>(std::move(learner)),
+        features_(features),
+        top_k_(top_k) {
+    assert(features_);
+  }
+
+  // max_candidates only applies to kApproximateTargetIndex
+  void SetTargetSearch(TargetSearch search, size_t max_candidates = 0) {
+    assert(kApproximateTargetIndex != search || max_candidates > 0);
+    search_ = search;
+    max_candidates_ = max_candidates;
+  }
+
+  void PrepareActions(CVC* cvc, Character* character) override {
+    if (kScanTargets != search_) {
+      // the index searches per character
+      return;
+    }
+    if (prepared_scored_) {
+      // the last group has been chosen, start over
+      prepared_.Clear();
+      prepared_ranges_.clear();
+      prepared_scored_ = false;
+    }
+    size_t begin = prepared_.Size();
+    AddCandidates(cvc, character, &prepared_);
+    prepared_ranges_[character] = {begin, prepared_.Size()};
+  }
+
+  void ScorePending(CVC* cvc) override {
+    if (kScanTargets != search_) {
+      return;
+    }
+    prepared_.Score(this->learner_.get());
+    prepared_scored_ = true;
+  }
 
   double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<Experience>>* actions) override {
+    auto make_action = [this, character](Character* target) {
+      return CreateAction(character, target);
+    };
+
+    auto prepared = prepared_ranges_.find(character);
+    if (prepared_scored_ && prepared != prepared_ranges_.end()) {
+      std::pair<size_t, size_t> range = prepared->second;
+      prepared_ranges_.erase(prepared);
+      return MaterializeBest(this->learner_.get(), &prepared_, range.first,
+                             range.second, top_k_, make_action, actions);
+    }
 
-    double best_score = std::numeric_limits<double>::lowest();
-    std::unique_ptr<Experience> best_action = nullptr;
+    CandidateBatch<kTargetFeatures, T>* batch =
+        CandidateBatch<kTargetFeatures, T>::ThreadLocal();
+    if (kScanTargets == search_ || !SearchCandidates(cvc, character, batch)) {
+      AddCandidates(cvc, character, batch);
+      batch->Score(this->learner_.get());
+    }
+    return MaterializeBest(this->learner_.get(), batch, 0, batch->Size(),
+                           top_k_, make_action, actions);
+  }
 
-    if (character->GetMoney() > 10.0) {
-      //choose a single target to potentially give to
-      for (Character* target : cvc->GetCharacters()) {
-        if(target == character) {
-          continue;
-        }
-        std::array<double, 10> features;
+  // number of targets scored by the target index, for benchmarks
+  size_t GetIndexScored() const { return index_scored_; }
 
-        std::unique_ptr<Experience> action = learner_.WrapAction(
-            TargetFeatures(cvc, character, target, features),
-            std::make_unique<GiveAction>(character, 0.0, target, 10.0));
+ protected:
+  // whether character can take this action at all
+  virtual bool CanAct(Character* character) { return true; }
+  // whether character could act on target
+  virtual bool IsTarget(Character* character, Character* target) = 0;
+  virtual std::unique_ptr<Action> CreateAction(Character* character,
+                                               Character* target) = 0;
 
-        if(action->action_->GetScore() > best_score) {
-          best_action = std::move(action);
-          best_score = best_action->action_->GetScore();
-        }
+  FeatureService* features_;
+
+ private:
+  // adds every target character could act on
+  void AddCandidates(CVC* cvc, Character* character,
+                     CandidateBatch<kTargetFeatures, T>* batch) {
+    if (!CanAct(character)) {
+      return;
+    }
+
+    const std::vector<Character*>& targets = features_->Characters(cvc);
+    const std::vector<FeatureService::PairFeatures>& pairs =
+        features_->ForTargets(cvc, character);
+    FeatureContext context = MakeFeatureContext(features_, cvc, character);
+    bool hashed = this->learner_->UsesHashedFeatures();
+    for (size_t i = 0; i < targets.size(); i++) {
+      Character* target = targets[i];
+      if (target == character || !IsTarget(character, target)) {
+        continue;
       }
-      if(best_action) {
-        actions->push_back(std::move(best_action));
-        return actions->back()->action_->GetScore();
+      context.pair_ = &pairs[i];
+      if (hashed) {
+        batch->Add(target, TargetSchema::Extract<T>(context),
+                   TargetIdentityFeatures(character, target));
       } else {
-        return 0.0;
+        batch->Add(target, TargetSchema::Extract<T>(context));
       }
     }
-    return 0.0;
   }
-};
 
-class SARSAAskActionFactory : public SARSAActionFactory<10> {
- public:
-  SARSAAskActionFactory(SARSALearner<10> learner)
-      : SARSAActionFactory<10>(learner) {}
+  // adds (scored) the targets the index had to look at, which include the
+  // top_k best, in the same order AddCandidates would so ties break the same
+  // way. returns false if the learner isn't linear
+  bool SearchCandidates(CVC* cvc, Character* character,
+                        CandidateBatch<kTargetFeatures, T>* batch) {
+    std::array<double, kTargetFeatures> weights;
+    if (!this->learner_->GetLinearWeights(&weights)) {
+      return false;
+    }
+    if (!CanAct(character)) {
+      return true;
+    }
 
-  double EnumerateActions(
-      CVC* cvc, Character* character,
-      std::vector<std::unique_ptr<Experience>>* actions) {
-    double best_score = std::numeric_limits<double>::lowest();
-    std::unique_ptr<Experience> best_action = nullptr;
-    for (Character* target : cvc->GetCharacters()) {
-      // skip self
-      if (character == target) {
+    const size_t opinion_of_target =
+        TargetSchema::Offset<OpinionOfTargetFeature>();
+    const size_t target_opinion = TargetSchema::Offset<TargetOpinionFeature>();
+    const size_t target_money = TargetSchema::Offset<TargetLogMoneyFeature>();
+
+    // everything but the pair features is the same for every target
+    FeatureContext context = MakeFeatureContext(features_, cvc, character);
+    FeatureService::PairFeatures no_pair = FeatureService::PairFeatures();
+    context.pair_ = &no_pair;
+    std::array<T, kTargetFeatures> shared = TargetSchema::Extract<T>(context);
+    double constant = 0.0;
+    for (size_t i = 0; i < kTargetFeatures; i++) {
+      constant += weights[i] * shared[i];
+    }
+    const FeatureService::CharacterFeatures& own = *context.own_;
+    double w = weights[opinion_of_target];
+    constant += w > 0.0 ? w * own.max_opinion_by_ : w * own.min_opinion_by_;
+    w = weights[target_opinion];
+    constant += w > 0.0 ? w * own.max_opinion_of_ : w * own.min_opinion_of_;
+    bool hashed = this->learner_->UsesHashedFeatures();
+    constant += this->learner_->HashedBound();
+
+    const std::vector<Character*>& targets = features_->Characters(cvc);
+    const std::vector<FeatureService::CharacterFeatures>& target_features =
+        features_->ForCharacters(cvc);
+    const std::vector<size_t>& by_money = features_->ByMoney(cvc);
+    // best money term first
+    bool ascending = weights[target_money] < 0.0;
+
+    std::vector<Scored>& scored = scored_;
+    std::vector<double>& top = top_;
+    scored.clear();
+    top.clear();
+    for (size_t n = 0; n < by_money.size(); n++) {
+      size_t i = ascending ? by_money[n] : by_money[by_money.size() - 1 - n];
+      Character* target = targets[i];
+      if (top.size() == top_k_) {
+        double bound =
+            constant + weights[target_money] * target_features[i].log_money_;
+        // scores are accumulated in T, leave room for rounding
+        if (bound + kBoundSlack * (1.0 + std::abs(bound)) < top.front()) {
+          break;
+        }
+      }
+      if (kApproximateTargetIndex == search_ &&
+          scored.size() >= max_candidates_) {
+        break;
+      }
+      if (target == character || !IsTarget(character, target)) {
         continue;
       }
 
-      if (target->GetMoney() <= 10.0) {
-        continue;
+      Scored candidate;
+      candidate.index_ = i;
+      FeatureService::PairFeatures pair =
+          features_->ForPair(cvc, character, target);
+      context.pair_ = &pair;
+      candidate.features_ = TargetSchema::Extract<T>(context);
+      this->learner_->ScoreBatch(&candidate.features_, 1, &candidate.score_);
+      if (hashed) {
+        candidate.hashed_ = TargetIdentityFeatures(character, target);
+        candidate.score_ += this->learner_->ScoreHashed(candidate.hashed_);
       }
-      std::array<double, 10> features;
-      //add this as an option to ask
-      std::unique_ptr<Experience> action = learner_.WrapAction(
-          TargetFeatures(cvc, character, target, features),
-          std::make_unique<AskAction>(character, 0.0, target, 10.0));
-      if(action->action_->GetScore() > best_score) {
-        best_action = std::move(action);
-        best_score = best_action->action_->GetScore();
+      scored.push_back(candidate);
+
+      // min heap of the top_k scores so far
+      top.push_back(candidate.score_);
+      std::push_heap(top.begin(), top.end(), std::greater<double>());
+      if (top.size() > top_k_) {
+        std::pop_heap(top.begin(), top.end(), std::greater<double>());
+        top.pop_back();
       }
     }
-
-    if(best_action) {
-      actions->push_back(std::move(best_action));
-      return actions->back()->action_->GetScore();
-    } else {
-      return 0.0;
+    index_scored_ += scored.size();
+
+    std::sort(scored.begin(), scored.end(),
+              [](const Scored& a, const Scored& b) {
+                return a.index_ < b.index_;
+              });
+    for (const Scored& candidate : scored) {
+      if (hashed) {
+        batch->Add(targets[candidate.index_], candidate.features_,
+                   candidate.hashed_);
+      } else {
+        batch->Add(targets[candidate.index_], candidate.features_);
+      }
+      batch->scores_.push_back(candidate.score_);
     }
+    return true;
   }
+
+  struct Scored {
+    size_t index_;
+    std::array<T, kTargetFeatures> features_;
+    HashedFeatures hashed_;
+    double score_;
+  };
+
+  static constexpr double kBoundSlack = 1e-5;
+
+  size_t top_k_;
+  TargetSearch search_ = kScanTargets;
+  size_t max_candidates_ = 0;
+  size_t index_scored_ = 0;
+  std::vector<Scored> scored_;
+  std::vector<double> top_;
+
+  // candidates queued by PrepareActions, with each character's [begin, end)
+  CandidateBatch<kTargetFeatures, T> prepared_;
+  std::unordered_map<Character*, std::pair<size_t, size_t>> prepared_ranges_;
+  bool prepared_scored_ = false;
 };
 
-class SARSAAskSuccessResponseFactory : public SARSAResponseFactory<10> {
+template <typename T = double>
+class SARSAGiveActionFactory : public SARSATargetActionFactory<T> {
  public:
-  SARSAAskSuccessResponseFactory(SARSALearner<10> learner)
-      : SARSAResponseFactory<10>(learner) {}
+  SARSAGiveActionFactory(std::unique_ptr<Learner<kTargetFeatures, T>> learner,
+                         FeatureService* features, size_t top_k = 1)
+      : SARSATargetActionFactory<T>(std::move(learner), features, top_k) {}
+
+ protected:
+  bool CanAct(Character* character) override {
+    return character->GetMoney() > 10.0;
+  }
+
+  bool IsTarget(Character* character, Character* target) override {
+    return true;
+  }
+
+  std::unique_ptr<Action> CreateAction(Character* character,
+                                       Character* target) override {
+    return std::make_unique<GiveAction>(character, 0.0, target, 10.0);
+  }
+};
+
+template <typename T = double>
+class SARSAAskActionFactory : public SARSATargetActionFactory<T> {
+ public:
+  SARSAAskActionFactory(std::unique_ptr<Learner<kTargetFeatures, T>> learner,
+                        FeatureService* features, size_t top_k = 1)
+      : SARSATargetActionFactory<T>(std::move(learner), features, top_k) {}
+
+ protected:
+  bool IsTarget(Character* character, Character* target) override {
+    return target->GetMoney() > 10.0;
+  }
+
+  std::unique_ptr<Action> CreateAction(Character* character,
+                                       Character* target) override {
+    return std::make_unique<AskAction>(character, 0.0, target, 10.0);
+  }
+};
+
+template <typename T = double>
+class SARSAAskSuccessResponseFactory
+    : public SARSAResponseFactory<TargetSchema, T> {
+ public:
+  SARSAAskSuccessResponseFactory(
+      std::unique_ptr<Learner<kTargetFeatures, T>> learner,
+      FeatureService* features)
+      : SARSAResponseFactory<TargetSchema, T>(std::move(learner)),
+        features_(features) {
+    assert(features_);
+  }
 
   double Respond(
       CVC* cvc, Character* character, Action* action,
@@ -137,19 +563,40 @@ class SARSAAskSuccessResponseFactory : public SARSAResponseFactory<10> {
       return 0.0;
     }
 
-    std::array<double, 10> features;
-    actions->push_back(learner_.WrapAction(
-        TargetFeatures(cvc, character, ask_action->GetTarget(), features),
-        std::make_unique<AskSuccessAction>(character, 0.0, ask_action->GetActor(),
-                                           ask_action)));
+    //features are about the asker
+    Character* asker = ask_action->GetActor();
+    FeatureService::PairFeatures pair =
+        features_->ForPair(cvc, character, asker);
+    std::array<T, kTargetFeatures> features = TargetSchema::Extract<T>(
+        MakeFeatureContext(features_, cvc, character, &pair));
+    auto response = std::make_unique<AskSuccessAction>(character, 0.0, asker,
+                                                       ask_action);
+    if (this->learner_->UsesHashedFeatures()) {
+      actions->push_back(this->learner_->WrapAction(
+          features, TargetIdentityFeatures(character, asker),
+          std::move(response)));
+    } else {
+      actions->push_back(
+          this->learner_->WrapAction(features, std::move(response)));
+    }
     return actions->back()->action_->GetScore();
   }
+
+ private:
+  FeatureService* features_;
 };
 
-class SARSAAskFailureResponseFactory : public SARSAResponseFactory<10> {
+template <typename T = double>
+class SARSAAskFailureResponseFactory
+    : public SARSAResponseFactory<TargetSchema, T> {
  public:
-  SARSAAskFailureResponseFactory(SARSALearner<10> learner)
-      : SARSAResponseFactory(learner) {}
+  SARSAAskFailureResponseFactory(
+      std::unique_ptr<Learner<kTargetFeatures, T>> learner,
+      FeatureService* features)
+      : SARSAResponseFactory<TargetSchema, T>(std::move(learner)),
+        features_(features) {
+    assert(features_);
+  }
 
   double Respond(
       CVC* cvc, Character* character, Action* action,
@@ -157,44 +604,86 @@ class SARSAAskFailureResponseFactory : public SARSAResponseFactory<10> {
     //action->GetTarget() is asking us for action->GetRequestAmount() money
     AskAction* ask_action = (AskAction*)action;
 
-    std::array<double, 10> features;
-    actions->push_back(learner_.WrapAction(
-        TargetFeatures(cvc, character, ask_action->GetTarget(), features),
-        std::make_unique<TrivialResponse>(character, 0.0)));
+    //features are about the asker
+    Character* asker = ask_action->GetActor();
+    FeatureService::PairFeatures pair =
+        features_->ForPair(cvc, character, asker);
+    std::array<T, kTargetFeatures> features = TargetSchema::Extract<T>(
+        MakeFeatureContext(features_, cvc, character, &pair));
+    auto response = std::make_unique<TrivialResponse>(character, 0.0);
+    if (this->learner_->UsesHashedFeatures()) {
+      actions->push_back(this->learner_->WrapAction(
+          features, TargetIdentityFeatures(character, asker),
+          std::move(response)));
+    } else {
+      actions->push_back(
+          this->learner_->WrapAction(features, std::move(response)));
+    }
     return actions->back()->action_->GetScore();
   }
+
+ private:
+  FeatureService* features_;
 };
 
-class SARSAWorkActionFactory : public SARSAActionFactory<6> {
+template <typename T = double>
+class SARSAWorkActionFactory : public SARSAActionFactory<StandardSchema, T> {
  public:
-  SARSAWorkActionFactory(SARSALearner<6> learner)
-      : SARSAActionFactory<6>(learner) {}
+  SARSAWorkActionFactory(
+      std::unique_ptr<Learner<kStandardFeatures, T>> learner,
+      FeatureService* features)
+      : SARSAActionFactory<StandardSchema, T>(std::move(learner)),
+        features_(features) {
+    assert(features_);
+  }
 
   double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<Experience>>* actions) override {
-    std::array<double, 6> features;
-    actions->push_back(
-        learner_.WrapAction(StandardFeatures(cvc, character, features),
-                             std::make_unique<WorkAction>(character, 0.0)));
+    actions->push_back(this->learner_->WrapAction(
+        StandardSchema::Extract<T>(
+            MakeFeatureContext(features_, cvc, character)),
+        std::make_unique<WorkAction>(character, 0.0)));
     return actions->back()->action_->GetScore();
   }
+
+ private:
+  FeatureService* features_;
 };
 
-class SARSATrivialActionFactory : public SARSAActionFactory<6> {
+template <typename T = double>
+class SARSATrivialActionFactory : public SARSAActionFactory<StandardSchema, T> {
  public:
-  SARSATrivialActionFactory(SARSALearner<6> learner)
-      : SARSAActionFactory<6>(learner) {}
+  SARSATrivialActionFactory(
+      std::unique_ptr<Learner<kStandardFeatures, T>> learner,
+      FeatureService* features)
+      : SARSAActionFactory<StandardSchema, T>(std::move(learner)),
+        features_(features) {
+    assert(features_);
+  }
 
   double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<Experience>>* actions) override {
-    std::array<double, 6> features;
-    StandardFeatures(cvc, character, features);
-    actions->push_back(learner_.WrapAction(features,
+    std::array<T, kStandardFeatures> features = StandardSchema::Extract<T>(
+        MakeFeatureContext(features_, cvc, character));
+    actions->push_back(this->learner_->WrapAction(features,
         std::make_unique<TrivialAction>(character, 0.0)));
     return actions->back()->action_->GetScore();
   }
+
+ private:
+  FeatureService* features_;
+};
+
+// always picks the best scoring action
+// keeps no state and doesn't log, so it's safe to share between threads, e.g.
+// for frozen agents
+class GreedyPolicy : public SARSAActionPolicy {
+ public:
+  std::unique_ptr<Experience> ChooseAction(
+      std::vector<std::unique_ptr<Experience>>* actions, CVC* cvc,
+      Character* character) override;
 };
 
 class EpsilonGreedyPolicy : public SARSAActionPolicy {
@@ -34,6 +34,8 @@ class Experience {
 
   virtual double Learn(CVC* cvc) = 0;
   virtual double PredictScore() const = 0;
+  // the experience and its action, counted as a plain Action
+  virtual size_t MemoryBytes() const = 0;
 };
 
 
@@ -47,10 +49,19 @@ class SARSAActionPolicy {
 
 };
 
-class ActionFactory {
+// action factories are batch scorers so they can be registered with the
+// DecisionEngine. factories that support it queue up candidates in
+// PrepareActions, score everything queued in ScorePending and use those scores
+// in the following EnumerateActions for the same character
+class ActionFactory : public BatchScorer {
  public:
   virtual ~ActionFactory() {}
 
+  virtual void PrepareActions(CVC* cvc, Character* character) {}
+  void ScorePending(CVC* cvc) override {}
+  // whether experiences from this factory can be learned from
+  virtual bool CanLearn() const { return true; }
+
   virtual double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<Experience>>* actions) = 0;
@@ -60,6 +71,9 @@ class ResponseFactory {
  public:
   virtual ~ResponseFactory() {}
 
+  // whether experiences from this factory can be learned from
+  virtual bool CanLearn() const { return true; }
+
   virtual double Respond(
       CVC* cvc, Character* character, Action* action,
       std::vector<std::unique_ptr<Experience>>* actions) = 0;
@@ -75,47 +89,102 @@ class ResponseFactory {
 //  a policy for choosing a single candidate action (or response) from a set of
 //  candidates
 //  a set of learners for different action experiences
+//
+// a frozen agent only uses its learners: it scores candidates and picks one
+// with the policy, but keeps no history of experiences and never learns, so
+// it never writes to the (shared) learners. agents with any factory that
+// can't learn (e.g. over a QuantizedLearner) are always frozen.
 template <class S>
-class SARSAAgent : public Agent {
+class SARSAAgent : public Agent, public MemoryFootprint {
  public:
   SARSAAgent(S* scorer, Character* character,
              std::vector<ActionFactory*> action_factories,
              std::unordered_map<std::string, std::set<ResponseFactory*>>
                  response_factories,
-             SARSAActionPolicy* policy, int n_steps)
+             SARSAActionPolicy* policy, int n_steps, bool frozen = false)
       : Agent(character),
         action_factories_(action_factories),
         response_factories_(response_factories),
         policy_(policy),
         n_steps_(n_steps),
+        frozen_(frozen),
         scorer_(scorer) {
     // set up experience queue so the "current" set of experiences is an empty
     // list
     experience_queue_.push_back({});
+    // never learn through a learner that can't
+    assert(frozen_ || CanLearn());
+    frozen_ = frozen_ || !CanLearn();
+  }
+
+  bool IsFrozen() const { return frozen_; }
+
+  // whether every factory's experiences can be learned from
+  bool CanLearn() const {
+    for (ActionFactory* factory : action_factories_) {
+      if (!factory->CanLearn()) {
+        return false;
+      }
+    }
+    for (const auto& factories : response_factories_) {
+      for (ResponseFactory* factory : factories.second) {
+        if (!factory->CanLearn()) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // must be called between ticks (i.e. after Learn)
+  // false (staying frozen) if unfreezing an agent that can't learn
+  bool SetFrozen(bool frozen) {
+    if (!frozen && !CanLearn()) {
+      return false;
+    }
+    if (frozen == frozen_) {
+      return true;
+    }
+    frozen_ = frozen;
+    // either way we start over with an empty history, the pending next action
+    // still needs to stick around until it's been evaluated
+    experience_queue_.clear();
+    experience_queue_.push_back({});
+    return true;
+  }
+
+  void PrepareAction(CVC* cvc) override {
+    for (ActionFactory* factory : action_factories_) {
+      factory->PrepareActions(cvc, character_);
+    }
   }
 
   Action* ChooseAction(CVC* cvc) override {
     //if we have what was previously the next action, stick it in the set of
-    //experiences
-    if(next_action_) {
+    //experiences (actions chosen while frozen are just let go, they've been
+    //evaluated already and have no score to learn from)
+    if(next_action_ && !next_action_frozen_) {
       experience_queue_.front().push_back(std::move(next_action_));
     }
 
     // list the choices of actions
-    std::vector<std::unique_ptr<Experience>> actions;
-
     double score = 0.0;
     for (ActionFactory* factory : action_factories_) {
-      score += factory->EnumerateActions(cvc, character_, &actions);
+      score += factory->EnumerateActions(cvc, character_, &candidates_);
     }
 
     // choose one according to the policy and store it, along with this agent in
     // a partial Experience which we will fill out later
-    next_action_ = policy_->ChooseAction(&actions, cvc, character_);
+    next_action_ = policy_->ChooseAction(&candidates_, cvc, character_);
+    // drop the rest, keeping the storage for next tick
+    candidates_.clear();
 
     //TODO: should really support other kinds of objectives than just money
     //keep track of the current score at the time this action was chosen
-    next_action_->score_ = Score(cvc);
+    if (!frozen_) {
+      next_action_->score_ = CurrentScore(cvc);
+    }
+    next_action_frozen_ = frozen_;
 
     return next_action_->action_.get();
   }
@@ -129,23 +198,31 @@ class SARSAAgent : public Agent {
            response_factories_.end());
 
     //2. ask it to enumerate some (scored) responses
-    std::vector<std::unique_ptr<Experience>> actions;
-
     double score = 0.0;
     for (ResponseFactory* factory :
          response_factories_[action->GetActionId()]) {
-      score += factory->Respond(cvc, character_, action, &actions);
+      score += factory->Respond(cvc, character_, action,
+                                &response_candidates_);
     }
 
     //3. choose
     experience_queue_.front().push_back(
-        policy_->ChooseAction(&actions, cvc, character_));
+        policy_->ChooseAction(&response_candidates_, cvc, character_));
+    response_candidates_.clear();
 
-    experience_queue_.front().back()->score_ = Score(cvc);
+    if (!frozen_) {
+      experience_queue_.front().back()->score_ = CurrentScore(cvc);
+    }
     return experience_queue_.front().back()->action_.get();
   }
 
   void Learn(CVC* cvc) override {
+    if (frozen_) {
+      // this tick's responses have been evaluated, nothing else to do
+      experience_queue_.front().clear();
+      return;
+    }
+
     // we've just wrapped up a turn, so now is a good time to incorporate
     // information about the reward we received this turn.
     // 1. update rewards for all experiences (the learner does this when it
@@ -158,6 +235,7 @@ class SARSAAgent : public Agent {
 
     // 2. learn if necessary
     // n-step SARSA
+    std::vector<std::unique_ptr<Experience>> recycled;
     if(experience_queue_.size() == n_steps_) {
       // we learn from all of the experiences n_steps ago
       // recall, multiple experiences might happen at the same step
@@ -169,12 +247,37 @@ class SARSAAgent : public Agent {
         // TODO: why have this at all?
         //policy_->UpdateGrad(dL_dy, experience->action_->GetScore());
       }
-      //toss the experiences from which we just learned (at the back)
+      //toss the experiences from which we just learned (at the back),
+      //keeping their storage for the upcoming turn
+      recycled = std::move(experience_queue_.back());
+      recycled.clear();
       experience_queue_.pop_back();
     }
 
     //set up space for the next batch of experiences (for the upcoming turn)
-    experience_queue_.push_front(std::vector<std::unique_ptr<Experience>>());
+    experience_queue_.push_front(std::move(recycled));
+  }
+
+  // the experience queue, candidate storage and factory lists, not the
+  // (shared) factories and learners
+  size_t MemoryBytes() const override {
+    size_t bytes = sizeof(*this) + VectorBytes(action_factories_) +
+                   HashMapBytes(response_factories_) +
+                   DequeBytes(experience_queue_) + VectorBytes(candidates_) +
+                   VectorBytes(response_candidates_);
+    for (const auto& factories : response_factories_) {
+      bytes += SetBytes(factories.second);
+    }
+    for (const auto& experiences : experience_queue_) {
+      bytes += VectorBytes(experiences);
+      for (const auto& experience : experiences) {
+        bytes += experience->MemoryBytes();
+      }
+    }
+    if (next_action_) {
+      bytes += next_action_->MemoryBytes();
+    }
+    return bytes;
   }
 
   double Score(CVC* cvc) override {
@@ -205,8 +308,16 @@ class SARSAAgent : public Agent {
   SARSAActionPolicy* policy_;
 
   std::unique_ptr<Experience> next_action_ = nullptr;
+  // whether next_action_ was chosen while frozen, and so isn't learned from
+  // even if the agent has been unfrozen since
+  bool next_action_frozen_ = false;
   size_t n_steps_ = 10;
+  bool frozen_ = false;
   std::deque<std::vector<std::unique_ptr<Experience>>> experience_queue_;
+  // candidates for the action being chosen and the response being made, kept
+  // between ticks so their storage is reused
+  std::vector<std::unique_ptr<Experience>> candidates_;
+  std::vector<std::unique_ptr<Experience>> response_candidates_;
 
   S *scorer_;
 };
@@ -2,26 +2,114 @@
 #define SARSA_LEARNER_H
 
 #include <stdio.h>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <memory>
 #include <array>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "../util.h"
 #include "../core.h"
+#include "../event_log.h"
 #include "sarsa_agent.h"
+#include "checkpoint.h"
+#include "feature_schema.h"
+#include "hashed_features.h"
 
 namespace cvc::sarsa {
 
-template <size_t N>
-class SARSALearner;
+template <size_t N, typename T = double>
+class ExperienceImpl;
 
-template <size_t N>
+// A model that scores a feature vector of size N and learns from experiences
+// carrying such feature vectors.
+// Factories only depend on this interface, so different learning rules (e.g.
+// n-step SARSA or SARSA(lambda)) can be swapped in per run.
+// T is the scalar type of features and parameters, scores are always double.
+template <size_t N, typename T = double>
+class Learner : public Checkpointable, public MemoryFootprint {
+ public:
+  virtual ~Learner() {}
+
+  // learners with more than fixed size parameters override this
+  size_t MemoryBytes() const override { return sizeof(*this); }
+
+  // inference only learners can't learn, agents using them must be frozen
+  virtual bool CanLearn() const { return true; }
+  // only called if CanLearn
+  virtual double Learn(CVC* cvc, ExperienceImpl<N, T>* experience) = 0;
+  virtual double Score(const std::array<T, N> features) const = 0;
+
+  // scores count feature vectors at once, models that can share work across
+  // candidates (e.g. matrix kernels) should override this
+  virtual void ScoreBatch(const std::array<T, N>* features, size_t count,
+                          double* scores) const {
+    for (size_t i = 0; i < count; i++) {
+      scores[i] = Score(features[i]);
+    }
+  }
+
+  // linear models expose their weights so callers can bound scores without
+  // scoring every candidate (see SARSATargetActionFactory), others return
+  // false
+  virtual bool GetLinearWeights(std::array<double, N>* weights) const {
+    return false;
+  }
+
+  // hashed features (see hashed_features.h) add ScoreHashed to the dense
+  // score. learners without a hashed table ignore them, callers can check
+  // UsesHashedFeatures to avoid building them at all
+  virtual bool UsesHashedFeatures() const { return false; }
+  virtual double ScoreHashed(const HashedFeatures& hashed) const {
+    return 0.0;
+  }
+  // an upper bound on |ScoreHashed| for hashed features with |values| <= 1
+  virtual double HashedBound() const { return 0.0; }
+
+  std::unique_ptr<Experience> WrapAction(std::array<T, N> features,
+                                         std::unique_ptr<Action> action) {
+    return WrapAction(features, std::move(action), Score(features));
+  }
+
+  std::unique_ptr<Experience> WrapAction(std::array<T, N> features,
+                                         const HashedFeatures& hashed,
+                                         std::unique_ptr<Action> action) {
+    return WrapAction(features, hashed, std::move(action),
+                      Score(features) + ScoreHashed(hashed));
+  }
+
+  // for callers that already scored features, e.g. with ScoreBatch
+  std::unique_ptr<Experience> WrapAction(std::array<T, N> features,
+                                         std::unique_ptr<Action> action,
+                                         double score) {
+    action->SetScore(score);
+    return std::make_unique<ExperienceImpl<N, T>>(std::move(action), 0.0,
+                                                  nullptr, features, this);
+  }
+
+  std::unique_ptr<Experience> WrapAction(std::array<T, N> features,
+                                         const HashedFeatures& hashed,
+                                         std::unique_ptr<Action> action,
+                                         double score) {
+    action->SetScore(score);
+    auto experience = std::make_unique<ExperienceImpl<N, T>>(
+        std::move(action), 0.0, nullptr, features, this);
+    experience->hashed_ = hashed;
+    return experience;
+  }
+};
+
+template <size_t N, typename T>
 class ExperienceImpl : public Experience {
  public:
   ExperienceImpl(std::unique_ptr<Action> action, double score,
-                 Experience* next_experience, std::array<double, N> features,
-                 SARSALearner<N>* learner)
+                 Experience* next_experience, std::array<T, N> features,
+                 Learner<N, T>* learner)
       : Experience(std::move(action), score, next_experience),
         learner_(learner) {
           for(size_t i=0; i<N; i++) {
@@ -29,81 +117,81 @@ class ExperienceImpl : public Experience {
           }
         }
 
-  std::array<double, N> features_;
-  SARSALearner<N>* learner_;
+  std::array<T, N> features_;
+  HashedFeatures hashed_; //usually empty
+  Learner<N, T>* learner_;
 
   double Learn(CVC* cvc) override {
     return learner_->Learn(cvc, this);
   }
 
   double PredictScore() const override {
+    if (hashed_.Size() > 0) {
+      return learner_->Score(features_) + learner_->ScoreHashed(hashed_);
+    }
     return learner_->Score(features_);
   }
-};
-
-template <size_t N>
-class SARSALearner {
- public:
-  static void ReadWeights(
-      const char* weight_file,
-      std::unordered_map<std::string, SARSALearner*> learners) {
-    FILE* weights = fopen(weight_file, "r");
-
-    if(!weights) {
-      //if the file doesn't exist, just leave existing weights
-      return;
-    }
 
-    size_t num_factories;
-    int ret = fread(&num_factories, sizeof(size_t), 1, weights);
-    assert(1 == ret);
-
-    for(size_t i=0; i<num_factories; i++) {
-      size_t name_length;
-      ret = fread(&name_length, sizeof(size_t), 1, weights);
-      assert(1 == ret);
-      assert(1024-1 > name_length);
-      char factory_name[1024];
-      factory_name[name_length] = 0;
-      ret = fread(factory_name, sizeof(char), name_length, weights);
-      assert((size_t)ret == name_length);
-
-      assert(learners.find(factory_name) != learners.end());
-      learners[factory_name]->ReadWeights(weights);
-    }
-    fclose(weights);
+  size_t MemoryBytes() const override {
+    return sizeof(*this) + (action_ ? sizeof(Action) : 0);
   }
+};
 
-  static void WriteWeights(
-      const char* weight_file,
-      std::unordered_map<std::string, SARSALearner*> learners) {
-    FILE* weights = fopen(weight_file, "w");
-    assert(weights);
-
-    size_t num_factories = learners.size();
-    int ret = fwrite(&num_factories, sizeof(size_t), 1, weights);
-    assert(ret);
+// n-step return: the discounted rewards along the chain of experiences plus
+// the discounted predicted score of the last one
+inline double DiscountedReturn(const Experience* experience, double g) {
+  const Experience *e = experience;
+  assert(e->next_experience_);
+  double discounted_rewards = 0.0;
+  int i = 0;
+  while(e->next_experience_) {
+    // reward is diff between score after action plays out minus score at time
+    // of choosing action (this can get complicated if there's a bunch of other
+    // stuff going on at the same time)
+    double reward = e->next_experience_->score_ - e->score_;
+    //TODO: what does it mean if g != e->learner->g_ ?
+    discounted_rewards += pow(g, i) * reward;
+    e = e->next_experience_;
+    i++;
+  }
 
-    for(const auto& factory : learners) {
-      size_t name_length = strlen(factory.first.c_str());
-      ret = fwrite(&name_length, sizeof(size_t), 1, weights);
-      assert(ret > 0);
-      ret = fwrite(factory.first.c_str(), sizeof(char), name_length, weights);
-      assert(name_length == (size_t)ret);
-      factory.second->WriteWeights(weights);
-    }
-    fclose(weights);
+  return discounted_rewards + pow(g, i) * e->PredictScore();
+}
+
+// logs a learning step for experience, as an event if learn_logger has an
+// EventLog, otherwise as a line of text
+template <size_t N, typename T>
+void LogLearnStep(Logger* learn_logger, CVC* cvc, int learner_id,
+                  const Experience* experience,
+                  const std::array<T, N>& features, double loss, double dL_dy,
+                  double prediction, double target) {
+  double reward = experience->next_experience_->score_ - experience->score_;
+  if (EventLog* events = learn_logger->GetEventLog()) {
+    std::array<double, N> values;
+    std::copy(features.begin(), features.end(), values.begin());
+    Character* actor = experience->action_->GetActor();
+    events->LogLearn({cvc->Now(), experience->action_->GetActionId(),
+                      learner_id, actor ? actor->GetId() : -1, loss, dL_dy,
+                      prediction, target, reward, values.data(), N});
+    return;
   }
+  learn_logger->Log(INFO, "%d\t%s\t%d\t%f\t%f\t%f\t%f\t%f\n", cvc->Now(),
+                    experience->action_->GetActionId(), learner_id, loss,
+                    dL_dy, prediction, target, reward);
+}
 
+template <size_t N, typename T = double>
+class SARSALearner : public Learner<N, T> {
+ public:
   //creates a randomly initialized learner
   static std::unique_ptr<SARSALearner> Create(int learner_id, double n,
                                               double g, double b1, double b2,
                                               std::mt19937& random_generator,
                                               Logger* learn_logger) {
-    std::array<double, N> weights;
+    std::array<T, N> weights;
     std::array<Stats, N> stats;
-    std::array<double, N> m;
-    std::array<double, N> r;
+    std::array<T, N> m;
+    std::array<T, N> r;
 
     std::uniform_real_distribution<> weight_dist(-1.0, 1.0);
     for (size_t i = 0; i < N; i++) {
@@ -118,8 +206,8 @@ class SARSALearner {
   }
 
   SARSALearner(int learner_id, double n, double g, double b1, double b2,
-               std::array<double, N> weights, std::array<Stats, N> s,
-               std::array<double, N> m, std::array<double, N> r,
+               std::array<T, N> weights, std::array<Stats, N> s,
+               std::array<T, N> m, std::array<T, N> r,
                Logger* learn_logger)
       : learner_id_(learner_id),
         n_(n),
@@ -135,11 +223,12 @@ class SARSALearner {
     }
   }
 
-  double Learn(CVC* cvc, ExperienceImpl<N>* experience) {
+  double Learn(CVC* cvc, ExperienceImpl<N, T>* experience) override {
     Action* action = experience->action_.get();
 
     assert(action);
-    double updated_score = Score(experience->features_);
+    double updated_score =
+        Score(experience->features_) + ScoreHashed(experience->hashed_);
 
     //SARSA-FA:
     //from https://artint.info/html/ArtInt_272.html
@@ -179,11 +268,9 @@ class SARSALearner {
     assert(!std::isinf(dL_dy));
 
     //log some info about model performance
-    learn_logger_->Log(INFO, "%d\t%s\t%d\t%f\t%f\t%f\t%f\t%f\n", cvc->Now(),
-                       action->GetActionId(), learner_id_, loss, dL_dy,
-                       updated_score, truth_estimate,
-                       experience->next_experience_->score_ -
-                           experience->score_);
+    LogLearnStep(learn_logger_, cvc, learner_id_, experience,
+                 experience->features_, loss, dL_dy, updated_score,
+                 truth_estimate);
 
     //TODO: clean up these needless lines
     //this might not be the case if someone has changed the weights since we
@@ -191,38 +278,11 @@ class SARSALearner {
     // update the weights
     //assert(action->GetFeatureVector().size() == weights_.size());
     //double n = n_;// / (double)(action->GetFeatureVector().size());
-    //hang on to the sum of the partials for debugging
-    double sum_d = 0.0;
-    t_ += 1;
-    for(size_t i = 0; i < N; i++) {
-      //keep some stats on the features for later analysis
-      feature_stats_[i].Update(experience->features_[i]);
-
-      //simple learning
-      //double weight_update = n * dL_dy * action->GetFeatureVector()[i];
-
-      //partial derivative of loss w.r.t. this weight
-      //by chain rule dL_dy * dy_dw
-      double dL_dw = dL_dy * experience->features_[i];
-
-      // ADAM optimizier
-      // as per https://arxiv.org/pdf/1412.6980.pdf
-      // taken from slides:
-      // https://moodle2.cs.huji.ac.il/nu15/pluginfile.php/316969/mod_resource/content/1/adam_pres.pdf
-      m_[i] = b1_*m_[i] + (1.0-b1_)*(dL_dw);
-      r_[i] = b2_*r_[i] + (1.0-b2_)*(dL_dw * dL_dw);
-      double m_hat = m_[i] / (1.0 - pow(b1_, t_));
-      double r_hat = r_[i] / (1.0 - pow(b2_, t_));
-      double weight_update = n_ * m_hat / sqrt(r_hat + epsilon_);
+    ApplyGradient(experience->features_, experience->features_, dL_dy);
+    ApplyHashedGradient(experience->hashed_, dL_dy);
 
-
-      assert(!std::isinf(weight_update));
-      assert(!std::isnan(weight_update));
-      weights_[i] = weights_[i] - weight_update;
-      sum_d += dL_dy * experience->features_[i];
-    }
-
-    double new_score = Score(experience->features_);
+    double new_score =
+        Score(experience->features_) + ScoreHashed(experience->hashed_);
     learn_logger_->Log(DEBUG, "after update:\t%s\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n",
                        action->GetActionId(), new_score, updated_score,
                        truth_estimate, (new_score - updated_score), dL_dy,
@@ -242,29 +302,66 @@ class SARSALearner {
     return dL_dy;
   }
 
-  void WriteWeights(FILE* weights_file) {
-    size_t num_weights = N;
-    fwrite(&num_weights, sizeof(size_t), 1, weights_file);
-    for(double w : weights_) {
-      fwrite(&w, sizeof(double), 1, weights_file);
+  void WriteCheckpoint(CheckpointWriter* writer,
+                       const char* name) const override {
+    WriteLinearSection(writer, name, 0.0);
+    WriteHashedSection(writer, name);
+  }
+
+  bool WriteQuantizedCheckpoint(CheckpointWriter* writer, const char* name,
+                                WeightFormat format) const override {
+    std::array<double, N> weights;
+    for (size_t i = 0; i < N; i++) {
+      weights[i] = weights_[i];
+    }
+    WriteQuantizedLinear(writer, name, learner_id_, weights.data(), N, format);
+    return true;
+  }
+
+  bool ReadCheckpoint(const Checkpoint& checkpoint, const char* name,
+                      Logger* logger) override {
+    LinearLearnerView view;
+    if (!ViewLinearLearner(checkpoint, name, N, &view, logger)) {
+      return false;
+    }
+
+    if (!ReadHeader(view, name, logger)) {
+      return false;
     }
+    for (size_t i = 0; i < N; i++) {
+      ReadFeature(view, i, i);
+    }
+    ReadHashedSection(checkpoint, name, logger);
+    return true;
   }
 
-  void ReadWeights(FILE* weights_file) {
-    size_t count;
-    int ret = fread(&count, sizeof(size_t), 1, weights_file);
-    assert(1 == ret);
-    assert(count == N);
-    for(size_t i=0; i<N; i++) {
-      double w;
-      fread(&w, sizeof(double), 1, weights_file);
-      weights_[i] = w;
+  bool ReadRemappedCheckpoint(const Checkpoint& checkpoint, const char* name,
+                              const std::vector<int>& file_features,
+                              size_t num_file_features,
+                              Logger* logger) override {
+    assert(file_features.size() == N);
+    LinearLearnerView view;
+    if (!ViewLinearLearner(checkpoint, name, num_file_features, &view,
+                           logger)) {
+      return false;
     }
+
+    if (!ReadHeader(view, name, logger)) {
+      return false;
+    }
+    for (size_t i = 0; i < N; i++) {
+      if (file_features[i] >= 0) {
+        ReadFeature(view, i, file_features[i]);
+      }
+    }
+    // hashed keys don't depend on the dense layout
+    ReadHashedSection(checkpoint, name, logger);
+    return true;
   }
 
-  double Score(const std::array<double, N> features) const {
+  double Score(const std::array<T, N> features) const override {
     //first feature had beter be bias term
-    double score = 0.0;
+    T score = 0.0;
     for(size_t i = 0; i < N; i++) {
       score += weights_[i] * features[i];
     }
@@ -273,38 +370,278 @@ class SARSALearner {
     return score;
   }
 
+  // a blocked dot product, each weight is loaded once per kScoreBlockRows rows
+  // rather than once per row behind a virtual Score call. each row is still
+  // summed in feature order, so scores match Score exactly
+  void ScoreBatch(const std::array<T, N>* features, size_t count,
+                  double* scores) const override {
+    size_t row = 0;
+    for (; row + kScoreBlockRows <= count; row += kScoreBlockRows) {
+      const std::array<T, N>* block = features + row;
+      T sums[kScoreBlockRows] = {};
+      for (size_t i = 0; i < N; i++) {
+        const T weight = weights_[i];
+        for (size_t j = 0; j < kScoreBlockRows; j++) {
+          sums[j] += weight * block[j][i];
+        }
+      }
+      for (size_t j = 0; j < kScoreBlockRows; j++) {
+        assert(!std::isinf(sums[j]));
+        assert(!std::isnan(sums[j]));
+        scores[row + j] = sums[j];
+      }
+    }
+    for (; row < count; row++) {
+      scores[row] = Score(features[row]);
+    }
+  }
+
+  bool GetLinearWeights(std::array<double, N>* weights) const override {
+    for (size_t i = 0; i < N; i++) {
+      (*weights)[i] = weights_[i];
+    }
+    return true;
+  }
+
+  // the trace decay of SARSA(lambda), zero for plain n-step SARSA
+  virtual double GetLambda() const { return 0.0; }
+
   double ComputeDiscountedRewards(const Experience* experience) const {
-    const Experience *e = experience;
-    assert(e->next_experience_);
-    double discounted_rewards = 0.0;
-    int i = 0;
-    while(e->next_experience_) {
-      // reward is diff between score after action plays out minus score at time
-      // of choosing action (this can get complicated if there's a bunch of other
-      // stuff going on at the same time)
-      double reward = e->next_experience_->score_ - e->score_;
-      //TODO: what does it mean if this->g_ != e->learner->g_ ?
-      discounted_rewards += pow(g_, i) * reward;
-      e = e->next_experience_;
-      i++;
+    return DiscountedReturn(experience, g_);
+  }
+
+  // adds a table of 2^log2_rows weights for hashed features, initially zero
+  // so hashed features only move scores once they've been learned
+  void EnableHashedFeatures(int log2_rows) {
+    assert(log2_rows > 0 && log2_rows <= 30);
+    size_t rows = (size_t)1 << log2_rows;
+    hashed_mask_ = rows - 1;
+    hashed_weights_.assign(rows, 0.0);
+    hashed_m_.assign(rows, 0.0);
+    hashed_r_.assign(rows, 0.0);
+    hashed_t_.assign(rows, 0);
+    hashed_max_weight_ = 0.0;
+  }
+
+  bool UsesHashedFeatures() const override {
+    return !hashed_weights_.empty();
+  }
+
+  double ScoreHashed(const HashedFeatures& hashed) const override {
+    if (hashed_weights_.empty()) {
+      return 0.0;
     }
+    T score = 0.0;
+    for (size_t k = 0; k < hashed.Size(); k++) {
+      score += hashed_weights_[hashed.keys_[k] & hashed_mask_] *
+               (T)hashed.values_[k];
+    }
+    assert(!std::isinf(score));
+    assert(!std::isnan(score));
+    return score;
+  }
 
-    return discounted_rewards + pow(g_, i) * e->PredictScore();
+  double HashedBound() const override {
+    return HashedFeatures::kMaxActive * hashed_max_weight_;
   }
 
-  std::unique_ptr<Experience> WrapAction(std::array<double, N> features,
-                                         std::unique_ptr<Action> action) {
-    action->SetScore(Score(features));
-    return std::make_unique<ExperienceImpl<N>>(std::move(action), 0.0, nullptr,
-                                               features, this);
+  size_t MemoryBytes() const override {
+    return sizeof(*this) + HashedTableBytes();
+  }
+
+  const T* GetHashedWeight(uint32_t key) const {
+    if (hashed_weights_.empty()) {
+      return nullptr;
+    }
+    return &hashed_weights_[key & hashed_mask_];
+  }
+
+ protected:
+  // rows scored together in ScoreBatch, small enough that their running sums
+  // stay in registers
+  static const size_t kScoreBlockRows = 4;
+
+  size_t HashedTableBytes() const {
+    return VectorBytes(hashed_weights_) + VectorBytes(hashed_m_) +
+           VectorBytes(hashed_r_) + VectorBytes(hashed_t_);
+  }
+
+  // false (and logs why) if the section was written by a different kind of
+  // learner, hyperparameters that only change how it goes on learning are
+  // just warned about
+  bool ReadHeader(const LinearLearnerView& view, const char* name,
+                  Logger* logger) {
+    const LearnerSectionHeader* header = view.header_;
+    if (header->lambda_ != GetLambda()) {
+      logger->Log(ERROR,
+                  "%s was trained with lambda %f, but this learner has lambda "
+                  "%f\n",
+                  name, header->lambda_, GetLambda());
+      return false;
+    }
+    if (header->n_ != n_ || header->g_ != g_ || header->b1_ != b1_ ||
+        header->b2_ != b2_) {
+      logger->Log(WARN,
+                  "%s was trained with different hyperparameters (n %f g %f "
+                  "b1 %f b2 %f), continuing with the configured ones\n",
+                  name, header->n_, header->g_, header->b1_, header->b2_);
+    }
+    t_ = header->t_;
+    return true;
+  }
+
+  // our feature i from the section's feature file_i
+  void ReadFeature(const LinearLearnerView& view, size_t i, size_t file_i) {
+    weights_[i] = view.weights_[file_i];
+    m_[i] = view.m_[file_i];
+    r_[i] = view.r_[file_i];
+    const FeatureStatsRecord& record = view.feature_stats_[file_i];
+    feature_stats_[i].Clear();
+    feature_stats_[i].n_ = record.n_;
+    feature_stats_[i].sum_ = record.sum_;
+    feature_stats_[i].ss_ = record.ss_;
+    feature_stats_[i].min_ = record.min_;
+    feature_stats_[i].max_ = record.max_;
+  }
+
+  void WriteLinearSection(CheckpointWriter* writer, const char* name,
+                          double lambda) const {
+    LearnerSectionHeader header;
+    memset(&header, 0, sizeof(header));
+    header.learner_id_ = learner_id_;
+    header.num_features_ = N;
+    header.t_ = t_;
+    header.n_ = n_;
+    header.g_ = g_;
+    header.b1_ = b1_;
+    header.b2_ = b2_;
+    header.epsilon_ = epsilon_;
+    header.lambda_ = lambda;
+    // sections always hold doubles, whatever precision we train in
+    std::array<double, N> weights;
+    std::array<double, N> m;
+    std::array<double, N> r;
+    for (size_t i = 0; i < N; i++) {
+      weights[i] = weights_[i];
+      m[i] = m_[i];
+      r[i] = r_[i];
+    }
+    WriteLinearLearner(writer, name, header, weights.data(), m.data(),
+                       r.data(), feature_stats_.data());
+  }
+
+  // takes one ADAM step against the gradient dL_dy * direction
+  // for plain SARSA direction is just the features, other learning rules (e.g.
+  // eligibility traces) can supply their own
+  void ApplyGradient(const std::array<T, N>& features,
+                     const std::array<T, N>& direction, double dL_dy) {
+    //hang on to the sum of the partials for debugging
+    double sum_d = 0.0;
+    t_ += 1;
+    for(size_t i = 0; i < N; i++) {
+      //keep some stats on the features for later analysis
+      feature_stats_[i].Update(features[i]);
+
+      //simple learning
+      //double weight_update = n * dL_dy * action->GetFeatureVector()[i];
+
+      //partial derivative of loss w.r.t. this weight
+      //by chain rule dL_dy * dy_dw
+      double dL_dw = dL_dy * direction[i];
+
+      // ADAM optimizier
+      // as per https://arxiv.org/pdf/1412.6980.pdf
+      // taken from slides:
+      // https://moodle2.cs.huji.ac.il/nu15/pluginfile.php/316969/mod_resource/content/1/adam_pres.pdf
+      m_[i] = b1_*m_[i] + (1.0-b1_)*(dL_dw);
+      r_[i] = b2_*r_[i] + (1.0-b2_)*(dL_dw * dL_dw);
+      double m_hat = m_[i] / (1.0 - pow(b1_, t_));
+      double r_hat = r_[i] / (1.0 - pow(b2_, t_));
+      double weight_update = n_ * m_hat / sqrt(r_hat + epsilon_);
+
+
+      assert(!std::isinf(weight_update));
+      assert(!std::isnan(weight_update));
+      weights_[i] = weights_[i] - weight_update;
+      sum_d += dL_dy * direction[i];
+    }
+  }
+
+  // lazy ADAM on the rows of the active hashed features, for the step t_ that
+  // ApplyGradient just took. rows that sat out steps had zero gradient for
+  // them, so their moments decay by b1, b2 per missed step, which we catch up
+  // on here. unlike dense ADAM the weights don't keep drifting on momentum
+  // while a row is inactive
+  void ApplyHashedGradient(const HashedFeatures& hashed, double dL_dy) {
+    if (hashed_weights_.empty()) {
+      return;
+    }
+    for (size_t k = 0; k < hashed.Size(); k++) {
+      size_t i = hashed.keys_[k] & hashed_mask_;
+      int missed = t_ - hashed_t_[i] - 1;
+      if (missed > 0) {
+        hashed_m_[i] *= pow(b1_, missed);
+        hashed_r_[i] *= pow(b2_, missed);
+      }
+      hashed_t_[i] = t_;
+
+      double dL_dw = dL_dy * hashed.values_[k];
+      hashed_m_[i] = b1_*hashed_m_[i] + (1.0-b1_)*(dL_dw);
+      hashed_r_[i] = b2_*hashed_r_[i] + (1.0-b2_)*(dL_dw * dL_dw);
+      double m_hat = hashed_m_[i] / (1.0 - pow(b1_, t_));
+      double r_hat = hashed_r_[i] / (1.0 - pow(b2_, t_));
+      double weight_update = n_ * m_hat / sqrt(r_hat + epsilon_);
+      assert(!std::isinf(weight_update));
+      assert(!std::isnan(weight_update));
+      hashed_weights_[i] = hashed_weights_[i] - weight_update;
+      hashed_max_weight_ =
+          std::max(hashed_max_weight_, std::abs((double)hashed_weights_[i]));
+    }
+  }
+
+  void WriteHashedSection(CheckpointWriter* writer, const char* name) const {
+    if (hashed_weights_.empty()) {
+      return;
+    }
+    HashedTableHeader header;
+    memset(&header, 0, sizeof(header));
+    header.num_rows_ = hashed_weights_.size();
+    header.max_weight_ = hashed_max_weight_;
+    std::vector<double> weights(hashed_weights_.begin(),
+                                hashed_weights_.end());
+    std::vector<double> m(hashed_m_.begin(), hashed_m_.end());
+    std::vector<double> r(hashed_r_.begin(), hashed_r_.end());
+    std::vector<int64_t> t(hashed_t_.begin(), hashed_t_.end());
+    WriteHashedTable(writer, name, header, weights.data(), m.data(), r.data(),
+                     t.data());
+  }
+
+  // the table is only restored if it's enabled with the same size
+  void ReadHashedSection(const Checkpoint& checkpoint, const char* name,
+                         Logger* logger) {
+    if (hashed_weights_.empty()) {
+      return;
+    }
+    HashedTableView view;
+    if (!ViewHashedTable(checkpoint, name, hashed_weights_.size(), &view,
+                         logger)) {
+      logger->Log(WARN, "no hashed table for %s, starting from zero\n", name);
+      return;
+    }
+    hashed_max_weight_ = view.header_->max_weight_;
+    for (size_t i = 0; i < hashed_weights_.size(); i++) {
+      hashed_weights_[i] = view.weights_[i];
+      hashed_m_[i] = view.m_[i];
+      hashed_r_[i] = view.r_[i];
+      hashed_t_[i] = view.t_[i];
+    }
   }
 
- private:
   int learner_id_;
 
   double n_; //learning rate
   double g_; //discount factor
-  std::array<double, N> weights_;
+  std::array<T, N> weights_;
 
   std::array<Stats, N> feature_stats_;
 
@@ -313,84 +650,321 @@ class SARSALearner {
   double b2_;
   //TODO: parametrize ADAM epsilon?
   double epsilon_ = .000000001; //10^-8
-  //TODO: setting learning epoch always to 0 means we can't load state
-  //so this would need to get serialized out
+  //learning epoch, saved with checkpoints so training can resume
   int t_=0;
-  std::array<double, N> m_;
-  std::array<double, N> r_;
+  std::array<T, N> m_;
+  std::array<T, N> r_;
+
+  //optional hashed feature table, empty unless EnableHashedFeatures
+  size_t hashed_mask_ = 0;
+  std::vector<T> hashed_weights_;
+  std::vector<T> hashed_m_;
+  std::vector<T> hashed_r_;
+  std::vector<int> hashed_t_; //step each row was last updated
+  double hashed_max_weight_ = 0.0; //never shrinks, see HashedBound
 
   Logger* learn_logger_;
 };
 
-// just one kind of action, one model
-template<size_t N>
-class SARSAActionFactory : public ActionFactory {
+// SARSA(lambda) with accumulating eligibility traces
+// instead of waiting n steps for a discounted return, this learns online from
+// the one step TD error of every experience and assigns that error to earlier
+// experiences through a decaying trace of their features.
+// one trace is kept per (agent, learner), so agents using this learner only
+// need to keep their experiences alive for a single step (n_steps = 1) and
+// memory is O(N) per agent rather than O(N * n_steps * actions).
+template <size_t N, typename T = double>
+class SARSALambdaLearner : public SARSALearner<N, T> {
  public:
-  static SARSALearner<N> CreateLearner(int learner_id, double n, double g,
-                                       double b1, double b2,
-                                       std::mt19937* random_generator,
-                                       Logger* learn_logger) {
-    std::array<double, N> weights;
+  //creates a randomly initialized learner
+  static std::unique_ptr<SARSALambdaLearner> Create(
+      int learner_id, double n, double g, double lambda, double b1, double b2,
+      std::mt19937& random_generator, Logger* learn_logger) {
+    std::array<T, N> weights;
     std::array<Stats, N> stats;
-    std::array<double, N> m;
-    std::array<double, N> r;
+    std::array<T, N> m;
+    std::array<T, N> r;
 
     std::uniform_real_distribution<> weight_dist(-1.0, 1.0);
     for (size_t i = 0; i < N; i++) {
-      weights[i] = weight_dist(*random_generator);
+      weights[i] = weight_dist(random_generator);
       m[i] = 0.0;
       r[i] = 0.0;
       stats[i] = Stats();
     }
-    return SARSALearner<N>(learner_id, n, g, b1, b2, weights, stats, m, r,
-                           learn_logger);
+
+    return std::make_unique<SARSALambdaLearner>(learner_id, n, g, lambda, b1,
+                                                b2, weights, stats, m, r,
+                                                learn_logger);
+  }
+
+  SARSALambdaLearner(int learner_id, double n, double g, double lambda,
+                     double b1, double b2, std::array<T, N> weights,
+                     std::array<Stats, N> s, std::array<T, N> m,
+                     std::array<T, N> r, Logger* learn_logger)
+      : SARSALearner<N, T>(learner_id, n, g, b1, b2, weights, s, m, r,
+                           learn_logger),
+        lambda_(lambda) {}
+
+  double Learn(CVC* cvc, ExperienceImpl<N, T>* experience) override {
+    Action* action = experience->action_.get();
+    assert(action);
+    assert(experience->next_experience_);
+    //traces over the hashed table aren't supported
+    assert(!this->UsesHashedFeatures());
+
+    //SARSA(lambda) with accumulating traces:
+    //  d = r + g*Q(s', a') - Q(s, a)
+    //  e <- g * lambda * e + F(s, a)
+    //  w <- w + n * d * e
+    //we express d as the squared error gradient so we can reuse ADAM:
+    //  dL_dy = 2 * (Q(s, a) - (r + g*Q(s', a')))
+    //  dL_dw = dL_dy * e
+    double updated_score = this->Score(experience->features_);
+    double reward =
+        experience->next_experience_->score_ - experience->score_;
+    double truth_estimate =
+        reward + this->g_ * experience->next_experience_->PredictScore();
+    double loss = pow(updated_score - truth_estimate, 2);
+    double dL_dy = 2 * (updated_score - truth_estimate);
+    assert(!std::isinf(dL_dy));
+
+    LogLearnStep(this->learn_logger_, cvc, this->learner_id_, experience,
+                 experience->features_, loss, dL_dy, updated_score,
+                 truth_estimate);
+
+    //traces decay once per tick, lazily, so ticks in which the agent used
+    //some other learner still count
+    Trace& trace = traces_[action->GetActor()];
+    double decay = 0.0;
+    if (trace.last_tick_ >= 0) {
+      decay = pow(this->g_ * lambda_, cvc->Now() - trace.last_tick_);
+    }
+    for (size_t i = 0; i < N; i++) {
+      trace.e_[i] = decay * trace.e_[i] + experience->features_[i];
+    }
+    trace.last_tick_ = cvc->Now();
+
+    this->ApplyGradient(experience->features_, trace.e_, dL_dy);
+
+    return dL_dy;
+  }
+
+  // traces are per agent and transient, so only the shared model is saved
+  void WriteCheckpoint(CheckpointWriter* writer,
+                       const char* name) const override {
+    this->WriteLinearSection(writer, name, lambda_);
   }
 
-  SARSAActionFactory(SARSALearner<N> learner) : learner_(learner) {}
+  double GetLambda() const override { return lambda_; }
+
+  // the parameters and every agent's trace
+  size_t MemoryBytes() const override {
+    return sizeof(*this) + this->HashedTableBytes() + HashMapBytes(traces_);
+  }
+
+  // drop the trace for an agent, e.g. at the end of an episode
+  void ResetTrace(Character* character) { traces_.erase(character); }
+
+  const std::array<T, N>* GetTrace(Character* character) const {
+    auto it = traces_.find(character);
+    if (it == traces_.end()) {
+      return nullptr;
+    }
+    return &it->second.e_;
+  }
+
+ private:
+  struct Trace {
+    std::array<T, N> e_ = {};
+    int last_tick_ = -1;
+  };
+
+  double lambda_; //trace decay
+  std::unordered_map<Character*, Trace> traces_;
+};
+
+// inference only model loaded from an int8 or fp16 export
+// (see SaveQuantizedCheckpoint). int8 weights are kept as is and dequantized
+// once per score, fp16 weights are widened to T when loaded.
+// Learning is not supported, SARSAAgents using this are always frozen.
+template <size_t N, typename T = float>
+class QuantizedLearner : public Learner<N, T> {
+ public:
+  QuantizedLearner(int learner_id)
+      : learner_id_(learner_id), format_(kFp16Weights), scale_(1.0) {
+    int8_weights_.fill(0);
+    weights_.fill(0.0);
+  }
+
+  bool CanLearn() const override { return false; }
+
+  // unreachable, see CanLearn
+  double Learn(CVC* cvc, ExperienceImpl<N, T>* experience) override {
+    assert(false);
+    return 0.0;
+  }
+
+  double Score(const std::array<T, N> features) const override {
+    T score = 0.0;
+    if (kInt8Weights == format_) {
+      for (size_t i = 0; i < N; i++) {
+        score += (T)int8_weights_[i] * features[i];
+      }
+      score *= scale_;
+    } else {
+      for (size_t i = 0; i < N; i++) {
+        score += weights_[i] * features[i];
+      }
+    }
+    assert(!std::isinf(score));
+    assert(!std::isnan(score));
+    return score;
+  }
+
+  bool GetLinearWeights(std::array<double, N>* weights) const override {
+    for (size_t i = 0; i < N; i++) {
+      (*weights)[i] = kInt8Weights == format_ ? scale_ * int8_weights_[i]
+                                              : (double)weights_[i];
+    }
+    return true;
+  }
+
+  void WriteCheckpoint(CheckpointWriter* writer,
+                       const char* name) const override {
+    WriteQuantizedCheckpoint(writer, name, format_);
+  }
+
+  bool WriteQuantizedCheckpoint(CheckpointWriter* writer, const char* name,
+                                WeightFormat format) const override {
+    std::array<double, N> weights;
+    for (size_t i = 0; i < N; i++) {
+      weights[i] = kInt8Weights == format_ ? scale_ * int8_weights_[i]
+                                           : (double)weights_[i];
+    }
+    WriteQuantizedLinear(writer, name, learner_id_, weights.data(), N, format);
+    return true;
+  }
+
+  bool ReadCheckpoint(const Checkpoint& checkpoint, const char* name,
+                      Logger* logger) override {
+    QuantizedLinearView view;
+    if (!ViewQuantizedLinear(checkpoint, name, N, &view, logger)) {
+      return false;
+    }
+
+    format_ = view.format_;
+    scale_ = view.header_->scale_;
+    for (size_t i = 0; i < N; i++) {
+      if (kInt8Weights == format_) {
+        int8_weights_[i] = view.int8_weights_[i];
+      } else {
+        weights_[i] = HalfToFloat(view.fp16_weights_[i]);
+      }
+    }
+    return true;
+  }
+
+  WeightFormat GetFormat() const { return format_; }
+
+  size_t MemoryBytes() const override { return sizeof(*this); }
+
+ private:
+  int learner_id_;
+  WeightFormat format_;
+  T scale_;
+  std::array<int8_t, N> int8_weights_;
+  std::array<T, N> weights_;
+};
+
+// just one kind of action, one model
+// Schema is the FeatureSchema the model's features are laid out by
+template <class Schema, typename T = double>
+class SARSAActionFactory : public ActionFactory {
+ public:
+  static const size_t kNumFeatures = Schema::kNumFeatures;
+  static const size_t N = kNumFeatures;
+  typedef T Scalar;
+
+  static std::unique_ptr<Learner<N, T>> CreateLearner(
+      int learner_id, double n, double g, double b1, double b2,
+      std::mt19937* random_generator, Logger* learn_logger) {
+    return SARSALearner<N, T>::Create(learner_id, n, g, b1, b2,
+                                      *random_generator, learn_logger);
+  }
+
+  static std::unique_ptr<Learner<N, T>> CreateLambdaLearner(
+      int learner_id, double n, double g, double lambda, double b1, double b2,
+      std::mt19937* random_generator, Logger* learn_logger) {
+    return SARSALambdaLearner<N, T>::Create(learner_id, n, g, lambda, b1, b2,
+                                            *random_generator, learn_logger);
+  }
+
+  // weights come from a quantized checkpoint, see QuantizedLearner
+  static std::unique_ptr<Learner<N, T>> CreateQuantizedLearner(
+      int learner_id) {
+    return std::make_unique<QuantizedLearner<N, T>>(learner_id);
+  }
+
+  SARSAActionFactory(std::unique_ptr<Learner<N, T>> learner)
+      : learner_(std::move(learner)) {
+    learner_->SetFeatureNames(Schema::Names());
+  }
 
   virtual ~SARSAActionFactory() {}
 
+  bool CanLearn() const override { return learner_->CanLearn(); }
+
   virtual double EnumerateActions(
       CVC* cvc, Character* character,
       std::vector<std::unique_ptr<Experience>>* actions) = 0;
 
  protected:
-  SARSALearner<N> learner_;
+  std::unique_ptr<Learner<N, T>> learner_;
 };
 
 // just one kind of response, one model
-template<size_t N>
+// Schema is the FeatureSchema the model's features are laid out by
+template <class Schema, typename T = double>
 class SARSAResponseFactory : public ResponseFactory {
  public:
+  static const size_t kNumFeatures = Schema::kNumFeatures;
+  static const size_t N = kNumFeatures;
+  typedef T Scalar;
+
+  static std::unique_ptr<Learner<N, T>> CreateLearner(
+      int learner_id, double n, double g, double b1, double b2,
+      std::mt19937* random_generator, Logger* learn_logger) {
+    return SARSALearner<N, T>::Create(learner_id, n, g, b1, b2,
+                                      *random_generator, learn_logger);
+  }
 
-  static SARSALearner<N> CreateLearner(int learner_id, double n, double g,
-                                       double b1, double b2,
-                                       std::mt19937* random_generator,
-                                       Logger* learn_logger) {
-    std::array<double, N> weights;
-    std::array<Stats, N> stats;
-    std::array<double, N> m;
-    std::array<double, N> r;
+  static std::unique_ptr<Learner<N, T>> CreateLambdaLearner(
+      int learner_id, double n, double g, double lambda, double b1, double b2,
+      std::mt19937* random_generator, Logger* learn_logger) {
+    return SARSALambdaLearner<N, T>::Create(learner_id, n, g, lambda, b1, b2,
+                                            *random_generator, learn_logger);
+  }
 
-    std::uniform_real_distribution<> weight_dist(-1.0, 1.0);
-    for (size_t i = 0; i < N; i++) {
-      weights[i] = weight_dist(*random_generator);
-      m[i] = 0.0;
-      r[i] = 0.0;
-      stats[i] = Stats();
-    }
-    return SARSALearner<N>(learner_id, n, g, b1, b2, weights, stats, m, r,
-                           learn_logger);
+  // weights come from a quantized checkpoint, see QuantizedLearner
+  static std::unique_ptr<Learner<N, T>> CreateQuantizedLearner(
+      int learner_id) {
+    return std::make_unique<QuantizedLearner<N, T>>(learner_id);
   }
 
-  SARSAResponseFactory(SARSALearner<N> learner) : learner_(learner) {}
+  SARSAResponseFactory(std::unique_ptr<Learner<N, T>> learner)
+      : learner_(std::move(learner)) {
+    learner_->SetFeatureNames(Schema::Names());
+  }
   virtual ~SARSAResponseFactory() {}
 
+  bool CanLearn() const override { return learner_->CanLearn(); }
+
   virtual double Respond(
       CVC* cvc, Character* character, Action* action,
       std::vector<std::unique_ptr<Experience>>* actions) = 0;
  protected:
-  SARSALearner<N> learner_;
+  std::unique_ptr<Learner<N, T>> learner_;
 };
 
 } //namespace cvc::sarsa
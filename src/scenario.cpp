@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "util.h"
+#include "scenario.h"
+
+namespace {
+
+std::string Trim(const std::string& s) {
+  size_t start = s.find_first_not_of(" \t\r\n");
+  if (std::string::npos == start) {
+    return "";
+  }
+  size_t end = s.find_last_not_of(" \t\r\n");
+  return s.substr(start, end - start + 1);
+}
+
+bool ParseInt(const std::string& value, int* out) {
+  char* end;
+  errno = 0;
+  long parsed = strtol(value.c_str(), &end, 10);
+  if (value.empty() || *end || errno || parsed != (int)parsed) {
+    return false;
+  }
+  *out = parsed;
+  return true;
+}
+
+bool ParseUnsigned(const std::string& value, unsigned* out) {
+  int parsed;
+  if (!ParseInt(value, &parsed) || parsed < 0) {
+    return false;
+  }
+  *out = parsed;
+  return true;
+}
+
+bool ParseDouble(const std::string& value, double* out) {
+  char* end;
+  errno = 0;
+  double parsed = strtod(value.c_str(), &end);
+  if (value.empty() || *end || errno) {
+    return false;
+  }
+  *out = parsed;
+  return true;
+}
+
+bool ParseIntList(const std::string& value, std::vector<int>* out) {
+  std::vector<int> parsed;
+  size_t start = 0;
+  while (start <= value.size()) {
+    size_t end = value.find(',', start);
+    if (std::string::npos == end) {
+      end = value.size();
+    }
+    int x;
+    if (!ParseInt(Trim(value.substr(start, end - start)), &x)) {
+      return false;
+    }
+    parsed.push_back(x);
+    start = end + 1;
+  }
+  *out = parsed;
+  return true;
+}
+
+}
+
+bool Scenario::Set(const std::string& key, const std::string& value,
+                   Logger* logger) {
+  bool parsed = true;
+  if ("heuristic_agents" == key) {
+    parsed = ParseInt(value, &heuristic_agents_);
+  } else if ("learning_agents" == key) {
+    parsed = ParseInt(value, &learning_agents_);
+  } else if ("organizations" == key) {
+    parsed = ParseInt(value, &organizations_);
+  } else if ("ticks" == key) {
+    parsed = ParseInt(value, &ticks_);
+  } else if ("log_state_every" == key) {
+    parsed = ParseInt(value, &log_state_every_);
+  } else if ("seed" == key) {
+    parsed = ParseUnsigned(value, &seed_);
+  } else if ("learning_rate" == key) {
+    parsed = ParseDouble(value, &learning_rate_);
+  } else if ("discount" == key) {
+    parsed = ParseDouble(value, &discount_);
+  } else if ("adam_beta1" == key) {
+    parsed = ParseDouble(value, &adam_beta1_);
+  } else if ("adam_beta2" == key) {
+    parsed = ParseDouble(value, &adam_beta2_);
+  } else if ("n_steps" == key) {
+    parsed = ParseInt(value, &n_steps_);
+  } else if ("lambda" == key) {
+    parsed = ParseDouble(value, &lambda_);
+  } else if ("initial_epsilon" == key) {
+    parsed = ParseDouble(value, &initial_epsilon_);
+  } else if ("epsilon_scale" == key) {
+    parsed = ParseDouble(value, &epsilon_scale_);
+  } else if ("learn_log" == key) {
+    learn_log_ = value;
+  } else if ("policy_log" == key) {
+    policy_log_ = value;
+  } else if ("action_log" == key) {
+    action_log_ = value;
+  } else if ("summary_log" == key) {
+    summary_log_ = value;
+  } else if ("perf_report" == key) {
+    perf_report_ = value;
+  } else if ("perf_window" == key) {
+    parsed = ParseInt(value, &perf_window_);
+  } else if ("memory_window" == key) {
+    parsed = ParseInt(value, &memory_window_);
+  } else if ("allocation_log" == key) {
+    allocation_log_ = value;
+  } else if ("sweep" == key) {
+    parsed = ParseIntList(value, &sweep_);
+  } else {
+    logger->Log(ERROR, "unknown scenario key %s\n", key.c_str());
+    return false;
+  }
+  if (!parsed) {
+    logger->Log(ERROR, "bad value for %s: %s\n", key.c_str(), value.c_str());
+  }
+  return parsed;
+}
+
+bool Scenario::Set(const std::string& assignment, Logger* logger) {
+  size_t equals = assignment.find('=');
+  if (std::string::npos == equals) {
+    logger->Log(ERROR, "expected key=value, got %s\n", assignment.c_str());
+    return false;
+  }
+  return Set(Trim(assignment.substr(0, equals)),
+             Trim(assignment.substr(equals + 1)), logger);
+}
+
+bool Scenario::Read(const char* path, Logger* logger) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    logger->Log(ERROR, "could not open scenario %s\n", path);
+    return false;
+  }
+
+  bool ok = true;
+  int line_number = 0;
+  char buffer[1024];
+  while (ok && fgets(buffer, sizeof(buffer), file)) {
+    line_number++;
+    std::string line(buffer);
+    size_t comment = line.find('#');
+    if (std::string::npos != comment) {
+      line.resize(comment);
+    }
+    line = Trim(line);
+    if (line.empty()) {
+      continue;
+    }
+    ok = Set(line, logger);
+    if (!ok) {
+      logger->Log(ERROR, "in %s line %d\n", path, line_number);
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+bool Scenario::Validate(Logger* logger) const {
+  std::vector<int> populations = sweep_;
+  if (populations.empty()) {
+    populations.push_back(learning_agents_);
+  }
+  for (int learning_agents : populations) {
+    // organizations are founded by learning agents
+    if (learning_agents < organizations_) {
+      logger->Log(ERROR, "%d learning agents can't found %d organizations\n",
+                  learning_agents, organizations_);
+      return false;
+    }
+  }
+  if (heuristic_agents_ < 0 || organizations_ <= 0 || ticks_ < 0 ||
+      memory_window_ < 0 ||
+      log_state_every_ <= 0 || n_steps_ <= 0 || perf_window_ <= 0) {
+    logger->Log(ERROR, "scenario counts must be positive\n");
+    return false;
+  }
+  if (lambda_ < 0.0 || lambda_ > 1.0) {
+    logger->Log(ERROR, "lambda must be in [0, 1]\n");
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,79 @@
+#ifndef SCENARIO_H_
+#define SCENARIO_H_
+
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+// Everything a run of main is configured with that isn't a mode flag
+//
+// defaults are the standard run. scenarios can be read from a file of
+// key = value lines (# starts a comment) and individual values overridden
+// with Set, e.g. from the command line. keys are the member names without
+// the trailing underscore, lists are comma separated, e.g.
+//
+//  # a bigger population, with shorter learning horizons
+//  learning_agents = 1000
+//  organizations = 50
+//  ticks = 2000
+//  n_steps = 10
+//  perf_report = /tmp/perf.json
+//  sweep = 25,100,1000
+struct Scenario {
+  // population
+  int heuristic_agents_ = 0;
+  int learning_agents_ = 25;
+  int organizations_ = 5;
+
+  // running
+  int ticks_ = 10000;
+  // CVC::LogState every this many ticks (and at the start and end)
+  int log_state_every_ = 10000;
+  // zero seeds the game from std::random_device
+  unsigned seed_ = 0;
+
+  // learners
+  double learning_rate_ = 0.001;
+  double discount_ = 0.9;
+  double adam_beta1_ = 0.9;
+  double adam_beta2_ = 0.999;
+  int n_steps_ = 100;
+  // set to something in (0, 1] to use SARSA(lambda) learners, which learn
+  // every tick instead of keeping n_steps of experiences around
+  double lambda_ = 0.0;
+
+  // learning policy, epsilon decays as initial / sqrt(scale * tick + 1)
+  double initial_epsilon_ = 0.5;
+  double epsilon_scale_ = 0.1;
+
+  // text logs, appended to
+  std::string learn_log_ = "/tmp/learn_log";
+  std::string policy_log_ = "/tmp/policy_log";
+  std::string action_log_ = "/tmp/action_log";
+  std::string summary_log_ = "/tmp/summary_log";
+
+  // where to write a performance report (see PerfRecorder), none if empty
+  std::string perf_report_;
+  // ticks per ticks/sec sample in the report
+  int perf_window_ = 1000;
+  // log the memory footprint by subsystem every this many ticks (see
+  // MemoryReport), never if zero
+  int memory_window_ = 0;
+  // where to log allocations per phase every tick (see AllocationRecorder),
+  // none if empty
+  std::string allocation_log_;
+  // runs the scenario once per entry with that many learning agents instead
+  std::vector<int> sweep_;
+
+  // false (and logs why) if key isn't known or value doesn't parse
+  bool Set(const std::string& key, const std::string& value, Logger* logger);
+  // key=value
+  bool Set(const std::string& assignment, Logger* logger);
+  // sets every value in the file at path
+  bool Read(const char* path, Logger* logger);
+  // false (and logs why) if the values don't make a runnable scenario
+  bool Validate(Logger* logger) const;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef SETTLEMENT_H_
+#define SETTLEMENT_H_
+
+#include "core.h"
+
+// applies effects that actions record while they're evaluated all at once
+// at the end of DecisionEngine::EvaluateQueuedActions, before characters are
+// rescored, e.g. to add up many small updates to shared totals in one pass
+class Settlement {
+ public:
+  virtual ~Settlement() {}
+
+  virtual void Settle(CVC* cvc) = 0;
+};
+
+#endif
@@ -3,8 +3,16 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
+class BinaryLog;
+class EventLog;
+// see binary_log.h
+void RecordBinaryLog(BinaryLog* log, const char* logger_name,
+                     const char* format, va_list args);
+
 enum LogLevel {
   TRACE,
   DEBUG,
@@ -21,7 +29,12 @@ class Logger {
 
   void Log(const LogLevel level, const char* format, ...) {
     if(level >= log_level_) {
-      if(log_sink_) {
+      if(binary_log_) {
+        va_list args;
+        va_start (args, format);
+        RecordBinaryLog(binary_log_, logger_name_, format, args);
+        va_end (args);
+      } else if(log_sink_) {
         fprintf(log_sink_, "%s	", logger_name_);
         va_list args;
         va_start (args, format);
@@ -37,10 +50,25 @@ class Logger {
   void SetLogLevel(LogLevel level) {
     log_level_ = level;
   }
+  // records events in log instead of writing them to the sink, nullptr goes
+  // back to the sink. log must outlive this Logger's use
+  void SetBinaryLog(BinaryLog* log) {
+    binary_log_ = log;
+  }
+  // structured events (see event_log.h) go to events instead of being
+  // formatted, whatever the log level. events must outlive this Logger's use
+  void SetEventLog(EventLog* events) {
+    event_log_ = events;
+  }
+  EventLog* GetEventLog() {
+    return event_log_;
+  }
  private:
   const char* logger_name_;
   FILE *log_sink_ = stderr;
   LogLevel log_level_ = INFO;
+  BinaryLog* binary_log_ = nullptr;
+  EventLog* event_log_ = nullptr;
 };
 
 struct Stats {
@@ -50,14 +78,14 @@ struct Stats {
   double sum_ = 0.0;
   double ss_ = 0.0;
   double min_ = std::numeric_limits<double>::max();
-  double max_ = std::numeric_limits<double>::min();
+  double max_ = std::numeric_limits<double>::lowest();
 
   void Clear() {
     n_ = 0;
     sum_ = 0.0;
     ss_ = 0.0;
     min_ = std::numeric_limits<double>::max();
-    max_ = std::numeric_limits<double>::min();
+    max_ = std::numeric_limits<double>::lowest();
   }
 
   void Update(double datum) {
@@ -75,7 +103,8 @@ struct Stats {
   void ComputeStats(double sum, double ss, int n) {
     n_ = n;
     mean_ = sum / (double)n_;
-    stdev_ = sqrt(ss / (double)n_ - (mean_ * mean_));
+    // rounding can leave the variance of (nearly) equal data just below zero
+    stdev_ = sqrt(std::max(0.0, ss / (double)n_ - (mean_ * mean_)));
   }
 
   void ComputeStats() {
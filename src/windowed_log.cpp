@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "util.h"
+#include "event_log.h"
+#include "windowed_log.h"
+
+int LogHistogram::Bucket(double value) {
+  double magnitude = std::abs(value);
+  int bucket;
+  if (std::isinf(magnitude)) {
+    bucket = kBucketsPerSign;
+  } else if (!(magnitude >= ldexp(1.0, kMinExponent - 1))) {
+    // including nan
+    return 0;
+  } else {
+    // magnitude is in [2^(exponent-1), 2^exponent)
+    int exponent;
+    frexp(magnitude, &exponent);
+    bucket = std::min(exponent - kMinExponent + 1, kBucketsPerSign);
+  }
+  return value < 0.0 ? -bucket : bucket;
+}
+
+double LogHistogram::BucketBound(int bucket) {
+  if (0 == bucket) {
+    return 0.0;
+  }
+  double bound = ldexp(1.0, std::abs(bucket) + kMinExponent - 2);
+  return bucket < 0 ? -bound : bound;
+}
+
+void LogHistogram::Add(double value) {
+  counts_[Bucket(value) + kBucketsPerSign]++;
+}
+
+WindowedEventLog::WindowedEventLog(int window_ticks, Logger* summary_logger,
+                                   EventLog* sampled, size_t sample_every)
+    : window_ticks_(window_ticks),
+      summary_logger_(summary_logger),
+      sampled_(sampled),
+      sample_every_(sample_every) {
+  assert(window_ticks_ > 0);
+}
+
+WindowedEventLog::~WindowedEventLog() { Flush(); }
+
+template <class Summary>
+Summary* WindowedEventLog::Find(std::vector<Entry<Summary>>* entries,
+                                int learner_id, const char* action_id) {
+  for (Entry<Summary>& entry : *entries) {
+    if (entry.learner_id_ == learner_id && entry.action_id_ == action_id) {
+      return &entry.summary_;
+    }
+  }
+  entries->push_back({learner_id, action_id, Summary()});
+  return &entries->back().summary_;
+}
+
+void WindowedEventLog::Advance(int tick) {
+  int window_start = tick - tick % window_ticks_;
+  if (window_start > window_start_) {
+    Flush();
+    window_start_ = window_start;
+  }
+}
+
+bool WindowedEventLog::Sample(size_t* counter) {
+  if (!sampled_ || 0 == sample_every_) {
+    return false;
+  }
+  return 0 == (*counter)++ % sample_every_;
+}
+
+void WindowedEventLog::LogAction(const ActionEvent& event) {
+  Advance(event.tick_);
+  ActionSummary* summary = Find(&actions_, -1, event.action_id_);
+  summary->count_++;
+  if (!event.valid_) {
+    summary->invalid_++;
+  }
+  summary->actor_score_.Update(event.actor_score_);
+  summary->score_.Update(event.score_);
+  if (Sample(&action_events_)) {
+    sampled_->LogAction(event);
+  }
+}
+
+void WindowedEventLog::LogLearn(const LearnEvent& event) {
+  Advance(event.tick_);
+  LearnSummary* summary =
+      Find(&learns_, event.learner_id_, event.action_id_);
+  summary->loss_.Update(event.loss_);
+  summary->dL_dy_.Update(event.dL_dy_);
+  summary->prediction_.Update(event.prediction_);
+  summary->target_.Update(event.target_);
+  summary->reward_.Update(event.reward_);
+  summary->loss_histogram_.Add(event.loss_);
+  summary->dL_dy_histogram_.Add(event.dL_dy_);
+  summary->prediction_histogram_.Add(event.prediction_);
+  summary->target_histogram_.Add(event.target_);
+  summary->reward_histogram_.Add(event.reward_);
+  if (Sample(&learn_events_)) {
+    sampled_->LogLearn(event);
+  }
+}
+
+void WindowedEventLog::LogPolicy(const PolicyEvent& event) {
+  Advance(event.tick_);
+  PolicySummary* summary = Find(&policies_, -1, event.action_id_);
+  summary->probability_.Update(event.probability_);
+  summary->rank_.Update(event.rank_);
+  summary->num_options_.Update(event.num_options_);
+  summary->ranks_[std::min(event.rank_, kMaxRank)]++;
+  if (Sample(&policy_events_)) {
+    sampled_->LogPolicy(event);
+  }
+}
+
+void WindowedEventLog::WriteStats(std::string* line, const Stats& stats) {
+  Stats computed = stats;
+  computed.ComputeStats();
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "\t%f\t%f\t%f\t%f", computed.mean_,
+           computed.stdev_, computed.min_, computed.max_);
+  line->append(buffer);
+}
+
+void WindowedEventLog::WriteHistogram(const char* quantity, int learner_id,
+                                      const std::string& action_id,
+                                      const LogHistogram& histogram) {
+  std::string buckets;
+  char buffer[64];
+  for (int bucket = -LogHistogram::kBucketsPerSign;
+       bucket <= LogHistogram::kBucketsPerSign; bucket++) {
+    uint32_t count = histogram.counts_[bucket + LogHistogram::kBucketsPerSign];
+    if (0 == count) {
+      continue;
+    }
+    snprintf(buffer, sizeof(buffer), "%s%g:%u", buckets.empty() ? "" : " ",
+             LogHistogram::BucketBound(bucket), count);
+    buckets.append(buffer);
+  }
+  summary_logger_->Log(INFO, "hist\t%d\t%d\t%s\t%s\t%s\n", window_start_,
+                       learner_id, action_id.c_str(), quantity,
+                       buckets.c_str());
+}
+
+void WindowedEventLog::Flush() {
+  if (window_start_ < 0) {
+    return;
+  }
+
+  std::string line;
+  for (const Entry<ActionSummary>& entry : actions_) {
+    const ActionSummary& summary = entry.summary_;
+    line.clear();
+    WriteStats(&line, summary.actor_score_);
+    WriteStats(&line, summary.score_);
+    summary_logger_->Log(INFO, "action\t%d\t%s\t%d\t%d%s\n", window_start_,
+                         entry.action_id_.c_str(), summary.count_,
+                         summary.invalid_, line.c_str());
+  }
+
+  for (const Entry<LearnSummary>& entry : learns_) {
+    const LearnSummary& summary = entry.summary_;
+    line.clear();
+    WriteStats(&line, summary.loss_);
+    WriteStats(&line, summary.dL_dy_);
+    WriteStats(&line, summary.prediction_);
+    WriteStats(&line, summary.target_);
+    WriteStats(&line, summary.reward_);
+    summary_logger_->Log(INFO, "learn\t%d\t%d\t%s\t%d%s\n", window_start_,
+                         entry.learner_id_, entry.action_id_.c_str(),
+                         summary.loss_.n_, line.c_str());
+    WriteHistogram("loss", entry.learner_id_, entry.action_id_,
+                   summary.loss_histogram_);
+    WriteHistogram("dL_dy", entry.learner_id_, entry.action_id_,
+                   summary.dL_dy_histogram_);
+    WriteHistogram("prediction", entry.learner_id_, entry.action_id_,
+                   summary.prediction_histogram_);
+    WriteHistogram("target", entry.learner_id_, entry.action_id_,
+                   summary.target_histogram_);
+    WriteHistogram("reward", entry.learner_id_, entry.action_id_,
+                   summary.reward_histogram_);
+  }
+
+  for (const Entry<PolicySummary>& entry : policies_) {
+    const PolicySummary& summary = entry.summary_;
+    line.clear();
+    WriteStats(&line, summary.probability_);
+    WriteStats(&line, summary.rank_);
+    WriteStats(&line, summary.num_options_);
+    line.append("\t");
+    char buffer[16];
+    for (size_t rank = 0; rank <= kMaxRank; rank++) {
+      snprintf(buffer, sizeof(buffer), "%s%u", rank > 0 ? " " : "",
+               summary.ranks_[rank]);
+      line.append(buffer);
+    }
+    summary_logger_->Log(INFO, "policy\t%d\t%s\t%d%s\n", window_start_,
+                         entry.action_id_.c_str(), summary.probability_.n_,
+                         line.c_str());
+  }
+
+  actions_.clear();
+  learns_.clear();
+  policies_.clear();
+}
@@ -0,0 +1,138 @@
+#ifndef WINDOWED_LOG_H_
+#define WINDOWED_LOG_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "util.h"
+#include "event_log.h"
+
+// Windowed event summaries
+//
+// most of what we read from the learn and policy logs are averages over
+// time, e.g. loss per action per learner. a WindowedEventLog keeps counters,
+// stats and histograms of the events in each window of window_ticks ticks
+// and writes just those summaries when the window closes, orders of magnitude
+// less than a line per event. optionally every sample_every-th raw event of
+// each kind is passed on to another EventLog (e.g. a ColumnarEventLog).
+//
+// summary lines (tab separated, written to the summary logger at INFO):
+//  action  window_start action_id count invalid actor_score score
+//  learn   window_start learner_id action_id count loss dL_dy prediction
+//          target reward
+//  policy  window_start action_id count probability rank num_options
+//          rank_histogram
+//  hist    window_start learner_id action_id quantity histogram
+// where each quantity is mean, stdev, min and max (tab separated), target is
+// the bootstrapped (n-step or lambda) return the learner learned towards,
+// reward the realized one step reward, rank_histogram is space separated
+// counts of ranks 0, 1, ... kMaxRank - 1 and kMaxRank or more, and histogram
+// is space separated bucket:count pairs of a LogHistogram (empty buckets left
+// out) for each of loss, dL_dy, prediction, target and reward. keys appear in
+// the order they were first seen in a window.
+
+// counts of values in buckets by sign and power of two: bucket 0 is
+// (-2^(kMinExponent-1), 2^(kMinExponent-1)), bucket e > 0 is
+// [2^(e + kMinExponent - 2), 2^(e + kMinExponent - 1)) and bucket -e its
+// negation, with magnitudes beyond the last bucket counted in it
+struct LogHistogram {
+  static constexpr int kMinExponent = -8;
+  static constexpr int kMaxExponent = 24;
+  static constexpr int kBucketsPerSign = kMaxExponent - kMinExponent + 1;
+
+  void Add(double value);
+  // the bucket of value, in [-kBucketsPerSign, kBucketsPerSign]
+  static int Bucket(double value);
+  // the smallest magnitude in bucket (0 for bucket 0), negated for bucket < 0
+  static double BucketBound(int bucket);
+
+  std::array<uint32_t, 2 * kBucketsPerSign + 1> counts_ = {};
+};
+
+class WindowedEventLog : public EventLog {
+ public:
+  static constexpr size_t kMaxRank = 8;
+
+  // sampled may be null, sample_every 0 passes on no raw events
+  WindowedEventLog(int window_ticks, Logger* summary_logger,
+                   EventLog* sampled = nullptr, size_t sample_every = 0);
+  // writes the last (partial) window
+  ~WindowedEventLog();
+
+  void LogAction(const ActionEvent& event) override;
+  void LogLearn(const LearnEvent& event) override;
+  void LogPolicy(const PolicyEvent& event) override;
+
+  // writes the summaries of the current window and starts a new one
+  void Flush();
+
+ private:
+  struct ActionSummary {
+    int count_ = 0;
+    int invalid_ = 0;
+    Stats actor_score_;
+    Stats score_;
+  };
+
+  struct LearnSummary {
+    Stats loss_;
+    Stats dL_dy_;
+    Stats prediction_;
+    Stats target_;
+    Stats reward_;
+    LogHistogram loss_histogram_;
+    LogHistogram dL_dy_histogram_;
+    LogHistogram prediction_histogram_;
+    LogHistogram target_histogram_;
+    LogHistogram reward_histogram_;
+  };
+
+  struct PolicySummary {
+    Stats probability_;
+    Stats rank_;
+    Stats num_options_;
+    std::array<uint32_t, kMaxRank + 1> ranks_ = {};
+  };
+
+  // a window's summaries, keyed by learner id (-1 if there isn't one) and
+  // action id. there are only a handful of keys, so they're found by a scan
+  template <class Summary>
+  struct Entry {
+    int learner_id_;
+    std::string action_id_;
+    Summary summary_;
+  };
+
+  template <class Summary>
+  static Summary* Find(std::vector<Entry<Summary>>* entries, int learner_id,
+                       const char* action_id);
+
+  // rolls over to tick's window, writing the current one if it's older
+  void Advance(int tick);
+  // whether to pass on the next raw event counted by counter
+  bool Sample(size_t* counter);
+  void WriteStats(std::string* line, const Stats& stats);
+  void WriteHistogram(const char* quantity, int learner_id,
+                      const std::string& action_id,
+                      const LogHistogram& histogram);
+
+  const int window_ticks_;
+  Logger* summary_logger_;
+  EventLog* sampled_;
+  const size_t sample_every_;
+
+  // start of the current window, -1 before the first event
+  int window_start_ = -1;
+  std::vector<Entry<ActionSummary>> actions_;
+  std::vector<Entry<LearnSummary>> learns_;
+  std::vector<Entry<PolicySummary>> policies_;
+
+  size_t action_events_ = 0;
+  size_t learn_events_ = 0;
+  size_t policy_events_ = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/core.h"
+#include "../src/action.h"
+#include "../src/action_factories.h"
+
+namespace {
+
+// the heuristics as they were written before HeuristicContext, scanning
+// everyone for each character
+Character* ScanGiveTarget(CVC* cvc, Character* character) {
+  Character* best_target = nullptr;
+  double worst_opinion = std::numeric_limits<double>::max();
+  for (Character* target : cvc->GetCharacters()) {
+    if (character == target ||
+        target->GetMoney() > cvc->GetMoneyStats().mean_) {
+      continue;
+    }
+    double opinion = target->GetOpinionOf(character);
+    if (opinion < worst_opinion) {
+      worst_opinion = opinion;
+      best_target = target;
+    }
+  }
+  return best_target;
+}
+
+Character* ScanAskTarget(CVC* cvc, Character* character) {
+  Character* best_target = nullptr;
+  double best_money = 0.0;
+  for (Character* target : cvc->GetCharacters()) {
+    if (character == target || target->GetMoney() < 10.0) {
+      continue;
+    }
+    if (target->GetMoney() > best_money) {
+      best_money = target->GetMoney();
+      best_target = target;
+    }
+  }
+  return best_target;
+}
+
+bool ScanWork(CVC* cvc, Character* character) {
+  for (Character* target : cvc->GetCharacters()) {
+    if (target->GetOpinionOf(character) > 0.0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+class HeuristicContextTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::mt19937 random_generator;
+    // few distinct values so there are plenty of ties
+    std::uniform_int_distribution<> money_dist(0, 4);
+    std::uniform_int_distribution<> opinion_dist(-2, 2);
+    std::vector<Character*> c;
+    for (int i = 0; i < 20; i++) {
+      characters_.push_back(
+          std::make_unique<Character>(i, 5.0 * money_dist(random_generator)));
+      c.push_back(characters_.back().get());
+    }
+    for (Character* observer : c) {
+      for (Character* target : c) {
+        if (0 != random_generator() % 3) {
+          continue;
+        }
+        observer->AddRelationship(std::make_unique<RelationshipModifier>(
+            target, 0, 100, opinion_dist(random_generator)));
+      }
+    }
+    cvc_ = CVC(c, &logger_, random_generator);
+  }
+
+  Logger logger_;
+  std::vector<std::unique_ptr<Character>> characters_;
+  CVC cvc_;
+};
+
+TEST_F(HeuristicContextTest, TestMatchesScans) {
+  HeuristicContext context;
+  GiveActionFactory give(&context);
+  AskActionFactory ask(&context);
+  WorkActionFactory work(&context);
+
+  for (int tick = 0; tick < 3; tick++) {
+    for (auto& character : characters_) {
+      Character* c = character.get();
+      std::vector<std::unique_ptr<Action>> actions;
+
+      Character* give_target = ScanGiveTarget(&cvc_, c);
+      double score = give.EnumerateActions(&cvc_, c, &actions);
+      if (c->GetMoney() > 10.0 && give_target) {
+        EXPECT_EQ(0.4, score);
+        ASSERT_EQ(1u, actions.size());
+        EXPECT_EQ(give_target, actions[0]->GetTarget());
+      } else {
+        EXPECT_EQ(0.0, score);
+        EXPECT_TRUE(actions.empty());
+      }
+
+      actions.clear();
+      Character* ask_target = ScanAskTarget(&cvc_, c);
+      score = ask.EnumerateActions(&cvc_, c, &actions);
+      if (ask_target) {
+        EXPECT_EQ(0.4, score);
+        ASSERT_EQ(1u, actions.size());
+        EXPECT_EQ(ask_target, actions[0]->GetTarget());
+      } else {
+        EXPECT_TRUE(actions.empty());
+      }
+
+      actions.clear();
+      score = work.EnumerateActions(&cvc_, c, &actions);
+      EXPECT_EQ(ScanWork(&cvc_, c) ? 0.3 : 0.0, score);
+      EXPECT_EQ(ScanWork(&cvc_, c) ? 1u : 0u, actions.size());
+    }
+
+    // the summary is rebuilt once the game moves on
+    characters_[tick]->SetMoney(50.0);
+    cvc_.Tick();
+  }
+}
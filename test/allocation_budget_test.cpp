@@ -0,0 +1,142 @@
+// Steady state heap allocations per tick
+//
+// built into its own allocation_budget_test target with the counting operator
+// new (allocation_hook.cpp) linked in. fails if a population of heuristic and
+// learning agents allocates more than ALLOCATION_BUDGET times per agent per
+// tick, on average, once their experience queues have filled up
+
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/util.h"
+#include "../src/core.h"
+#include "../src/action_factories.h"
+#include "../src/decision_engine.h"
+#include "../src/allocation_counter.h"
+#include "../src/perf_report.h"
+#include "../src/sarsa/sarsa_agent.h"
+#include "../src/sarsa/sarsa_learner.h"
+#include "../src/sarsa/sarsa_action_factories.h"
+
+#ifndef ALLOCATION_BUDGET
+#define ALLOCATION_BUDGET 12
+#endif
+
+namespace {
+
+const int kHeuristicAgents = 25;
+const int kLearningAgents = 25;
+const size_t kNSteps = 4;
+// enough for the experience queues and caches to reach their steady size
+const int kWarmupTicks = 50;
+const int kMeasuredTicks = 200;
+
+}
+
+TEST(AllocationBudgetTest, TestSteadyStateAllocationsPerTick) {
+  if (!AllocationHookInstalled()) {
+    GTEST_SKIP() << "needs allocation_hook.cpp linked in";
+  }
+
+  Logger logger("test", nullptr, ERROR);
+  std::mt19937 random_generator(23);
+  std::uniform_real_distribution<> money_dist(10.0, 1000.0);
+  std::vector<std::unique_ptr<Character>> characters;
+  std::vector<Character*> character_ptrs;
+  for (int i = 0; i < kHeuristicAgents + kLearningAgents; i++) {
+    characters.push_back(
+        std::make_unique<Character>(i, money_dist(random_generator)));
+    character_ptrs.push_back(characters.back().get());
+  }
+
+  HeuristicContext context;
+  GiveActionFactory give_heuristic(&context);
+  AskActionFactory ask_heuristic(&context);
+  WorkActionFactory work_heuristic(&context);
+  TrivialActionFactory trivial_heuristic;
+  CompositeActionFactory heuristic_factory({{"WorkAction", &work_heuristic},
+                                            {"GiveAction", &give_heuristic},
+                                            {"AskAction", &ask_heuristic},
+                                            {"TrivialAction",
+                                             &trivial_heuristic}});
+  AskResponseFactory heuristic_response;
+  ProbDistPolicy heuristic_policy;
+
+  cvc::sarsa::FeatureService features;
+  cvc::sarsa::SARSAGiveActionFactory<> give(
+      cvc::sarsa::SARSAGiveActionFactory<>::CreateLearner(
+          0, 0.01, 0.9, 0.9, 0.999, &random_generator, &logger),
+      &features);
+  cvc::sarsa::SARSAAskActionFactory<> ask(
+      cvc::sarsa::SARSAAskActionFactory<>::CreateLearner(
+          1, 0.01, 0.9, 0.9, 0.999, &random_generator, &logger),
+      &features);
+  cvc::sarsa::SARSATrivialActionFactory<> trivial(
+      cvc::sarsa::SARSATrivialActionFactory<>::CreateLearner(
+          2, 0.01, 0.9, 0.9, 0.999, &random_generator, &logger),
+      &features);
+  cvc::sarsa::SARSAAskSuccessResponseFactory<> success(
+      cvc::sarsa::SARSAAskSuccessResponseFactory<>::CreateLearner(
+          3, 0.01, 0.9, 0.9, 0.999, &random_generator, &logger),
+      &features);
+  cvc::sarsa::SARSAAskFailureResponseFactory<> failure(
+      cvc::sarsa::SARSAAskFailureResponseFactory<>::CreateLearner(
+          4, 0.01, 0.9, 0.9, 0.999, &random_generator, &logger),
+      &features);
+  cvc::sarsa::EpsilonGreedyPolicy policy(0.1, &logger);
+  cvc::sarsa::MoneyScorer scorer;
+
+  std::vector<std::unique_ptr<Agent>> agents;
+  std::vector<Agent*> agent_ptrs;
+  for (int i = 0; i < kHeuristicAgents; i++) {
+    agents.push_back(std::make_unique<HeuristicAgent>(
+        character_ptrs[i], &heuristic_factory, &heuristic_response,
+        &heuristic_policy));
+    agent_ptrs.push_back(agents.back().get());
+  }
+  for (int i = kHeuristicAgents; i < kHeuristicAgents + kLearningAgents;
+       i++) {
+    agents.push_back(
+        std::make_unique<cvc::sarsa::SARSAAgent<cvc::sarsa::MoneyScorer>>(
+            &scorer, character_ptrs[i],
+            std::vector<cvc::sarsa::ActionFactory*>({&give, &ask, &trivial}),
+            std::unordered_map<std::string,
+                               std::set<cvc::sarsa::ResponseFactory*>>(
+                {{"AskAction", {&success, &failure}}}),
+            &policy, kNSteps));
+    agent_ptrs.push_back(agents.back().get());
+  }
+
+  CVC cvc(character_ptrs, &logger, random_generator);
+  DecisionEngine engine(agent_ptrs, &cvc, &logger);
+  engine.AddBatchScorer(&give);
+  engine.AddBatchScorer(&ask);
+  engine.AddBatchScorer(&trivial);
+  AllocationRecorder allocations;
+  engine.AddPhaseObserver(&allocations);
+
+  for (int i = 0; i < kWarmupTicks; i++) {
+    engine.RunOneGameLoop();
+  }
+  allocations.Start();
+  for (int i = 0; i < kMeasuredTicks; i++) {
+    engine.RunOneGameLoop();
+  }
+  SetAllocationCounting(false);
+
+  ASSERT_EQ(kMeasuredTicks, allocations.Ticks());
+  double budget = (double)ALLOCATION_BUDGET * agent_ptrs.size();
+  double per_tick = (double)allocations.Total().allocations_ / kMeasuredTicks;
+  for (int scope = 0; scope < AllocationRecorder::kNumScopes; scope++) {
+    RecordProperty(AllocationRecorder::ScopeName(scope),
+                   std::to_string(allocations.Total(scope).allocations_ /
+                                  kMeasuredTicks));
+  }
+  EXPECT_LE(per_tick, budget)
+      << "allocations per tick, " << ALLOCATION_BUDGET << " per agent";
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/util.h"
+#include "../src/binary_log.h"
+
+class BinaryLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    logger_.SetLogLevel(ERROR);
+    path_ = "/tmp/cvc_binary_log_test." + std::to_string(getpid());
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  // everything logged by log_events, as text
+  template <class LogEvents>
+  std::string Text(LogEvents log_events) {
+    char* text = nullptr;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    Logger text_logger("test", out, INFO);
+    log_events(&text_logger);
+    fclose(out);
+    std::string result(text, length);
+    free(text);
+    return result;
+  }
+
+  // everything logged by log_events through a binary log, decoded
+  template <class LogEvents>
+  std::string Decoded(LogEvents log_events, const char* only_logger = nullptr,
+                      size_t buffer_bytes = 1 << 20) {
+    {
+      std::unique_ptr<BinaryLog> log =
+          BinaryLog::Open(path_.c_str(), &logger_, buffer_bytes);
+      Logger binary_logger("test", nullptr, INFO);
+      binary_logger.SetBinaryLog(log.get());
+      log_events(&binary_logger);
+    }
+    char* text = nullptr;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    FILE* in = fopen(path_.c_str(), "rb");
+    EXPECT_TRUE(DecodeBinaryLog(in, out, only_logger, &logger_));
+    fclose(in);
+    fclose(out);
+    std::string result(text, length);
+    free(text);
+    return result;
+  }
+
+  Logger logger_;
+  std::string path_;
+};
+
+TEST_F(BinaryLogTest, TestDecodesToText) {
+  // decoding gives back exactly what Logger would have written
+  int local = 0;
+  auto log_events = [&local](Logger* logger) {
+    for (int i = 0; i < 3; i++) {
+      logger->Log(INFO, "%d\t%s\t%d\t%f\t%f\t%f\t%f\t%f\n", 100 + i,
+                  "GiveAction", i, 373.900866, -38.6, 1.0 / 3.0, -1e10, 0.0);
+    }
+    logger->Log(INFO, "%zu of %zu %5.2f%% %-8s|\n", (size_t)3, (size_t)10,
+                30.0, "ask");
+    logger->Log(INFO, "%*d|%.*f|%c|%x|%lld|%g|%e|%p\n", -6, 42, 3, 3.14159,
+                'z', 255u, -1234567890123ll, 1e-7, 6.02e23, (void*)&local);
+    logger->Log(INFO, "%ld %u %hd %lu\n", -5l, 7u, (short)-3, 123456789ul);
+    logger->Log(DEBUG, "filtered %d\n", 1);
+    logger->Log(INFO, "no arguments\n");
+    logger->Log(INFO, "%s and %s\n", "", std::string(300, 'x').c_str());
+  };
+  EXPECT_EQ(Text(log_events), Decoded(log_events));
+}
+
+TEST_F(BinaryLogTest, TestOnlyLogger) {
+  // loggers share a binary log, and can be decoded separately
+  {
+    std::unique_ptr<BinaryLog> log = BinaryLog::Open(path_.c_str(), &logger_);
+    Logger learner("learner", nullptr, INFO);
+    Logger action("action", nullptr, INFO);
+    learner.SetBinaryLog(log.get());
+    action.SetBinaryLog(log.get());
+    learner.Log(INFO, "learned %d\n", 1);
+    action.Log(INFO, "acted %d\n", 2);
+    learner.Log(INFO, "learned %d\n", 3);
+  }
+
+  for (const char* only : {"learner", "action"}) {
+    char* text = nullptr;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    FILE* in = fopen(path_.c_str(), "rb");
+    EXPECT_TRUE(DecodeBinaryLog(in, out, only, &logger_));
+    fclose(in);
+    fclose(out);
+    EXPECT_EQ(std::string("learner") == only
+                  ? "learner\tlearned 1\nlearner\tlearned 3\n"
+                  : "action\tacted 2\n",
+              std::string(text, length));
+    free(text);
+  }
+}
+
+TEST_F(BinaryLogTest, TestThreads) {
+  // records from many threads all arrive, each thread's in order, even when
+  // buffers wrap and fill up
+  const int kThreads = 4;
+  const int kEvents = 5000;
+  std::string decoded = Decoded(
+      [](Logger* logger) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; t++) {
+          threads.emplace_back([logger, t]() {
+            for (int i = 0; i < kEvents; i++) {
+              logger->Log(INFO, "%d %d %f\n", t, i, i * 0.5);
+            }
+          });
+        }
+        for (std::thread& thread : threads) {
+          thread.join();
+        }
+      },
+      nullptr, BinaryLog::kMaxRecordBytes * 2);
+
+  std::vector<int> next(kThreads, 0);
+  int t;
+  int i;
+  double half;
+  const char* line = decoded.c_str();
+  int events = 0;
+  while (3 == sscanf(line, "test\t%d %d %lf\n", &t, &i, &half)) {
+    ASSERT_GE(t, 0);
+    ASSERT_LT(t, kThreads);
+    EXPECT_EQ(next[t], i);
+    EXPECT_EQ(i * 0.5, half);
+    next[t] = i + 1;
+    events++;
+    line = strchr(line, '\n') + 1;
+  }
+  EXPECT_EQ(kThreads * kEvents, events);
+}
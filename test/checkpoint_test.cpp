@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/util.h"
+#include "../src/core.h"
+#include "../src/sarsa/checkpoint.h"
+#include "../src/sarsa/sarsa_learner.h"
+
+class NoopTestActionCT : public Action {
+ public:
+  NoopTestActionCT() : Action("NTA", nullptr, 1.0) {}
+
+  bool IsValid(const CVC* gamestate) { return true; }
+  void TakeEffect(CVC* gamestate) {}
+};
+
+class CheckpointTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    logger_.SetLogLevel(ERROR);
+    path_ = "/tmp/cvc_checkpoint_test." + std::to_string(getpid());
+    learner_ = cvc::sarsa::SARSALearner<3>::Create(
+        7, 0.01, 0.9, 0.9, 0.999, random_generator_, &logger_);
+    other_ = cvc::sarsa::SARSALearner<3>::Create(
+        8, 0.01, 0.9, 0.9, 0.999, random_generator_, &logger_);
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  // take a learning step so the optimizer state is non-trivial
+  void Train(cvc::sarsa::SARSALearner<3>* learner) {
+    CVC cvc;
+    std::array<double, 3> features = {1.0, 0.5, -2.0};
+    cvc::sarsa::ExperienceImpl<3> e2(std::make_unique<NoopTestActionCT>(), 3.0,
+                                     nullptr, features, learner);
+    cvc::sarsa::ExperienceImpl<3> e1(std::make_unique<NoopTestActionCT>(), 0.0,
+                                     &e2, features, learner);
+    e1.Learn(&cvc);
+  }
+
+  std::mt19937 random_generator_;
+  Logger logger_;
+  std::string path_;
+  std::unique_ptr<cvc::sarsa::SARSALearner<3>> learner_;
+  std::unique_ptr<cvc::sarsa::SARSALearner<3>> other_;
+};
+
+TEST_F(CheckpointTest, TestRoundTrip) {
+  Train(learner_.get());
+  ASSERT_TRUE(cvc::sarsa::SaveCheckpoint(path_.c_str(), {{"a", learner_.get()}},
+                                         &logger_));
+
+  // weights and optimizer state come back exactly, so the next learning step
+  // is identical too
+  ASSERT_TRUE(cvc::sarsa::LoadCheckpoint(path_.c_str(), {{"a", other_.get()}},
+                                         &logger_));
+  std::array<double, 3> features = {0.3, -1.0, 2.0};
+  EXPECT_EQ(learner_->Score(features), other_->Score(features));
+
+  Train(learner_.get());
+  Train(other_.get());
+  EXPECT_EQ(learner_->Score(features), other_->Score(features));
+}
+
+TEST_F(CheckpointTest, TestReportsLearnersNotRestored) {
+  ASSERT_TRUE(cvc::sarsa::SaveCheckpoint(path_.c_str(), {{"a", learner_.get()}},
+                                         &logger_));
+
+  // "b" has no section and a four feature learner rejects "a"'s
+  std::unique_ptr<cvc::sarsa::SARSALearner<4>> wider =
+      cvc::sarsa::SARSALearner<4>::Create(9, 0.01, 0.9, 0.9, 0.999,
+                                          random_generator_, &logger_);
+  std::array<double, 3> features = {0.3, -1.0, 2.0};
+  double score = other_->Score(features);
+  std::vector<std::string> not_restored;
+  EXPECT_FALSE(cvc::sarsa::LoadCheckpoint(
+      path_.c_str(), {{"b", other_.get()}}, &logger_, &not_restored));
+  EXPECT_EQ(std::vector<std::string>({"b"}), not_restored);
+  EXPECT_EQ(score, other_->Score(features));
+
+  not_restored.clear();
+  EXPECT_FALSE(cvc::sarsa::LoadCheckpoint(
+      path_.c_str(), {{"a", wider.get()}}, &logger_, &not_restored));
+  EXPECT_EQ(std::vector<std::string>({"a"}), not_restored);
+
+  not_restored.clear();
+  EXPECT_TRUE(cvc::sarsa::LoadCheckpoint(
+      path_.c_str(), {{"a", other_.get()}}, &logger_, &not_restored));
+  EXPECT_TRUE(not_restored.empty());
+}
+
+TEST_F(CheckpointTest, TestRejectsDifferentLambda) {
+  std::unique_ptr<cvc::sarsa::SARSALambdaLearner<3>> traced =
+      cvc::sarsa::SARSALambdaLearner<3>::Create(
+          9, 0.01, 0.9, 0.5, 0.9, 0.999, random_generator_, &logger_);
+  std::unique_ptr<cvc::sarsa::SARSALambdaLearner<3>> retraced =
+      cvc::sarsa::SARSALambdaLearner<3>::Create(
+          10, 0.01, 0.9, 0.8, 0.9, 0.999, random_generator_, &logger_);
+  ASSERT_TRUE(cvc::sarsa::SaveCheckpoint(path_.c_str(),
+                                         {{"a", traced.get()}}, &logger_));
+
+  // neither plain SARSA nor a different lambda picks it up
+  std::array<double, 3> features = {0.3, -1.0, 2.0};
+  double score = other_->Score(features);
+  double retraced_score = retraced->Score(features);
+  EXPECT_FALSE(cvc::sarsa::LoadCheckpoint(path_.c_str(),
+                                          {{"a", other_.get()}}, &logger_));
+  EXPECT_FALSE(cvc::sarsa::LoadCheckpoint(path_.c_str(),
+                                          {{"a", retraced.get()}}, &logger_));
+  EXPECT_EQ(score, other_->Score(features));
+  EXPECT_EQ(retraced_score, retraced->Score(features));
+}
+
+TEST_F(CheckpointTest, TestZeroCopyView) {
+  ASSERT_TRUE(cvc::sarsa::SaveCheckpoint(path_.c_str(), {{"a", learner_.get()}},
+                                         &logger_));
+
+  std::unique_ptr<cvc::sarsa::Checkpoint> checkpoint =
+      cvc::sarsa::Checkpoint::Open(path_.c_str(), &logger_);
+  ASSERT_NE(nullptr, checkpoint);
+  EXPECT_EQ(1u, checkpoint->NumSections());
+
+  cvc::sarsa::LinearLearnerView view;
+  ASSERT_TRUE(cvc::sarsa::ViewLinearLearner(*checkpoint, "a", 3, &view,
+                                            &logger_));
+  EXPECT_EQ(7, view.header_->learner_id_);
+  EXPECT_EQ(0u, (uintptr_t)view.weights_ % cvc::sarsa::kCheckpointAlignment);
+
+  std::array<double, 3> features = {1.0, 0.0, 0.0};
+  EXPECT_EQ(learner_->Score(features), view.weights_[0]);
+
+  // wrong feature count is rejected rather than asserted on
+  EXPECT_FALSE(cvc::sarsa::ViewLinearLearner(*checkpoint, "a", 4, &view,
+                                             &logger_));
+  EXPECT_FALSE(cvc::sarsa::ViewLinearLearner(*checkpoint, "b", 3, &view,
+                                             &logger_));
+}
+
+TEST_F(CheckpointTest, TestRejectsCorruption) {
+  ASSERT_TRUE(cvc::sarsa::SaveCheckpoint(path_.c_str(), {{"a", learner_.get()}},
+                                         &logger_));
+
+  // find the first weight's offset in the file
+  long offset;
+  {
+    std::unique_ptr<cvc::sarsa::Checkpoint> checkpoint =
+        cvc::sarsa::Checkpoint::Open(path_.c_str(), &logger_);
+    ASSERT_NE(nullptr, checkpoint);
+    cvc::sarsa::LinearLearnerView view;
+    ASSERT_TRUE(cvc::sarsa::ViewLinearLearner(*checkpoint, "a", 3, &view,
+                                              &logger_));
+    const cvc::sarsa::CheckpointSectionEntry* section =
+        checkpoint->FindSection("a");
+    const char* file = checkpoint->SectionData(section) - section->offset_;
+    offset = (const char*)view.weights_ - file;
+  }
+
+  // flip a byte in the weights
+  FILE* f = fopen(path_.c_str(), "r+");
+  ASSERT_NE(nullptr, f);
+  fseek(f, offset, SEEK_SET);
+  int c = fgetc(f);
+  fseek(f, offset, SEEK_SET);
+  fputc(c ^ 0xff, f);
+  fclose(f);
+
+  std::array<double, 3> features = {1.0, 1.0, 1.0};
+  double score = other_->Score(features);
+  EXPECT_EQ(nullptr, cvc::sarsa::Checkpoint::Open(path_.c_str(), &logger_));
+  EXPECT_FALSE(cvc::sarsa::LoadCheckpoint(path_.c_str(), {{"a", other_.get()}},
+                                          &logger_));
+  EXPECT_EQ(score, other_->Score(features));
+}
+
+TEST_F(CheckpointTest, TestMissingFile) {
+  EXPECT_EQ(nullptr, cvc::sarsa::Checkpoint::Open(path_.c_str(), &logger_));
+}
+
+TEST(HalfPrecisionTest, TestConversion) {
+  // exactly representable values survive the round trip
+  for (float value : {0.0f, 1.0f, -2.5f, 0.000060975552f, 65504.0f}) {
+    EXPECT_EQ(value, cvc::sarsa::HalfToFloat(cvc::sarsa::FloatToHalf(value)));
+  }
+  // ties round to even
+  EXPECT_EQ(1.0f, cvc::sarsa::HalfToFloat(
+                      cvc::sarsa::FloatToHalf(1.0f + 1.0f / 2048.0f)));
+  EXPECT_EQ(0x7c00, cvc::sarsa::FloatToHalf(1e6f));
+  // smallest subnormal
+  EXPECT_EQ(0x0001, cvc::sarsa::FloatToHalf(5.9604645e-8f));
+  EXPECT_EQ(5.9604645e-8f, cvc::sarsa::HalfToFloat(0x0001));
+}
+
+TEST_F(CheckpointTest, TestQuantizedExport) {
+  Train(learner_.get());
+  std::array<double, 3> features = {1.0, 0.5, -2.0};
+  std::array<float, 3> float_features = {1.0f, 0.5f, -2.0f};
+  double score = learner_->Score(features);
+
+  for (cvc::sarsa::WeightFormat format :
+       {cvc::sarsa::kInt8Weights, cvc::sarsa::kFp16Weights}) {
+    ASSERT_TRUE(cvc::sarsa::SaveQuantizedCheckpoint(
+        path_.c_str(), {{"a", learner_.get()}}, format, &logger_));
+
+    cvc::sarsa::QuantizedLearner<3> quantized(7);
+    ASSERT_TRUE(cvc::sarsa::LoadCheckpoint(path_.c_str(),
+                                           {{"a", &quantized}}, &logger_));
+    EXPECT_EQ(format, quantized.GetFormat());
+    // weights are in [-1, 1], so the error is at most half a step per weight
+    EXPECT_NEAR(score, quantized.Score(float_features), 3.5 * 0.5 / 127.0);
+
+    // full precision learners don't load quantized sections
+    double other_score = other_->Score(features);
+    EXPECT_FALSE(other_->ReadCheckpoint(
+        *cvc::sarsa::Checkpoint::Open(path_.c_str(), &logger_), "a",
+        &logger_));
+    EXPECT_EQ(other_score, other_->Score(features));
+  }
+}
+
+TEST_F(CheckpointTest, TestFeatureNameRemap) {
+  Train(learner_.get());
+  learner_->SetFeatureNames({"bias", "money", "opinion"});
+  ASSERT_TRUE(cvc::sarsa::SaveCheckpoint(path_.c_str(), {{"a", learner_.get()}},
+                                         &logger_));
+
+  std::unique_ptr<cvc::sarsa::Checkpoint> checkpoint =
+      cvc::sarsa::Checkpoint::Open(path_.c_str(), &logger_);
+  ASSERT_NE(nullptr, checkpoint);
+  std::vector<std::string> names;
+  ASSERT_TRUE(cvc::sarsa::ReadFeatureNames(*checkpoint, "a", &names,
+                                           &logger_));
+  EXPECT_EQ(learner_->GetFeatureNames(), names);
+
+  // a layout with the features reordered, one dropped and one added
+  std::unique_ptr<cvc::sarsa::SARSALearner<3>> remapped =
+      cvc::sarsa::SARSALearner<3>::Create(7, 0.01, 0.9, 0.9, 0.999,
+                                          random_generator_, &logger_);
+  remapped->SetFeatureNames({"opinion", "new", "bias"});
+  std::array<double, 3> fresh;
+  ASSERT_TRUE(remapped->GetLinearWeights(&fresh));
+  ASSERT_TRUE(cvc::sarsa::LoadCheckpoint(path_.c_str(),
+                                         {{"a", remapped.get()}}, &logger_));
+
+  std::array<double, 3> saved;
+  std::array<double, 3> loaded;
+  ASSERT_TRUE(learner_->GetLinearWeights(&saved));
+  ASSERT_TRUE(remapped->GetLinearWeights(&loaded));
+  EXPECT_EQ(saved[2], loaded[0]);
+  EXPECT_EQ(fresh[1], loaded[1]);
+  EXPECT_EQ(saved[0], loaded[2]);
+}
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/util.h"
+#include "../src/core.h"
+#include "../src/columnar_log.h"
+#include "../src/sarsa/sarsa_learner.h"
+
+class NoopTestActionCLT : public Action {
+ public:
+  NoopTestActionCLT(Character* actor = nullptr) : Action("NTA", actor, 1.0) {}
+
+  bool IsValid(const CVC* gamestate) { return true; }
+  void TakeEffect(CVC* gamestate) {}
+};
+
+class ColumnarLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    logger_.SetLogLevel(ERROR);
+    path_ = "/tmp/cvc_columnar_log_test." + std::to_string(getpid());
+  }
+
+  void TearDown() override {
+    unlink(path_.c_str());
+    for (const char* table : {".action.cols", ".learn.cols", ".policy.cols"}) {
+      unlink((path_ + table).c_str());
+    }
+  }
+
+  Logger logger_;
+  std::string path_;
+};
+
+TEST_F(ColumnarLogTest, TestRoundTrip) {
+  {
+    // 3 rows per group, so the 7 rows span a partial last group
+    std::unique_ptr<ColumnarWriter> writer = ColumnarWriter::Open(
+        path_.c_str(),
+        {{"tick", kIntColumn},
+         {"id", kStringColumn},
+         {"score", kDoubleColumn},
+         {"features", kDoubleListColumn}},
+        &logger_, 3);
+    ASSERT_TRUE(writer);
+    for (int i = 0; i < 7; i++) {
+      std::string id = i % 2 ? "odd" : "even";
+      std::array<double, 3> features = {(double)i, i + 0.5, i + 0.25};
+      writer->AppendInt(1000 + i);
+      writer->AppendString(id.c_str());
+      writer->AppendDouble(i * 1.5);
+      writer->AppendDoubles(features.data(), i % 4);
+      writer->EndRow();
+    }
+  }
+
+  std::unique_ptr<ColumnarReader> reader =
+      ColumnarReader::Open(path_.c_str(), &logger_);
+  ASSERT_TRUE(reader);
+  ASSERT_EQ(4u, reader->GetColumns().size());
+  EXPECT_EQ(kDoubleListColumn, reader->GetColumns()[3].type_);
+  ASSERT_EQ(2, reader->FindColumn("score"));
+  EXPECT_EQ(-1, reader->FindColumn("missing"));
+  ASSERT_EQ(2u, reader->GetDictionary().size());
+  EXPECT_EQ("even", reader->GetDictionary()[0]);
+  EXPECT_EQ("odd", reader->GetDictionary()[1]);
+
+  ASSERT_EQ(3u, reader->NumRowGroups());
+  int i = 0;
+  std::vector<double> decoded_scores;
+  std::vector<double> decoded_features;
+  for (size_t group = 0; group < reader->NumRowGroups(); group++) {
+    const double* scores = reader->GetDoubles(group, 2, &decoded_scores);
+    const double* features = reader->GetDoubles(group, 3, &decoded_features);
+    size_t feature = 0;
+    for (size_t row = 0; row < reader->NumRows(group); row++, i++) {
+      EXPECT_EQ(1000 + i, reader->GetInt(group, 0, row));
+      EXPECT_EQ(i % 2, reader->GetInt(group, 1, row));
+      EXPECT_EQ(i * 1.5, scores[row]);
+      ASSERT_EQ(i % 4, reader->GetInt(group, 3, row));
+      for (int j = 0; j < i % 4; j++) {
+        EXPECT_EQ(i + (j ? 1.0 / (1 << j) : 0.0), features[feature++]);
+      }
+    }
+    EXPECT_EQ(feature, reader->NumDoubles(group, 3));
+  }
+  EXPECT_EQ(7, i);
+}
+
+TEST_F(ColumnarLogTest, TestIntWidths) {
+  const int64_t kValues[][3] = {
+      {5, 5, 5},
+      {-3, 250, 0},
+      {-40000, 20000, 0},
+      {INT64_MIN, INT64_MAX, 0},
+  };
+  {
+    std::unique_ptr<ColumnarWriter> writer =
+        ColumnarWriter::Open(path_.c_str(),
+                             {{"constant", kIntColumn},
+                              {"byte", kIntColumn},
+                              {"short", kIntColumn},
+                              {"full", kIntColumn}},
+                             &logger_);
+    ASSERT_TRUE(writer);
+    for (size_t row = 0; row < 3; row++) {
+      for (const auto& column : kValues) {
+        writer->AppendInt(column[row]);
+      }
+      writer->EndRow();
+    }
+  }
+
+  std::unique_ptr<ColumnarReader> reader =
+      ColumnarReader::Open(path_.c_str(), &logger_);
+  ASSERT_TRUE(reader);
+  ASSERT_EQ(1u, reader->NumRowGroups());
+  for (size_t row = 0; row < 3; row++) {
+    for (size_t column = 0; column < 4; column++) {
+      EXPECT_EQ(kValues[column][row], reader->GetInt(0, column, row));
+    }
+  }
+}
+
+TEST_F(ColumnarLogTest, TestLearnerEvents) {
+  std::unique_ptr<ColumnarEventLog> events =
+      ColumnarEventLog::Open(path_.c_str(), &logger_);
+  ASSERT_TRUE(events);
+  Logger learn_logger;
+  learn_logger.SetEventLog(events.get());
+
+  std::mt19937 random_generator;
+  std::unique_ptr<cvc::sarsa::SARSALearner<2>> learner =
+      cvc::sarsa::SARSALearner<2>::Create(7, 0.01, 0.9, 0.9, 0.999,
+                                          random_generator, &learn_logger);
+  CVC cvc;
+  Character actor(3, 1.0);
+  std::array<double, 2> features = {1.0, 0.5};
+  std::array<double, 2> zero = {0.0, 0.0};
+  cvc::sarsa::ExperienceImpl<2> e2(std::make_unique<NoopTestActionCLT>(&actor),
+                                   2.0, nullptr, zero, learner.get());
+  cvc::sarsa::ExperienceImpl<2> e1(std::make_unique<NoopTestActionCLT>(&actor),
+                                   0.5, &e2, features, learner.get());
+  double dL_dy = e1.Learn(&cvc);
+
+  events->LogPolicy({3, 4, "NTA", 0.25, 0.75, 1, 5});
+  // closes the logs
+  events.reset();
+
+  std::unique_ptr<ColumnarReader> learns =
+      ColumnarReader::Open((path_ + ".learn.cols").c_str(), &logger_);
+  ASSERT_TRUE(learns);
+  ASSERT_EQ(1u, learns->NumRowGroups());
+  ASSERT_EQ(1u, learns->NumRows(0));
+  EXPECT_EQ("NTA", learns->GetDictionary()[learns->GetInt(0, 1, 0)]);
+  EXPECT_EQ(7, learns->GetInt(0, learns->FindColumn("learner_id"), 0));
+  EXPECT_EQ(3, learns->GetInt(0, learns->FindColumn("actor"), 0));
+  std::vector<double> decoded;
+  EXPECT_EQ(dL_dy,
+            *learns->GetDoubles(0, learns->FindColumn("dL_dy"), &decoded));
+  EXPECT_EQ(1.5,
+            *learns->GetDoubles(0, learns->FindColumn("reward"), &decoded));
+  int column = learns->FindColumn("features");
+  ASSERT_EQ(2u, learns->NumDoubles(0, column));
+  EXPECT_EQ(1.0, learns->GetDoubles(0, column, &decoded)[0]);
+  EXPECT_EQ(0.5, learns->GetDoubles(0, column, &decoded)[1]);
+
+  std::unique_ptr<ColumnarReader> policies =
+      ColumnarReader::Open((path_ + ".policy.cols").c_str(), &logger_);
+  ASSERT_TRUE(policies);
+  ASSERT_EQ(1u, policies->NumRows(0));
+  EXPECT_EQ(0.75, *policies->GetDoubles(
+                      0, policies->FindColumn("probability"), &decoded));
+  EXPECT_EQ(1, policies->GetInt(0, policies->FindColumn("rank"), 0));
+  EXPECT_EQ(5, policies->GetInt(0, policies->FindColumn("num_options"), 0));
+
+  // nothing was acted on
+  std::unique_ptr<ColumnarReader> actions =
+      ColumnarReader::Open((path_ + ".action.cols").c_str(), &logger_);
+  ASSERT_TRUE(actions);
+  EXPECT_EQ(0u, actions->NumRowGroups());
+}
+
+TEST_F(ColumnarLogTest, TestDoubleEncodings) {
+  const size_t kRows = 1000;
+  std::mt19937 random_generator;
+  std::uniform_real_distribution<> dist(-1.0, 1.0);
+  std::vector<std::vector<double>> columns(4);
+  for (size_t row = 0; row < kRows; row++) {
+    // repeats, small steps, special values and noise
+    columns[0].push_back(0.25);
+    columns[1].push_back(row % 2 ? 1.0 : 0.0);
+    const double kSpecial[] = {-0.0, std::numeric_limits<double>::infinity(),
+                               std::numeric_limits<double>::quiet_NaN(),
+                               std::numeric_limits<double>::denorm_min()};
+    columns[2].push_back(kSpecial[row % 4]);
+    columns[3].push_back(dist(random_generator));
+  }
+
+  auto write = [this, &columns](const std::vector<size_t>& which) {
+    std::vector<ColumnarColumn> schema;
+    for (size_t column : which) {
+      schema.push_back({"c" + std::to_string(column), kDoubleColumn});
+    }
+    std::unique_ptr<ColumnarWriter> writer =
+        ColumnarWriter::Open(path_.c_str(), schema, &logger_);
+    ASSERT_TRUE(writer);
+    for (size_t row = 0; row < kRows; row++) {
+      for (size_t column : which) {
+        writer->AppendDouble(columns[column][row]);
+      }
+      writer->EndRow();
+    }
+  };
+  auto file_size = [this]() {
+    struct stat st;
+    stat(path_.c_str(), &st);
+    return (size_t)st.st_size;
+  };
+
+  // repeats take no bytes, 0/1 flips a byte or two per row
+  write({0});
+  EXPECT_LT(file_size(), 256u);
+  write({1});
+  EXPECT_LT(file_size(), 256u + kRows * 2);
+  // noise doesn't shrink, so is written raw
+  write({3});
+  EXPECT_GE(file_size(), kRows * sizeof(double));
+
+  write({0, 1, 2, 3});
+  std::unique_ptr<ColumnarReader> reader =
+      ColumnarReader::Open(path_.c_str(), &logger_);
+  ASSERT_TRUE(reader);
+  ASSERT_EQ(1u, reader->NumRowGroups());
+  std::vector<double> decoded;
+  for (size_t column = 0; column < columns.size(); column++) {
+    ASSERT_EQ(kRows, reader->NumDoubles(0, column));
+    const double* values = reader->GetDoubles(0, column, &decoded);
+    // bit for bit, so NaNs and signed zeros come back as they were
+    EXPECT_EQ(0, memcmp(columns[column].data(), values,
+                        kRows * sizeof(double)))
+        << "column " << column;
+  }
+  // used in place, straight from the mapping
+  const double* raw = reader->GetDoubles(0, 3, &decoded);
+  EXPECT_NE(decoded.data(), raw);
+  EXPECT_EQ(0u, (uintptr_t)raw % 64);
+}
+
+TEST_F(ColumnarLogTest, TestRejectsTruncated) {
+  {
+    std::unique_ptr<ColumnarWriter> writer = ColumnarWriter::Open(
+        path_.c_str(), {{"score", kDoubleColumn}}, &logger_);
+    ASSERT_TRUE(writer);
+    writer->AppendDouble(1.0);
+    writer->EndRow();
+  }
+  ASSERT_TRUE(ColumnarReader::Open(path_.c_str(), &logger_));
+  ASSERT_EQ(0, truncate(path_.c_str(), 70));
+  EXPECT_FALSE(ColumnarReader::Open(path_.c_str(), &logger_));
+}
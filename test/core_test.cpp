@@ -98,6 +98,19 @@ TEST_F(CVCTest, TestOpinionStats) {
   EXPECT_DOUBLE_EQ(0.0, cvc.GetOpinionByStats(1).mean_);
 }
 
+TEST_F(CVCTest, TestMemoryBytes) {
+  size_t character_bytes = characters[0]->MemoryBytes();
+  EXPECT_GT(character_bytes, sizeof(Character));
+  characters[0]->AddRelationship(std::make_unique<RelationshipModifier>(
+      characters[1].get(), 0, 10, 5.0));
+  EXPECT_GE(characters[0]->MemoryBytes(),
+            character_bytes + sizeof(RelationshipModifier));
+
+  // characters aren't part of the game state's footprint
+  EXPECT_GE(cvc.MemoryBytes(), sizeof(CVC) + 2 * sizeof(Character*));
+  EXPECT_LT(cvc.MemoryBytes(), sizeof(CVC) + sizeof(Character));
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
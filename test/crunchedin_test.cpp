@@ -0,0 +1,298 @@
+#include <array>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/core.h"
+#include "../src/util.h"
+#include "../src/crunchedin/culture_index.h"
+#include "../src/crunchedin/crunchedin.h"
+
+namespace {
+
+std::array<double, cvc::crunchedin::CULTURE_DIMENSIONS> RandomCulture(
+    std::mt19937* random_generator) {
+  std::normal_distribution<> dist(0.0, 1.0);
+  std::array<double, cvc::crunchedin::CULTURE_DIMENSIONS> culture;
+  double magnitude = 0.0;
+  for (double& x : culture) {
+    x = dist(*random_generator);
+    magnitude += x * x;
+  }
+  for (double& x : culture) {
+    x /= sqrt(magnitude);
+  }
+  return culture;
+}
+
+std::array<double, cvc::crunchedin::CULTURE_DIMENSIONS> Axis(size_t i) {
+  std::array<double, cvc::crunchedin::CULTURE_DIMENSIONS> culture = {};
+  culture[i] = 1.0;
+  return culture;
+}
+
+}
+
+TEST(CultureIndexTest, TestFindsNearest) {
+  std::mt19937 random_generator;
+  cvc::crunchedin::CultureIndex<int> index;
+  std::vector<cvc::crunchedin::Culture> cultures;
+  for (int i = 0; i < 1000; i++) {
+    cultures.emplace_back(RandomCulture(&random_generator));
+    index.Insert(i, cultures.back());
+  }
+  EXPECT_EQ(1000u, index.Size());
+
+  int found = 0;
+  std::vector<int> nearest;
+  for (int query = 0; query < 100; query++) {
+    cvc::crunchedin::Culture culture(RandomCulture(&random_generator));
+    int best = 0;
+    for (int i = 1; i < 1000; i++) {
+      if (culture.Dot(cultures[i]) > culture.Dot(cultures[best])) {
+        best = i;
+      }
+    }
+
+    index.Query(culture, 5, &nearest);
+    ASSERT_EQ(5u, nearest.size());
+    for (size_t i = 1; i < nearest.size(); i++) {
+      EXPECT_GE(culture.Dot(cultures[nearest[i - 1]]),
+                culture.Dot(cultures[nearest[i]]));
+    }
+    if (best == nearest[0]) {
+      found++;
+    }
+  }
+  // it's approximate, but shouldn't miss often
+  EXPECT_GE(found, 90);
+}
+
+TEST(CultureIndexTest, TestRemove) {
+  std::mt19937 random_generator;
+  cvc::crunchedin::CultureIndex<int> index;
+  index.Insert(0, Axis(0));
+  index.Insert(1, cvc::crunchedin::Culture(RandomCulture(&random_generator)));
+  index.Remove(0);
+  EXPECT_EQ(1u, index.Size());
+
+  std::vector<int> nearest;
+  index.Query(Axis(0), 2, &nearest);
+  for (int item : nearest) {
+    EXPECT_NE(0, item);
+  }
+
+  // slots are reused
+  index.Insert(2, Axis(0));
+  index.Query(Axis(0), 1, &nearest);
+  EXPECT_EQ(std::vector<int>({2}), nearest);
+}
+
+class CrunchedInTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int i = 0; i < 3; i++) {
+      characters_.push_back(std::make_unique<Character>(i, 0.0));
+      EXPECT_EQ(i, crunchedin_.AddCurriculumVitae(characters_.back().get(),
+                                                  Axis(0)));
+    }
+    cvc_ = CVC({characters_[0].get(), characters_[1].get(),
+                characters_[2].get()},
+               &logger_, std::mt19937());
+  }
+
+  Logger logger_;
+  std::vector<std::unique_ptr<Character>> characters_;
+  CVC cvc_;
+  cvc::crunchedin::CrunchedIn crunchedin_;
+};
+
+TEST_F(CrunchedInTest, TestLookups) {
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(i, crunchedin_.GetCurriculumVitae(characters_[i].get()));
+    EXPECT_EQ(characters_[i].get(), crunchedin_.GetCharacter(i));
+  }
+  Character stranger(7, 0.0);
+  EXPECT_EQ(cvc::crunchedin::kNoId, crunchedin_.GetCurriculumVitae(&stranger));
+  EXPECT_EQ(cvc::crunchedin::kNoId, crunchedin_.GetCurrentRole(0));
+}
+
+TEST_F(CrunchedInTest, TestMemoryBytes) {
+  size_t bytes = crunchedin_.MemoryBytes();
+  EXPECT_GT(bytes, sizeof(cvc::crunchedin::CrunchedIn));
+  cvc::crunchedin::OrgId org = crunchedin_.FoundOrganization(Axis(0), 0, 0);
+  crunchedin_.StartRole(org, 1, 0);
+  crunchedin_.StartRole(org, 2, 0);
+  EXPECT_GT(crunchedin_.MemoryBytes(), bytes);
+}
+
+TEST_F(CrunchedInTest, TestApplyAndHire) {
+  cvc::crunchedin::OrgId a = crunchedin_.FoundOrganization(Axis(0), 0, 0);
+  cvc::crunchedin::OrgId b = crunchedin_.FoundOrganization(Axis(0), 1, 0);
+  crunchedin_.StartRole(a, 2, 0);
+  EXPECT_EQ(2u, crunchedin_.NumOrganizations());
+  EXPECT_EQ(2u, crunchedin_.GetStaff(a).size());
+  EXPECT_EQ(3u, crunchedin_.NumRoles());
+
+  // can't apply where we already work
+  cvc::crunchedin::ApplyAction stay(characters_[2].get(), 0.0, &crunchedin_,
+                                    2, a);
+  EXPECT_FALSE(stay.IsValid(&cvc_));
+
+  cvc::crunchedin::ApplyAction apply(characters_[2].get(), 0.0, &crunchedin_,
+                                     2, b);
+  EXPECT_TRUE(apply.IsValid(&cvc_));
+  EXPECT_TRUE(apply.RequiresResponse());
+  EXPECT_EQ(characters_[1].get(), apply.GetTarget());
+
+  cvc::crunchedin::HireAction hire(characters_[1].get(), 0.0, &apply,
+                                   &crunchedin_);
+  EXPECT_EQ(characters_[2].get(), hire.GetTarget());
+  ASSERT_TRUE(hire.IsValid(&cvc_));
+  hire.TakeEffect(&cvc_);
+
+  // the old role ended as the new one started
+  std::vector<cvc::crunchedin::RoleId> roles;
+  crunchedin_.GetRoles(2, &roles);
+  ASSERT_EQ(2u, roles.size());
+  EXPECT_EQ(2u, crunchedin_.GetNumRoles(2));
+  EXPECT_EQ(roles[0], crunchedin_.GetPreviousRole(roles[1]));
+  EXPECT_EQ(cvc::crunchedin::kNoId, crunchedin_.GetPreviousRole(roles[0]));
+  EXPECT_EQ(0, crunchedin_.GetRoleEndTick(roles[0]));
+  EXPECT_EQ(roles[1], crunchedin_.GetCurrentRole(2));
+  EXPECT_EQ(b, crunchedin_.GetRoleOrg(roles[1]));
+  EXPECT_EQ(1u, crunchedin_.GetStaff(a).size());
+  EXPECT_EQ(2u, crunchedin_.GetStaff(b).size());
+  EXPECT_FALSE(apply.IsValid(&cvc_));
+}
+
+TEST_F(CrunchedInTest, TestCEOLeavingDissolves) {
+  cvc::crunchedin::OrgId a = crunchedin_.FoundOrganization(Axis(0), 0, 0);
+  cvc::crunchedin::OrgId b = crunchedin_.FoundOrganization(Axis(0), 1, 0);
+  crunchedin_.StartRole(a, 2, 0);
+
+  cvc::crunchedin::ApplyAction to_a(characters_[1].get(), 0.0, &crunchedin_,
+                                    1, a);
+  EXPECT_TRUE(to_a.IsValid(&cvc_));
+  // a's ceo moves to b, a is gone and so are its jobs
+  crunchedin_.StartRole(b, 0, 0);
+  EXPECT_TRUE(crunchedin_.IsDissolved(a));
+  EXPECT_EQ(cvc::crunchedin::kNoId, crunchedin_.GetCEO(a));
+  EXPECT_TRUE(crunchedin_.GetStaff(a).empty());
+  EXPECT_EQ(cvc::crunchedin::kNoId, crunchedin_.GetCurrentRole(2));
+  EXPECT_FALSE(to_a.IsValid(&cvc_));
+  EXPECT_EQ(1u, crunchedin_.NumOrganizations());
+
+  std::vector<cvc::crunchedin::OrgId> found;
+  crunchedin_.FindOrganizations(crunchedin_.GetCulture(2), 2, &found);
+  EXPECT_EQ(std::vector<cvc::crunchedin::OrgId>({b}), found);
+
+  // the unemployed can found a new one
+  cvc::crunchedin::FoundAction found_action(characters_[2].get(), 0.0,
+                                            &crunchedin_, 2);
+  ASSERT_TRUE(found_action.IsValid(&cvc_));
+  found_action.TakeEffect(&cvc_);
+  EXPECT_EQ(2u, crunchedin_.NumOrganizations());
+  EXPECT_EQ(3u, crunchedin_.NumOrganizationIds());
+  EXPECT_EQ(2, crunchedin_.GetCEO(
+                   crunchedin_.GetRoleOrg(crunchedin_.GetCurrentRole(2))));
+  EXPECT_FALSE(found_action.IsValid(&cvc_));
+}
+
+TEST(CurriculumVitaeTest, TestContributeMarksScoreDirty) {
+  Character character(0, 0.0);
+  character.SetScore(0.0);
+  Character founder(1, 0.0);
+  cvc::crunchedin::CrunchedIn crunchedin;
+  cvc::crunchedin::CvId cv =
+      crunchedin.AddCurriculumVitae(&character, {{1.0, 0.0}});
+  cvc::crunchedin::OrgId org = crunchedin.FoundOrganization(
+      {{1.0, 0.0}}, crunchedin.AddCurriculumVitae(&founder, {{1.0, 0.0}}), 0);
+  crunchedin.FoundOrganization({{1.0, 0.0}}, cv, 0);
+  cvc::crunchedin::RoleId first = crunchedin.GetCurrentRole(cv);
+  // the first role's org is gone, but the role still counts
+  cvc::crunchedin::RoleId second = crunchedin.StartRole(org, cv, 0);
+
+  crunchedin.Contribute(first, 2.0);
+  crunchedin.Contribute(second, 1.0);
+  EXPECT_TRUE(character.IsScoreDirty());
+  EXPECT_EQ(3.0, crunchedin.TotalContribution(cv));
+  EXPECT_EQ(2.0, crunchedin.GetRoleContribution(first));
+  EXPECT_EQ(1.0, crunchedin.GetOrgContributions(org));
+
+  character.SetMoney(2.0);
+  cvc::crunchedin::ContributionScorer scorer(&crunchedin);
+  EXPECT_EQ(3.0, scorer.Score(nullptr, &character));
+}
+
+TEST_F(CrunchedInTest, TestSettlementMatchesContribute) {
+  std::mt19937 random_generator;
+  std::vector<cvc::crunchedin::Culture> cultures;
+  for (int i = 0; i < 5; i++) {
+    cultures.emplace_back(RandomCulture(&random_generator));
+  }
+  // the same characters and orgs on both sides
+  cvc::crunchedin::CrunchedIn immediate;
+  cvc::crunchedin::CrunchedIn settled;
+  for (cvc::crunchedin::CrunchedIn* crunchedin : {&immediate, &settled}) {
+    for (int i = 0; i < 3; i++) {
+      crunchedin->AddCurriculumVitae(characters_[i].get(), cultures[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+      crunchedin->FoundOrganization(cultures[3 + i], i, 0);
+    }
+  }
+
+  std::uniform_real_distribution<> dist(0.0, 3.0);
+  std::uniform_int_distribution<> roles(0, 1);
+  for (int i = 0; i < 100; i++) {
+    cvc::crunchedin::RoleId role = roles(random_generator);
+    double contribution = dist(random_generator);
+    immediate.Contribute(role, contribution);
+    settled.QueueContribution(role, contribution);
+    if (50 == i) {
+      // a new role starts from everything contributed so far
+      immediate.StartRole(0, 2, 1);
+      settled.StartRole(0, 2, 1);
+    }
+  }
+  // queued work isn't counted until it's settled
+  EXPECT_NE(immediate.GetOrgContributions(1), settled.GetOrgContributions(1));
+  settled.Settle(&cvc_);
+
+  // roles are summed before they're added to totals, so up to rounding
+  for (int org = 0; org < 2; org++) {
+    EXPECT_NEAR(immediate.GetOrgContributions(org),
+                settled.GetOrgContributions(org), 1e-9);
+  }
+  for (int role = 0; role < 3; role++) {
+    EXPECT_NEAR(immediate.GetRoleContribution(role),
+                settled.GetRoleContribution(role), 1e-9);
+    EXPECT_NEAR(immediate.GetContributionsAtStart(role),
+                settled.GetContributionsAtStart(role), 1e-9);
+  }
+  for (int cv = 0; cv < 3; cv++) {
+    EXPECT_NEAR(immediate.TotalContribution(cv), settled.TotalContribution(cv),
+                1e-9);
+    EXPECT_EQ(0.0, settled.PendingContribution(cv));
+  }
+  EXPECT_GT(settled.GetContributionsAtStart(2), 0.0);
+}
+
+TEST_F(CrunchedInTest, TestScoringCountsPendingWork) {
+  crunchedin_.FoundOrganization(Axis(0), 0, 0);
+  characters_[0]->SetScore(0.0);
+  crunchedin_.QueueContribution(0, 2.0);
+  EXPECT_TRUE(characters_[0]->IsScoreDirty());
+  cvc::crunchedin::ContributionScorer scorer(&crunchedin_);
+  EXPECT_EQ(2.0, scorer.Score(&cvc_, characters_[0].get()));
+  // without settling it
+  EXPECT_EQ(0.0, crunchedin_.TotalContribution(0));
+  EXPECT_EQ(0.0, crunchedin_.GetOrgContributions(0));
+  crunchedin_.Settle(&cvc_);
+  EXPECT_EQ(2.0, crunchedin_.TotalContribution(0));
+  EXPECT_EQ(0.0, crunchedin_.PendingContribution(0));
+  EXPECT_EQ(2.0, scorer.Score(&cvc_, characters_[0].get()));
+}
@@ -0,0 +1,104 @@
+#include <array>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/crunchedin/culture.h"
+#include "../src/crunchedin/crunchedin.h"
+
+namespace {
+
+// unit vectors of n dimensions, padded with zeros to whole lane blocks of
+// every type (floats have the most lanes)
+std::vector<double> RandomUnit(size_t n, std::mt19937* random_generator) {
+  std::uniform_real_distribution<> dist(-1.0, 1.0);
+  const size_t lanes = cvc::crunchedin::CultureLanes<float>();
+  std::vector<double> v((n + lanes - 1) / lanes * lanes);
+  double magnitude = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    v[i] = dist(*random_generator);
+    magnitude += v[i] * v[i];
+  }
+  for (size_t i = 0; i < n; i++) {
+    v[i] /= sqrt(magnitude);
+  }
+  return v;
+}
+
+template <typename T>
+std::vector<T> Narrow(const std::vector<double>& v) {
+  return std::vector<T>(v.begin(), v.end());
+}
+
+}
+
+TEST(CultureTest, TestDotKernels) {
+  std::mt19937 random_generator;
+  for (size_t n : {2, 17, 64, 512}) {
+    std::vector<double> a = RandomUnit(n, &random_generator);
+    std::vector<double> b = RandomUnit(n, &random_generator);
+    double expected = 0.0;
+    for (size_t i = 0; i < n; i++) {
+      expected += a[i] * b[i];
+    }
+    EXPECT_NEAR(expected, cvc::crunchedin::CultureDot(a.data(), b.data(),
+                                                      a.size()),
+                1e-12);
+
+    std::vector<float> a_f = Narrow<float>(a);
+    std::vector<float> b_f = Narrow<float>(b);
+    EXPECT_NEAR(expected,
+                cvc::crunchedin::CultureDot(a_f.data(), b_f.data(), a.size()),
+                1e-5);
+
+    // 8 bits of mantissa
+    std::vector<cvc::crunchedin::BFloat16> a_b =
+        Narrow<cvc::crunchedin::BFloat16>(a);
+    std::vector<cvc::crunchedin::BFloat16> b_b =
+        Narrow<cvc::crunchedin::BFloat16>(b);
+    EXPECT_NEAR(expected,
+                cvc::crunchedin::CultureDot(a_b.data(), b_b.data(), a.size()),
+                2e-2);
+  }
+}
+
+TEST(CultureTest, TestPadding) {
+  // less than a vector of padding, and none for alignment
+  typedef cvc::crunchedin::Culture Culture;
+  EXPECT_EQ(0u, Culture::kPadded % cvc::crunchedin::kCultureLanes);
+  EXPECT_LT(Culture::kPadded, cvc::crunchedin::CULTURE_DIMENSIONS +
+                                  cvc::crunchedin::kCultureLanes);
+  EXPECT_EQ(Culture::kBytes, sizeof(Culture));
+  EXPECT_EQ(0u, Culture::kBytes % alignof(Culture));
+}
+
+TEST(CultureTest, TestBFloat16) {
+  EXPECT_EQ(1.0f, (float)cvc::crunchedin::BFloat16(1.0f));
+  EXPECT_EQ(-0.5f, (float)cvc::crunchedin::BFloat16(-0.5f));
+  // rounds to the nearest of 1 and 1 + 2^-7
+  EXPECT_EQ(1.0f, (float)cvc::crunchedin::BFloat16(1.0f + 1.0f / 512));
+  EXPECT_EQ(1.0f + 1.0f / 128,
+            (float)cvc::crunchedin::BFloat16(1.0f + 3.0f / 512));
+}
+
+TEST(CultureTest, TestRoleCachesAlignment) {
+  std::array<double, cvc::crunchedin::CULTURE_DIMENSIONS> culture = {};
+  culture[0] = 1.0;
+  Character character(0, 0.0);
+  cvc::crunchedin::CrunchedIn crunchedin;
+  cvc::crunchedin::CvId cv = crunchedin.AddCurriculumVitae(&character, culture);
+  crunchedin.FoundOrganization(culture, cv, 0);
+  cvc::crunchedin::RoleId role = crunchedin.GetCurrentRole(cv);
+  EXPECT_EQ(1.0, crunchedin.GetCultureAlignment(role));
+  EXPECT_EQ(1.0, crunchedin.GetCultureFit(role)[0]);
+
+  // a perfect fit contributes everything
+  crunchedin.Contribute(role, 2.0);
+  EXPECT_EQ(2.0, crunchedin.GetRoleContribution(role));
+
+  std::array<double, cvc::crunchedin::CULTURE_DIMENSIONS> features;
+  crunchedin.GetCultureFit(role).CopyTo(features.data());
+  EXPECT_EQ(1.0, features[0]);
+}
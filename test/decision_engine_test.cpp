@@ -46,16 +46,35 @@ class TestAgent : public Agent {
   }
 
   double Score(CVC* cvc) override {
-    return 0.0;
+    score_calls_++;
+    return character_->GetMoney();
   }
 
   std::unique_ptr<Action> next_action_ = nullptr;
 
   int choose_calls_ = 0;
   int learn_calls_ = 0;
+  int score_calls_ = 0;
   TestActionState tas_;
 };
 
+// records what had happened by the time it settled
+class TestSettlementDET : public Settlement {
+ public:
+  TestSettlementDET(TestActionState* tas) : tas_(tas) {}
+
+  void Settle(CVC* cvc) override {
+    settle_calls_++;
+    effects_at_settle_ = tas_->effects_;
+    tick_at_settle_ = cvc->Now();
+  }
+
+  TestActionState* tas_;
+  int settle_calls_ = 0;
+  int effects_at_settle_ = -1;
+  int tick_at_settle_ = -1;
+};
+
 class DecisionEngineTest : public ::testing::Test {
  protected:
   void SetUp() override {
@@ -104,3 +123,37 @@ TEST_F(DecisionEngineTest, TestRunOneGameLoop) {
   EXPECT_EQ(2, a_.learn_calls_);
 }
 
+
+TEST_F(DecisionEngineTest, TestRescoresOnlyDirtyCharacters) {
+  //the first loop scores everyone, after that only characters whose money
+  //changed are rescored
+  decision_engine_->RunOneGameLoop();
+  EXPECT_EQ(1, a_.score_calls_);
+  EXPECT_FALSE(c_.IsScoreDirty());
+
+  decision_engine_->RunOneGameLoop();
+  EXPECT_EQ(1, a_.score_calls_);
+  EXPECT_EQ(0.0, a_.CurrentScore(&cvc_));
+  EXPECT_EQ(1, a_.score_calls_);
+
+  c_.SetMoney(5.0);
+  EXPECT_TRUE(c_.IsScoreDirty());
+  decision_engine_->RunOneGameLoop();
+  EXPECT_EQ(2, a_.score_calls_);
+  EXPECT_EQ(5.0, c_.GetScore());
+}
+
+TEST_F(DecisionEngineTest, TestSettlesAfterEvaluating) {
+  TestSettlementDET settlement(&a_.tas_);
+  decision_engine_->AddSettlement(&settlement);
+
+  decision_engine_->RunOneGameLoop();
+  EXPECT_EQ(1, settlement.settle_calls_);
+  EXPECT_EQ(0, settlement.effects_at_settle_);
+
+  // once the tick's actions have taken effect, before the clock moves on
+  decision_engine_->RunOneGameLoop();
+  EXPECT_EQ(2, settlement.settle_calls_);
+  EXPECT_EQ(1, settlement.effects_at_settle_);
+  EXPECT_EQ(cvc_.Now() - 1, settlement.tick_at_settle_);
+}
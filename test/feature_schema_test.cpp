@@ -0,0 +1,60 @@
+#include <array>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/sarsa/feature_schema.h"
+
+namespace {
+
+struct ContextFST {
+  double value_;
+};
+
+struct ValueFeatureFST : cvc::sarsa::Feature {
+  static constexpr const char* kName = "value";
+  template <typename T>
+  static void Extract(const ContextFST& context, T* out) {
+    out[0] = context.value_;
+  }
+};
+
+struct PlaceholderFeatureFST : cvc::sarsa::DeadFeature {
+  static constexpr const char* kName = "placeholder";
+};
+
+struct WideFeatureFST : cvc::sarsa::Feature {
+  static constexpr const char* kName = "wide";
+  static constexpr size_t kWidth = 3;
+  template <typename T>
+  static void Extract(const ContextFST& context, T* out) {
+    for (size_t i = 0; i < kWidth; i++) {
+      out[i] = context.value_ * (i + 1);
+    }
+  }
+};
+
+typedef cvc::sarsa::FeatureSchema<cvc::sarsa::BiasFeature,
+                                  PlaceholderFeatureFST, ValueFeatureFST,
+                                  WideFeatureFST, PlaceholderFeatureFST>
+    SchemaFST;
+
+// dead features take no space, everything is laid out at compile time
+static_assert(5 == SchemaFST::kNumFeatures, "dead features are dropped");
+static_assert(0 == SchemaFST::Offset<cvc::sarsa::BiasFeature>(), "");
+static_assert(1 == SchemaFST::Offset<ValueFeatureFST>(), "");
+static_assert(2 == SchemaFST::Offset<WideFeatureFST>(), "");
+
+} //namespace
+
+TEST(FeatureSchemaTest, TestExtract) {
+  std::array<float, 5> features = SchemaFST::Extract<float>(ContextFST{2.0});
+  std::array<float, 5> expected = {1.0f, 2.0f, 2.0f, 4.0f, 6.0f};
+  EXPECT_EQ(expected, features);
+}
+
+TEST(FeatureSchemaTest, TestNames) {
+  std::vector<std::string> expected = {"bias", "value", "wide[0]", "wide[1]",
+                                       "wide[2]"};
+  EXPECT_EQ(expected, SchemaFST::Names());
+}
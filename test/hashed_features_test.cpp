@@ -0,0 +1,120 @@
+#include <unistd.h>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "../src/util.h"
+#include "../src/core.h"
+#include "../src/sarsa/checkpoint.h"
+#include "../src/sarsa/hashed_features.h"
+#include "../src/sarsa/sarsa_learner.h"
+
+class NoopTestActionHFT : public Action {
+ public:
+  NoopTestActionHFT() : Action("NTA", nullptr, 1.0) {}
+
+  bool IsValid(const CVC* gamestate) { return true; }
+  void TakeEffect(CVC* gamestate) {}
+};
+
+class HashedFeaturesTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    logger_.SetLogLevel(ERROR);
+    learner_ = cvc::sarsa::SARSALearner<1>::Create(
+        1, 0.01, 0.9, 0.9, 0.999, random_generator_, &logger_);
+    learner_->EnableHashedFeatures(8);
+  }
+
+  static cvc::sarsa::HashedFeatures Identity(uint64_t id) {
+    cvc::sarsa::HashedFeatures hashed;
+    hashed.Add(cvc::sarsa::HashFeature(cvc::sarsa::kTargetIdentityFeature,
+                                       id));
+    return hashed;
+  }
+
+  // one step towards reward for an action with just a bias and hashed
+  void Learn(cvc::sarsa::SARSALearner<1>* learner,
+             const cvc::sarsa::HashedFeatures& hashed, double reward) {
+    CVC cvc;
+    std::array<double, 1> bias = {1.0};
+    std::array<double, 1> zero = {0.0};
+    cvc::sarsa::ExperienceImpl<1> e2(std::make_unique<NoopTestActionHFT>(),
+                                     reward, nullptr, zero, learner);
+    cvc::sarsa::ExperienceImpl<1> e1(std::make_unique<NoopTestActionHFT>(),
+                                     0.0, &e2, bias, learner);
+    e1.hashed_ = hashed;
+    e1.Learn(&cvc);
+  }
+
+  std::mt19937 random_generator_;
+  Logger logger_;
+  std::unique_ptr<cvc::sarsa::SARSALearner<1>> learner_;
+};
+
+TEST_F(HashedFeaturesTest, TestLearnsPerTargetValues) {
+  // identical dense features, the identities alone tell the rewards apart
+  cvc::sarsa::HashedFeatures good = Identity(3);
+  cvc::sarsa::HashedFeatures bad = Identity(4);
+  for (int i = 0; i < 2000; i++) {
+    Learn(learner_.get(), good, 1.0);
+    Learn(learner_.get(), bad, -1.0);
+  }
+
+  std::array<double, 1> bias = {1.0};
+  double good_score = learner_->Score(bias) + learner_->ScoreHashed(good);
+  double bad_score = learner_->Score(bias) + learner_->ScoreHashed(bad);
+  EXPECT_NEAR(1.0, good_score, 0.1);
+  EXPECT_NEAR(-1.0, bad_score, 0.1);
+  EXPECT_LE(std::abs(learner_->ScoreHashed(good)),
+            learner_->HashedBound() + 1e-12);
+}
+
+TEST_F(HashedFeaturesTest, TestOnlyActiveRowsChange) {
+  cvc::sarsa::HashedFeatures active = Identity(3);
+  uint32_t active_key = active.keys_[0];
+  for (int i = 0; i < 10; i++) {
+    Learn(learner_.get(), active, 1.0);
+  }
+  EXPECT_NE(0.0, *learner_->GetHashedWeight(active_key));
+  for (uint32_t key = 0; key < 256; key++) {
+    if ((key & 255) != (active_key & 255)) {
+      EXPECT_EQ(0.0, *learner_->GetHashedWeight(key));
+    }
+  }
+
+  // without the table hashed features do nothing
+  std::unique_ptr<cvc::sarsa::SARSALearner<1>> dense =
+      cvc::sarsa::SARSALearner<1>::Create(2, 0.01, 0.9, 0.9, 0.999,
+                                          random_generator_, &logger_);
+  EXPECT_FALSE(dense->UsesHashedFeatures());
+  Learn(dense.get(), active, 1.0);
+  EXPECT_EQ(0.0, dense->ScoreHashed(active));
+  EXPECT_EQ(nullptr, dense->GetHashedWeight(active_key));
+}
+
+TEST_F(HashedFeaturesTest, TestCheckpointRoundTrip) {
+  std::string path =
+      "/tmp/cvc_hashed_features_test." + std::to_string(getpid());
+  cvc::sarsa::HashedFeatures a = Identity(3);
+  cvc::sarsa::HashedFeatures b = Identity(4);
+  Learn(learner_.get(), a, 1.0);
+  Learn(learner_.get(), b, -1.0);
+  ASSERT_TRUE(cvc::sarsa::SaveCheckpoint(path.c_str(), {{"a", learner_.get()}},
+                                         &logger_));
+
+  std::unique_ptr<cvc::sarsa::SARSALearner<1>> other =
+      cvc::sarsa::SARSALearner<1>::Create(2, 0.01, 0.9, 0.9, 0.999,
+                                          random_generator_, &logger_);
+  other->EnableHashedFeatures(8);
+  ASSERT_TRUE(cvc::sarsa::LoadCheckpoint(path.c_str(), {{"a", other.get()}},
+                                         &logger_));
+  unlink(path.c_str());
+  EXPECT_EQ(learner_->ScoreHashed(a), other->ScoreHashed(a));
+  EXPECT_EQ(learner_->HashedBound(), other->HashedBound());
+
+  // including the lazy optimizer state, so training continues identically
+  Learn(learner_.get(), a, 1.0);
+  Learn(other.get(), a, 1.0);
+  EXPECT_EQ(learner_->ScoreHashed(a), other->ScoreHashed(a));
+}
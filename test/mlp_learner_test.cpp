@@ -0,0 +1,152 @@
+#include <unistd.h>
+#include <array>
+#include <cmath>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "../src/util.h"
+#include "../src/core.h"
+#include "../src/sarsa/checkpoint.h"
+#include "../src/sarsa/sarsa_learner.h"
+#include "../src/sarsa/mlp_learner.h"
+
+class NoopTestActionMLT : public Action {
+ public:
+  NoopTestActionMLT() : Action("NTA", nullptr, 1.0) {}
+
+  bool IsValid(const CVC* gamestate) { return true; }
+  void TakeEffect(CVC* gamestate) {}
+};
+
+class MLPLearnerTest : public ::testing::Test {
+ protected:
+  void SetUp() override { logger_.SetLogLevel(ERROR); }
+
+  // one supervised step (g = 0) towards target, returns the squared error
+  template <class L>
+  double Train(L* learner, std::array<double, 3> features, double target) {
+    CVC cvc;
+    cvc::sarsa::ExperienceImpl<3> next(std::make_unique<NoopTestActionMLT>(),
+                                       target, nullptr, features, learner);
+    cvc::sarsa::ExperienceImpl<3> experience(
+        std::make_unique<NoopTestActionMLT>(), 0.0, &next, features, learner);
+    double dL_dy = experience.Learn(&cvc);
+    return dL_dy * dL_dy / 4.0;
+  }
+
+  // mean squared error fitting |x1| + |x2|, which a linear model can't
+  template <class L>
+  double FitAbs(L* learner, int epochs) {
+    std::uniform_real_distribution<> dist(-1.0, 1.0);
+    double loss = 0.0;
+    for (int epoch = 0; epoch < epochs; epoch++) {
+      loss = 0.0;
+      for (int i = 0; i < 100; i++) {
+        double x1 = dist(random_generator_);
+        double x2 = dist(random_generator_);
+        loss += Train(learner, {1.0, x1, x2}, std::abs(x1) + std::abs(x2));
+      }
+    }
+    return loss / 100.0;
+  }
+
+  std::mt19937 random_generator_;
+  Logger logger_;
+};
+
+TEST_F(MLPLearnerTest, TestScoreBatchMatchesScore) {
+  auto learner = cvc::sarsa::MLPLearner<3, 8, 4>::Create(
+      0, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+
+  // more rows than a block, and a partial block at the end
+  std::array<std::array<double, 3>, 37> features;
+  std::uniform_real_distribution<> dist(-1.0, 1.0);
+  for (auto& f : features) {
+    f = {1.0, dist(random_generator_), dist(random_generator_)};
+  }
+  std::array<double, 37> scores;
+  learner->ScoreBatch(features.data(), features.size(), scores.data());
+  for (size_t i = 0; i < features.size(); i++) {
+    EXPECT_EQ(learner->Score(features[i]), scores[i]);
+  }
+}
+
+TEST_F(MLPLearnerTest, TestLearnPredictsLikeScore) {
+  auto learner = cvc::sarsa::MLPLearner<3, 8, 4>::Create(
+      0, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+  std::array<double, 3> features = {1.0, 0.25, -0.75};
+  double score = learner->Score(features);
+
+  // learning forwards one row on its own, with a target of zero dL_dy is
+  // exactly twice what it predicted
+  CVC cvc;
+  cvc::sarsa::ExperienceImpl<3> next(std::make_unique<NoopTestActionMLT>(),
+                                     0.0, nullptr, features, learner.get());
+  cvc::sarsa::ExperienceImpl<3> experience(
+      std::make_unique<NoopTestActionMLT>(), 0.0, &next, features,
+      learner.get());
+  EXPECT_EQ(2.0 * score, experience.Learn(&cvc));
+}
+
+TEST_F(MLPLearnerTest, TestLinearScoreBatchMatchesScore) {
+  auto learner = cvc::sarsa::SARSALearner<3>::Create(
+      0, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+
+  // whole blocks of rows and a partial one at the end
+  std::array<std::array<double, 3>, 11> features;
+  std::uniform_real_distribution<> dist(-1.0, 1.0);
+  for (auto& f : features) {
+    f = {1.0, dist(random_generator_), dist(random_generator_)};
+  }
+  std::array<double, 11> scores;
+  learner->ScoreBatch(features.data(), features.size(), scores.data());
+  for (size_t i = 0; i < features.size(); i++) {
+    EXPECT_EQ(learner->Score(features[i]), scores[i]);
+  }
+}
+
+TEST_F(MLPLearnerTest, TestFitsNonlinearTarget) {
+  auto linear = cvc::sarsa::SARSALearner<3>::Create(
+      0, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+  auto one_layer = cvc::sarsa::MLPLearner<3, 16>::Create(
+      0, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+  auto two_layers = cvc::sarsa::MLPLearner<3, 16, 8>::Create(
+      0, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+
+  double linear_loss = FitAbs(linear.get(), 50);
+  double one_layer_loss = FitAbs(one_layer.get(), 50);
+  double two_layer_loss = FitAbs(two_layers.get(), 50);
+
+  // the best linear fit has an mse of about 0.18
+  EXPECT_GT(linear_loss, 0.1);
+  EXPECT_LT(one_layer_loss, linear_loss / 2.0);
+  EXPECT_LT(two_layer_loss, linear_loss / 2.0);
+}
+
+TEST_F(MLPLearnerTest, TestCheckpointRoundTrip) {
+  std::string path = "/tmp/cvc_mlp_test." + std::to_string(getpid());
+  auto learner = cvc::sarsa::MLPLearner<3, 8, 4>::Create(
+      0, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+  auto other = cvc::sarsa::MLPLearner<3, 8, 4>::Create(
+      1, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+  auto wrong_shape = cvc::sarsa::MLPLearner<3, 8>::Create(
+      2, 0.01, 0.0, 0.9, 0.999, random_generator_, &logger_);
+  FitAbs(learner.get(), 1);
+
+  ASSERT_TRUE(cvc::sarsa::SaveCheckpoint(path.c_str(), {{"a", learner.get()}},
+                                         &logger_));
+  std::unique_ptr<cvc::sarsa::Checkpoint> checkpoint =
+      cvc::sarsa::Checkpoint::Open(path.c_str(), &logger_);
+  ASSERT_NE(nullptr, checkpoint);
+  EXPECT_TRUE(other->ReadCheckpoint(*checkpoint, "a", &logger_));
+  EXPECT_FALSE(wrong_shape->ReadCheckpoint(*checkpoint, "a", &logger_));
+  unlink(path.c_str());
+
+  // optimizer state came along too, so training continues identically
+  std::array<double, 3> features = {1.0, 0.5, -0.25};
+  EXPECT_EQ(learner->Score(features), other->Score(features));
+  Train(learner.get(), features, 1.0);
+  Train(other.get(), features, 1.0);
+  EXPECT_EQ(learner->Score(features), other->Score(features));
+}
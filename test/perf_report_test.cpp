@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/core.h"
+#include "../src/decision_engine.h"
+#include "../src/perf_report.h"
+
+TEST(LatencyHistogramTest, TestBuckets) {
+  for (uint64_t ns : {0, 1, 3, 4, 5, 7, 8, 100, 1000, 123456789}) {
+    size_t bucket = LatencyHistogram::Bucket(ns);
+    ASSERT_LT(bucket, LatencyHistogram::kNumBuckets);
+    uint64_t lower = LatencyHistogram::BucketLowerBound(bucket);
+    EXPECT_LE(lower, ns);
+    // within a quarter
+    EXPECT_GE(lower * 5 / 4 + 1, ns);
+    EXPECT_EQ(bucket, LatencyHistogram::Bucket(lower));
+  }
+  EXPECT_LT(LatencyHistogram::Bucket(~0ull), LatencyHistogram::kNumBuckets);
+}
+
+TEST(LatencyHistogramTest, TestQuantiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0u, histogram.QuantileNs(0.5));
+  for (uint64_t ns = 1; ns <= 1000; ns++) {
+    histogram.Record(ns);
+  }
+  EXPECT_EQ(1000u, histogram.Count());
+  EXPECT_EQ(1000u, histogram.MaxNs());
+  EXPECT_DOUBLE_EQ(500.5, histogram.MeanNs());
+  EXPECT_EQ(1u, histogram.QuantileNs(0.0));
+  for (double q : {0.5, 0.9, 0.99}) {
+    double ns = histogram.QuantileNs(q);
+    EXPECT_LE(ns, q * 1000);
+    EXPECT_GE(ns, q * 1000 * 0.75);
+  }
+}
+
+namespace {
+
+class IdleAgent : public Agent {
+ public:
+  IdleAgent(Character* character) : Agent(character) {}
+
+  Action* ChooseAction(CVC* cvc) override {
+    action_ = std::make_unique<TrivialAction>(character_, 0.0);
+    return action_.get();
+  }
+  Action* Respond(CVC* cvc, Action* action) override { return nullptr; }
+  void Learn(CVC* cvc) override {}
+  double Score(CVC* cvc) override { return 0.0; }
+
+ private:
+  std::unique_ptr<Action> action_;
+};
+
+class FixedFootprint : public MemoryFootprint {
+ public:
+  size_t MemoryBytes() const override { return bytes_; }
+
+  size_t bytes_ = 0;
+};
+
+}
+
+TEST(PerfRecorderTest, TestRecordsRun) {
+  Logger logger("test", nullptr, ERROR);
+  std::vector<std::unique_ptr<Character>> characters;
+  std::vector<std::unique_ptr<IdleAgent>> agents;
+  std::vector<Character*> c;
+  std::vector<Agent*> a;
+  for (int i = 0; i < 3; i++) {
+    characters.push_back(std::make_unique<Character>(i, 10.0));
+    agents.push_back(std::make_unique<IdleAgent>(characters.back().get()));
+    c.push_back(characters.back().get());
+    a.push_back(agents.back().get());
+  }
+  CVC cvc(c, &logger, std::mt19937());
+  DecisionEngine d(a, &cvc, &logger);
+  PerfRecorder perf(3, 4);
+  d.AddPhaseObserver(&perf);
+
+  perf.Start();
+  for (int i = 0; i < 10; i++) {
+    d.RunOneGameLoop();
+  }
+  EXPECT_EQ(10, perf.Ticks());
+  EXPECT_EQ(30u, perf.GetDecisionLatency().Count());
+  EXPECT_GT(perf.Seconds(), 0.0);
+  for (int phase = 0; phase < kNumEnginePhases; phase++) {
+    EXPECT_GE(perf.PhaseSeconds((EnginePhase)phase), 0.0);
+  }
+  EXPECT_GT(perf.PhaseSeconds(kChoosePhase), 0.0);
+
+  char* buffer;
+  size_t size;
+  FILE* out = open_memstream(&buffer, &size);
+  perf.WriteJSON(out, "");
+  fclose(out);
+  std::string json(buffer, size);
+  free(buffer);
+  EXPECT_EQ('{', json.front());
+  EXPECT_EQ('}', json.back());
+  EXPECT_NE(std::string::npos, json.find("\"ticks\": 10,"));
+  EXPECT_NE(std::string::npos, json.find("\"choose\": "));
+  // two samples of 4 ticks
+  EXPECT_NE(std::string::npos, json.find("{\"tick\": 8,"));
+  EXPECT_EQ(std::string::npos, json.find("{\"tick\": 12,"));
+}
+
+TEST(PerfRecorderTest, TestPeakRSSResets) {
+  {
+    // 64MB, touched so it's resident, then given back
+    std::vector<char> big(64 << 20, 1);
+    ASSERT_EQ(1, big[12345]);
+  }
+  long before = PerfRecorder::PeakRSSKb();
+  ASSERT_GT(before, 64 << 10);
+  if (!PerfRecorder::ResetPeakRSS()) {
+    GTEST_SKIP() << "can't reset the peak resident set size here";
+  }
+  EXPECT_LT(PerfRecorder::PeakRSSKb(), before - (32 << 10));
+}
+
+TEST(AllocationRecorderTest, TestRecordsTicks) {
+  Logger logger("test", nullptr, ERROR);
+  Character character(0, 10.0);
+  IdleAgent agent(&character);
+  CVC cvc({&character}, &logger, std::mt19937());
+  DecisionEngine d({&agent}, &cvc, &logger);
+  AllocationRecorder allocations;
+  d.AddPhaseObserver(&allocations);
+
+  allocations.Start();
+  for (int i = 0; i < 5; i++) {
+    d.RunOneGameLoop();
+  }
+  EXPECT_EQ(5, allocations.Ticks());
+  uint64_t total = 0;
+  for (int scope = 0; scope < AllocationRecorder::kNumScopes; scope++) {
+    total += allocations.Total(scope).allocations_;
+  }
+  EXPECT_EQ(total, allocations.Total().allocations_);
+  EXPECT_LE(allocations.LastTick().allocations_,
+            allocations.MaxTickAllocations());
+  if (AllocationHookInstalled()) {
+    // the idle agent makes a new action every tick
+    EXPECT_GE(allocations.Total(kChoosePhase).allocations_, 5u);
+  } else {
+    EXPECT_EQ(0u, total);
+  }
+  EXPECT_STREQ("choose", AllocationRecorder::ScopeName(kChoosePhase));
+  EXPECT_STREQ("other",
+               AllocationRecorder::ScopeName(AllocationRecorder::kOther));
+  SetAllocationCounting(false);
+}
+
+TEST(MemoryReportTest, TestLivePeak) {
+  Logger logger("test", nullptr, ERROR);
+  Character character(0, 10.0);
+  IdleAgent agent(&character);
+  CVC cvc({&character}, &logger, std::mt19937());
+  DecisionEngine d({&agent}, &cvc, &logger);
+  FixedFootprint a;
+  FixedFootprint b;
+  FixedFootprint c;
+  MemoryReport memory(2, &logger);
+  memory.AddSubsystem("ab", {&a, &b});
+  memory.AddSubsystem("c", {&c});
+  d.AddPhaseObserver(&memory);
+  ASSERT_EQ(2u, memory.NumSubsystems());
+  EXPECT_STREQ("c", memory.Name(1));
+
+  a.bytes_ = 10;
+  b.bytes_ = 20;
+  c.bytes_ = 5;
+  d.RunOneGameLoop();
+  // not sampled until the end of the window
+  EXPECT_EQ(0u, memory.LiveBytes());
+  d.RunOneGameLoop();
+  EXPECT_EQ(30u, memory.LiveBytes(0));
+  EXPECT_EQ(5u, memory.LiveBytes(1));
+  EXPECT_EQ(35u, memory.LiveBytes());
+
+  a.bytes_ = 1;
+  c.bytes_ = 50;
+  memory.Sample();
+  EXPECT_EQ(21u, memory.LiveBytes(0));
+  EXPECT_EQ(30u, memory.PeakBytes(0));
+  EXPECT_EQ(50u, memory.PeakBytes(1));
+  EXPECT_EQ(71u, memory.LiveBytes());
+  EXPECT_EQ(71u, memory.PeakBytes());
+}
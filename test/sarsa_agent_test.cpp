@@ -1,4 +1,5 @@
 #include <random>
+#include <cmath>
 
 #include "gtest/gtest.h"
 #include "../src/util.h"
@@ -6,6 +7,7 @@
 #include "../src/action.h"
 #include "../src/sarsa/sarsa_agent.h"
 #include "../src/sarsa/sarsa_learner.h"
+#include "../src/sarsa/sarsa_action_factories.h"
 
 struct TestActionState {
   int effects_ = 0;
@@ -100,3 +102,536 @@ TEST_F(SarsaAgentTest, TestLearningMonotonic) {
               dL_dy, second_loss);
   EXPECT_LT(second_loss, first_loss);
 }
+
+TEST_F(SarsaAgentTest, TestLambdaTraceDecay) {
+  // traces should accumulate features and decay by g * lambda every tick
+  std::unique_ptr<cvc::sarsa::SARSALambdaLearner<1>> learner =
+      cvc::sarsa::SARSALambdaLearner<1>::Create(
+          1, 0.001, 0.8, 0.5, 0.9, 0.999, random_generator_, &learn_logger_);
+  learn_logger_.SetLogLevel(WARN);
+
+  Character character(0, 0.0);
+  CVC cvc({&character}, &learn_logger_, random_generator_);
+  std::array<double, 1> one_array = {1.0};
+
+  cvc::sarsa::ExperienceImpl<1> e3(
+      std::make_unique<RecordingTestActionSAT>(&character, nullptr), 2.0,
+      nullptr, one_array, learner.get());
+  cvc::sarsa::ExperienceImpl<1> e2(
+      std::make_unique<RecordingTestActionSAT>(&character, nullptr), 1.0, &e3,
+      one_array, learner.get());
+  cvc::sarsa::ExperienceImpl<1> e1(
+      std::make_unique<RecordingTestActionSAT>(&character, nullptr), 0.0, &e2,
+      one_array, learner.get());
+
+  EXPECT_EQ(nullptr, learner->GetTrace(&character));
+
+  e1.Learn(&cvc);
+  ASSERT_NE(nullptr, learner->GetTrace(&character));
+  EXPECT_DOUBLE_EQ(1.0, (*learner->GetTrace(&character))[0]);
+
+  cvc.Tick();
+  cvc.Tick();
+  e2.Learn(&cvc);
+  EXPECT_DOUBLE_EQ(0.4 * 0.4 + 1.0, (*learner->GetTrace(&character))[0]);
+
+  learner->ResetTrace(&character);
+  EXPECT_EQ(nullptr, learner->GetTrace(&character));
+}
+
+TEST_F(SarsaAgentTest, TestLambdaLearningMonotonic) {
+  // one step TD error should shrink after learning from it
+  std::unique_ptr<cvc::sarsa::SARSALambdaLearner<1>> learner =
+      cvc::sarsa::SARSALambdaLearner<1>::Create(
+          1, 0.001, 0.8, 0.9, 0.0, 0.0, random_generator_, &learn_logger_);
+  learn_logger_.SetLogLevel(WARN);
+
+  CVC cvc;
+  std::array<double, 1> one_array = {1.0};
+  std::array<double, 1> zero_array = {0.0};
+  cvc::sarsa::ExperienceImpl<1> e2(
+      std::make_unique<RecordingTestActionSAT>(nullptr, nullptr), 10.0, nullptr,
+      zero_array, learner.get());
+  cvc::sarsa::ExperienceImpl<1> e1(
+      std::make_unique<RecordingTestActionSAT>(nullptr, nullptr), 0.0, &e2,
+      one_array, learner.get());
+
+  double first_loss = pow(learner->Score(one_array) - 10.0, 2);
+  e1.Learn(&cvc);
+  double second_loss = pow(learner->Score(one_array) - 10.0, 2);
+  EXPECT_LT(second_loss, first_loss);
+}
+
+class TestActionFactorySAT : public cvc::sarsa::ActionFactory {
+ public:
+  TestActionFactorySAT(cvc::sarsa::Learner<1>* learner, TestActionState* tas)
+      : learner_(learner), tas_(tas) {}
+
+  bool CanLearn() const override { return learner_->CanLearn(); }
+
+  double EnumerateActions(
+      CVC* cvc, Character* character,
+      std::vector<std::unique_ptr<cvc::sarsa::Experience>>* actions) override {
+    actions->push_back(learner_->WrapAction(
+        {1.0}, std::make_unique<RecordingTestActionSAT>(character, tas_)));
+    return actions->back()->action_->GetScore();
+  }
+
+  cvc::sarsa::Learner<1>* learner_;
+  TestActionState* tas_;
+};
+
+TEST_F(SarsaAgentTest, TestFrozenAgent) {
+  // a frozen agent acts according to its learner, but never updates it
+  learn_logger_.SetLogLevel(WARN);
+  Character character(0, 0.0);
+  CVC cvc({&character}, &learn_logger_, random_generator_);
+  TestActionState tas;
+  TestActionFactorySAT factory(learner_.get(), &tas);
+  cvc::sarsa::GreedyPolicy policy;
+  cvc::sarsa::MoneyScorer scorer;
+  cvc::sarsa::SARSAAgent<cvc::sarsa::MoneyScorer> agent(
+      &scorer, &character, {&factory}, {}, &policy, 1, true);
+  EXPECT_TRUE(agent.IsFrozen());
+
+  DecisionEngine engine({&agent}, &cvc, &learn_logger_);
+  std::array<double, 1> one_array = {1.0};
+  double score = learner_->Score(one_array);
+  for (int i = 0; i < 5; i++) {
+    // the agent gets a reward every tick which would change the weights
+    character.SetMoney(character.GetMoney() + 1.0);
+    engine.RunOneGameLoop();
+  }
+  EXPECT_EQ(4, tas.effects_);
+  EXPECT_EQ(score, learner_->Score(one_array));
+
+  // once unfrozen the same agent learns again
+  agent.SetFrozen(false);
+  for (int i = 0; i < 5; i++) {
+    character.SetMoney(character.GetMoney() + 1.0);
+    engine.RunOneGameLoop();
+  }
+  EXPECT_EQ(9, tas.effects_);
+  EXPECT_NE(score, learner_->Score(one_array));
+}
+
+TEST_F(SarsaAgentTest, TestQuantizedAgentStaysFrozen) {
+  // inference only learners can't be learned through
+  Character character(0, 0.0);
+  TestActionState tas;
+  cvc::sarsa::QuantizedLearner<1, double> quantized(0);
+  EXPECT_FALSE(quantized.CanLearn());
+  TestActionFactorySAT factory(&quantized, &tas);
+  cvc::sarsa::GreedyPolicy policy;
+  cvc::sarsa::MoneyScorer scorer;
+  cvc::sarsa::SARSAAgent<cvc::sarsa::MoneyScorer> agent(
+      &scorer, &character, {&factory}, {}, &policy, 1, true);
+  EXPECT_FALSE(agent.CanLearn());
+  EXPECT_FALSE(agent.SetFrozen(false));
+  EXPECT_TRUE(agent.IsFrozen());
+
+  TestActionFactorySAT learning_factory(learner_.get(), &tas);
+  cvc::sarsa::SARSAAgent<cvc::sarsa::MoneyScorer> learning_agent(
+      &scorer, &character, {&learning_factory}, {}, &policy, 1, true);
+  EXPECT_TRUE(learning_agent.SetFrozen(false));
+  EXPECT_FALSE(learning_agent.IsFrozen());
+}
+
+// records the reward of every experience it learns from
+class RewardLearnerSAT : public cvc::sarsa::Learner<1> {
+ public:
+  double Learn(CVC* cvc, cvc::sarsa::ExperienceImpl<1>* experience) override {
+    assert(experience->next_experience_);
+    rewards_.push_back(experience->next_experience_->score_ -
+                       experience->score_);
+    return 0.0;
+  }
+  double Score(const std::array<double, 1> features) const override {
+    return 0.0;
+  }
+  void WriteCheckpoint(cvc::sarsa::CheckpointWriter* writer,
+                       const char* name) const override {}
+  bool ReadCheckpoint(const cvc::sarsa::Checkpoint& checkpoint,
+                      const char* name, Logger* logger) override {
+    return false;
+  }
+
+  std::vector<double> rewards_;
+};
+
+TEST_F(SarsaAgentTest, TestUnfreezeLearnsFromScoredExperiences) {
+  // the action chosen while frozen is still pending when the agent is
+  // unfrozen, it has no score so it mustn't be learned from
+  learn_logger_.SetLogLevel(WARN);
+  Character character(0, 10.0);
+  CVC cvc({&character}, &learn_logger_, random_generator_);
+  TestActionState tas;
+  RewardLearnerSAT learner;
+  TestActionFactorySAT factory(&learner, &tas);
+  cvc::sarsa::GreedyPolicy policy;
+  cvc::sarsa::MoneyScorer scorer;
+  cvc::sarsa::SARSAAgent<cvc::sarsa::MoneyScorer> agent(
+      &scorer, &character, {&factory}, {}, &policy, 1, true);
+
+  DecisionEngine engine({&agent}, &cvc, &learn_logger_);
+  for (int i = 0; i < 3; i++) {
+    character.SetMoney(character.GetMoney() + 1.0);
+    engine.RunOneGameLoop();
+  }
+  EXPECT_TRUE(learner.rewards_.empty());
+
+  agent.SetFrozen(false);
+  for (int i = 0; i < 4; i++) {
+    character.SetMoney(character.GetMoney() + 1.0);
+    engine.RunOneGameLoop();
+  }
+  // money goes up by one between every decision
+  ASSERT_FALSE(learner.rewards_.empty());
+  for (double reward : learner.rewards_) {
+    EXPECT_EQ(1.0, reward);
+  }
+}
+
+const size_t kTargetFeaturesSAT = cvc::sarsa::kTargetFeatures;
+
+// scores candidates from a fixed list, in the order they're presented
+class FixedScoreLearnerSAT : public cvc::sarsa::Learner<kTargetFeaturesSAT> {
+ public:
+  FixedScoreLearnerSAT(std::vector<double> scores) : scores_(scores) {}
+
+  double Learn(CVC* cvc,
+               cvc::sarsa::ExperienceImpl<kTargetFeaturesSAT>* experience)
+      override {
+    return 0.0;
+  }
+  double Score(
+      const std::array<double, kTargetFeaturesSAT> features) const override {
+    return 0.0;
+  }
+  void ScoreBatch(const std::array<double, kTargetFeaturesSAT>* features,
+                  size_t count, double* scores) const override {
+    for (size_t i = 0; i < count; i++) {
+      scores[i] = scores_[i];
+    }
+  }
+  void WriteCheckpoint(cvc::sarsa::CheckpointWriter* writer,
+                       const char* name) const override {}
+  bool ReadCheckpoint(const cvc::sarsa::Checkpoint& checkpoint,
+                      const char* name, Logger* logger) override {
+    return false;
+  }
+
+  std::vector<double> scores_;
+};
+
+TEST_F(SarsaAgentTest, TestGiveFactoryTopK) {
+  // only the best targets are materialized, best first, ties to the earlier
+  Character giver(0, 100.0);
+  Character a(1, 100.0);
+  Character b(2, 100.0);
+  Character c(3, 100.0);
+  Character d(4, 100.0);
+  CVC cvc({&giver, &a, &b, &c, &d}, &learn_logger_, random_generator_);
+
+  std::vector<double> scores = {1.0, 3.0, 2.0, 3.0};
+  cvc::sarsa::FeatureService features;
+  cvc::sarsa::SARSAGiveActionFactory<> best(
+      std::make_unique<FixedScoreLearnerSAT>(scores), &features);
+  std::vector<std::unique_ptr<cvc::sarsa::Experience>> actions;
+  EXPECT_EQ(3.0, best.EnumerateActions(&cvc, &giver, &actions));
+  ASSERT_EQ(1u, actions.size());
+  EXPECT_EQ(&b, ((GiveAction*)actions[0]->action_.get())->GetTarget());
+
+  cvc::sarsa::SARSAGiveActionFactory<> top_three(
+      std::make_unique<FixedScoreLearnerSAT>(scores), &features, 3);
+  actions.clear();
+  EXPECT_EQ(3.0, top_three.EnumerateActions(&cvc, &giver, &actions));
+  ASSERT_EQ(3u, actions.size());
+  EXPECT_EQ(&b, ((GiveAction*)actions[0]->action_.get())->GetTarget());
+  EXPECT_EQ(&d, ((GiveAction*)actions[1]->action_.get())->GetTarget());
+  EXPECT_EQ(&c, ((GiveAction*)actions[2]->action_.get())->GetTarget());
+  EXPECT_EQ(2.0, actions[2]->action_->GetScore());
+}
+
+TEST_F(SarsaAgentTest, TestFeatureServiceSnapshot) {
+  // features are computed once per tick and shared between rows and pairs
+  Character a(0, 100.0);
+  Character b(1, 20.0);
+  Character c(2, 0.0);
+  CVC cvc({&a, &b, &c}, &learn_logger_, random_generator_);
+  cvc::sarsa::FeatureService features;
+
+  EXPECT_DOUBLE_EQ(std::log1p(40.0), features.Global(&cvc).log_mean_money_);
+  EXPECT_DOUBLE_EQ(std::log1p(100.0),
+                   features.ForCharacter(&cvc, &a).log_money_);
+
+  const std::vector<cvc::sarsa::FeatureService::PairFeatures>& row =
+      features.ForTargets(&cvc, &a);
+  ASSERT_EQ(3u, row.size());
+  EXPECT_DOUBLE_EQ(std::log1p(20.0), row[1].target_log_money_);
+  EXPECT_DOUBLE_EQ(0.0, row[2].target_log_money_);
+  cvc::sarsa::FeatureService::PairFeatures pair =
+      features.ForPair(&cvc, &b, &a);
+  EXPECT_DOUBLE_EQ(std::log1p(100.0), pair.target_log_money_);
+  EXPECT_DOUBLE_EQ(b.GetOpinionOf(&a) / 100.0, pair.opinion_of_target_);
+  EXPECT_DOUBLE_EQ(a.GetOpinionOf(&b) / 100.0, pair.target_opinion_);
+
+  // changes show up next tick, opinions like money
+  double opinion = pair.opinion_of_target_;
+  a.SetMoney(10.0);
+  b.AddRelationship(std::make_unique<RelationshipModifier>(&a, 0, 100, 25.0));
+  EXPECT_DOUBLE_EQ(std::log1p(100.0),
+                   features.ForCharacter(&cvc, &a).log_money_);
+  EXPECT_DOUBLE_EQ(opinion, features.ForPair(&cvc, &b, &a).opinion_of_target_);
+  EXPECT_DOUBLE_EQ(opinion,
+                   features.ForTargets(&cvc, &b)[0].opinion_of_target_);
+  cvc.Tick();
+  EXPECT_DOUBLE_EQ(std::log1p(10.0),
+                   features.ForCharacter(&cvc, &a).log_money_);
+  EXPECT_DOUBLE_EQ(std::log1p(10.0),
+                   features.ForTargets(&cvc, &b)[0].target_log_money_);
+  EXPECT_DOUBLE_EQ(opinion + 0.25,
+                   features.ForPair(&cvc, &b, &a).opinion_of_target_);
+}
+
+TEST_F(SarsaAgentTest, TestTargetIndexMatchesScan) {
+  // the exact index picks the same targets as scoring everyone
+  std::mt19937 random_generator(3);
+  std::uniform_real_distribution<> money_dist(0.0, 100.0);
+  std::uniform_int_distribution<> trait_dist(0, 3);
+  std::vector<std::unique_ptr<Character>> characters;
+  std::vector<Character*> character_ptrs;
+  for (int i = 0; i < 50; i++) {
+    characters.push_back(
+        std::make_unique<Character>(i, money_dist(random_generator)));
+    characters.back()->traits_[kBackground] = trait_dist(random_generator);
+    characters.back()->traits_[kLanguage] = trait_dist(random_generator);
+    character_ptrs.push_back(characters.back().get());
+  }
+  CVC cvc(character_ptrs, &learn_logger_, random_generator_);
+
+  cvc::sarsa::FeatureService features;
+  for (int seed = 0; seed < 5; seed++) {
+    for (size_t top_k : {1, 3}) {
+      std::mt19937 learner_generator(seed);
+      cvc::sarsa::SARSAAskActionFactory<> scan(
+          cvc::sarsa::SARSAAskActionFactory<>::CreateLearner(
+              0, 0.01, 0.9, 0.9, 0.999, &learner_generator, &learn_logger_),
+          &features, top_k);
+      learner_generator.seed(seed);
+      cvc::sarsa::SARSAAskActionFactory<> exact(
+          cvc::sarsa::SARSAAskActionFactory<>::CreateLearner(
+              0, 0.01, 0.9, 0.9, 0.999, &learner_generator, &learn_logger_),
+          &features, top_k);
+      exact.SetTargetSearch(cvc::sarsa::kExactTargetIndex);
+
+      for (Character* character : character_ptrs) {
+        std::vector<std::unique_ptr<cvc::sarsa::Experience>> scanned;
+        std::vector<std::unique_ptr<cvc::sarsa::Experience>> searched;
+        EXPECT_EQ(scan.EnumerateActions(&cvc, character, &scanned),
+                  exact.EnumerateActions(&cvc, character, &searched));
+        ASSERT_EQ(scanned.size(), searched.size());
+        for (size_t i = 0; i < scanned.size(); i++) {
+          EXPECT_EQ(
+              ((AskAction*)scanned[i]->action_.get())->GetTarget(),
+              ((AskAction*)searched[i]->action_.get())->GetTarget());
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SarsaAgentTest, TestTargetIndexWithHashedFeatures) {
+  // per target values learned in a hashed table don't break the index
+  std::mt19937 random_generator(5);
+  std::uniform_real_distribution<> money_dist(0.0, 100.0);
+  std::vector<std::unique_ptr<Character>> characters;
+  std::vector<Character*> character_ptrs;
+  for (int i = 0; i < 50; i++) {
+    characters.push_back(
+        std::make_unique<Character>(i, money_dist(random_generator)));
+    character_ptrs.push_back(characters.back().get());
+  }
+  CVC cvc(character_ptrs, &learn_logger_, random_generator_);
+
+  cvc::sarsa::FeatureService features;
+  for (int seed = 0; seed < 3; seed++) {
+    std::mt19937 learner_generator(seed);
+    auto scan_learner = cvc::sarsa::SARSALearner<kTargetFeaturesSAT>::Create(
+        0, 0.05, 0.9, 0.9, 0.999, learner_generator, &learn_logger_);
+    learner_generator.seed(seed);
+    auto exact_learner = cvc::sarsa::SARSALearner<kTargetFeaturesSAT>::Create(
+        0, 0.05, 0.9, 0.9, 0.999, learner_generator, &learn_logger_);
+    std::vector<cvc::sarsa::SARSALearner<kTargetFeaturesSAT>*> learners = {
+        scan_learner.get(), exact_learner.get()};
+
+    // teach both that a few (character, target) pairs are worth a lot
+    std::array<double, kTargetFeaturesSAT> zero = {};
+    TestActionState tas;
+    for (cvc::sarsa::SARSALearner<kTargetFeaturesSAT>* learner : learners) {
+      learner->EnableHashedFeatures(10);
+      for (int i = 0; i < 50; i++) {
+        Character* character = character_ptrs[i];
+        Character* target = character_ptrs[(i * 7 + 1 + seed) % 50];
+        cvc::sarsa::ExperienceImpl<kTargetFeaturesSAT> next(
+            std::make_unique<RecordingTestActionSAT>(character, &tas), 50.0,
+            nullptr, zero, learner);
+        cvc::sarsa::ExperienceImpl<kTargetFeaturesSAT> experience(
+            std::make_unique<RecordingTestActionSAT>(character, &tas), 0.0,
+            &next, zero, learner);
+        experience.hashed_ =
+            cvc::sarsa::TargetIdentityFeatures(character, target);
+        experience.Learn(&cvc);
+      }
+    }
+
+    cvc::sarsa::SARSAGiveActionFactory<> scan(std::move(scan_learner),
+                                              &features, 2);
+    cvc::sarsa::SARSAGiveActionFactory<> exact(std::move(exact_learner),
+                                               &features, 2);
+    exact.SetTargetSearch(cvc::sarsa::kExactTargetIndex);
+    for (Character* character : character_ptrs) {
+      std::vector<std::unique_ptr<cvc::sarsa::Experience>> scanned;
+      std::vector<std::unique_ptr<cvc::sarsa::Experience>> searched;
+      EXPECT_EQ(scan.EnumerateActions(&cvc, character, &scanned),
+                exact.EnumerateActions(&cvc, character, &searched));
+      ASSERT_EQ(scanned.size(), searched.size());
+      for (size_t i = 0; i < scanned.size(); i++) {
+        EXPECT_EQ(((GiveAction*)scanned[i]->action_.get())->GetTarget(),
+                  ((GiveAction*)searched[i]->action_.get())->GetTarget());
+        EXPECT_EQ(scanned[i]->action_->GetScore(),
+                  scanned[i]->PredictScore());
+      }
+    }
+  }
+}
+
+// runs a small population of learning agents, returns everyone's money
+std::vector<double> RunPopulationSAT(bool batched, Logger* logger) {
+  std::mt19937 random_generator(17);
+  std::vector<std::unique_ptr<Character>> characters;
+  std::vector<Character*> character_ptrs;
+  for (int i = 0; i < 5; i++) {
+    characters.push_back(std::make_unique<Character>(i, 20.0 + i));
+    character_ptrs.push_back(characters.back().get());
+  }
+
+  cvc::sarsa::FeatureService features;
+  cvc::sarsa::SARSAGiveActionFactory<> give(
+      cvc::sarsa::SARSAGiveActionFactory<>::CreateLearner(
+          0, 0.01, 0.9, 0.9, 0.999, &random_generator, logger),
+      &features);
+  cvc::sarsa::SARSAAskActionFactory<> ask(
+      cvc::sarsa::SARSAAskActionFactory<>::CreateLearner(
+          1, 0.01, 0.9, 0.9, 0.999, &random_generator, logger),
+      &features);
+  cvc::sarsa::SARSATrivialActionFactory<> trivial(
+      cvc::sarsa::SARSATrivialActionFactory<>::CreateLearner(
+          2, 0.01, 0.9, 0.9, 0.999, &random_generator, logger),
+      &features);
+  cvc::sarsa::SARSAAskSuccessResponseFactory<> success(
+      cvc::sarsa::SARSAAskSuccessResponseFactory<>::CreateLearner(
+          3, 0.01, 0.9, 0.9, 0.999, &random_generator, logger),
+      &features);
+  cvc::sarsa::SARSAAskFailureResponseFactory<> failure(
+      cvc::sarsa::SARSAAskFailureResponseFactory<>::CreateLearner(
+          4, 0.01, 0.9, 0.9, 0.999, &random_generator, logger),
+      &features);
+
+  cvc::sarsa::EpsilonGreedyPolicy policy(0.5, logger);
+  cvc::sarsa::MoneyScorer scorer;
+  std::vector<std::unique_ptr<Agent>> agents;
+  std::vector<Agent*> agent_ptrs;
+  for (Character* character : character_ptrs) {
+    agents.push_back(
+        std::make_unique<cvc::sarsa::SARSAAgent<cvc::sarsa::MoneyScorer>>(
+            &scorer, character,
+            std::vector<cvc::sarsa::ActionFactory*>({&give, &ask, &trivial}),
+            std::unordered_map<std::string,
+                               std::set<cvc::sarsa::ResponseFactory*>>(
+                {{"AskAction", {&success, &failure}}}),
+            &policy, 2));
+    agent_ptrs.push_back(agents.back().get());
+  }
+
+  CVC cvc(character_ptrs, logger, random_generator);
+  DecisionEngine engine(agent_ptrs, &cvc, logger);
+  if (batched) {
+    engine.AddBatchScorer(&give);
+    engine.AddBatchScorer(&ask);
+    engine.AddBatchScorer(&trivial);
+    // groups that don't divide the population evenly
+    engine.SetDecisionBatchSize(2);
+  }
+  for (int i = 0; i < 50; i++) {
+    engine.RunOneGameLoop();
+  }
+
+  std::vector<double> money;
+  for (Character* character : character_ptrs) {
+    money.push_back(character->GetMoney());
+  }
+  return money;
+}
+
+TEST_F(SarsaAgentTest, TestBatchedDecisionsMatch) {
+  // scoring candidates across agents changes nothing about the decisions
+  learn_logger_.SetLogLevel(ERROR);
+  EXPECT_EQ(RunPopulationSAT(false, &learn_logger_),
+            RunPopulationSAT(true, &learn_logger_));
+}
+
+// experiences with the given scores, each a RecordingTestActionSAT
+std::vector<std::unique_ptr<cvc::sarsa::Experience>> ScoredExperiencesSAT(
+    cvc::sarsa::Learner<1>* learner, const std::vector<double>& scores,
+    TestActionState* tas) {
+  std::vector<std::unique_ptr<cvc::sarsa::Experience>> experiences;
+  for (double score : scores) {
+    experiences.push_back(learner->WrapAction(
+        {0.0}, std::make_unique<RecordingTestActionSAT>(nullptr, tas), score));
+  }
+  return experiences;
+}
+
+TEST_F(SarsaAgentTest, TestSoftmaxLowTemperature) {
+  // scores far beyond exp's range don't overflow, the best option wins
+  learn_logger_.SetLogLevel(ERROR);
+  CVC cvc({}, &learn_logger_, random_generator_);
+  cvc::sarsa::SoftmaxPolicy policy(0.001, &learn_logger_);
+  TestActionState tas;
+  for (int i = 0; i < 10; i++) {
+    std::vector<std::unique_ptr<cvc::sarsa::Experience>> experiences =
+        ScoredExperiencesSAT(learner_.get(), {1000.0, 1000.5, -1e6, 999.0}, &tas);
+    std::unique_ptr<cvc::sarsa::Experience> chosen =
+        policy.ChooseAction(&experiences, &cvc, nullptr);
+    EXPECT_EQ(1000.5, chosen->action_->GetScore());
+  }
+}
+
+TEST_F(SarsaAgentTest, TestSoftmaxProbabilities) {
+  // choices follow exp(score / temperature)
+  learn_logger_.SetLogLevel(ERROR);
+  std::mt19937 random_generator(11);
+  CVC cvc({}, &learn_logger_, random_generator);
+  double temperature = 2.0;
+  cvc::sarsa::SoftmaxPolicy policy(temperature, &learn_logger_);
+  TestActionState tas;
+  std::vector<double> scores = {0.0, temperature * log(3.0), 0.0};
+  int counts[3] = {0, 0, 0};
+  int trials = 10000;
+  for (int i = 0; i < trials; i++) {
+    std::vector<std::unique_ptr<cvc::sarsa::Experience>> experiences =
+        ScoredExperiencesSAT(learner_.get(), scores, &tas);
+    cvc::sarsa::Experience* first = experiences[0].get();
+    std::unique_ptr<cvc::sarsa::Experience> chosen =
+        policy.ChooseAction(&experiences, &cvc, nullptr);
+    if (chosen.get() == first) {
+      counts[0]++;
+    } else {
+      counts[chosen->action_->GetScore() > 0.0 ? 1 : 2]++;
+    }
+  }
+  EXPECT_NEAR(0.2, (double)counts[0] / trials, 0.02);
+  EXPECT_NEAR(0.6, (double)counts[1] / trials, 0.02);
+  EXPECT_NEAR(0.2, (double)counts[2] / trials, 0.02);
+}
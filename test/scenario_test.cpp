@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/util.h"
+#include "../src/scenario.h"
+
+TEST(ScenarioTest, TestSet) {
+  Logger logger("test", nullptr, ERROR);
+  Scenario scenario;
+  EXPECT_EQ(25, scenario.learning_agents_);
+
+  EXPECT_TRUE(scenario.Set("learning_agents", "100", &logger));
+  EXPECT_TRUE(scenario.Set(" learning_rate = 0.01 ", &logger));
+  EXPECT_TRUE(scenario.Set("action_log=/tmp/other_log", &logger));
+  EXPECT_TRUE(scenario.Set("sweep", "25, 100,1000", &logger));
+  EXPECT_EQ(100, scenario.learning_agents_);
+  EXPECT_EQ(0.01, scenario.learning_rate_);
+  EXPECT_EQ("/tmp/other_log", scenario.action_log_);
+  EXPECT_EQ(std::vector<int>({25, 100, 1000}), scenario.sweep_);
+  EXPECT_TRUE(scenario.Validate(&logger));
+
+  EXPECT_FALSE(scenario.Set("no_such_key", "1", &logger));
+  EXPECT_FALSE(scenario.Set("ticks", "ten", &logger));
+  EXPECT_FALSE(scenario.Set("ticks", "10x", &logger));
+  EXPECT_FALSE(scenario.Set("sweep", "25,,100", &logger));
+  EXPECT_FALSE(scenario.Set("ticks", &logger));
+  // failures leave values alone
+  EXPECT_EQ(10000, scenario.ticks_);
+  EXPECT_EQ(std::vector<int>({25, 100, 1000}), scenario.sweep_);
+}
+
+TEST(ScenarioTest, TestRead) {
+  Logger logger("test", nullptr, ERROR);
+  char path[] = "/tmp/scenario_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  FILE* file = fdopen(fd, "w");
+  fprintf(file,
+          "# a comment\n"
+          "\n"
+          "ticks = 50 # trailing comment\n"
+          "organizations=2\n"
+          "learning_agents = 3\n");
+  fclose(file);
+
+  Scenario scenario;
+  EXPECT_TRUE(scenario.Read(path, &logger));
+  EXPECT_EQ(50, scenario.ticks_);
+  EXPECT_EQ(2, scenario.organizations_);
+  EXPECT_EQ(3, scenario.learning_agents_);
+  EXPECT_TRUE(scenario.Validate(&logger));
+
+  // every sweep entry needs enough agents to found the organizations
+  scenario.Set("sweep", "1,10", &logger);
+  EXPECT_FALSE(scenario.Validate(&logger));
+
+  file = fopen(path, "w");
+  fprintf(file, "ticks = 50\nbogus = 1\n");
+  fclose(file);
+  EXPECT_FALSE(Scenario().Read(path, &logger));
+  remove(path);
+
+  EXPECT_FALSE(Scenario().Read("/tmp/no/such/scenario", &logger));
+}
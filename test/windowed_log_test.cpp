@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../src/util.h"
+#include "../src/event_log.h"
+#include "../src/windowed_log.h"
+
+// keeps the ticks of the events passed on to it
+class RecordingEventLogWLT : public EventLog {
+ public:
+  void LogAction(const ActionEvent& event) override {
+    actions_.push_back(event.tick_);
+  }
+  void LogLearn(const LearnEvent& event) override {
+    learns_.push_back(event.tick_);
+  }
+  void LogPolicy(const PolicyEvent& event) override {
+    policies_.push_back(event.tick_);
+  }
+
+  std::vector<int> actions_;
+  std::vector<int> learns_;
+  std::vector<int> policies_;
+};
+
+class WindowedLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    out_ = open_memstream(&text_, &length_);
+    logger_ = Logger("summary", out_, INFO);
+  }
+
+  void TearDown() override {
+    fclose(out_);
+    free(text_);
+  }
+
+  // the summary lines written so far, without the logger name
+  std::vector<std::string> Lines() {
+    fflush(out_);
+    std::vector<std::string> lines;
+    std::istringstream in(std::string(text_, length_));
+    std::string line;
+    while (std::getline(in, line)) {
+      EXPECT_EQ(0u, line.find("summary\t"));
+      lines.push_back(line.substr(strlen("summary\t")));
+    }
+    return lines;
+  }
+
+  static LearnEvent Learn(int tick, const char* action_id, int learner_id,
+                          double loss) {
+    return {tick, action_id, learner_id, 0, loss, 2.0, 1.0, 3.0, 0.5,
+            nullptr, 0};
+  }
+
+  FILE* out_;
+  char* text_ = nullptr;
+  size_t length_ = 0;
+  Logger logger_;
+};
+
+TEST_F(WindowedLogTest, TestWindows) {
+  {
+    WindowedEventLog log(10, &logger_);
+    // the ids' content, not their addresses, identify the keys
+    std::string give = "GiveAction";
+    log.LogLearn(Learn(3, "GiveAction", 1, 1.0));
+    log.LogLearn(Learn(4, give.c_str(), 1, 3.0));
+    log.LogLearn(Learn(5, "GiveAction", 2, 5.0));
+    log.LogPolicy({6, 0, "GiveAction", 1.0, 0.25, 0, 4});
+    log.LogPolicy({7, 1, "GiveAction", 1.0, 0.75, 9, 12});
+    // nothing is written until the window closes
+    EXPECT_TRUE(Lines().empty());
+    log.LogAction({12, 0, 10.0, "WorkAction", 1.0, true});
+    log.LogAction({13, 0, 10.0, "WorkAction", 1.0, false});
+  }
+
+  std::vector<std::string> lines = Lines();
+  ASSERT_EQ(14u, lines.size());
+  // loss mean, stdev, min and max, then dL_dy's and so on
+  EXPECT_EQ(0u, lines[0].find("learn\t0\t1\tGiveAction\t2\t2.000000\t1.000000"
+                              "\t1.000000\t3.000000\t2.000000"));
+  EXPECT_EQ("hist\t0\t1\tGiveAction\tloss\t1:1 2:1", lines[1]);
+  EXPECT_EQ("hist\t0\t1\tGiveAction\tdL_dy\t2:2", lines[2]);
+  // the target the learner learned towards and the reward it saw
+  EXPECT_EQ("hist\t0\t1\tGiveAction\ttarget\t2:2", lines[4]);
+  EXPECT_EQ("hist\t0\t1\tGiveAction\treward\t0.5:2", lines[5]);
+  EXPECT_EQ(0u, lines[6].find("learn\t0\t2\tGiveAction\t1\t5.000000"));
+  EXPECT_EQ("hist\t0\t2\tGiveAction\tloss\t4:1", lines[7]);
+  // probability, rank and option stats, then counts by rank (9 is 8 or more)
+  EXPECT_EQ(0u, lines[12].find("policy\t0\tGiveAction\t2\t0.500000"));
+  EXPECT_NE(std::string::npos, lines[12].find("\t1 0 0 0 0 0 0 0 1"));
+  // the second window only had actions
+  EXPECT_EQ(0u, lines[13].find("action\t10\tWorkAction\t2\t1\t10.000000"));
+}
+
+TEST_F(WindowedLogTest, TestSampling) {
+  RecordingEventLogWLT sampled;
+  {
+    WindowedEventLog log(100, &logger_, &sampled, 3);
+    for (int tick = 0; tick < 7; tick++) {
+      log.LogLearn(Learn(tick, "GiveAction", 1, 1.0));
+      log.LogPolicy({tick, 0, "GiveAction", 1.0, 1.0, 0, 1});
+    }
+  }
+  EXPECT_EQ(std::vector<int>({0, 3, 6}), sampled.learns_);
+  EXPECT_EQ(std::vector<int>({0, 3, 6}), sampled.policies_);
+  EXPECT_TRUE(sampled.actions_.empty());
+  // summaries are written all the same
+  EXPECT_EQ(7u, Lines().size());
+}
+
+TEST_F(WindowedLogTest, TestHistogramBuckets) {
+  const int kMin = LogHistogram::kMinExponent;
+  const int kBuckets = LogHistogram::kBucketsPerSign;
+  EXPECT_EQ(0, LogHistogram::Bucket(0.0));
+  EXPECT_EQ(0, LogHistogram::Bucket(ldexp(1.0, kMin - 2)));
+  EXPECT_EQ(0, LogHistogram::Bucket(NAN));
+  EXPECT_EQ(1, LogHistogram::Bucket(ldexp(1.0, kMin - 1)));
+  EXPECT_EQ(-1, LogHistogram::Bucket(-ldexp(1.0, kMin - 1)));
+  EXPECT_EQ(kBuckets, LogHistogram::Bucket(1e300));
+  EXPECT_EQ(-kBuckets, LogHistogram::Bucket(-INFINITY));
+
+  // every bucket's bound falls in it, and just below it in the one before
+  for (int bucket = 1; bucket <= kBuckets; bucket++) {
+    double bound = LogHistogram::BucketBound(bucket);
+    EXPECT_EQ(bucket, LogHistogram::Bucket(bound));
+    EXPECT_EQ(bucket - 1, LogHistogram::Bucket(std::nextafter(bound, 0.0)));
+    EXPECT_EQ(-bucket,
+              LogHistogram::Bucket(LogHistogram::BucketBound(-bucket)));
+  }
+}